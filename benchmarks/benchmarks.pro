@@ -0,0 +1,13 @@
+QT       += testlib
+
+TARGET = benchmarks
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../fooplayer/core.pri)
+
+SOURCES += \
+    tst_benchmarks.cpp
@@ -0,0 +1,234 @@
+#include "benchmarksuite.h"
+#include "gainstage.h"
+#include "waveform.h"
+#include "playlistmodel.h"
+#include "playlistsorter.h"
+#include "searchindex.h"
+#include "displayscheduler.h"
+#include <QtTest>
+#include <QtWidgets>
+
+static const int defaultRows = 200000;
+static const int playbackSeconds = 60;
+static const int tickSpeedup = 10;
+
+class Benchmarks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void gain_data();
+    void gain();
+    void peaks();
+    void append();
+    void search_data();
+    void search();
+    void sort_data();
+    void sort();
+    void display_data();
+    void display();
+    void groups_data();
+    void groups();
+
+private:
+    int rows;
+    QVector<TrackInfo> tracks;
+    PlaylistModel model;
+};
+
+void Benchmarks::initTestCase()
+{
+    rows = qEnvironmentVariableIsSet("FOOPLAYER_BENCHMARK_ROWS") ? qEnvironmentVariableIntValue("FOOPLAYER_BENCHMARK_ROWS") : defaultRows;
+    QVERIFY(rows > 0);
+    tracks = BenchmarkSuite::syntheticTracks(rows);
+    model.appendTracks(tracks);
+}
+
+void Benchmarks::gain_data()
+{
+    QTest::addColumn<int>("type");
+    QTest::newRow("int16") << int(QAudioFormat::SignedInt);
+    QTest::newRow("float32") << int(QAudioFormat::Float);
+}
+
+void Benchmarks::gain()
+{
+    QFETCH(int, type);
+    QAudioFormat format;
+    format.setSampleRate(44100);
+    format.setChannelCount(2);
+    format.setSampleSize(type == QAudioFormat::Float ? 32 : 16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SampleType(type));
+    GainStage stage(format);
+    QVERIFY(stage.isSupported());
+    stage.setGain(0.5, 0);
+    QByteArray source(format.bytesForFrames(44100), Qt::Uninitialized);
+    quint32 seed = 1;
+    for (int i = 0; i < source.size(); i++) {
+        seed = seed * 1664525 + 1013904223;
+        source[i] = char(seed >> 24);
+    }
+    if (type == QAudioFormat::Float) {
+        float *samples = reinterpret_cast<float *>(source.data());
+        for (int i = 0; i < source.size() / 4; i++)
+            samples[i] = qint16(seed = seed * 1664525 + 1013904223) / 32768.0f;
+    }
+    QByteArray buffer = source;
+    QBENCHMARK {
+        memcpy(buffer.data(), source.constData(), size_t(buffer.size()));
+        stage.process(buffer.data(), buffer.size());
+    }
+}
+
+void Benchmarks::peaks()
+{
+    QVector<qint16> samples(44100 * 2);
+    quint32 seed = 1;
+    for (int i = 0; i < samples.size(); i++) {
+        seed = seed * 1664525 + 1013904223;
+        samples[i] = qint16(seed >> 16);
+    }
+    QBENCHMARK {
+        Waveform waveform;
+        waveform.append(samples.constData(), 44100, 2);
+        waveform.setComplete(true);
+    }
+}
+
+void Benchmarks::append()
+{
+    QBENCHMARK {
+        PlaylistModel model;
+        model.appendTracks(tracks);
+    }
+}
+
+void Benchmarks::search_data()
+{
+    QTest::addColumn<int>("row");
+    QTest::addColumn<bool>("album");
+    QTest::newRow("artist") << 7919 << false;
+    QTest::newRow("album") << 104729 << true;
+}
+
+void Benchmarks::search()
+{
+    QFETCH(int, row);
+    QFETCH(bool, album);
+    const TrackInfo &track = tracks.at(row % rows);
+    const QString query = SearchIndex::terms(album ? track.album : track.artist + ' ' + track.title.section(' ', 0, 0)).join(' ');
+    SearchIndex index;
+    index.build(&model);
+    QBENCHMARK {
+        index.search(query);
+    }
+}
+
+void Benchmarks::sort_data()
+{
+    QTest::addColumn<int>("column");
+    QTest::newRow("title") << int(PlaylistModel::Title);
+    QTest::newRow("artist") << int(PlaylistModel::Artist);
+    QTest::newRow("length") << int(PlaylistModel::Length);
+}
+
+void Benchmarks::sort()
+{
+    QFETCH(int, column);
+    SortKey key;
+    key.column = column;
+    key.order = Qt::AscendingOrder;
+    const PlaylistColumns columns = model.columns();
+    QBENCHMARK {
+        PlaylistSorter::sortOrder(columns, QList<SortKey>() << key);
+    }
+}
+
+void Benchmarks::display_data()
+{
+    QTest::addColumn<bool>("scheduled");
+    QTest::newRow("direct") << false;
+    QTest::newRow("scheduled") << true;
+}
+
+// GUI thread CPU time for a minute of playback position updates, with the
+// engine's 250 ms ticks sped up tenfold. "direct" updates the slider and
+// label on every tick, "scheduled" goes through DisplayScheduler the way
+// Player does.
+void Benchmarks::display()
+{
+    QFETCH(bool, scheduled);
+    QWidget window;
+    QLabel *label = new QLabel(&window);
+    QSlider *slider = new QSlider(Qt::Horizontal, &window);
+    QVBoxLayout *layout = new QVBoxLayout(&window);
+    layout->addWidget(slider);
+    layout->addWidget(label);
+    slider->setRange(0, playbackSeconds * 1000);
+    window.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&window));
+
+    DisplayScheduler scheduler(&window);
+    qint64 position = 0;
+    qint64 shown = -1;
+    connect(&scheduler, &DisplayScheduler::refresh, [&]() {
+        slider->setValue(int(position));
+        shown = position / 1000;
+        label->setText(QString("%1:%2").arg(shown / 60, 2, 10, QChar('0')).arg(shown % 60, 2, 10, QChar('0')));
+    });
+    QTimer ticks;
+    connect(&ticks, &QTimer::timeout, [&]() {
+        position += 250;
+        if (scheduled) {
+            if (position / 1000 != shown)
+                scheduler.schedule();
+            return;
+        }
+        slider->setValue(int(position));
+        label->setText(QTime(0, 0).addMSecs(int(position)).toString("mm:ss") + " / "
+                       + QTime(0, 0).addSecs(playbackSeconds).toString("mm:ss"));
+    });
+
+    const int updates = playbackSeconds * 4;
+    const qint64 cpu = BenchmarkSuite::threadCpuTime();
+    ticks.start(250 / tickSpeedup);
+    QTRY_VERIFY_WITH_TIMEOUT(position >= updates * 250, updates * 250 / tickSpeedup * 4);
+    ticks.stop();
+    QTest::qWait(100);
+    const qint64 busy = BenchmarkSuite::threadCpuTime() - cpu;
+    qInfo("display.cpu %.1f ms per minute of playback, %d refreshes for %d position updates",
+          busy / 1e6 * 60 / playbackSeconds, scheduled ? scheduler.refreshes() : updates, updates);
+    if (scheduled)
+        QVERIFY(scheduler.refreshes() <= playbackSeconds + 1);
+}
+
+void Benchmarks::groups_data()
+{
+    QTest::addColumn<QString>("group");
+    foreach (const QString &group, BenchmarkSuite::groups())
+        QTest::newRow(qPrintable(group)) << group;
+}
+
+void Benchmarks::groups()
+{
+    QFETCH(QString, group);
+    BenchmarkSuite suite(rows);
+    suite.setFixtures(QString::fromLocal8Bit(qgetenv("FOOPLAYER_FIXTURES")));
+    QBENCHMARK_ONCE {
+        QVERIFY(suite.run(QStringList(group)));
+    }
+    QString report;
+    QTextStream out(&report);
+    suite.print(out);
+    out.flush();
+    foreach (const QString &line, report.split('\n', QString::SkipEmptyParts))
+        qInfo("%s", qPrintable(line));
+    QVERIFY2(suite.failures().isEmpty(), qPrintable(suite.failures().join("; ")));
+}
+
+QTEST_MAIN(Benchmarks)
+
+#include "tst_benchmarks.moc"
@@ -0,0 +1,415 @@
+#include "acousticfingerprint.h"
+#include "pcmreader.h"
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QtMath>
+#include <cstring>
+
+#if defined(Q_PROCESSOR_X86) && (defined(Q_CC_GNU) || defined(Q_CC_CLANG))
+#define FINGERPRINT_X86
+#include <immintrin.h>
+#endif
+
+static const int spectrumSize = AcousticFingerprint::FrameSize / 2 + 1;
+static const int maxOffset = 80;
+static const int minOverlap = 40;
+static const int minDistinctCodes = 8;
+static const int minSharedCodes = 4;
+static const int stopListSize = 64;
+
+struct FingerprintTables
+{
+    FingerprintTables() :
+        window(AcousticFingerprint::FrameSize), reverse(AcousticFingerprint::FrameSize),
+        twiddleRe(AcousticFingerprint::FrameSize), twiddleIm(AcousticFingerprint::FrameSize), note(spectrumSize, -1)
+    {
+        const int size = AcousticFingerprint::FrameSize;
+        int bits = 0;
+        while ((1 << bits) < size)
+            bits++;
+        for (int i = 0; i < size; i++) {
+            window[i] = float(0.54 - 0.46 * qCos(2 * M_PI * i / (size - 1)));
+            int r = 0;
+            for (int b = 0; b < bits; b++)
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            reverse[i] = r;
+        }
+        // Stage twiddles are stored back to back so each butterfly run reads them contiguously.
+        for (int half = 1, offset = 0; half < size; offset += half, half *= 2) {
+            for (int k = 0; k < half; k++) {
+                twiddleRe[offset + k] = float(qCos(-M_PI * k / half));
+                twiddleIm[offset + k] = float(qSin(-M_PI * k / half));
+            }
+        }
+        firstBin = spectrumSize;
+        lastBin = 0;
+        for (int bin = 1; bin < spectrumSize; bin++) {
+            const double frequency = double(bin) * AcousticFingerprint::SampleRate / size;
+            if (frequency < 28 || frequency > 3520)
+                continue;
+            note[bin] = (qRound(12 * std::log2(frequency / 27.5)) % 12 + 12) % 12;
+            firstBin = qMin(firstBin, bin);
+            lastBin = qMax(lastBin, bin + 1);
+        }
+    }
+
+    QVector<float> window;
+    QVector<int> reverse;
+    QVector<float> twiddleRe;
+    QVector<float> twiddleIm;
+    QVector<int> note;
+    int firstBin;
+    int lastBin;
+};
+
+typedef void (*ButterflyKernel)(float *re, float *im, const float *wr, const float *wi, int half);
+typedef void (*PowerKernel)(const float *re, const float *im, float *power, int count);
+typedef int (*DistanceKernel)(const quint32 *a, const quint32 *b, int count);
+
+struct FingerprintKernels
+{
+    const char *name;
+    ButterflyKernel butterflies;
+    PowerKernel power;
+    DistanceKernel distance;
+};
+
+static void butterfliesScalar(float *re, float *im, const float *wr, const float *wi, int half)
+{
+    for (int k = 0; k < half; k++) {
+        const float tr = re[k + half] * wr[k] - im[k + half] * wi[k];
+        const float ti = re[k + half] * wi[k] + im[k + half] * wr[k];
+        re[k + half] = re[k] - tr;
+        im[k + half] = im[k] - ti;
+        re[k] += tr;
+        im[k] += ti;
+    }
+}
+
+static void powerScalar(const float *re, const float *im, float *power, int count)
+{
+    for (int i = 0; i < count; i++)
+        power[i] = re[i] * re[i] + im[i] * im[i];
+}
+
+static int distanceScalar(const quint32 *a, const quint32 *b, int count)
+{
+    int bits = 0;
+    for (int i = 0; i < count; i++)
+        bits += __builtin_popcount(a[i] ^ b[i]);
+    return bits;
+}
+
+#ifdef FINGERPRINT_X86
+__attribute__((target("sse2")))
+static void butterfliesSse2(float *re, float *im, const float *wr, const float *wi, int half)
+{
+    if (half < 4) {
+        butterfliesScalar(re, im, wr, wi, half);
+        return;
+    }
+    for (int k = 0; k < half; k += 4) {
+        const __m128 br = _mm_loadu_ps(re + k + half);
+        const __m128 bi = _mm_loadu_ps(im + k + half);
+        const __m128 cr = _mm_loadu_ps(wr + k);
+        const __m128 ci = _mm_loadu_ps(wi + k);
+        const __m128 tr = _mm_sub_ps(_mm_mul_ps(br, cr), _mm_mul_ps(bi, ci));
+        const __m128 ti = _mm_add_ps(_mm_mul_ps(br, ci), _mm_mul_ps(bi, cr));
+        const __m128 ar = _mm_loadu_ps(re + k);
+        const __m128 ai = _mm_loadu_ps(im + k);
+        _mm_storeu_ps(re + k + half, _mm_sub_ps(ar, tr));
+        _mm_storeu_ps(im + k + half, _mm_sub_ps(ai, ti));
+        _mm_storeu_ps(re + k, _mm_add_ps(ar, tr));
+        _mm_storeu_ps(im + k, _mm_add_ps(ai, ti));
+    }
+}
+
+__attribute__((target("sse2")))
+static void powerSse2(const float *re, const float *im, float *power, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 r = _mm_loadu_ps(re + i);
+        const __m128 m = _mm_loadu_ps(im + i);
+        _mm_storeu_ps(power + i, _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m)));
+    }
+    powerScalar(re + i, im + i, power + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void butterfliesAvx2(float *re, float *im, const float *wr, const float *wi, int half)
+{
+    if (half < 8) {
+        butterfliesSse2(re, im, wr, wi, half);
+        return;
+    }
+    for (int k = 0; k < half; k += 8) {
+        const __m256 br = _mm256_loadu_ps(re + k + half);
+        const __m256 bi = _mm256_loadu_ps(im + k + half);
+        const __m256 cr = _mm256_loadu_ps(wr + k);
+        const __m256 ci = _mm256_loadu_ps(wi + k);
+        const __m256 tr = _mm256_sub_ps(_mm256_mul_ps(br, cr), _mm256_mul_ps(bi, ci));
+        const __m256 ti = _mm256_add_ps(_mm256_mul_ps(br, ci), _mm256_mul_ps(bi, cr));
+        const __m256 ar = _mm256_loadu_ps(re + k);
+        const __m256 ai = _mm256_loadu_ps(im + k);
+        _mm256_storeu_ps(re + k + half, _mm256_sub_ps(ar, tr));
+        _mm256_storeu_ps(im + k + half, _mm256_sub_ps(ai, ti));
+        _mm256_storeu_ps(re + k, _mm256_add_ps(ar, tr));
+        _mm256_storeu_ps(im + k, _mm256_add_ps(ai, ti));
+    }
+}
+
+__attribute__((target("avx2")))
+static void powerAvx2(const float *re, const float *im, float *power, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 r = _mm256_loadu_ps(re + i);
+        const __m256 m = _mm256_loadu_ps(im + i);
+        _mm256_storeu_ps(power + i, _mm256_add_ps(_mm256_mul_ps(r, r), _mm256_mul_ps(m, m)));
+    }
+    powerScalar(re + i, im + i, power + i, count - i);
+}
+
+__attribute__((target("popcnt")))
+static int distancePopcnt(const quint32 *a, const quint32 *b, int count)
+{
+    int bits = 0;
+    for (int i = 0; i < count; i++)
+        bits += __builtin_popcount(a[i] ^ b[i]);
+    return bits;
+}
+#endif
+
+static FingerprintKernels selectKernels()
+{
+#ifdef FINGERPRINT_X86
+    __builtin_cpu_init();
+    const DistanceKernel distance = __builtin_cpu_supports("popcnt") ? distancePopcnt : distanceScalar;
+    if (__builtin_cpu_supports("avx2")) {
+        const FingerprintKernels avx2 = { "avx2", butterfliesAvx2, powerAvx2, distance };
+        return avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        const FingerprintKernels sse2 = { "sse2", butterfliesSse2, powerSse2, distance };
+        return sse2;
+    }
+#endif
+    const FingerprintKernels scalar = { "scalar", butterfliesScalar, powerScalar, distanceScalar };
+    return scalar;
+}
+
+static const FingerprintKernels &kernels()
+{
+    static const FingerprintKernels selected = selectKernels();
+    return selected;
+}
+
+static const FingerprintTables &tables()
+{
+    static const FingerprintTables built;
+    return built;
+}
+
+// Each code compares neighbouring pitch classes, each class with the previous frame and
+// pairs of classes a tritone apart, so it survives re-encoding and gain changes.
+static quint32 chromaCode(const float *chroma, const float *previous)
+{
+    quint32 code = 0;
+    for (int i = 0; i < 12; i++) {
+        if (chroma[i] > chroma[(i + 1) % 12])
+            code |= 1u << i;
+        if (chroma[i] > previous[i])
+            code |= 1u << (12 + i);
+    }
+    for (int i = 0; i < 8; i++) {
+        if (chroma[i] + chroma[(i + 1) % 12] > chroma[(i + 6) % 12] + chroma[(i + 7) % 12])
+            code |= 1u << (24 + i);
+    }
+    return code;
+}
+
+QByteArray AcousticFingerprint::compute(const qint16 *samples, int count)
+{
+    const FingerprintKernels &kernel = kernels();
+    const FingerprintTables &table = tables();
+    QVector<float> re(FrameSize);
+    QVector<float> im(FrameSize);
+    QVector<float> power(spectrumSize);
+    float chroma[2][12];
+    QByteArray fingerprint;
+    fingerprint.reserve(qMax(0, (count - FrameSize) / FrameStep + 1) * int(sizeof(quint32)));
+    int frame = 0;
+    for (int start = 0; start + FrameSize <= count; start += FrameStep, frame++) {
+        for (int i = 0; i < FrameSize; i++)
+            re[table.reverse.at(i)] = samples[start + i] * table.window.at(i);
+        im.fill(0);
+        for (int half = 1, offset = 0; half < FrameSize; offset += half, half *= 2) {
+            for (int group = 0; group < FrameSize; group += 2 * half)
+                kernel.butterflies(re.data() + group, im.data() + group, table.twiddleRe.constData() + offset, table.twiddleIm.constData() + offset, half);
+        }
+        kernel.power(re.constData(), im.constData(), power.data(), spectrumSize);
+
+        float *current = chroma[frame & 1];
+        std::memset(current, 0, sizeof(chroma[0]));
+        for (int bin = table.firstBin; bin < table.lastBin; bin++)
+            current[table.note.at(bin)] += power.at(bin);
+        float energy = 0;
+        for (int i = 0; i < 12; i++)
+            energy += current[i] * current[i];
+        const float scale = energy > 1e-3f ? 1 / std::sqrt(energy) : 0;
+        for (int i = 0; i < 12; i++)
+            current[i] *= scale;
+        if (frame > 0) {
+            const quint32 code = chromaCode(current, chroma[(frame - 1) & 1]);
+            fingerprint.append(reinterpret_cast<const char *>(&code), sizeof(code));
+        }
+    }
+    return fingerprint;
+}
+
+QByteArray AcousticFingerprint::fromFile(const QString &path)
+{
+    QAudioFormat format;
+    format.setSampleRate(SampleRate);
+    format.setChannelCount(1);
+    format.setSampleSize(16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+    PcmReader reader(format);
+    if (!reader.open(path))
+        return QByteArray();
+    const int limit = WindowSeconds * SampleRate * format.bytesPerFrame();
+    QByteArray pcm;
+    pcm.reserve(limit);
+    while (pcm.size() < limit && !reader.atEnd())
+        pcm += reader.read(qMin(65536, limit - pcm.size()));
+    return compute(reinterpret_cast<const qint16 *>(pcm.constData()), pcm.size() / format.bytesPerFrame());
+}
+
+double AcousticFingerprint::similarity(const QByteArray &a, const QByteArray &b)
+{
+    const quint32 *first = reinterpret_cast<const quint32 *>(a.constData());
+    const quint32 *second = reinterpret_cast<const quint32 *>(b.constData());
+    const int firstCount = a.size() / int(sizeof(quint32));
+    const int secondCount = b.size() / int(sizeof(quint32));
+    double best = 0;
+    for (int offset = -maxOffset; offset <= maxOffset; offset++) {
+        const int begin = qMax(0, -offset);
+        const int end = qMin(firstCount, secondCount - offset);
+        if (end - begin < minOverlap)
+            continue;
+        const int bits = kernels().distance(first + begin, second + begin + offset, end - begin);
+        best = qMax(best, 1 - bits / (32.0 * (end - begin)));
+    }
+    return best;
+}
+
+bool AcousticFingerprint::isDistinctive(const QByteArray &fingerprint)
+{
+    const quint32 *codes = reinterpret_cast<const quint32 *>(fingerprint.constData());
+    const int count = fingerprint.size() / int(sizeof(quint32));
+    QSet<quint32> distinct;
+    for (int i = 0; i < count && distinct.size() < minDistinctCodes; i++) {
+        if (codes[i])
+            distinct.insert(codes[i]);
+    }
+    return count >= minOverlap && distinct.size() >= minDistinctCodes;
+}
+
+static int findRoot(QVector<int> &parent, int i)
+{
+    while (parent.at(i) != i)
+        i = parent[i] = parent.at(parent.at(i));
+    return i;
+}
+
+// Only pairs that share several exact codes are compared in full; codes that occur in
+// many tracks (silence, steady tones) are left out of the candidate search.
+QVector<QVector<int> > AcousticFingerprint::group(const QVector<QByteArray> &fingerprints, double threshold)
+{
+    QHash<quint32, QVector<int> > postings;
+    for (int i = 0; i < fingerprints.size(); i++) {
+        if (!isDistinctive(fingerprints.at(i)))
+            continue;
+        const quint32 *codes = reinterpret_cast<const quint32 *>(fingerprints.at(i).constData());
+        const int count = fingerprints.at(i).size() / int(sizeof(quint32));
+        QSet<quint32> seen;
+        for (int j = 0; j < count; j++) {
+            if (codes[j] && !seen.contains(codes[j])) {
+                seen.insert(codes[j]);
+                postings[codes[j]].append(i);
+            }
+        }
+    }
+
+    QHash<quint64, int> shared;
+    for (QHash<quint32, QVector<int> >::const_iterator it = postings.constBegin(); it != postings.constEnd(); ++it) {
+        const QVector<int> &tracks = it.value();
+        if (tracks.size() < 2 || tracks.size() > stopListSize)
+            continue;
+        for (int a = 0; a < tracks.size(); a++) {
+            for (int b = a + 1; b < tracks.size(); b++)
+                shared[(quint64(tracks.at(a)) << 32) | quint64(tracks.at(b))]++;
+        }
+    }
+
+    QVector<int> parent(fingerprints.size());
+    for (int i = 0; i < parent.size(); i++)
+        parent[i] = i;
+    for (QHash<quint64, int>::const_iterator it = shared.constBegin(); it != shared.constEnd(); ++it) {
+        if (it.value() < minSharedCodes)
+            continue;
+        const int a = int(it.key() >> 32);
+        const int b = int(it.key() & 0xffffffff);
+        const int rootA = findRoot(parent, a);
+        const int rootB = findRoot(parent, b);
+        if (rootA != rootB && similarity(fingerprints.at(a), fingerprints.at(b)) >= threshold)
+            parent[rootB] = rootA;
+    }
+
+    QHash<int, int> groupOf;
+    QVector<QVector<int> > groups;
+    for (int i = 0; i < parent.size(); i++) {
+        const int root = findRoot(parent, i);
+        QHash<int, int>::const_iterator it = groupOf.constFind(root);
+        if (it == groupOf.constEnd()) {
+            groupOf.insert(root, groups.size());
+            groups.append(QVector<int>() << i);
+        } else {
+            groups[it.value()].append(i);
+        }
+    }
+    QVector<QVector<int> > duplicates;
+    foreach (const QVector<int> &members, groups) {
+        if (members.size() > 1)
+            duplicates.append(members);
+    }
+    return duplicates;
+}
+
+const char *AcousticFingerprint::kernel()
+{
+    return kernels().name;
+}
+
+double AcousticFingerprint::benchmark(int msecs)
+{
+    QVector<qint16> samples(WindowSeconds * SampleRate);
+    quint32 seed = 1;
+    for (int i = 0; i < samples.size(); i++) {
+        seed = seed * 1664525 + 1013904223;
+        const double tone = qSin(2 * M_PI * (220 + (i / SampleRate) * 37 % 440) * i / SampleRate);
+        samples[i] = qint16(tone * 12000 + int(seed >> 20) - 2048);
+    }
+    QElapsedTimer timer;
+    timer.start();
+    qint64 tracks = 0;
+    do {
+        compute(samples.constData(), samples.size());
+        tracks++;
+    } while (timer.elapsed() < msecs);
+    return tracks * 60000.0 / qMax<qint64>(1, timer.elapsed());
+}
@@ -0,0 +1,22 @@
+#ifndef ACOUSTICFINGERPRINT_H
+#define ACOUSTICFINGERPRINT_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class AcousticFingerprint
+{
+public:
+    enum { SampleRate = 11025, FrameSize = 4096, FrameStep = FrameSize / 3, WindowSeconds = 30 };
+
+    static QByteArray compute(const qint16 *samples, int count);
+    static QByteArray fromFile(const QString &path);
+    static double similarity(const QByteArray &a, const QByteArray &b);
+    static bool isDistinctive(const QByteArray &fingerprint);
+    static QVector<QVector<int> > group(const QVector<QByteArray> &fingerprints, double threshold = 0.85);
+    static const char *kernel();
+    static double benchmark(int msecs);
+};
+
+#endif // ACOUSTICFINGERPRINT_H
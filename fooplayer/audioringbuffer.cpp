@@ -0,0 +1,83 @@
+#include "audioringbuffer.h"
+#include <QtMath>
+#include <cstring>
+
+AudioRingBuffer::AudioRingBuffer(int capacity) :
+    data(0), size(0), mask(0), readCount(0), writeCount(0)
+{
+    setCapacity(capacity);
+}
+
+int AudioRingBuffer::write(const char *source, int bytes)
+{
+    const quint32 written = writeCount.load();
+    const quint32 consumed = readCount.loadAcquire();
+    bytes = qMin(bytes, size - int(written - consumed));
+    if (bytes <= 0)
+        return 0;
+    const int pos = int(written & mask);
+    const int first = qMin(bytes, size - pos);
+    memcpy(data + pos, source, first);
+    memcpy(data, source + first, bytes - first);
+    writeCount.storeRelease(written + quint32(bytes));
+    return bytes;
+}
+
+int AudioRingBuffer::read(char *target, int bytes)
+{
+    const quint32 consumed = readCount.load();
+    const quint32 written = writeCount.loadAcquire();
+    bytes = qMin(bytes, int(written - consumed));
+    if (bytes <= 0)
+        return 0;
+    const int pos = int(consumed & mask);
+    const int first = qMin(bytes, size - pos);
+    memcpy(target, data + pos, first);
+    memcpy(target + first, data, bytes - first);
+    readCount.storeRelease(consumed + quint32(bytes));
+    return bytes;
+}
+
+int AudioRingBuffer::peek(char *target, int bytes, int offset) const
+{
+    const quint32 consumed = readCount.load() + quint32(offset);
+    const quint32 written = writeCount.loadAcquire();
+    bytes = qMin(bytes, int(written - consumed));
+    if (bytes <= 0)
+        return 0;
+    const int pos = int(consumed & mask);
+    const int first = qMin(bytes, size - pos);
+    memcpy(target, data + pos, first);
+    memcpy(target + first, data, bytes - first);
+    return bytes;
+}
+
+int AudioRingBuffer::available() const
+{
+    return int(writeCount.loadAcquire() - readCount.loadAcquire());
+}
+
+int AudioRingBuffer::free() const
+{
+    return size - available();
+}
+
+int AudioRingBuffer::capacity() const
+{
+    return size;
+}
+
+void AudioRingBuffer::setCapacity(int capacity)
+{
+    storage = QByteArray(int(qNextPowerOfTwo(quint32(qMax(1, capacity) - 1))), 0);
+    data = storage.data();
+    size = storage.size();
+    mask = quint32(size - 1);
+    clear();
+}
+
+void AudioRingBuffer::clear()
+{
+    readCount.storeRelease(0);
+    writeCount.storeRelease(0);
+}
@@ -0,0 +1,29 @@
+#ifndef AUDIORINGBUFFER_H
+#define AUDIORINGBUFFER_H
+
+#include <QByteArray>
+#include <QAtomicInteger>
+
+class AudioRingBuffer
+{
+public:
+    explicit AudioRingBuffer(int capacity);
+    int write(const char *source, int bytes);
+    int read(char *target, int bytes);
+    int peek(char *target, int bytes, int offset) const;
+    int available() const;
+    int free() const;
+    int capacity() const;
+    void setCapacity(int capacity);
+    void clear();
+
+private:
+    QByteArray storage;
+    char *data;
+    int size;
+    quint32 mask;
+    QAtomicInteger<quint32> readCount;
+    QAtomicInteger<quint32> writeCount;
+};
+
+#endif // AUDIORINGBUFFER_H
@@ -0,0 +1,53 @@
+#include "audiosink.h"
+#include <QAudioDeviceInfo>
+
+AudioSink::AudioSink(const QAudioFormat &format, AudioSource *source) :
+    QObject(0), format(format), source(source), output(0), volume(1), bufferSize(0), softwareVolume(false)
+{
+    source->setParent(this);
+    source->open(QIODevice::ReadOnly);
+}
+
+void AudioSink::start()
+{
+    if (!output) {
+        output = new QAudioOutput(QAudioDeviceInfo::defaultOutputDevice(), format, this);
+        connect(output, SIGNAL(stateChanged(QAudio::State)), this, SIGNAL(stateChanged(QAudio::State)));
+    }
+    output->stop();
+    if (bufferSize > 0)
+        output->setBufferSize(bufferSize);
+    output->setVolume(softwareVolume ? 1 : volume);
+    output->start(source);
+}
+
+void AudioSink::stop()
+{
+    if (output)
+        output->stop();
+}
+
+void AudioSink::suspend()
+{
+    if (output)
+        output->suspend();
+}
+
+void AudioSink::resume()
+{
+    if (output)
+        output->resume();
+}
+
+void AudioSink::setVolume(qreal volume)
+{
+    this->volume = volume;
+    softwareVolume = source->setVolume(volume);
+    if (output)
+        output->setVolume(softwareVolume ? 1 : volume);
+}
+
+void AudioSink::setBufferSize(int bytes)
+{
+    bufferSize = bytes;
+}
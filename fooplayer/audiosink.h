@@ -0,0 +1,35 @@
+#ifndef AUDIOSINK_H
+#define AUDIOSINK_H
+
+#include "audiosource.h"
+#include <QObject>
+#include <QAudioFormat>
+#include <QAudioOutput>
+
+class AudioSink : public QObject
+{
+    Q_OBJECT
+public:
+    AudioSink(const QAudioFormat &format, AudioSource *source);
+
+public slots:
+    void start();
+    void stop();
+    void suspend();
+    void resume();
+    void setVolume(qreal volume);
+    void setBufferSize(int bytes);
+
+signals:
+    void stateChanged(QAudio::State state);
+
+private:
+    QAudioFormat format;
+    AudioSource *source;
+    QAudioOutput *output;
+    qreal volume;
+    int bufferSize;
+    bool softwareVolume;
+};
+
+#endif // AUDIOSINK_H
@@ -0,0 +1,91 @@
+#include "audiosource.h"
+#include <cstring>
+
+static const int rampMilliseconds = 20;
+
+AudioSource::AudioSource(AudioRingBuffer *buffer, const QAudioFormat &format, QObject *parent) :
+    QIODevice(parent), buffer(buffer), bytesPerFrame(format.bytesPerFrame()),
+    rampFrames(format.framesForDuration(rampMilliseconds * 1000)), volume(format), dsp(buffer, format)
+{
+}
+
+bool AudioSource::isSequential() const
+{
+    return true;
+}
+
+qint64 AudioSource::bytesAvailable() const
+{
+    return buffer->available() + QIODevice::bytesAvailable();
+}
+
+void AudioSource::reset(bool endOfStream)
+{
+    this->endOfStream.store(endOfStream ? 1 : 0);
+    primed.store(0);
+    dsp.reset();
+    readFrames.store(0);
+    silence.store(0);
+}
+
+void AudioSource::setEndOfStream()
+{
+    endOfStream.store(1);
+}
+
+bool AudioSource::isFinished() const
+{
+    return endOfStream.load() && buffer->available() == 0;
+}
+
+qint64 AudioSource::framesRead() const
+{
+    return readFrames.load();
+}
+
+qint64 AudioSource::silentFrames() const
+{
+    return silence.load();
+}
+
+int AudioSource::underruns() const
+{
+    return underrunCount.load();
+}
+
+bool AudioSource::setVolume(qreal volume)
+{
+    if (!this->volume.isSupported())
+        return false;
+    this->volume.setGain(volume, rampFrames);
+    return true;
+}
+
+DspChain *AudioSource::dspChain()
+{
+    return &dsp;
+}
+
+qint64 AudioSource::readData(char *data, qint64 maxlen)
+{
+    maxlen -= maxlen % bytesPerFrame;
+    const int bytes = dsp.render(data, int(maxlen / bytesPerFrame)) * bytesPerFrame;
+    volume.process(data, bytes);
+    readFrames.store(dsp.framesConsumed());
+    if (bytes > 0)
+        primed.store(1);
+    if (bytes == maxlen || endOfStream.load())
+        return bytes;
+    if (primed.load())
+        underrunCount.ref();
+    memset(data + bytes, 0, size_t(maxlen - bytes));
+    silence.fetchAndAddRelaxed((maxlen - bytes) / bytesPerFrame);
+    return maxlen;
+}
+
+qint64 AudioSource::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(len);
+    return -1;
+}
@@ -0,0 +1,44 @@
+#ifndef AUDIOSOURCE_H
+#define AUDIOSOURCE_H
+
+#include "audioringbuffer.h"
+#include "gainstage.h"
+#include "dspchain.h"
+#include <QIODevice>
+#include <QAtomicInt>
+#include <QAudioFormat>
+
+class AudioSource : public QIODevice
+{
+    Q_OBJECT
+public:
+    AudioSource(AudioRingBuffer *buffer, const QAudioFormat &format, QObject *parent = nullptr);
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+    void reset(bool endOfStream);
+    void setEndOfStream();
+    bool isFinished() const;
+    qint64 framesRead() const;
+    qint64 silentFrames() const;
+    int underruns() const;
+    bool setVolume(qreal volume);
+    DspChain *dspChain();
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    AudioRingBuffer *buffer;
+    int bytesPerFrame;
+    int rampFrames;
+    GainStage volume;
+    DspChain dsp;
+    QAtomicInt endOfStream;
+    QAtomicInt primed;
+    QAtomicInt underrunCount;
+    QAtomicInteger<qint64> readFrames;
+    QAtomicInteger<qint64> silence;
+};
+
+#endif // AUDIOSOURCE_H
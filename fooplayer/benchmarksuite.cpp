@@ -0,0 +1,1408 @@
+#include "benchmarksuite.h"
+#include "gainstage.h"
+#include "waveform.h"
+#include "waveformservice.h"
+#include "playlistmodel.h"
+#include "playlistfiltermodel.h"
+#include "playlistsorter.h"
+#include "playlistreader.h"
+#include "playlistwriter.h"
+#include "session.h"
+#include "tagscanner.h"
+#include "fixturegenerator.h"
+#include "seekindexcache.h"
+#include "pcmreader.h"
+#include "acousticfingerprint.h"
+#include "loudnessmeter.h"
+#include "loudnessanalyzer.h"
+#include "dspchain.h"
+#include "streamcache.h"
+#include "decoderthread.h"
+#include "playbackengine.h"
+#include "library.h"
+#include "controlserver.h"
+#include "controlclient.h"
+#include <QMediaPlaylist>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QThread>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QSemaphore>
+#include <QtDebug>
+#include <QEventLoop>
+#include <QTimer>
+#include <QCoreApplication>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <algorithm>
+#include <limits>
+#include <QStandardItemModel>
+#include <QAudioDeviceInfo>
+#include <malloc.h>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static const qint64 searchBudget = 5000000;
+static const int streamSeconds = 60;
+static const int streamSpeedup = 4;
+
+template <typename Function>
+static qint64 fastest(int runs, Function run)
+{
+    qint64 best = std::numeric_limits<qint64>::max();
+    for (int i = 0; i < runs; i++)
+        best = qMin(best, qint64(run()));
+    return best;
+}
+
+static double milliseconds(qint64 nsecs)
+{
+    return nsecs / 1000000.0;
+}
+
+// Bytes currently allocated from the C heap, counted block by block. Unlike the
+// process footprint this does not depend on what earlier benchmarks freed, so a
+// model built on reused heap is still charged for every allocation it makes.
+static qint64 heapInUse()
+{
+#if defined(Q_OS_WIN)
+    qint64 bytes = 0;
+    _HEAPINFO entry;
+    entry._pentry = 0;
+    while (_heapwalk(&entry) == _HEAPOK) {
+        if (entry._useflag == _USEDENTRY)
+            bytes += qint64(entry._size);
+    }
+    return bytes;
+#elif defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    return qint64(mallinfo2().uordblks);
+#elif defined(__GLIBC__)
+    return qint64(uint(mallinfo().uordblks));
+#else
+    return 0;
+#endif
+}
+
+// The playlist model as it was before PlaylistModel: one QStandardItem per cell.
+static void appendStandardItems(QStandardItemModel *model, const QVector<TrackInfo> &tracks)
+{
+    foreach (const TrackInfo &track, tracks) {
+        QList<QStandardItem *> items;
+        items.append(new QStandardItem(track.title));
+        items.append(new QStandardItem(track.artist));
+        items.append(new QStandardItem(QString::number(track.trackNumber)));
+        items.append(new QStandardItem(track.album));
+        items.append(new QStandardItem(QString::number(track.bitrate)));
+        items.append(new QStandardItem(PlaylistModel::lengthString(track.length / 1000)));
+        model->appendRow(items);
+    }
+}
+
+template <typename Model>
+static qint64 randomLookups(const Model &model, int lookups)
+{
+    quint32 seed = 11;
+    int characters = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < lookups; i++) {
+        seed = seed * 1664525 + 1013904223;
+        const QModelIndex index = model.index(int(seed % quint32(model.rowCount())), int((seed >> 24) % quint32(model.columnCount())));
+        characters += model.data(index, Qt::DisplayRole).toString().size();
+    }
+    const qint64 nsecs = timer.nsecsElapsed();
+    if (!characters)
+        qWarning() << "model lookups returned no text";
+    return nsecs;
+}
+
+static QString syntheticWord(quint32 &seed)
+{
+    static const char *const syllables[] = { "ka", "lo", "mi", "ren", "tor", "sa", "vel", "din", "ro", "e", "an", "bri", "us", "qua", "zel", "fo" };
+    QString word;
+    seed = seed * 1664525 + 1013904223;
+    const int count = 2 + (seed >> 28) % 3;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1664525 + 1013904223;
+        word += QLatin1String(syllables[(seed >> 24) % 16]);
+    }
+    return word;
+}
+
+QVector<TrackInfo> BenchmarkSuite::syntheticTracks(int rows)
+{
+    QVector<TrackInfo> tracks;
+    tracks.reserve(rows);
+    quint32 seed = 7;
+    for (int i = 0; i < rows; i++) {
+        TrackInfo track;
+        track.path = QString("/music/%1/%2.mp3").arg(i / 12).arg(i);
+        track.title = syntheticWord(seed) + ' ' + syntheticWord(seed);
+        track.artist = syntheticWord(seed);
+        track.album = syntheticWord(seed) + ' ' + syntheticWord(seed);
+        track.trackNumber = i % 12 + 1;
+        track.bitrate = 128 + (seed >> 24) % 192;
+        track.length = 60000 + (seed >> 8) % 400000;
+        track.valid = true;
+        tracks.append(track);
+    }
+    return tracks;
+}
+
+BenchmarkSuite::BenchmarkSuite(int rows) :
+    rows(qMax(1000, rows))
+{
+}
+
+void BenchmarkSuite::setFixtures(const QString &directory)
+{
+    fixtures = directory;
+}
+
+QStringList BenchmarkSuite::groups()
+{
+    return QStringList() << "gain" << "peaks" << "model" << "playlist" << "search" << "sort" << "view" << "tags" << "seek" << "gapless" << "underrun" << "fingerprint" << "loudness" << "dsp" << "stream" << "control" << "startup";
+}
+
+bool BenchmarkSuite::run(const QStringList &selected)
+{
+    const QStringList names = selected.contains("all") ? groups() : selected;
+    foreach (const QString &name, names) {
+        if (!groups().contains(name))
+            return false;
+    }
+    foreach (const QString &name, names) {
+        if (name == "gain")
+            runGain();
+        else if (name == "peaks")
+            runPeaks();
+        else if (name == "model")
+            runModel();
+        else if (name == "playlist")
+            runPlaylist();
+        else if (name == "search")
+            runSearch();
+        else if (name == "sort")
+            runSort();
+        else if (name == "view")
+            runView();
+        else if (name == "tags")
+            runTags();
+        else if (name == "seek")
+            runSeek();
+        else if (name == "gapless")
+            runGapless();
+        else if (name == "underrun")
+            runUnderrun();
+        else if (name == "fingerprint")
+            runFingerprint();
+        else if (name == "loudness")
+            runLoudness();
+        else if (name == "dsp")
+            runDsp();
+        else if (name == "stream")
+            runStream();
+        else if (name == "control")
+            runControl();
+        else if (name == "startup")
+            runStartup();
+    }
+    return true;
+}
+
+void BenchmarkSuite::record(const QString &name, double value, const char *unit, bool higherIsBetter)
+{
+    QJsonObject metric;
+    metric.insert("value", value);
+    metric.insert("unit", QString(unit));
+    metric.insert("higherIsBetter", higherIsBetter);
+    metrics.insert(name, metric);
+}
+
+QJsonObject BenchmarkSuite::results() const
+{
+    QJsonObject object;
+    object.insert("rows", rows);
+    object.insert("threads", QThread::idealThreadCount());
+    object.insert("gainKernel", QString(GainStage::kernel()));
+    object.insert("peakKernel", QString(Waveform::kernel()));
+    object.insert("fingerprintKernel", QString(AcousticFingerprint::kernel()));
+    object.insert("loudnessKernel", QString(LoudnessMeter::kernel()));
+    object.insert("metrics", metrics);
+    return object;
+}
+
+QStringList BenchmarkSuite::failures() const
+{
+    return failed;
+}
+
+void BenchmarkSuite::fail(const QString &message)
+{
+    failed.append(message);
+}
+
+void BenchmarkSuite::print(QTextStream &out) const
+{
+    for (QJsonObject::const_iterator it = metrics.begin(); it != metrics.end(); ++it) {
+        const QJsonObject metric = it.value().toObject();
+        out << qSetFieldWidth(32) << left << it.key() << qSetFieldWidth(0)
+            << metric.value("value").toDouble() << ' ' << metric.value("unit").toString() << endl;
+    }
+}
+
+int BenchmarkSuite::compare(const QJsonObject &results, const QJsonObject &baseline, double tolerance, QTextStream &out)
+{
+    const QJsonObject current = results.value("metrics").toObject();
+    const QJsonObject reference = baseline.value("metrics").toObject();
+    int regressions = 0;
+    for (QJsonObject::const_iterator it = reference.begin(); it != reference.end(); ++it) {
+        if (!current.contains(it.key()))
+            continue;
+        const QJsonObject before = it.value().toObject();
+        const QJsonObject after = current.value(it.key()).toObject();
+        const double old = before.value("value").toDouble();
+        const double now = after.value("value").toDouble();
+        if (old <= 0 || now <= 0)
+            continue;
+        const double slowdown = before.value("higherIsBetter").toBool() ? old / now : now / old;
+        const bool regressed = slowdown > 1 + tolerance;
+        if (regressed)
+            regressions++;
+        out << qSetFieldWidth(32) << left << it.key() << qSetFieldWidth(0) << old << " -> " << now << ' '
+            << after.value("unit").toString() << " (" << qRound(qAbs(slowdown - 1) * 1000) / 10.0
+            << (slowdown < 1 ? "% faster)" : "% slower)") << (regressed ? " REGRESSION" : "") << endl;
+    }
+    return regressions;
+}
+
+void BenchmarkSuite::runGain()
+{
+    record("gain.int16", GainStage::benchmark(QAudioFormat::SignedInt, 1000), "samples/s", true);
+    record("gain.float32", GainStage::benchmark(QAudioFormat::Float, 1000), "samples/s", true);
+    record("gain.limiter.int16", GainStage::benchmark(QAudioFormat::SignedInt, 1000, 2), "samples/s", true);
+    record("gain.limiter.float32", GainStage::benchmark(QAudioFormat::Float, 1000, 2), "samples/s", true);
+}
+
+void BenchmarkSuite::runPeaks()
+{
+    record("peaks.kernel", Waveform::benchmark(1000), "s/s", true);
+
+    // Decode, extract and cache a ten minute MP3 through the service, then read it back.
+    QTemporaryDir directory;
+    const QString path = directory.path() + "/peaks.mp3";
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(FixtureGenerator::mp3(FixtureGenerator::track(0), 600)) < 0) {
+        fail("peaks: cannot write " + path);
+        return;
+    }
+    file.close();
+    for (int pass = 0; pass < 2; pass++) {
+        WaveformService service(directory.path() + "/cache");
+        QEventLoop loop;
+        double seconds = 0;
+        QObject::connect(&service, &WaveformService::waveformUpdated, &loop, [&loop, &seconds](const QString &, const Waveform &waveform) {
+            if (!waveform.isComplete())
+                return;
+            seconds = waveform.frames() / double(qMax(1, waveform.sampleRate()));
+            loop.quit();
+        });
+        QTimer::singleShot(120000, &loop, SLOT(quit()));
+        QElapsedTimer timer;
+        timer.start();
+        service.request(path);
+        loop.exec();
+        const qint64 elapsed = timer.nsecsElapsed();
+        if (seconds <= 0) {
+            fail("peaks: no waveform for " + path);
+            return;
+        }
+        if (pass == 0)
+            record("peaks.extract", seconds / (elapsed / 1e9), "s/s", true);
+        else
+            record("peaks.cached", milliseconds(elapsed), "ms");
+    }
+}
+
+void BenchmarkSuite::runModel()
+{
+    const QVector<TrackInfo> tracks = syntheticTracks(rows);
+    record("model.append", milliseconds(fastest(3, [&tracks]() {
+        PlaylistModel model;
+        QElapsedTimer timer;
+        timer.start();
+        model.appendTracks(tracks);
+        return timer.nsecsElapsed();
+    })), "ms");
+    record("model.remove", milliseconds(fastest(3, [&tracks]() {
+        PlaylistModel model;
+        model.appendTracks(tracks);
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < 1000; i++)
+            model.removeRow(int(quint64(i) * 7919 % model.rowCount()));
+        return timer.nsecsElapsed();
+    })), "ms");
+    PlaylistModel model;
+    model.appendTracks(tracks);
+    record("model.memory", model.memoryUsage() / 1048576.0, "MiB");
+
+    // Against the QStandardItemModel it replaced, at a fixed 100k rows. Each model
+    // gets its own temporary tracks, so it ends up owning every string it keeps.
+    const int compared = 100000;
+    const int lookups = 1000000;
+    qint64 columnar = 0;
+    {
+        const qint64 before = heapInUse();
+        PlaylistModel model;
+        model.appendTracks(syntheticTracks(compared));
+        columnar = heapInUse() - before;
+        record("model.lookup", double(randomLookups(model, lookups)) / lookups, "ns");
+    }
+    const qint64 before = heapInUse();
+    QStandardItemModel items;
+    appendStandardItems(&items, syntheticTracks(compared));
+    const qint64 standard = heapInUse() - before;
+    record("model.lookup.standardItem", double(randomLookups(items, lookups)) / lookups, "ns");
+    if (columnar > 0 && standard > 0) {
+        record("model.bytesPerTrack", double(columnar) / compared, "bytes");
+        record("model.bytesPerTrack.standardItem", double(standard) / compared, "bytes");
+        record("model.memoryReduction", double(standard) / columnar, "x", true);
+    }
+}
+
+// What Library::addPaths does before the tag scan starts.
+static int addBatch(QMediaPlaylist *playlist, PlaylistModel *model, const QStringList &paths)
+{
+    const QStringList fresh = model->newPaths(paths);
+    QList<QMediaContent> media;
+    QVector<TrackInfo> tracks;
+    media.reserve(fresh.size());
+    tracks.reserve(fresh.size());
+    foreach (const QString &path, fresh) {
+        media.append(QMediaContent(QUrl::fromLocalFile(path)));
+        TrackInfo track;
+        track.path = path;
+        tracks.append(track);
+    }
+    playlist->addMedia(media);
+    model->appendTracks(tracks);
+    return fresh.size();
+}
+
+void BenchmarkSuite::runPlaylist()
+{
+    const QVector<TrackInfo> tracks = syntheticTracks(rows);
+    record("playlist.add", milliseconds(fastest(3, [&tracks]() {
+        QMediaPlaylist playlist;
+        PlaylistModel model;
+        QElapsedTimer timer;
+        timer.start();
+        QList<QMediaContent> media;
+        media.reserve(tracks.size());
+        foreach (const TrackInfo &track, tracks)
+            media.append(QMediaContent(QUrl::fromLocalFile(track.path)));
+        playlist.addMedia(media);
+        model.appendTracks(tracks);
+        return timer.nsecsElapsed();
+    })), "ms");
+
+    // Growing one playlist to 100k rows in import-sized batches, each checked against the
+    // rows already there: a batch should cost the same at the end as at the start.
+    const int batch = 1000;
+    const QVector<TrackInfo> library = syntheticTracks(100000);
+    QVector<qint64> batches(library.size() / batch, std::numeric_limits<qint64>::max());
+    int skipped = 0;
+    for (int run = 0; run < 3; run++) {
+        QMediaPlaylist playlist;
+        PlaylistModel model;
+        for (int first = 0; first < library.size(); first += batch) {
+            QStringList paths;
+            for (int i = first; i < first + batch; i++)
+                paths.append(library.at(i).path);
+            QElapsedTimer timer;
+            timer.start();
+            addBatch(&playlist, &model, paths);
+            batches[first / batch] = qMin(batches.at(first / batch), timer.nsecsElapsed());
+        }
+        QStringList again;
+        for (int i = 0; i < batch; i++)
+            again.append(library.at(i * 97).path);
+        skipped = batch - addBatch(&playlist, &model, again);
+    }
+    record("playlist.addBatch.1k", milliseconds(batches.at(0)), "ms");
+    record("playlist.addBatch.10k", milliseconds(batches.at(9)), "ms");
+    record("playlist.addBatch.50k", milliseconds(batches.at(49)), "ms");
+    record("playlist.addBatch.100k", milliseconds(batches.last()), "ms");
+    record("playlist.addGrowth", double(batches.last()) / qMax<qint64>(1, batches.at(0)), "x");
+    record("playlist.duplicatesSkipped", 100.0 * skipped / batch, "%", true);
+
+    QTemporaryDir directory;
+    const QString fileName = directory.path() + "/benchmark.m3u8";
+    PlaylistModel model;
+    model.appendTracks(tracks);
+    QElapsedTimer timer;
+    timer.start();
+    PlaylistWriter::write(fileName, &model);
+    record("playlist.export", milliseconds(timer.nsecsElapsed()), "ms");
+    record("playlist.import", milliseconds(fastest(3, [&fileName]() {
+        QElapsedTimer timer;
+        timer.start();
+        PlaylistReader reader(fileName);
+        QString path;
+        if (reader.open()) {
+            while (reader.next(path)) {
+            }
+        }
+        return timer.nsecsElapsed();
+    })), "ms");
+}
+
+void BenchmarkSuite::runSearch()
+{
+    PlaylistModel model;
+    const QVector<TrackInfo> tracks = syntheticTracks(rows);
+    model.appendTracks(tracks);
+
+    PlaylistFilterModel filter;
+    QElapsedTimer timer;
+    timer.start();
+    filter.setSourceModel(&model);
+    record("search.index", milliseconds(timer.nsecsElapsed()), "ms");
+
+    QVector<qint64> times;
+    for (int q = 0; q < 50; q++) {
+        const TrackInfo &track = tracks.at(int(quint64(q) * 7919 % rows));
+        const QString query = q % 2 ? track.artist + ' ' + track.title.section(' ', 0, 0) : track.album;
+        filter.setFilterText(QString());
+        for (int length = 1; length <= query.size(); length++) {
+            filter.setFilterText(query.left(length));
+            times.append(filter.lastFilterTime());
+        }
+    }
+    std::sort(times.begin(), times.end());
+    record("search.keystroke.p50", times.at(times.size() / 2) / 1000.0, "us");
+    record("search.keystroke.p99", times.at(times.size() * 99 / 100) / 1000.0, "us");
+
+    // A tag scan delivers batches through updateTracks while the user types.
+    const int batch = 64;
+    QVector<qint64> keystrokes;
+    QVector<qint64> updates;
+    QElapsedTimer keystroke;
+    int next = 0;
+    for (int q = 0; q < 50; q++) {
+        const TrackInfo &track = tracks.at(int(quint64(q) * 104729 % rows));
+        const QString query = q % 2 ? track.album : track.artist + ' ' + track.title.section(' ', 0, 0);
+        filter.setFilterText(QString());
+        for (int length = 1; length <= query.size(); length++) {
+            QVector<int> changed;
+            QVector<TrackInfo> scanned;
+            for (int i = 0; i < batch; i++, next = (next + 1) % rows) {
+                TrackInfo info = model.track(next);
+                info.title += QLatin1Char(' ') + QString::number(q);
+                changed.append(next);
+                scanned.append(info);
+            }
+            keystroke.start();
+            model.updateTracks(changed, scanned);
+            updates.append(keystroke.nsecsElapsed());
+            keystroke.start();
+            filter.setFilterText(query.left(length));
+            keystrokes.append(keystroke.nsecsElapsed());
+        }
+    }
+    std::sort(keystrokes.begin(), keystrokes.end());
+    std::sort(updates.begin(), updates.end());
+    const qint64 p99 = keystrokes.at(keystrokes.size() * 99 / 100);
+    record("search.scanning.keystroke.p50", keystrokes.at(keystrokes.size() / 2) / 1000.0, "us");
+    record("search.scanning.keystroke.p99", p99 / 1000.0, "us");
+    record("search.scanning.update.p99", updates.at(updates.size() * 99 / 100) / 1000.0, "us");
+    if (p99 > searchBudget)
+        fail(QString("search: keystroke p99 %1 ms during a tag scan of %2 rows").arg(p99 / 1e6, 0, 'f', 2).arg(rows));
+
+    // The first keystroke after deleting rows must not pay for an index rebuild.
+    filter.setFilterText(QString());
+    timer.start();
+    model.removeRows(rows / 2, 100);
+    record("search.remove", milliseconds(timer.nsecsElapsed()), "ms");
+    keystroke.start();
+    filter.setFilterText(tracks.at(rows / 3).album);
+    const qint64 first = keystroke.nsecsElapsed();
+    record("search.keystroke.afterRemove", first / 1000.0, "us");
+    if (first > searchBudget)
+        fail(QString("search: first keystroke after a removal took %1 ms").arg(first / 1e6, 0, 'f', 2));
+}
+
+void BenchmarkSuite::runSort()
+{
+    PlaylistModel model;
+    model.appendTracks(syntheticTracks(rows));
+    const char *const names[] = { "sort.title", "sort.artist_album_number", "sort.length" };
+    const int columns[][3] = { { PlaylistModel::Title, -1, -1 }, { PlaylistModel::Artist, PlaylistModel::Album, PlaylistModel::Number },
+                               { PlaylistModel::Length, -1, -1 } };
+    qint64 permute = 0;
+    for (int i = 0; i < 3; i++) {
+        QList<SortKey> keys;
+        for (int k = 0; k < 3 && columns[i][k] >= 0; k++) {
+            SortKey key;
+            key.column = columns[i][k];
+            key.order = i == 2 ? Qt::DescendingOrder : Qt::AscendingOrder;
+            keys.append(key);
+        }
+        QElapsedTimer timer;
+        timer.start();
+        const QVector<int> order = PlaylistSorter::sortOrder(model.columns(), keys);
+        record(names[i], milliseconds(timer.nsecsElapsed()), "ms");
+        timer.restart();
+        model.permute(order);
+        permute = qMax(permute, timer.nsecsElapsed());
+    }
+    record("sort.permute", milliseconds(permute), "ms");
+}
+
+static void paintViewport(QAbstractItemModel *model, int top, int height)
+{
+    static const int roles[] = { Qt::DisplayRole, Qt::DecorationRole, Qt::FontRole, Qt::TextAlignmentRole,
+                                 Qt::ForegroundRole, Qt::BackgroundRole, Qt::CheckStateRole };
+    const int bottom = qMin(top + height, model->rowCount());
+    for (int row = top; row < bottom; row++) {
+        for (int column = 0; column < model->columnCount(); column++) {
+            const QModelIndex index = model->index(row, column);
+            for (unsigned i = 0; i < sizeof(roles) / sizeof(roles[0]); i++)
+                model->data(index, roles[i]);
+        }
+    }
+}
+
+void BenchmarkSuite::runView()
+{
+    const int size = qMax(rows, 500000);
+    const int viewport = 60;
+    PlaylistModel first;
+    PlaylistModel second;
+    first.appendTracks(syntheticTracks(size));
+    second.appendTracks(syntheticTracks(size));
+    PlaylistFilterModel filter;
+    filter.setSourceModel(&first);
+
+    int switches = 0;
+    record("view.switch", milliseconds(fastest(5, [&]() {
+        QElapsedTimer timer;
+        timer.start();
+        filter.setSourceModel(switches++ % 2 ? &first : &second);
+        paintViewport(&filter, 0, viewport);
+        return timer.nsecsElapsed();
+    })), "ms");
+
+    QVector<qint64> frames;
+    int top = 0;
+    for (int frame = 0; frame < 2000; frame++) {
+        QElapsedTimer timer;
+        timer.start();
+        top = qMin(top + viewport / 3, size - viewport);
+        while (top + viewport > filter.rowCount() && filter.canFetchMore(QModelIndex()))
+            filter.fetchMore(QModelIndex());
+        paintViewport(&filter, top, viewport);
+        frames.append(timer.nsecsElapsed());
+    }
+    std::sort(frames.begin(), frames.end());
+    record("view.scroll.frame.p50", frames.at(frames.size() / 2) / 1000.0, "us");
+    record("view.scroll.frame.p99", frames.at(frames.size() * 99 / 100) / 1000.0, "us");
+}
+
+static qint64 scanTags(const QStringList &files, MetadataCache *cache, bool cold, int *cached)
+{
+    TagScanner scanner;
+    scanner.setCache(cache);
+    scanner.setColdCache(cold);
+    QEventLoop loop;
+    QObject::connect(&scanner, &TagScanner::finished, [&loop, cached](int, int hits, qint64) {
+        *cached = hits;
+        loop.quit();
+    });
+    QElapsedTimer timer;
+    timer.start();
+    scanner.scan(files, 0);
+    loop.exec();
+    return timer.nsecsElapsed();
+}
+
+void BenchmarkSuite::runTags()
+{
+    QTemporaryDir generated;
+    QString directory = fixtures;
+    if (directory.isEmpty()) {
+        directory = generated.path();
+        FixtureGenerator::generate(directory, 300, 1);
+    }
+    QStringList files;
+    QDirIterator it(directory, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        files.append(it.next());
+    if (files.isEmpty())
+        return;
+    int valid = 0;
+    const qint64 nsecs = fastest(3, [&files, &valid]() {
+        QElapsedTimer timer;
+        timer.start();
+        valid = 0;
+        foreach (const QString &file, files)
+            valid += TagReader::read(file).valid;
+        return timer.nsecsElapsed();
+    });
+    record("tags.read", files.size() * 1e9 / qMax<qint64>(1, nsecs), "files/s", true);
+    record("tags.valid", 100.0 * valid / files.size(), "%", true);
+
+    // The same import twice through the scanner: once into an empty metadata cache with
+    // the page cache dropped, once more after reopening the saved cache.
+    const QString cacheFile = generated.path() + "/metadata.cache";
+    QFile::remove(cacheFile);
+    int cached = 0;
+    {
+        MetadataCache cache(cacheFile);
+        const qint64 cold = scanTags(files, &cache, true, &cached);
+        record("tags.cold", files.size() * 1e9 / qMax<qint64>(1, cold), "files/s", true);
+        cache.save();
+    }
+    MetadataCache cache(cacheFile);
+    const qint64 warm = scanTags(files, &cache, false, &cached);
+    record("tags.cached", files.size() * 1e9 / qMax<qint64>(1, warm), "files/s", true);
+    record("tags.cacheHits", 100.0 * cached / files.size(), "%", true);
+}
+
+void BenchmarkSuite::runSeek()
+{
+    QTemporaryDir directory;
+    const QString path = directory.path() + "/seek.mp3";
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(FixtureGenerator::mp3(FixtureGenerator::track(0), 2 * 3600, true)) < 0)
+        return;
+    file.close();
+
+    SeekIndex index;
+    record("seek.indexBuild", milliseconds(fastest(3, [&path, &index]() {
+        QElapsedTimer timer;
+        timer.start();
+        index = SeekIndex::build(path);
+        return timer.nsecsElapsed();
+    })), "ms");
+    if (!index.isValid())
+        return;
+    record("seek.indexSize", index.serialize().size() / 1024.0, "KiB");
+
+    const int lookups = 1000000;
+    qint64 checksum = 0;
+    record("seek.locate", fastest(3, [&index, &checksum, lookups]() {
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < lookups; i++) {
+            qint64 offset, start;
+            index.locate(qint64(quint64(i) * 2654435761u % quint64(index.samples())), offset, start);
+            checksum += offset - start;
+        }
+        return timer.nsecsElapsed();
+    }) / double(lookups), "ns");
+
+    QAudioFormat format;
+    format.setSampleRate(44100);
+    format.setChannelCount(2);
+    format.setSampleSize(16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+    SeekIndexCache cache(directory.path() + "/index");
+    cache.index(path);
+    PcmReader reader(format);
+    reader.setSeekIndexCache(&cache);
+    const int seeks = 16;
+    qint64 total = 0;
+    int done = 0;
+    for (int i = 1; i <= seeks; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        if (reader.open(path, index.samples() * i / (seeks + 1)) && !reader.read(4096 * format.bytesPerFrame()).isEmpty()) {
+            total += timer.nsecsElapsed();
+            done++;
+        }
+    }
+    if (done)
+        record("seek.latency", milliseconds(total / done), "ms");
+}
+
+void BenchmarkSuite::runFingerprint()
+{
+    record("fingerprint.compute", AcousticFingerprint::benchmark(1000), "tracks/min", true);
+    const QVector<qint16> window(AcousticFingerprint::WindowSeconds * AcousticFingerprint::SampleRate);
+    record("fingerprint.bytes", AcousticFingerprint::compute(window.constData(), window.size()).size(), "bytes");
+
+    // Every tenth fingerprint is a shifted copy of the one before with a few bits flipped.
+    const int count = qMin(rows, 5000);
+    const int codes = AcousticFingerprint::compute(window.constData(), window.size()).size() / int(sizeof(quint32));
+    QVector<QByteArray> fingerprints;
+    quint32 seed = 1;
+    for (int i = 0; i < count; i++) {
+        QVector<quint32> values(codes);
+        for (int j = 0; j < codes; j++) {
+            seed = seed * 1664525 + 1013904223;
+            values[j] = seed;
+        }
+        if (i % 10 == 9) {
+            const quint32 *previous = reinterpret_cast<const quint32 *>(fingerprints.last().constData());
+            for (int j = 0; j < codes; j++) {
+                seed = seed * 1664525 + 1013904223;
+                values[j] = previous[qMin(codes - 1, j + 3)];
+                if (seed >> 28 == 0)
+                    values[j] ^= 1u << (seed & 31);
+            }
+        }
+        fingerprints.append(QByteArray(reinterpret_cast<const char *>(values.constData()), codes * int(sizeof(quint32))));
+    }
+    int groups = 0;
+    record("fingerprint.group", milliseconds(fastest(3, [&fingerprints, &groups]() {
+        QElapsedTimer timer;
+        timer.start();
+        groups = AcousticFingerprint::group(fingerprints).size();
+        return timer.nsecsElapsed();
+    })), "ms");
+    record("fingerprint.groups", groups, "groups", true);
+
+    QTemporaryDir generated;
+    QString directory = fixtures;
+    if (directory.isEmpty()) {
+        directory = generated.path();
+        FixtureGenerator::generate(directory, 30, AcousticFingerprint::WindowSeconds);
+    }
+    QStringList files;
+    QDirIterator it(directory, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        files.append(it.next());
+    if (files.isEmpty())
+        return;
+    QElapsedTimer timer;
+    timer.start();
+    QtConcurrent::blockingMapped<QVector<QByteArray> >(files, AcousticFingerprint::fromFile);
+    record("fingerprint.scan", files.size() * 60000.0 / qMax<qint64>(1, timer.elapsed()), "tracks/min", true);
+}
+
+void BenchmarkSuite::runLoudness()
+{
+    record("loudness.meter", LoudnessMeter::benchmark(1000), "x realtime", true);
+
+    QTemporaryDir generated;
+    QString directory = fixtures;
+    if (directory.isEmpty()) {
+        directory = generated.path();
+        FixtureGenerator::generate(directory, 30, 60);
+    }
+    QVector<TrackInfo> tracks;
+    QDirIterator it(directory, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        tracks.append(TagReader::read(it.next()));
+    if (tracks.isEmpty())
+        return;
+    LoudnessAnalyzer analyzer;
+    QEventLoop loop;
+    double realtime = 0;
+    QObject::connect(&analyzer, &LoudnessAnalyzer::finished, [&loop, &realtime](int, int, int, qint64 audioMsecs, qint64 msecs) {
+        realtime = double(audioMsecs) / qMax<qint64>(1, msecs);
+        loop.quit();
+    });
+    analyzer.analyze(tracks, false);
+    loop.exec();
+    record("loudness.analyze", realtime, "x realtime", true);
+}
+
+// Each stage runs alone over an hour of synthetic audio, next to a bypassed chain
+// that only pays for the ring buffer; the difference is the stage's own cost.
+void BenchmarkSuite::runDsp()
+{
+    const int seconds = 3600;
+    const DspSettings bypass;
+    record("dsp.bypass", milliseconds(DspChain::benchmark(bypass, seconds)), "ms");
+    for (int stage = 0; stage < DspChain::StageCount; stage++) {
+        DspSettings settings;
+        if (stage == DspChain::Crossfade) {
+            settings.crossfade = 5000;
+        } else if (stage == DspChain::Resampler) {
+            settings.speed = 1.25f;
+        } else if (stage == DspChain::Equalizer) {
+            for (int i = 0; i < settings.bands.size(); i++)
+                settings.bands[i].gain = 3;
+        } else {
+            settings.balance = 0.5f;
+        }
+        record(QString("dsp.%1").arg(DspChain::stageName(stage)), milliseconds(DspChain::benchmark(settings, seconds)), "ms");
+    }
+    DspSettings all;
+    all.crossfade = 5000;
+    all.speed = 1.25f;
+    for (int i = 0; i < all.bands.size(); i++)
+        all.bands[i].gain = 3;
+    all.balance = 0.5f;
+    record("dsp.chain", milliseconds(DspChain::benchmark(all, seconds)), "ms");
+}
+
+// Stand-in for a slow NAS or HTTP share: serves one file from memory, honours single
+// Range requests and holds every response back by a fixed latency.
+class LatencyServer : public QThread
+{
+public:
+    LatencyServer(const QByteArray &content, int latency) :
+        content(content), latency(latency), port(0)
+    {
+    }
+
+    ~LatencyServer()
+    {
+        stopping.store(1);
+        wait();
+    }
+
+    QString url(const QString &path)
+    {
+        if (!isRunning()) {
+            start();
+            ready.acquire();
+        }
+        return QString("http://127.0.0.1:%1/%2").arg(port).arg(path);
+    }
+
+protected:
+    void run() override
+    {
+        QTcpServer server;
+        server.listen(QHostAddress::LocalHost);
+        port = server.serverPort();
+        ready.release();
+        while (!stopping.load()) {
+            if (!server.waitForNewConnection(50))
+                continue;
+            QTcpSocket *socket = server.nextPendingConnection();
+            serve(socket);
+            delete socket;
+        }
+    }
+
+private:
+    void serve(QTcpSocket *socket)
+    {
+        QByteArray request;
+        while (!request.contains("\r\n\r\n") && socket->waitForReadyRead(1000))
+            request += socket->readAll();
+        qint64 begin = 0;
+        qint64 end = content.size() - 1;
+        const int range = request.indexOf("Range: bytes=");
+        if (range >= 0) {
+            const QByteArray value = request.mid(range + 13, request.indexOf("\r\n", range) - range - 13);
+            begin = value.left(value.indexOf('-')).toLongLong();
+            if (!value.endsWith('-'))
+                end = qMin(end, value.mid(value.indexOf('-') + 1).toLongLong());
+        }
+        msleep(latency);
+        QByteArray header;
+        if (range >= 0)
+            header = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + QByteArray::number(begin) + '-'
+                    + QByteArray::number(end) + '/' + QByteArray::number(content.size()) + "\r\n";
+        else
+            header = "HTTP/1.1 200 OK\r\n";
+        header += "Content-Length: " + QByteArray::number(end - begin + 1) + "\r\nConnection: close\r\n\r\n";
+        socket->write(header);
+        socket->write(content.constData() + begin, end - begin + 1);
+        while (socket->bytesToWrite() && socket->waitForBytesWritten(1000)) {
+        }
+        socket->disconnectFromHost();
+        if (socket->state() != QAbstractSocket::UnconnectedState)
+            socket->waitForDisconnected(1000);
+    }
+
+    QByteArray content;
+    int latency;
+    quint16 port;
+    QSemaphore ready;
+    QAtomicInt stopping;
+};
+
+static QAudioFormat streamFormat()
+{
+    QAudioFormat format;
+    format.setSampleRate(44100);
+    format.setChannelCount(2);
+    format.setSampleSize(16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+    return format;
+}
+
+static qint64 firstAudio(StreamCache *cache, const QString &url)
+{
+    const QAudioFormat format = streamFormat();
+    PcmReader reader(format);
+    reader.setStreamCache(cache);
+    QElapsedTimer timer;
+    timer.start();
+    if (!reader.open(url) || reader.read(4096 * format.bytesPerFrame()).isEmpty())
+        return -1;
+    return timer.nsecsElapsed();
+}
+
+// Reads the first streamSeconds of audio at streamSpeedup times the fixture's average
+// bitrate, in 100 ms blocks like the decoder pulls them, and returns the share of bytes
+// served from the cache without waiting for the network.
+static double streamPass(StreamCache *cache, const QString &url, const QByteArray &content, int seconds)
+{
+    const qint64 hits = cache->hitBytes();
+    const qint64 misses = cache->missBytes();
+    StreamDevice device(cache, url);
+    if (!device.open(QIODevice::ReadOnly))
+        return -1;
+    const qint64 bytesPerSecond = content.size() / seconds * streamSpeedup;
+    const qint64 limit = qMin<qint64>(content.size(), content.size() / seconds * streamSeconds);
+    const int blockBytes = int(qMax<qint64>(1, bytesPerSecond / 10));
+    QByteArray data;
+    QElapsedTimer clock;
+    clock.start();
+    while (data.size() < limit && !device.atEnd()) {
+        const qint64 due = qint64(data.size()) * 1000 / bytesPerSecond;
+        if (due > clock.elapsed())
+            QThread::msleep(quint32(due - clock.elapsed()));
+        const QByteArray block = device.read(qMin<qint64>(blockBytes, limit - data.size()));
+        if (block.isEmpty())
+            break;
+        data += block;
+    }
+    if (data != content.left(data.size()) || data.size() < limit)
+        qWarning() << "stream cache returned" << data.size() << "of" << limit << "bytes or data that differs from the served file";
+    const qint64 hit = cache->hitBytes() - hits;
+    const qint64 total = hit + cache->missBytes() - misses;
+    return total ? 100.0 * hit / total : 0;
+}
+
+void BenchmarkSuite::runStream()
+{
+    const int latency = 40;
+    const int seconds = 600;
+    QTemporaryDir directory;
+    const QByteArray content = FixtureGenerator::mp3(FixtureGenerator::track(0), seconds, true);
+    LatencyServer server(content, latency);
+    const QString url = server.url("stream.mp3");
+    const QString seekUrl = server.url("seek.mp3");
+    {
+        StreamCache cache(directory.path(), Q_INT64_C(1024) * 1024 * 1024);
+        const qint64 cold = firstAudio(&cache, url);
+        if (cold >= 0)
+            record("stream.startup.cold", milliseconds(cold), "ms");
+        record("stream.hitRatio.cold", streamPass(&cache, url, content, seconds), "%", true);
+
+        StreamDevice device(&cache, seekUrl);
+        if (device.open(QIODevice::ReadOnly)) {
+            const int seeks = 16;
+            qint64 times[2] = { 0, 0 };
+            for (int pass = 0; pass < 2; pass++) {
+                for (int i = 1; i <= seeks; i++) {
+                    QElapsedTimer timer;
+                    timer.start();
+                    device.seek(content.size() * i / (seeks + 1));
+                    device.read(16 * 1024);
+                    times[pass] += timer.nsecsElapsed();
+                }
+            }
+            record("stream.seek.miss", milliseconds(times[0] / seeks), "ms");
+            record("stream.seek.hit", milliseconds(times[1] / seeks), "ms");
+        }
+    }
+
+    StreamCache cache(directory.path(), Q_INT64_C(1024) * 1024 * 1024);
+    const qint64 warm = firstAudio(&cache, url);
+    if (warm >= 0)
+        record("stream.startup.warm", milliseconds(warm), "ms");
+    record("stream.hitRatio.warm", streamPass(&cache, url, content, seconds), "%", true);
+    cache.setMaxBytes(content.size());
+    record("stream.cachedAfterEvict", cache.cachedBytes() / 1048576.0, "MiB");
+}
+
+// 16-bit stereo WAV whose left samples count up frame by frame from the given frame, so
+// any dropped or repeated frame in a decoded sequence breaks the count.
+static QByteArray countingWave(int sampleRate, qint64 first, int frames)
+{
+    const quint32 bytes = quint32(frames) * 4;
+    // fmt chunk size, PCM with two channels, rate, byte rate, four byte frames of 16 bits.
+    const quint32 fmt[] = { 16, 0x00020001, quint32(sampleRate), quint32(sampleRate) * 4, 0x00100004 };
+    uchar header[44];
+    memcpy(header, "RIFF....WAVEfmt ....................data....", 44);
+    qToLittleEndian<quint32>(36 + bytes, header + 4);
+    for (int i = 0; i < 5; i++)
+        qToLittleEndian<quint32>(fmt[i], header + 16 + 4 * i);
+    qToLittleEndian<quint32>(bytes, header + 40);
+    QByteArray wave(reinterpret_cast<const char *>(header), 44);
+    QByteArray samples(int(bytes), Qt::Uninitialized);
+    uchar *p = reinterpret_cast<uchar *>(samples.data());
+    for (int i = 0; i < frames; i++) {
+        qToLittleEndian<quint16>(quint16(first + i), p + i * 4);
+        qToLittleEndian<quint16>(quint16(~(first + i)), p + i * 4 + 2);
+    }
+    return wave + samples;
+}
+
+// Plays through the real output at the smallest buffer depth while the GUI thread is kept
+// busy with model rebuilds and long stalls, which must not reach the output thread.
+void BenchmarkSuite::runUnderrun()
+{
+    if (QAudioDeviceInfo::defaultOutputDevice().isNull()) {
+        qWarning() << "underrun benchmark skipped, no audio output device";
+        return;
+    }
+    const int depth = 10;
+    QTemporaryDir directory;
+    QMediaPlaylist playlist;
+    for (int i = 0; i < 4; i++) {
+        const QString path = QString("%1/%2.wav").arg(directory.path()).arg(i);
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(FixtureGenerator::wave(FixtureGenerator::track(i), 2)) < 0) {
+            fail("underrun: cannot write " + path);
+            return;
+        }
+        playlist.addMedia(QMediaContent(QUrl::fromLocalFile(path)));
+    }
+    PlaybackEngine engine;
+    engine.setPlaylist(&playlist);
+    engine.setBufferDepth(depth);
+    engine.setVolume(0);
+    engine.play();
+
+    const QVector<TrackInfo> tracks = syntheticTracks(20000);
+    QElapsedTimer wall;
+    wall.start();
+    qint64 blocked = 0;
+    while (engine.state() == QMediaPlayer::PlayingState && wall.elapsed() < 20000) {
+        QElapsedTimer busy;
+        busy.start();
+        {
+            PlaylistModel model;
+            model.appendTracks(tracks);
+        }
+        QThread::msleep(100);
+        blocked += busy.nsecsElapsed();
+        QCoreApplication::processEvents();
+    }
+    engine.stop();
+    record("underrun.count", engine.underruns(), "underruns");
+    record("underrun.guiBlocked", 100.0 * blocked / qMax<qint64>(1, wall.nsecsElapsed()), "%", true);
+    if (engine.underruns() > 0)
+        fail(QString("underrun: %1 underruns at %2 ms buffer depth").arg(engine.underruns()).arg(depth));
+}
+
+void BenchmarkSuite::runGapless()
+{
+    const QAudioFormat format = streamFormat();
+    QTemporaryDir directory;
+    QStringList paths;
+    QVector<qint64> starts;
+    qint64 total = 0;
+    for (int i = 0; i < 8; i++) {
+        // Odd lengths so the splices fall in the middle of decoder chunks.
+        const int frames = format.sampleRate() / 2 + 1237 * i + i % 3;
+        const QString path = QString("%1/%2.wav").arg(directory.path()).arg(i);
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(countingWave(format.sampleRate(), total, frames)) < 0) {
+            fail("gapless: cannot write " + path);
+            return;
+        }
+        paths.append(path);
+        starts.append(total);
+        total += frames;
+    }
+
+    AudioRingBuffer buffer(format.bytesForDuration(100000));
+    AudioSource source(&buffer, format);
+    DecoderThread decoder(&buffer, &source, format);
+    QByteArray output;
+    QEventLoop loop;
+    QTimer drain;
+    auto take = [&buffer, &output]() {
+        const int offset = output.size();
+        output.resize(offset + buffer.available());
+        output.resize(offset + buffer.read(output.data() + offset, output.size() - offset));
+    };
+    QObject::connect(&drain, &QTimer::timeout, take);
+    QObject::connect(&decoder, &DecoderThread::trackStarted, &loop, [&decoder, &paths](int index) {
+        const int next = index + 1 < paths.size() ? index + 1 : -1;
+        decoder.setNext(index, next, next >= 0 ? paths.at(next) : QString());
+    });
+    bool ended = false;
+    QObject::connect(&decoder, &DecoderThread::endOfStream, &loop, [&take, &loop, &ended]() {
+        ended = true;
+        take();
+        loop.quit();
+    });
+    QTimer::singleShot(30000, &loop, SLOT(quit()));
+    decoder.start();
+    drain.start(2);
+    decoder.decode(0, paths.first(), 0);
+    loop.exec();
+    drain.stop();
+
+    const qint64 frames = output.size() / format.bytesPerFrame();
+    const uchar *p = reinterpret_cast<const uchar *>(output.constData());
+    qint64 wrong = -1;
+    int errors = 0;
+    for (qint64 i = 0; i < qMin(frames, total); i++) {
+        if (qFromLittleEndian<quint16>(p + i * 4) != quint16(i) || qFromLittleEndian<quint16>(p + i * 4 + 2) != quint16(~i)) {
+            if (wrong < 0)
+                wrong = i;
+            errors++;
+        }
+    }
+    record("gapless.frameError", double(frames - total), "frames");
+    record("gapless.sampleErrors", errors, "frames");
+    if (!ended)
+        fail(QString("gapless: no end of stream after %1 of %2 frames").arg(frames).arg(total));
+    else if (frames != total || wrong >= 0) {
+        if (wrong < 0)
+            wrong = qMin(frames, total);
+        const int track = int(std::upper_bound(starts.begin(), starts.end(), wrong) - starts.begin()) - 1;
+        fail(QString("gapless: %1 frames %2, first wrong frame %3 is %4 frames into track %5")
+             .arg(qAbs(frames - total)).arg(frames < total ? "missing" : "extra")
+             .arg(wrong).arg(wrong - starts.at(track)).arg(track));
+    }
+}
+
+// One remote front-end: subscribes to pushed updates, then pings the core and pages
+// through the playlist the way a remote list view would, timing every round trip.
+class ControlLoadClient : public QThread
+{
+public:
+    ControlLoadClient(const QString &name, int requests, int rows) :
+        updates(0), name(name), requests(requests), rows(rows)
+    {
+    }
+
+    QVector<qint64> rtts;
+    int updates;
+
+protected:
+    void run() override
+    {
+        ControlClient client;
+        if (!client.connectToServer(name))
+            return;
+        QElapsedTimer clock;
+        clock.start();
+        bool answered = false;
+        QObject::connect(&client, &ControlClient::updated, [this]() { updates++; });
+        QObject::connect(&client, &ControlClient::pong, [&answered](const QByteArray &) { answered = true; });
+        QObject::connect(&client, &ControlClient::tracksReceived, [&answered]() { answered = true; });
+        QObject::connect(&client, &ControlClient::errorReceived, [&answered]() { answered = true; });
+        client.subscribe();
+        rtts.reserve(requests);
+        for (int i = 0; i < requests; i++) {
+            answered = false;
+            const qint64 sent = clock.nsecsElapsed();
+            if (i % 10 == 9)
+                client.requestTracks(0, i * 50 % qMax(1, rows - 50), 50);
+            else
+                client.ping(QByteArray::number(sent));
+            while (!answered && client.waitForMessage(5000)) {
+            }
+            if (!answered)
+                return;
+            rtts.append(clock.nsecsElapsed() - sent);
+        }
+        client.disconnectFromServer();
+    }
+
+private:
+    QString name;
+    int requests;
+    int rows;
+};
+
+qint64 BenchmarkSuite::threadCpuTime()
+{
+#ifdef Q_OS_WIN
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+        return 0;
+    const quint64 ticks = (quint64(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime)
+            + (quint64(user.dwHighDateTime) << 32 | user.dwLowDateTime);
+    return qint64(ticks * 100);
+#else
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now))
+        return 0;
+    return qint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+}
+
+void BenchmarkSuite::runControl()
+{
+    const int clients = 64;
+    const int requests = 200;
+    QTemporaryDir directory;
+    Library library(directory.path() + "/metadata.cache");
+    const int tracks = qMin(rows, 100000);
+    library.appendTracks(0, syntheticTracks(tracks));
+    ControlServer server(&library);
+    if (!server.listen(QString("fooplayer-benchmark-%1").arg(QCoreApplication::applicationPid()))) {
+        qWarning() << "control benchmark could not listen on a local socket";
+        return;
+    }
+
+    // The core keeps playing while it serves: position ticks arrive as often as the
+    // engine's own position timer fires.
+    qint64 position = 0;
+    QTimer ticks;
+    QObject::connect(&ticks, &QTimer::timeout, [&library, &position]() {
+        emit library.engine()->positionChanged(position += 250);
+    });
+
+    QVector<ControlLoadClient *> load;
+    for (int i = 0; i < clients; i++)
+        load.append(new ControlLoadClient(server.serverName(), requests, tracks));
+    QElapsedTimer wall;
+    wall.start();
+    const qint64 cpu = threadCpuTime();
+    ticks.start(10);
+    foreach (ControlLoadClient *client, load)
+        client->start();
+    QEventLoop loop;
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, [&load, &loop]() {
+        foreach (ControlLoadClient *client, load) {
+            if (!client->isFinished())
+                return;
+        }
+        loop.quit();
+    });
+    poll.start(10);
+    loop.exec();
+    ticks.stop();
+    const qint64 busy = threadCpuTime() - cpu;
+    const qint64 elapsed = wall.nsecsElapsed();
+
+    QVector<qint64> rtts;
+    int starved = 0;
+    foreach (ControlLoadClient *client, load) {
+        rtts += client->rtts;
+        if (!client->updates)
+            starved++;
+        delete client;
+    }
+    if (starved)
+        qWarning() << "control benchmark:" << starved << "clients received no pushed updates";
+    if (rtts.size() < clients * requests)
+        qWarning() << "control benchmark answered" << rtts.size() << "of" << clients * requests << "requests";
+    if (rtts.isEmpty())
+        return;
+    std::sort(rtts.begin(), rtts.end());
+    record("control.rtt.p50", rtts.at(rtts.size() / 2) / 1000.0, "us");
+    record("control.rtt.p99", rtts.at(rtts.size() * 99 / 100) / 1000.0, "us");
+    record("control.cpu", 100.0 * busy / elapsed, "%");
+    if (server.pushedUpdates())
+        record("control.push.bytes", double(server.pushedBytes()) / server.pushedUpdates(), "bytes");
+
+    QStringList paths;
+    for (int i = 0; i < 10000; i++)
+        paths.append(QString("/music/remote/%1.mp3").arg(i));
+    QVector<int> removed;
+    for (int i = 0; i < 1000; i++)
+        removed.append(i * 7);
+    ControlBatch batch;
+    batch.append(paths);
+    batch.remove(removed);
+    ControlClient client;
+    if (!client.connectToServer(server.serverName()))
+        return;
+    QEventLoop reply;
+    QObject::connect(&client, &ControlClient::mutated, &reply, &QEventLoop::quit);
+    QObject::connect(&client, &ControlClient::errorReceived, &reply, &QEventLoop::quit);
+    QElapsedTimer timer;
+    timer.start();
+    client.mutate(0, batch);
+    reply.exec();
+    record("control.mutate", milliseconds(timer.nsecsElapsed()), "ms");
+}
+
+// Restores a ten playlist, 200k track session the way Player::restoreSession does: the
+// visible playlist first, the others in the background.
+void BenchmarkSuite::runStartup()
+{
+    const int playlists = 10;
+    const int total = 200000;
+    QTemporaryDir directory;
+    const QString fileName = directory.path() + "/session.bin";
+    {
+        const QVector<TrackInfo> tracks = syntheticTracks(total);
+        QVector<PlaylistModel *> models;
+        QStringList names;
+        for (int i = 0; i < playlists; i++) {
+            models.append(new PlaylistModel);
+            models.last()->appendTracks(tracks.mid(i * total / playlists, total / playlists));
+            names.append(QString("Playlist %1").arg(i + 1));
+        }
+        SessionState state;
+        state.currentTrack = total / playlists / 2;
+        Session session(fileName);
+        session.save(state, names, models);
+        qDeleteAll(models);
+    }
+
+    qint64 times[3] = { std::numeric_limits<qint64>::max(), std::numeric_limits<qint64>::max(), std::numeric_limits<qint64>::max() };
+    for (int run = 0; run < 3; run++) {
+        QElapsedTimer timer;
+        timer.start();
+        Session session(fileName);
+        if (!session.open())
+            return;
+        const int visible = session.state().currentPlaylist;
+        QVector<QMediaPlaylist *> mediaPlaylists;
+        QVector<PlaylistModel *> models;
+        for (int i = 0; i < session.names().size(); i++) {
+            mediaPlaylists.append(new QMediaPlaylist);
+            models.append(new PlaylistModel);
+        }
+        PlaylistFilterModel filter;
+        filter.setSourceModel(models.at(visible));
+        const QVector<TrackInfo> tracks = session.tracks(visible);
+        QList<QMediaContent> media;
+        media.reserve(tracks.size());
+        foreach (const TrackInfo &track, tracks)
+            media.append(QMediaContent(QUrl::fromLocalFile(track.path)));
+        mediaPlaylists.at(visible)->addMedia(media);
+        models.at(visible)->appendTracks(tracks);
+        mediaPlaylists.at(visible)->setCurrentIndex(session.state().currentTrack);
+        times[0] = qMin(times[0], timer.nsecsElapsed());
+        const QModelIndex current = filter.reveal(models.at(visible)->index(session.state().currentTrack, 0));
+        paintViewport(&filter, qMax(0, current.row() - 20), 40);
+        times[1] = qMin(times[1], timer.nsecsElapsed());
+
+        QList<int> others;
+        for (int i = 0; i < models.size(); i++) {
+            if (i != visible)
+                others.append(i);
+        }
+        int loaded = 0;
+        QEventLoop loop;
+        QObject::connect(&session, &Session::playlistLoaded, &loop, [&](int index, const QVector<TrackInfo> &loadedTracks) {
+            models.at(index)->appendTracks(loadedTracks);
+            if (++loaded == others.size())
+                loop.quit();
+        });
+        session.loadInBackground(others);
+        if (!others.isEmpty())
+            loop.exec();
+        times[2] = qMin(times[2], timer.nsecsElapsed());
+        qDeleteAll(mediaPlaylists);
+        qDeleteAll(models);
+    }
+    record("startup.playable", milliseconds(times[0]), "ms");
+    record("startup.firstPaint", milliseconds(times[1]), "ms");
+    record("startup.restored", milliseconds(times[2]), "ms");
+}
@@ -0,0 +1,53 @@
+#ifndef BENCHMARKSUITE_H
+#define BENCHMARKSUITE_H
+
+#include "tagreader.h"
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QJsonObject>
+
+class QTextStream;
+
+class BenchmarkSuite
+{
+public:
+    explicit BenchmarkSuite(int rows);
+    void setFixtures(const QString &directory);
+    bool run(const QStringList &groups);
+    QJsonObject results() const;
+    QStringList failures() const;
+    void print(QTextStream &out) const;
+    static QStringList groups();
+    static int compare(const QJsonObject &results, const QJsonObject &baseline, double tolerance, QTextStream &out);
+    static QVector<TrackInfo> syntheticTracks(int rows);
+    static qint64 threadCpuTime();
+
+private:
+    void record(const QString &name, double value, const char *unit, bool higherIsBetter = false);
+    void fail(const QString &message);
+    void runGain();
+    void runPeaks();
+    void runModel();
+    void runPlaylist();
+    void runSearch();
+    void runSort();
+    void runView();
+    void runTags();
+    void runSeek();
+    void runGapless();
+    void runUnderrun();
+    void runFingerprint();
+    void runLoudness();
+    void runDsp();
+    void runStream();
+    void runControl();
+    void runStartup();
+
+    int rows;
+    QString fixtures;
+    QJsonObject metrics;
+    QStringList failed;
+};
+
+#endif // BENCHMARKSUITE_H
@@ -0,0 +1,201 @@
+#include "controlclient.h"
+#include <QLocalSocket>
+
+ControlClient::ControlClient(QObject *parent) :
+    QObject(parent), playlists(0)
+{
+    socket = new QLocalSocket(this);
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readyRead()));
+}
+
+bool ControlClient::connectToServer(const QString &name, int timeout)
+{
+    buffer.clear();
+    current = ControlState();
+    socket->connectToServer(name);
+    return socket->waitForConnected(timeout);
+}
+
+void ControlClient::disconnectFromServer()
+{
+    socket->disconnectFromServer();
+}
+
+bool ControlClient::isConnected() const
+{
+    return socket->state() == QLocalSocket::ConnectedState;
+}
+
+bool ControlClient::waitForMessage(int timeout)
+{
+    return socket->waitForReadyRead(timeout);
+}
+
+ControlState ControlClient::state() const
+{
+    return current;
+}
+
+int ControlClient::playlistCount() const
+{
+    return playlists;
+}
+
+void ControlClient::subscribe()
+{
+    current = ControlState();
+    send(ControlProtocol::Subscribe);
+}
+
+void ControlClient::play()
+{
+    send(ControlProtocol::Play);
+}
+
+void ControlClient::pause()
+{
+    send(ControlProtocol::Pause);
+}
+
+void ControlClient::stop()
+{
+    send(ControlProtocol::Stop);
+}
+
+void ControlClient::next()
+{
+    send(ControlProtocol::Next);
+}
+
+void ControlClient::previous()
+{
+    send(ControlProtocol::Previous);
+}
+
+void ControlClient::seek(qint64 position)
+{
+    ControlWriter writer;
+    writer.signedVarint(position);
+    send(ControlProtocol::Seek, writer.data());
+}
+
+void ControlClient::setVolume(int volume)
+{
+    ControlWriter writer;
+    writer.varint(quint64(qBound(0, volume, 100)));
+    send(ControlProtocol::SetVolume, writer.data());
+}
+
+void ControlClient::setMuted(bool muted)
+{
+    ControlWriter writer;
+    writer.varint(muted);
+    send(ControlProtocol::SetMuted, writer.data());
+}
+
+void ControlClient::playTrack(int playlist, int row)
+{
+    ControlWriter writer;
+    writer.varint(quint64(playlist));
+    writer.varint(quint64(row));
+    send(ControlProtocol::PlayTrack, writer.data());
+}
+
+void ControlClient::requestTracks(int playlist, int first, int count)
+{
+    ControlWriter writer;
+    writer.varint(quint64(playlist));
+    writer.varint(quint64(first));
+    writer.varint(quint64(count));
+    send(ControlProtocol::GetTracks, writer.data());
+}
+
+void ControlClient::mutate(int playlist, const ControlBatch &batch)
+{
+    ControlWriter writer;
+    writer.varint(quint64(playlist));
+    writer.varint(quint64(batch.size()));
+    send(ControlProtocol::Mutate, writer.data() + batch.operations());
+}
+
+void ControlClient::ping(const QByteArray &payload)
+{
+    send(ControlProtocol::Ping, payload);
+}
+
+void ControlClient::readyRead()
+{
+    buffer += socket->readAll();
+    QByteArray payload;
+    int message;
+    while ((message = ControlProtocol::takeFrame(buffer, payload)) > 0)
+        handle(message, payload);
+    if (message < 0) {
+        buffer.clear();
+        socket->disconnectFromServer();
+    }
+}
+
+void ControlClient::send(int message, const QByteArray &payload)
+{
+    socket->write(ControlProtocol::frame(message, payload));
+    socket->flush();
+}
+
+void ControlClient::handle(int message, const QByteArray &payload)
+{
+    ControlReader reader(payload);
+    switch (message) {
+    case ControlProtocol::Hello:
+        if (reader.varint() == ControlProtocol::Version)
+            playlists = int(reader.varint());
+        else
+            emit errorReceived(tr("unsupported control protocol"));
+        break;
+    case ControlProtocol::Update: {
+        const int fields = ControlProtocol::applyUpdate(payload, current);
+        if (fields >= 0)
+            emit updated(fields);
+        break;
+    }
+    case ControlProtocol::PlaylistChanged: {
+        const int playlist = int(reader.varint());
+        const int rows = int(reader.varint());
+        playlists = qMax(playlists, playlist + 1);
+        emit playlistChanged(playlist, rows);
+        break;
+    }
+    case ControlProtocol::Tracks: {
+        const int playlist = int(reader.varint());
+        const int first = int(reader.varint());
+        const int count = int(qMin<quint64>(reader.varint(), ControlProtocol::MaxTracks));
+        QVector<TrackInfo> tracks;
+        tracks.reserve(count);
+        for (int i = 0; i < count && reader.isValid(); i++) {
+            TrackInfo track;
+            track.path = reader.string();
+            track.title = reader.string();
+            track.artist = reader.string();
+            track.album = reader.string();
+            track.length = qint64(reader.varint());
+            track.valid = true;
+            tracks.append(track);
+        }
+        if (reader.isValid())
+            emit tracksReceived(playlist, first, tracks);
+        break;
+    }
+    case ControlProtocol::Mutated: {
+        const int playlist = int(reader.varint());
+        const int rows = int(reader.varint());
+        emit mutated(playlist, rows);
+        break;
+    }
+    case ControlProtocol::Pong:
+        emit pong(payload);
+        break;
+    case ControlProtocol::Error:
+        emit errorReceived(reader.string());
+        break;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef CONTROLCLIENT_H
+#define CONTROLCLIENT_H
+
+#include "controlprotocol.h"
+#include "tagreader.h"
+#include <QObject>
+#include <QVector>
+
+class QLocalSocket;
+
+// Front-end side of the control socket. Works from an event loop through its signals, or
+// from a plain thread by calling waitForMessage().
+class ControlClient : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ControlClient(QObject *parent = nullptr);
+    bool connectToServer(const QString &name, int timeout = 3000);
+    void disconnectFromServer();
+    bool isConnected() const;
+    bool waitForMessage(int timeout);
+    ControlState state() const;
+    int playlistCount() const;
+
+    void subscribe();
+    void play();
+    void pause();
+    void stop();
+    void next();
+    void previous();
+    void seek(qint64 position);
+    void setVolume(int volume);
+    void setMuted(bool muted);
+    void playTrack(int playlist, int row);
+    void requestTracks(int playlist, int first, int count);
+    void mutate(int playlist, const ControlBatch &batch);
+    void ping(const QByteArray &payload);
+
+signals:
+    void updated(int fields);
+    void playlistChanged(int playlist, int rows);
+    void tracksReceived(int playlist, int first, const QVector<TrackInfo> &tracks);
+    void mutated(int playlist, int rows);
+    void pong(const QByteArray &payload);
+    void errorReceived(const QString &message);
+
+private slots:
+    void readyRead();
+
+private:
+    void send(int message, const QByteArray &payload = QByteArray());
+    void handle(int message, const QByteArray &payload);
+
+    QLocalSocket *socket;
+    QByteArray buffer;
+    ControlState current;
+    int playlists;
+};
+
+#endif // CONTROLCLIENT_H
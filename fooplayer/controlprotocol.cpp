@@ -0,0 +1,216 @@
+#include "controlprotocol.h"
+#include <QtEndian>
+
+ControlState::ControlState() :
+    state(0), playlist(0), index(-1), position(0), duration(0), volume(100), muted(false)
+{
+}
+
+QByteArray ControlProtocol::frame(int message, const QByteArray &payload)
+{
+    QByteArray frame(5, Qt::Uninitialized);
+    qToLittleEndian<quint32>(quint32(payload.size() + 1), reinterpret_cast<uchar *>(frame.data()));
+    frame[4] = char(message);
+    return frame + payload;
+}
+
+// Returns the message of the first complete frame and removes it from the buffer, 0 when
+// the frame is still incomplete and -1 when the stream is corrupt.
+int ControlProtocol::takeFrame(QByteArray &buffer, QByteArray &payload)
+{
+    if (buffer.size() < 5)
+        return 0;
+    const quint32 length = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(buffer.constData()));
+    if (length == 0 || length > MaxFrame)
+        return -1;
+    if (quint32(buffer.size()) < 4 + length)
+        return 0;
+    const int message = quint8(buffer.at(4));
+    payload = buffer.mid(5, int(length) - 1);
+    buffer.remove(0, int(length) + 4);
+    return message;
+}
+
+int ControlProtocol::changedFields(const ControlState &from, const ControlState &to)
+{
+    int fields = 0;
+    if (from.state != to.state)
+        fields |= StateField;
+    if (from.playlist != to.playlist)
+        fields |= PlaylistField;
+    if (from.index != to.index)
+        fields |= IndexField;
+    if (from.position != to.position)
+        fields |= PositionField;
+    if (from.duration != to.duration)
+        fields |= DurationField;
+    if (from.volume != to.volume)
+        fields |= VolumeField;
+    if (from.muted != to.muted)
+        fields |= MutedField;
+    return fields;
+}
+
+// Index, position and duration travel as differences from the previous update, so a
+// position tick while playing usually costs two or three bytes.
+QByteArray ControlProtocol::encodeUpdate(const ControlState &from, const ControlState &to, int fields)
+{
+    ControlWriter writer;
+    writer.varint(quint64(fields));
+    if (fields & StateField)
+        writer.varint(quint64(to.state));
+    if (fields & PlaylistField)
+        writer.signedVarint(to.playlist);
+    if (fields & IndexField)
+        writer.signedVarint(to.index - from.index);
+    if (fields & PositionField)
+        writer.signedVarint(to.position - from.position);
+    if (fields & DurationField)
+        writer.signedVarint(to.duration - from.duration);
+    if (fields & VolumeField)
+        writer.varint(quint64(to.volume));
+    if (fields & MutedField)
+        writer.varint(to.muted);
+    return writer.data();
+}
+
+int ControlProtocol::applyUpdate(const QByteArray &payload, ControlState &state)
+{
+    ControlReader reader(payload);
+    ControlState next = state;
+    const int fields = int(reader.varint());
+    if (fields & StateField)
+        next.state = int(reader.varint());
+    if (fields & PlaylistField)
+        next.playlist = int(reader.signedVarint());
+    if (fields & IndexField)
+        next.index += int(reader.signedVarint());
+    if (fields & PositionField)
+        next.position += reader.signedVarint();
+    if (fields & DurationField)
+        next.duration += reader.signedVarint();
+    if (fields & VolumeField)
+        next.volume = int(reader.varint());
+    if (fields & MutedField)
+        next.muted = reader.varint() != 0;
+    if (!reader.isValid())
+        return -1;
+    state = next;
+    return fields;
+}
+
+void ControlWriter::varint(quint64 value)
+{
+    while (value >= 0x80) {
+        bytes.append(char(value | 0x80));
+        value >>= 7;
+    }
+    bytes.append(char(value));
+}
+
+void ControlWriter::signedVarint(qint64 value)
+{
+    varint((quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+void ControlWriter::string(const QString &value)
+{
+    const QByteArray utf8 = value.toUtf8();
+    varint(quint64(utf8.size()));
+    bytes.append(utf8);
+}
+
+QByteArray ControlWriter::data() const
+{
+    return bytes;
+}
+
+ControlReader::ControlReader(const QByteArray &data) :
+    bytes(data), position(0), valid(true)
+{
+}
+
+quint64 ControlReader::varint()
+{
+    quint64 value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (position >= bytes.size())
+            break;
+        const quint8 byte = quint8(bytes.at(position++));
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    valid = false;
+    return 0;
+}
+
+qint64 ControlReader::signedVarint()
+{
+    const quint64 value = varint();
+    return qint64(value >> 1) ^ -qint64(value & 1);
+}
+
+QString ControlReader::string()
+{
+    const quint64 size = varint();
+    if (!valid || size > quint64(bytes.size() - position)) {
+        valid = false;
+        return QString();
+    }
+    const QString value = QString::fromUtf8(bytes.constData() + position, int(size));
+    position += int(size);
+    return value;
+}
+
+bool ControlReader::isValid() const
+{
+    return valid;
+}
+
+bool ControlReader::atEnd() const
+{
+    return position >= bytes.size();
+}
+
+ControlBatch::ControlBatch() :
+    count(0)
+{
+}
+
+void ControlBatch::append(const QStringList &paths)
+{
+    writer.varint(ControlProtocol::Append);
+    writer.varint(quint64(paths.size()));
+    foreach (const QString &path, paths)
+        writer.string(path);
+    count++;
+}
+
+void ControlBatch::remove(const QVector<int> &rows)
+{
+    writer.varint(ControlProtocol::Remove);
+    writer.varint(quint64(rows.size()));
+    foreach (int row, rows)
+        writer.varint(quint64(row));
+    count++;
+}
+
+void ControlBatch::reorder(const QVector<int> &order)
+{
+    writer.varint(ControlProtocol::Reorder);
+    writer.varint(quint64(order.size()));
+    foreach (int row, order)
+        writer.varint(quint64(row));
+    count++;
+}
+
+int ControlBatch::size() const
+{
+    return count;
+}
+
+QByteArray ControlBatch::operations() const
+{
+    return writer.data();
+}
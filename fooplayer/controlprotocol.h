@@ -0,0 +1,90 @@
+#ifndef CONTROLPROTOCOL_H
+#define CONTROLPROTOCOL_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct ControlState
+{
+    ControlState();
+
+    int state;
+    int playlist;
+    int index;
+    qint64 position;
+    qint64 duration;
+    int volume;
+    bool muted;
+};
+
+// Frames are a little-endian quint32 length, a message byte and a payload of varints and
+// length-prefixed UTF-8 strings.
+class ControlProtocol
+{
+public:
+    enum { Version = 1, MaxFrame = 16 * 1024 * 1024, MaxTracks = 10000 };
+    enum Message {
+        Hello = 1, Error, Ping, Pong, Subscribe, Update, PlaylistChanged,
+        Play, Pause, Stop, Next, Previous, Seek, SetVolume, SetMuted, PlayTrack,
+        GetTracks, Tracks, Mutate, Mutated
+    };
+    enum Field {
+        StateField = 0x01, PlaylistField = 0x02, IndexField = 0x04, PositionField = 0x08,
+        DurationField = 0x10, VolumeField = 0x20, MutedField = 0x40, AllFields = 0x7f
+    };
+    enum Mutation { Append = 1, Remove, Reorder };
+
+    static QByteArray frame(int message, const QByteArray &payload = QByteArray());
+    static int takeFrame(QByteArray &buffer, QByteArray &payload);
+    static int changedFields(const ControlState &from, const ControlState &to);
+    static QByteArray encodeUpdate(const ControlState &from, const ControlState &to, int fields);
+    static int applyUpdate(const QByteArray &payload, ControlState &state);
+};
+
+class ControlWriter
+{
+public:
+    void varint(quint64 value);
+    void signedVarint(qint64 value);
+    void string(const QString &value);
+    QByteArray data() const;
+
+private:
+    QByteArray bytes;
+};
+
+class ControlReader
+{
+public:
+    explicit ControlReader(const QByteArray &data);
+    quint64 varint();
+    qint64 signedVarint();
+    QString string();
+    bool isValid() const;
+    bool atEnd() const;
+
+private:
+    QByteArray bytes;
+    int position;
+    bool valid;
+};
+
+// A list of playlist mutations sent in one Mutate message and applied in order.
+class ControlBatch
+{
+public:
+    ControlBatch();
+    void append(const QStringList &paths);
+    void remove(const QVector<int> &rows);
+    void reorder(const QVector<int> &order);
+    int size() const;
+    QByteArray operations() const;
+
+private:
+    ControlWriter writer;
+    int count;
+};
+
+#endif // CONTROLPROTOCOL_H
@@ -0,0 +1,430 @@
+#include "controlserver.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTimer>
+
+static const int flushInterval = 20;
+static const int probeTimeout = 200;
+static const qint64 positionBacklog = 64 * 1024;
+static const qint64 maxBacklog = 1024 * 1024;
+
+ControlServer::ControlServer(Library *library, QObject *parent) :
+    QObject(parent), library(library), bytes(0), updates(0)
+{
+    server = new QLocalServer(this);
+    server->setSocketOptions(QLocalServer::UserAccessOption);
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(flushInterval);
+    connect(server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+
+    PlaybackEngine *engine = library->engine();
+    connect(engine, SIGNAL(stateChanged(QMediaPlayer::State)), this, SLOT(stateChanged(QMediaPlayer::State)));
+    connect(engine, SIGNAL(positionChanged(qint64)), this, SLOT(positionChanged(qint64)));
+    connect(engine, SIGNAL(durationChanged(qint64)), this, SLOT(durationChanged(qint64)));
+    connect(engine, SIGNAL(volumeChanged(int)), this, SLOT(volumeChanged(int)));
+    connect(engine, SIGNAL(mutedChanged(bool)), this, SLOT(mutedChanged(bool)));
+    connect(engine, SIGNAL(metaDataChanged()), this, SLOT(metaDataChanged()));
+    current.state = engine->state();
+    current.playlist = library->currentPlaylist();
+    current.index = engine->currentIndex();
+    current.position = engine->position();
+    current.duration = engine->duration();
+    current.volume = engine->volume();
+    current.muted = engine->isMuted();
+    sent = current;
+    watchPlaylists();
+}
+
+ControlServer::~ControlServer()
+{
+    foreach (QLocalSocket *socket, clients.keys())
+        socket->disconnect(this);
+    server->close();
+}
+
+// A second core on the same name is refused; a socket left behind by a crashed one is
+// removed so the name can be reused.
+bool ControlServer::listen(const QString &name)
+{
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(probeTimeout)) {
+        error = QString("control socket %1 is already served by another process").arg(name);
+        return false;
+    }
+    QLocalServer::removeServer(name);
+    if (!server->listen(name)) {
+        error = QString("cannot listen on control socket %1: %2").arg(name, server->errorString());
+        return false;
+    }
+    error.clear();
+    return true;
+}
+
+QString ControlServer::errorString() const
+{
+    return error;
+}
+
+QString ControlServer::serverName() const
+{
+    return server->serverName();
+}
+
+int ControlServer::clientCount() const
+{
+    return clients.size();
+}
+
+qint64 ControlServer::pushedBytes() const
+{
+    return bytes;
+}
+
+int ControlServer::pushedUpdates() const
+{
+    return updates;
+}
+
+void ControlServer::newConnection()
+{
+    watchPlaylists();
+    while (QLocalSocket *socket = server->nextPendingConnection()) {
+        Client client;
+        client.subscribed = false;
+        clients.insert(socket, client);
+        connect(socket, SIGNAL(readyRead()), this, SLOT(clientReadyRead()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(clientDisconnected()));
+        ControlWriter writer;
+        writer.varint(ControlProtocol::Version);
+        writer.varint(quint64(library->count()));
+        socket->write(ControlProtocol::frame(ControlProtocol::Hello, writer.data()));
+    }
+}
+
+void ControlServer::clientReadyRead()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    if (!clients.contains(socket))
+        return;
+    clients[socket].buffer += socket->readAll();
+    QByteArray payload;
+    int message;
+    while ((message = ControlProtocol::takeFrame(clients[socket].buffer, payload)) > 0) {
+        handle(socket, message, payload);
+        if (!clients.contains(socket))
+            return;
+    }
+    if (message < 0) {
+        sendError(socket, tr("corrupt frame"));
+        clients[socket].buffer.clear();
+        socket->disconnectFromServer();
+    }
+}
+
+void ControlServer::clientDisconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    clients.remove(socket);
+    socket->deleteLater();
+}
+
+void ControlServer::handle(QLocalSocket *socket, int message, const QByteArray &payload)
+{
+    PlaybackEngine *engine = library->engine();
+    ControlReader reader(payload);
+    watchPlaylists();
+    switch (message) {
+    case ControlProtocol::Ping:
+        socket->write(ControlProtocol::frame(ControlProtocol::Pong, payload));
+        break;
+    case ControlProtocol::Subscribe:
+        clients[socket].subscribed = true;
+        clients[socket].sent = sent;
+        socket->write(ControlProtocol::frame(ControlProtocol::Update, ControlProtocol::encodeUpdate(ControlState(), sent, ControlProtocol::AllFields)));
+        break;
+    case ControlProtocol::Play:
+        engine->play();
+        break;
+    case ControlProtocol::Pause:
+        engine->pause();
+        break;
+    case ControlProtocol::Stop:
+        engine->stop();
+        break;
+    case ControlProtocol::Next:
+        library->playlist(library->currentPlaylist())->next();
+        break;
+    case ControlProtocol::Previous:
+        library->playlist(library->currentPlaylist())->previous();
+        break;
+    case ControlProtocol::Seek: {
+        const qint64 position = reader.signedVarint();
+        if (reader.isValid())
+            engine->setPosition(qMax<qint64>(0, position));
+        break;
+    }
+    case ControlProtocol::SetVolume: {
+        const int volume = int(reader.varint());
+        if (reader.isValid())
+            engine->setVolume(qBound(0, volume, 100));
+        break;
+    }
+    case ControlProtocol::SetMuted: {
+        const bool muted = reader.varint() != 0;
+        if (reader.isValid())
+            engine->setMuted(muted);
+        break;
+    }
+    case ControlProtocol::PlayTrack: {
+        const quint64 playlist = reader.varint();
+        const quint64 row = reader.varint();
+        if (!reader.isValid() || playlist >= quint64(library->count()) || row >= quint64(library->model(int(playlist))->rowCount()))
+            sendError(socket, tr("no such track"));
+        else
+            emit trackRequested(int(playlist), int(row));
+        return;
+    }
+    case ControlProtocol::GetTracks:
+        sendTracks(socket, reader);
+        return;
+    case ControlProtocol::Mutate:
+        mutate(socket, reader);
+        return;
+    default:
+        sendError(socket, tr("unknown message %1").arg(message));
+        return;
+    }
+    if (!reader.isValid())
+        sendError(socket, tr("malformed message %1").arg(message));
+}
+
+void ControlServer::sendTracks(QLocalSocket *socket, ControlReader &reader)
+{
+    const quint64 playlist = reader.varint();
+    const quint64 first = reader.varint();
+    const quint64 count = reader.varint();
+    if (!reader.isValid() || playlist >= quint64(library->count())) {
+        sendError(socket, tr("no such playlist"));
+        return;
+    }
+    PlaylistModel *model = library->model(int(playlist));
+    const int begin = int(qMin<quint64>(first, quint64(model->rowCount())));
+    const int end = begin + int(qMin<quint64>(count, quint64(qMin<int>(ControlProtocol::MaxTracks, model->rowCount() - begin))));
+    ControlWriter writer;
+    writer.varint(playlist);
+    writer.varint(quint64(begin));
+    writer.varint(quint64(end - begin));
+    for (int row = begin; row < end; row++) {
+        const TrackInfo track = model->track(row);
+        writer.string(track.path);
+        writer.string(track.title);
+        writer.string(track.artist);
+        writer.string(track.album);
+        writer.varint(quint64(qMax<qint64>(0, track.length)));
+    }
+    socket->write(ControlProtocol::frame(ControlProtocol::Tracks, writer.data()));
+}
+
+// Applies every operation of a batch in order against the playlist as the previous ones
+// left it, then answers with the new row count. Removed rows are resolved to paths first,
+// so duplicates of a removed path go with it, as they do in the window.
+void ControlServer::mutate(QLocalSocket *socket, ControlReader &reader)
+{
+    const quint64 playlist = reader.varint();
+    const quint64 operations = reader.varint();
+    if (!reader.isValid() || playlist >= quint64(library->count())) {
+        sendError(socket, tr("no such playlist"));
+        return;
+    }
+    const int row = int(playlist);
+    PlaylistModel *model = library->model(row);
+    for (quint64 i = 0; i < operations && reader.isValid(); i++) {
+        const quint64 kind = reader.varint();
+        const quint64 size = reader.varint();
+        if (!reader.isValid() || size > ControlProtocol::MaxFrame)
+            break;
+        if (kind == ControlProtocol::Append) {
+            QStringList paths;
+            for (quint64 j = 0; j < size && reader.isValid(); j++)
+                paths.append(reader.string());
+            if (reader.isValid())
+                library->addPaths(paths, row);
+        } else if (kind == ControlProtocol::Remove) {
+            QStringList paths;
+            for (quint64 j = 0; j < size && reader.isValid(); j++) {
+                const quint64 index = reader.varint();
+                if (index < quint64(model->rowCount()))
+                    paths.append(model->path(int(index)));
+            }
+            if (reader.isValid())
+                library->removePaths(paths, row);
+        } else if (kind == ControlProtocol::Reorder) {
+            QVector<int> order;
+            QVector<bool> seen(model->rowCount());
+            bool permutation = size == quint64(model->rowCount());
+            for (quint64 j = 0; j < size && reader.isValid() && permutation; j++) {
+                const quint64 index = reader.varint();
+                permutation = index < quint64(seen.size()) && !seen.at(int(index));
+                if (permutation) {
+                    seen[int(index)] = true;
+                    order.append(int(index));
+                }
+            }
+            if (!permutation) {
+                sendError(socket, tr("reorder is not a permutation of %1 rows").arg(model->rowCount()));
+                return;
+            }
+            if (reader.isValid())
+                library->reorder(row, order);
+        } else {
+            sendError(socket, tr("unknown playlist operation %1").arg(kind));
+            return;
+        }
+    }
+    if (!reader.isValid()) {
+        sendError(socket, tr("malformed playlist batch"));
+        return;
+    }
+    ControlWriter writer;
+    writer.varint(playlist);
+    writer.varint(quint64(model->rowCount()));
+    socket->write(ControlProtocol::frame(ControlProtocol::Mutated, writer.data()));
+}
+
+void ControlServer::sendError(QLocalSocket *socket, const QString &message)
+{
+    ControlWriter writer;
+    writer.string(message);
+    socket->write(ControlProtocol::frame(ControlProtocol::Error, writer.data()));
+}
+
+void ControlServer::stateChanged(QMediaPlayer::State state)
+{
+    current.state = state;
+    scheduleFlush();
+}
+
+void ControlServer::positionChanged(qint64 position)
+{
+    current.position = position;
+    scheduleFlush();
+}
+
+void ControlServer::durationChanged(qint64 duration)
+{
+    current.duration = duration;
+    scheduleFlush();
+}
+
+void ControlServer::volumeChanged(int volume)
+{
+    current.volume = volume;
+    scheduleFlush();
+}
+
+void ControlServer::mutedChanged(bool muted)
+{
+    current.muted = muted;
+    scheduleFlush();
+}
+
+void ControlServer::metaDataChanged()
+{
+    current.index = library->engine()->currentIndex();
+    current.playlist = library->currentPlaylist();
+    scheduleFlush();
+}
+
+void ControlServer::playlistChanged()
+{
+    const int row = library->indexOf(qobject_cast<PlaylistModel *>(sender()));
+    if (row < 0)
+        return;
+    changedPlaylists.insert(row);
+    scheduleFlush();
+}
+
+// A subscriber that stops reading keeps its deltas against the last state it was sent.
+// Past positionBacklog unread bytes it only gets non-position changes, and past
+// maxBacklog it is disconnected.
+void ControlServer::flush()
+{
+    QList<QLocalSocket *> subscribers;
+    QList<QLocalSocket *> stalled;
+    for (QHash<QLocalSocket *, Client>::const_iterator it = clients.constBegin(); it != clients.constEnd(); ++it) {
+        if (!it.value().subscribed)
+            continue;
+        if (it.key()->bytesToWrite() > maxBacklog)
+            stalled.append(it.key());
+        else
+            subscribers.append(it.key());
+    }
+    foreach (QLocalSocket *socket, stalled) {
+        clients.remove(socket);
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+
+    const int fields = ControlProtocol::changedFields(sent, current);
+    QByteArray frame;
+    if (fields)
+        frame = ControlProtocol::frame(ControlProtocol::Update, ControlProtocol::encodeUpdate(sent, current, fields));
+    bool behind = false;
+    foreach (QLocalSocket *socket, subscribers) {
+        Client &client = clients[socket];
+        int pending = ControlProtocol::changedFields(client.sent, current);
+        if ((pending & ControlProtocol::PositionField) && socket->bytesToWrite() > positionBacklog) {
+            pending &= ~ControlProtocol::PositionField;
+            behind = true;
+        }
+        if (!pending)
+            continue;
+        if (pending == fields && !ControlProtocol::changedFields(client.sent, sent))
+            socket->write(frame);
+        else
+            socket->write(ControlProtocol::frame(ControlProtocol::Update, ControlProtocol::encodeUpdate(client.sent, current, pending)));
+        const qint64 position = client.sent.position;
+        client.sent = current;
+        if (!(pending & ControlProtocol::PositionField))
+            client.sent.position = position;
+    }
+    if (fields && !subscribers.isEmpty()) {
+        bytes += frame.size();
+        updates++;
+    }
+    sent = current;
+
+    foreach (int row, changedPlaylists) {
+        if (row >= library->count() || subscribers.isEmpty())
+            continue;
+        ControlWriter writer;
+        writer.varint(quint64(row));
+        writer.varint(quint64(library->model(row)->rowCount()));
+        const QByteArray changed = ControlProtocol::frame(ControlProtocol::PlaylistChanged, writer.data());
+        foreach (QLocalSocket *socket, subscribers)
+            socket->write(changed);
+    }
+    changedPlaylists.clear();
+    if (behind)
+        scheduleFlush();
+}
+
+void ControlServer::watchPlaylists()
+{
+    foreach (PlaylistModel *model, library->models()) {
+        connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(playlistChanged()), Qt::UniqueConnection);
+        connect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(playlistChanged()), Qt::UniqueConnection);
+        connect(model, SIGNAL(layoutChanged()), this, SLOT(playlistChanged()), Qt::UniqueConnection);
+        connect(model, SIGNAL(modelReset()), this, SLOT(playlistChanged()), Qt::UniqueConnection);
+    }
+}
+
+void ControlServer::scheduleFlush()
+{
+    if (!flushTimer->isActive())
+        flushTimer->start();
+}
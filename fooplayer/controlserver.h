@@ -0,0 +1,73 @@
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include "library.h"
+#include "controlprotocol.h"
+#include <QObject>
+#include <QHash>
+#include <QSet>
+
+class QLocalServer;
+class QLocalSocket;
+class QTimer;
+
+// Exposes a library's playback engine and playlists to other processes over a local
+// socket. Engine changes are coalesced and pushed to subscribed clients as deltas against
+// the last state they were sent.
+class ControlServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ControlServer(Library *library, QObject *parent = nullptr);
+    ~ControlServer();
+    bool listen(const QString &name);
+    QString errorString() const;
+    QString serverName() const;
+    int clientCount() const;
+    qint64 pushedBytes() const;
+    int pushedUpdates() const;
+
+signals:
+    void trackRequested(int playlist, int row);
+
+private slots:
+    void newConnection();
+    void clientReadyRead();
+    void clientDisconnected();
+    void stateChanged(QMediaPlayer::State state);
+    void positionChanged(qint64 position);
+    void durationChanged(qint64 duration);
+    void volumeChanged(int volume);
+    void mutedChanged(bool muted);
+    void metaDataChanged();
+    void playlistChanged();
+    void flush();
+
+private:
+    struct Client
+    {
+        QByteArray buffer;
+        bool subscribed;
+        ControlState sent;
+    };
+
+    void handle(QLocalSocket *socket, int message, const QByteArray &payload);
+    void mutate(QLocalSocket *socket, ControlReader &reader);
+    void sendTracks(QLocalSocket *socket, ControlReader &reader);
+    void sendError(QLocalSocket *socket, const QString &message);
+    void watchPlaylists();
+    void scheduleFlush();
+
+    Library *library;
+    QLocalServer *server;
+    QTimer *flushTimer;
+    QHash<QLocalSocket *, Client> clients;
+    ControlState current;
+    ControlState sent;
+    QSet<int> changedPlaylists;
+    qint64 bytes;
+    int updates;
+    QString error;
+};
+
+#endif // CONTROLSERVER_H
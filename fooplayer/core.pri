@@ -0,0 +1,108 @@
+# Sources shared by the player and the benchmarks project.
+
+QT       += core gui multimedia concurrent network
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += c++11
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/player.cpp \
+    $$PWD/playercontrols.cpp \
+    $$PWD/tagreader.cpp \
+    $$PWD/tagscanner.cpp \
+    $$PWD/metadatacache.cpp \
+    $$PWD/playlistmodel.cpp \
+    $$PWD/pcmreader.cpp \
+    $$PWD/audioringbuffer.cpp \
+    $$PWD/audiosource.cpp \
+    $$PWD/decoderthread.cpp \
+    $$PWD/playbackengine.cpp \
+    $$PWD/audiosink.cpp \
+    $$PWD/gainstage.cpp \
+    $$PWD/playlistreader.cpp \
+    $$PWD/playlistwriter.cpp \
+    $$PWD/session.cpp \
+    $$PWD/coverartservice.cpp \
+    $$PWD/searchindex.cpp \
+    $$PWD/playlistfiltermodel.cpp \
+    $$PWD/playlistsorter.cpp \
+    $$PWD/folderscanner.cpp \
+    $$PWD/librarywatcher.cpp \
+    $$PWD/library.cpp \
+    $$PWD/headlessplayer.cpp \
+    $$PWD/benchmarksuite.cpp \
+    $$PWD/fixturegenerator.cpp \
+    $$PWD/profiler.cpp \
+    $$PWD/performanceoverlay.cpp \
+    $$PWD/displayscheduler.cpp \
+    $$PWD/waveform.cpp \
+    $$PWD/waveformservice.cpp \
+    $$PWD/waveformseekbar.cpp \
+    $$PWD/seekindex.cpp \
+    $$PWD/seekindexcache.cpp \
+    $$PWD/acousticfingerprint.cpp \
+    $$PWD/fingerprintscanner.cpp \
+    $$PWD/duplicatesdialog.cpp \
+    $$PWD/loudnessmeter.cpp \
+    $$PWD/loudnessanalyzer.cpp \
+    $$PWD/tagwriter.cpp \
+    $$PWD/dspstages.cpp \
+    $$PWD/dspchain.cpp \
+    $$PWD/dspdialog.cpp \
+    $$PWD/streamcache.cpp \
+    $$PWD/controlprotocol.cpp \
+    $$PWD/controlserver.cpp \
+    $$PWD/controlclient.cpp
+
+HEADERS += \
+    $$PWD/player.h \
+    $$PWD/playercontrols.h \
+    $$PWD/tagreader.h \
+    $$PWD/tagscanner.h \
+    $$PWD/metadatacache.h \
+    $$PWD/playlistmodel.h \
+    $$PWD/pcmreader.h \
+    $$PWD/audioringbuffer.h \
+    $$PWD/audiosource.h \
+    $$PWD/decoderthread.h \
+    $$PWD/playbackengine.h \
+    $$PWD/audiosink.h \
+    $$PWD/gainstage.h \
+    $$PWD/playlistreader.h \
+    $$PWD/playlistwriter.h \
+    $$PWD/session.h \
+    $$PWD/coverartservice.h \
+    $$PWD/searchindex.h \
+    $$PWD/playlistfiltermodel.h \
+    $$PWD/playlistsorter.h \
+    $$PWD/folderscanner.h \
+    $$PWD/librarywatcher.h \
+    $$PWD/library.h \
+    $$PWD/headlessplayer.h \
+    $$PWD/benchmarksuite.h \
+    $$PWD/fixturegenerator.h \
+    $$PWD/profiler.h \
+    $$PWD/performanceoverlay.h \
+    $$PWD/displayscheduler.h \
+    $$PWD/waveform.h \
+    $$PWD/waveformservice.h \
+    $$PWD/waveformseekbar.h \
+    $$PWD/seekindex.h \
+    $$PWD/seekindexcache.h \
+    $$PWD/acousticfingerprint.h \
+    $$PWD/fingerprintscanner.h \
+    $$PWD/duplicatesdialog.h \
+    $$PWD/loudnessmeter.h \
+    $$PWD/loudnessanalyzer.h \
+    $$PWD/tagwriter.h \
+    $$PWD/lockfreequeue.h \
+    $$PWD/dspstages.h \
+    $$PWD/dspchain.h \
+    $$PWD/dspdialog.h \
+    $$PWD/streamcache.h \
+    $$PWD/controlprotocol.h \
+    $$PWD/controlserver.h \
+    $$PWD/controlclient.h
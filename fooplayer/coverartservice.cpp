@@ -0,0 +1,193 @@
+#include "coverartservice.h"
+#include "tagreader.h"
+#include "profiler.h"
+#include <QCryptographicHash>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QDir>
+#include <QRunnable>
+
+static const int defaultMemoryLimit = 32 * 1024 * 1024;
+static const char *const coverNames[] = { "cover.jpg", "folder.jpg", "front.jpg", "cover.png", "folder.png" };
+
+class CoverArtTask : public QRunnable
+{
+public:
+    CoverArtTask(CoverArtService *service, const QString &path, const QSize &size, int generation) :
+        service(service), path(path), size(size), generation(generation)
+    {
+    }
+
+    void run() override
+    {
+        PROFILE_SCOPE("cover.load");
+        service->load(path, size, generation);
+    }
+
+private:
+    CoverArtService *service;
+    QString path;
+    QSize size;
+    int generation;
+};
+
+CoverArtService::CoverArtService(const QString &cacheDirectory, QObject *parent) :
+    QObject(parent), directory(cacheDirectory), memory(defaultMemoryLimit)
+{
+    QDir().mkpath(directory);
+    pool.setMaxThreadCount(2);
+}
+
+CoverArtService::~CoverArtService()
+{
+    current.ref();
+    pool.waitForDone();
+}
+
+void CoverArtService::request(const QString &path, const QSize &size)
+{
+    const int generation = current.fetchAndAddOrdered(1) + 1;
+    QImage image;
+    if (cached(memoryKey(path, size), image)) {
+        memoryHitCount.ref();
+        emit coverReady(path, image);
+        return;
+    }
+    pool.start(new CoverArtTask(this, path, size, generation));
+}
+
+void CoverArtService::setMemoryLimit(int bytes)
+{
+    QMutexLocker locker(&mutex);
+    memory.setMaxCost(bytes);
+}
+
+int CoverArtService::memoryHits() const
+{
+    return memoryHitCount.load();
+}
+
+int CoverArtService::diskHits() const
+{
+    return diskHitCount.load();
+}
+
+int CoverArtService::misses() const
+{
+    return missCount.load();
+}
+
+qint64 CoverArtService::averageDecodeTime() const
+{
+    const int count = missCount.load();
+    return count ? decodeTime.load() / count : 0;
+}
+
+void CoverArtService::load(const QString &path, const QSize &size, int generation)
+{
+    if (generation != current.load())
+        return;
+    const QString key = memoryKey(path, size);
+    QImage image;
+    if (cached(key, image)) {
+        memoryHitCount.ref();
+        emit coverReady(path, image);
+        return;
+    }
+
+    const QString cover = coverFile(path);
+    const QString thumbnail = thumbnailPath(path, cover, size);
+    if (QFile::exists(thumbnail)) {
+        QImageReader reader(thumbnail);
+        image = reader.read();
+        if (!image.isNull()) {
+            diskHitCount.ref();
+            store(key, image);
+            emit coverReady(path, image);
+            return;
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QByteArray data = TagReader::readPicture(path);
+    if (!data.isEmpty()) {
+        QBuffer buffer(&data);
+        QImageReader reader(&buffer);
+        image = decode(reader, size);
+    }
+    if (image.isNull() && !cover.isEmpty()) {
+        QImageReader reader(cover);
+        image = decode(reader, size);
+    }
+    if (!image.isNull())
+        QImageWriter(thumbnail, "jpg").write(image);
+    const qint64 elapsed = timer.elapsed();
+    decodeTime.fetchAndAddRelaxed(elapsed);
+    missCount.ref();
+    store(key, image);
+    emit coverReady(path, image);
+}
+
+bool CoverArtService::cached(const QString &key, QImage &image)
+{
+    QMutexLocker locker(&mutex);
+    const QImage *entry = memory.object(key);
+    if (!entry)
+        return false;
+    image = *entry;
+    return true;
+}
+
+void CoverArtService::store(const QString &key, const QImage &image)
+{
+    QMutexLocker locker(&mutex);
+    memory.insert(key, new QImage(image), qMax(1, image.byteCount()));
+}
+
+QString CoverArtService::thumbnailPath(const QString &path, const QString &cover, const QSize &size) const
+{
+    const QFileInfo track(path);
+    const QFileInfo image(cover);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(path.toUtf8());
+    hash.addData(QByteArray::number(track.lastModified().toMSecsSinceEpoch()));
+    hash.addData(QByteArray::number(track.size()));
+    if (!cover.isEmpty())
+        hash.addData(QByteArray::number(image.lastModified().toMSecsSinceEpoch()));
+    hash.addData(QByteArray::number(size.width()) + 'x' + QByteArray::number(size.height()));
+    return directory + '/' + QString::fromLatin1(hash.result().toHex()) + ".jpg";
+}
+
+QString CoverArtService::coverFile(const QString &path)
+{
+    const QDir dir = QFileInfo(path).absoluteDir();
+    for (size_t i = 0; i < sizeof(coverNames) / sizeof(coverNames[0]); i++) {
+        const QString file = dir.filePath(QLatin1String(coverNames[i]));
+        if (QFile::exists(file))
+            return file;
+    }
+    return QString();
+}
+
+// Keyed like the thumbnails on disk, so a retagged file does not get its old cover back.
+QString CoverArtService::memoryKey(const QString &path, const QSize &size)
+{
+    const QFileInfo track(path);
+    return QString::number(size.width()) + 'x' + QString::number(size.height()) + ':'
+            + QString::number(track.lastModified().toMSecsSinceEpoch()) + ':' + QString::number(track.size()) + ':' + path;
+}
+
+QImage CoverArtService::decode(QImageReader &reader, const QSize &size)
+{
+    const QSize original = reader.size();
+    if (original.isValid() && (original.width() > size.width() || original.height() > size.height()))
+        reader.setScaledSize(original.scaled(size, Qt::KeepAspectRatio));
+    QImage image = reader.read();
+    if (!image.isNull() && (image.width() > size.width() || image.height() > size.height()))
+        image = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return image;
+}
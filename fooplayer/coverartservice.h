@@ -0,0 +1,52 @@
+#ifndef COVERARTSERVICE_H
+#define COVERARTSERVICE_H
+
+#include <QObject>
+#include <QImage>
+#include <QCache>
+#include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+class QImageReader;
+
+class CoverArtService : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CoverArtService(const QString &cacheDirectory, QObject *parent = nullptr);
+    ~CoverArtService();
+    void request(const QString &path, const QSize &size);
+    void setMemoryLimit(int bytes);
+    int memoryHits() const;
+    int diskHits() const;
+    int misses() const;
+    qint64 averageDecodeTime() const;
+
+signals:
+    void coverReady(const QString &path, const QImage &image);
+
+private:
+    friend class CoverArtTask;
+
+    void load(const QString &path, const QSize &size, int generation);
+    bool cached(const QString &key, QImage &image);
+    void store(const QString &key, const QImage &image);
+    QString thumbnailPath(const QString &path, const QString &cover, const QSize &size) const;
+    static QString coverFile(const QString &path);
+    static QString memoryKey(const QString &path, const QSize &size);
+    static QImage decode(QImageReader &reader, const QSize &size);
+
+    QString directory;
+    QCache<QString, QImage> memory;
+    QMutex mutex;
+    QThreadPool pool;
+    QAtomicInt current;
+    QAtomicInt memoryHitCount;
+    QAtomicInt diskHitCount;
+    QAtomicInt missCount;
+    QAtomicInteger<qint64> decodeTime;
+};
+
+#endif // COVERARTSERVICE_H
@@ -0,0 +1,257 @@
+#include "decoderthread.h"
+#include "profiler.h"
+#include <QElapsedTimer>
+
+static const int chunkFrames = 4096;
+static const int bufferWait = 10;
+static const int maxFailures = 16;
+static const int rampMilliseconds = 200;
+static const int prefetchBytes = 1024 * 1024;
+
+DecoderThread::DecoderThread(AudioRingBuffer *buffer, AudioSource *source, const QAudioFormat &format, QObject *parent) :
+    QThread(parent), buffer(buffer), source(source), format(format), writtenFrames(0), generation(0),
+    decodingIndex(-1), requestIndex(-1), requestPosition(0), nextIndex(UnknownIndex), replayGainMode(GainStage::ReplayGainOff), seekIndexes(0), metadataCache(0), streamCache(0), exiting(false)
+{
+}
+
+DecoderThread::~DecoderThread()
+{
+    {
+        QMutexLocker locker(&mutex);
+        exiting = true;
+        condition.wakeAll();
+    }
+    wait();
+}
+
+void DecoderThread::decode(int index, const QString &path, qint64 position)
+{
+    QMutexLocker locker(&mutex);
+    buffer->clear();
+    boundaries.clear();
+    writtenFrames = 0;
+    generation++;
+    decodingIndex = -1;
+    requestIndex = index;
+    requestPath = path;
+    requestPosition = position;
+    nextIndex = UnknownIndex;
+    nextPath.clear();
+    condition.wakeAll();
+}
+
+void DecoderThread::setNext(int after, int index, const QString &path)
+{
+    QMutexLocker locker(&mutex);
+    if (after != decodingIndex)
+        return;
+    nextIndex = index;
+    nextPath = path;
+    if (streamCache && StreamCache::isRemote(path))
+        streamCache->prefetch(path, 0, prefetchBytes);
+    condition.wakeAll();
+}
+
+void DecoderThread::resizeBuffer(int bytes)
+{
+    QMutexLocker locker(&mutex);
+    buffer->setCapacity(bytes);
+    boundaries.clear();
+    writtenFrames = 0;
+    generation++;
+    decodingIndex = -1;
+    requestIndex = -1;
+    nextIndex = UnknownIndex;
+    condition.wakeAll();
+}
+
+void DecoderThread::setReplayGainMode(GainStage::ReplayGainMode mode)
+{
+    QMutexLocker locker(&mutex);
+    replayGainMode = mode;
+}
+
+void DecoderThread::remapIndices(const QVector<int> &position)
+{
+    QMutexLocker locker(&mutex);
+    for (int i = 0; i < boundaries.size(); i++) {
+        const int index = boundaries.at(i).index;
+        if (index >= 0 && index < position.size())
+            boundaries[i].index = position.at(index);
+    }
+    if (decodingIndex >= 0 && decodingIndex < position.size())
+        decodingIndex = position.at(decodingIndex);
+    if (requestIndex >= 0 && requestIndex < position.size())
+        requestIndex = position.at(requestIndex);
+    if (nextIndex >= 0 && nextIndex < position.size())
+        nextIndex = position.at(nextIndex);
+}
+
+void DecoderThread::setSeekIndexCache(SeekIndexCache *cache)
+{
+    QMutexLocker locker(&mutex);
+    seekIndexes = cache;
+}
+
+void DecoderThread::setMetadataCache(MetadataCache *cache)
+{
+    QMutexLocker locker(&mutex);
+    metadataCache = cache;
+}
+
+void DecoderThread::setStreamCache(StreamCache *cache)
+{
+    QMutexLocker locker(&mutex);
+    streamCache = cache;
+}
+
+int DecoderThread::currentIndex()
+{
+    QMutexLocker locker(&mutex);
+    return decodingIndex;
+}
+
+bool DecoderThread::boundaryAt(qint64 frame, TrackBoundary &boundary)
+{
+    QMutexLocker locker(&mutex);
+    while (boundaries.size() > 1 && boundaries.at(1).frame <= frame)
+        boundaries.removeFirst();
+    if (boundaries.isEmpty() || boundaries.first().frame > frame)
+        return false;
+    boundary = boundaries.first();
+    return true;
+}
+
+bool DecoderThread::openTrack(PcmReader &reader, QMutexLocker &locker, int index, const QString &path, qint64 position)
+{
+    const int current = generation;
+    reader.setSeekIndexCache(seekIndexes);
+    reader.setStreamCache(streamCache);
+    MetadataCache *cache = metadataCache;
+    locker.unlock();
+    bool opened;
+    TrackInfo info;
+    {
+        PROFILE_SCOPE("decoder.open");
+        opened = reader.open(path, position * format.sampleRate() / 1000);
+        if (opened)
+            info = TagReader::read(path);
+        TrackInfo analyzed;
+        if (opened && cache && !info.hasTrackGain && cache->lookup(path, info.modified, info.size, analyzed)) {
+            info.trackGain = analyzed.trackGain;
+            info.trackPeak = analyzed.trackPeak;
+            info.albumGain = analyzed.albumGain;
+            info.albumPeak = analyzed.albumPeak;
+            info.hasTrackGain = analyzed.hasTrackGain;
+            info.hasAlbumGain = analyzed.hasAlbumGain;
+        }
+    }
+    locker.relock();
+    if (current != generation)
+        return false;
+
+    tags = info;
+
+    decodingIndex = index;
+    if (opened) {
+        TrackBoundary boundary;
+        boundary.frame = writtenFrames;
+        boundary.index = index;
+        boundary.startPosition = position;
+        boundary.duration = reader.duration();
+        boundary.latency = -1;
+        boundary.headroom = -1;
+        boundaries.append(boundary);
+        if (boundary.frame > 0)
+            source->dspChain()->addBoundary(boundary.frame);
+    }
+    emit trackStarted(index);
+    return opened;
+}
+
+void DecoderThread::run()
+{
+    PcmReader reader(format);
+    GainStage replayGain(format);
+    const int bytesPerFrame = format.bytesPerFrame();
+    const int rampFrames = format.framesForDuration(rampMilliseconds * 1000);
+    QByteArray pending;
+    QElapsedTimer transition;
+    int current = -1;
+    int index = -1;
+    int failures = 0;
+    bool decoding = false;
+    bool firstChunk = false;
+
+    QMutexLocker locker(&mutex);
+    while (!exiting) {
+        if (current != generation) {
+            current = generation;
+            pending.clear();
+            decoding = false;
+            failures = 0;
+            index = requestIndex;
+            if (index >= 0) {
+                transition.start();
+                decoding = firstChunk = openTrack(reader, locker, index, requestPath, requestPosition);
+            }
+            continue;
+        }
+
+        if (!pending.isEmpty()) {
+            const int space = buffer->free();
+            const int written = buffer->write(pending.constData(), qMin(pending.size(), space - space % bytesPerFrame));
+            writtenFrames += written / bytesPerFrame;
+            pending.remove(0, written);
+            if (!pending.isEmpty())
+                condition.wait(&mutex, qBound(1, int(format.durationForBytes(buffer->capacity()) / 4000), bufferWait));
+            continue;
+        }
+
+        if (decoding) {
+            locker.unlock();
+            PROFILE_SCOPE("decoder.read");
+            const QByteArray chunk = reader.read(chunkFrames * bytesPerFrame);
+            const qint64 duration = reader.duration();
+            locker.relock();
+            if (current != generation)
+                continue;
+            if (!chunk.isEmpty()) {
+                if (!boundaries.isEmpty()) {
+                    TrackBoundary &boundary = boundaries.last();
+                    if (firstChunk) {
+                        boundary.latency = transition.elapsed();
+                        boundary.headroom = qint64(buffer->available() / bytesPerFrame) * 1000 / format.sampleRate();
+                    }
+                    boundary.duration = duration;
+                }
+                const qreal gain = GainStage::replayGain(tags, replayGainMode);
+                if (gain != replayGain.gain())
+                    replayGain.setGain(gain, firstChunk ? 0 : rampFrames);
+                firstChunk = false;
+                failures = 0;
+                pending = chunk;
+                replayGain.process(pending.data(), pending.size());
+                continue;
+            }
+            decoding = false;
+            transition.start();
+        }
+
+        if (index >= 0 && nextIndex != UnknownIndex) {
+            index = nextIndex;
+            const QString path = nextPath;
+            nextIndex = UnknownIndex;
+            if (index < 0 || ++failures > maxFailures) {
+                index = -1;
+                source->setEndOfStream();
+                emit endOfStream();
+                continue;
+            }
+            decoding = firstChunk = openTrack(reader, locker, index, path, 0);
+            continue;
+        }
+
+        condition.wait(&mutex);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef DECODERTHREAD_H
+#define DECODERTHREAD_H
+
+#include "audioringbuffer.h"
+#include "audiosource.h"
+#include "pcmreader.h"
+#include "gainstage.h"
+#include "seekindexcache.h"
+#include "metadatacache.h"
+#include "streamcache.h"
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAudioFormat>
+#include <QList>
+
+struct TrackBoundary
+{
+    qint64 frame;
+    int index;
+    qint64 startPosition;
+    qint64 duration;
+    qint64 latency;
+    qint64 headroom;
+};
+
+class DecoderThread : public QThread
+{
+    Q_OBJECT
+public:
+    enum { UnknownIndex = -2 };
+
+    DecoderThread(AudioRingBuffer *buffer, AudioSource *source, const QAudioFormat &format, QObject *parent = nullptr);
+    ~DecoderThread();
+    void decode(int index, const QString &path, qint64 position);
+    void setNext(int after, int index, const QString &path);
+    void resizeBuffer(int bytes);
+    void setReplayGainMode(GainStage::ReplayGainMode mode);
+    void setSeekIndexCache(SeekIndexCache *cache);
+    void setMetadataCache(MetadataCache *cache);
+    void setStreamCache(StreamCache *cache);
+    void remapIndices(const QVector<int> &position);
+    int currentIndex();
+    bool boundaryAt(qint64 frame, TrackBoundary &boundary);
+
+signals:
+    void trackStarted(int index);
+    void endOfStream();
+
+protected:
+    void run() override;
+
+private:
+    bool openTrack(PcmReader &reader, QMutexLocker &locker, int index, const QString &path, qint64 position);
+
+    AudioRingBuffer *buffer;
+    AudioSource *source;
+    QAudioFormat format;
+    QMutex mutex;
+    QWaitCondition condition;
+    QList<TrackBoundary> boundaries;
+    qint64 writtenFrames;
+    int generation;
+    int decodingIndex;
+    int requestIndex;
+    QString requestPath;
+    qint64 requestPosition;
+    int nextIndex;
+    QString nextPath;
+    TrackInfo tags;
+    GainStage::ReplayGainMode replayGainMode;
+    SeekIndexCache *seekIndexes;
+    MetadataCache *metadataCache;
+    StreamCache *streamCache;
+    bool exiting;
+};
+
+#endif // DECODERTHREAD_H
@@ -0,0 +1,65 @@
+#include "displayscheduler.h"
+#include "profiler.h"
+#include <QWidget>
+#include <QWindow>
+#include <QScreen>
+#include <QTimer>
+#include <QEvent>
+
+DisplayScheduler::DisplayScheduler(QWidget *window) :
+    QObject(window), window(window), refreshCount(0), requestCount(0), pending(false)
+{
+    timer = new QTimer(this);
+    timer->setSingleShot(true);
+    timer->setTimerType(Qt::CoarseTimer);
+    connect(timer, SIGNAL(timeout()), this, SLOT(fire()));
+    window->installEventFilter(this);
+}
+
+void DisplayScheduler::schedule()
+{
+    requestCount++;
+    pending = true;
+    if (isDisplayed() && !timer->isActive())
+        timer->start(frameInterval());
+}
+
+bool DisplayScheduler::isDisplayed() const
+{
+    return window->isVisible() && !window->isMinimized();
+}
+
+int DisplayScheduler::refreshes() const
+{
+    return refreshCount;
+}
+
+int DisplayScheduler::requests() const
+{
+    return requestCount;
+}
+
+int DisplayScheduler::frameInterval() const
+{
+    const QWindow *handle = window->windowHandle();
+    const qreal rate = handle && handle->screen() ? handle->screen()->refreshRate() : 60;
+    return qBound(4, qRound(1000 / qMax<qreal>(1, rate)), 100);
+}
+
+bool DisplayScheduler::eventFilter(QObject *object, QEvent *event)
+{
+    if (object == window && pending && !timer->isActive()
+            && (event->type() == QEvent::Show || event->type() == QEvent::WindowStateChange) && isDisplayed())
+        timer->start(0);
+    return QObject::eventFilter(object, event);
+}
+
+void DisplayScheduler::fire()
+{
+    if (!pending || !isDisplayed())
+        return;
+    pending = false;
+    refreshCount++;
+    PROFILE_MARK("ui.refresh");
+    emit refresh();
+}
@@ -0,0 +1,38 @@
+#ifndef DISPLAYSCHEDULER_H
+#define DISPLAYSCHEDULER_H
+
+#include <QObject>
+
+class QWidget;
+class QTimer;
+
+class DisplayScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DisplayScheduler(QWidget *window);
+    void schedule();
+    bool isDisplayed() const;
+    int refreshes() const;
+    int requests() const;
+
+signals:
+    void refresh();
+
+protected:
+    bool eventFilter(QObject *object, QEvent *event) override;
+
+private slots:
+    void fire();
+
+private:
+    int frameInterval() const;
+
+    QWidget *window;
+    QTimer *timer;
+    int refreshCount;
+    int requestCount;
+    bool pending;
+};
+
+#endif // DISPLAYSCHEDULER_H
@@ -0,0 +1,222 @@
+#include "dspchain.h"
+#include <QElapsedTimer>
+#include <QtMath>
+#include <cmath>
+
+static const int benchmarkTrackSeconds = 180;
+
+DspSettings::DspSettings() :
+    crossfade(0), speed(1), mono(false), balance(0)
+{
+    static const EqualizerBand defaults[] = {
+        { DspEqualizer::LowShelf, 80, 0, 0.707f },
+        { DspEqualizer::Peak, 250, 0, 1 },
+        { DspEqualizer::Peak, 1000, 0, 1 },
+        { DspEqualizer::Peak, 4000, 0, 1 },
+        { DspEqualizer::HighShelf, 12000, 0, 0.707f }
+    };
+    for (unsigned i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++)
+        bands.append(defaults[i]);
+}
+
+QVector<float> DspSettings::mixerMatrix(int channels) const
+{
+    QVector<float> matrix(channels * channels);
+    for (int o = 0; o < channels; o++) {
+        for (int i = 0; i < channels; i++)
+            matrix[o * channels + i] = mono ? 1.0f / channels : (o == i ? 1 : 0);
+    }
+    if (channels == 2 && balance != 0) {
+        const float left = qMin(1.0f, 1 - balance);
+        const float right = qMin(1.0f, 1 + balance);
+        for (int i = 0; i < channels; i++) {
+            matrix[i] *= left;
+            matrix[channels + i] *= right;
+        }
+    }
+    return matrix;
+}
+
+DspChain::DspChain(AudioRingBuffer *buffer, const QAudioFormat &format) :
+    format(format), crossfader(buffer, format), postedAll(false)
+{
+    const int channels = qBound(1, format.channelCount(), int(DspSource::MaxChannels));
+    resampler.prepare(channels);
+    equalizer.prepare(format.sampleRate(), channels);
+    mixer.prepare(channels);
+    work = QVector<float>(DspSource::BlockFrames * channels);
+}
+
+bool DspChain::isSupported() const
+{
+    return crossfader.isSupported();
+}
+
+// Runs on the GUI thread. Only changed values are queued, and nothing is queued
+// unless the whole change fits, so the audio thread never sees half a setting.
+bool DspChain::configure(const DspSettings &settings)
+{
+    if (!isSupported())
+        return false;
+    QVector<Message> changes;
+    if (!postedAll || settings.crossfade != posted.crossfade) {
+        const Message message = { Crossfade, 0, float(settings.crossfade) };
+        changes.append(message);
+    }
+    if (!postedAll || settings.speed != posted.speed) {
+        const Message message = { Resampler, 0, settings.speed };
+        changes.append(message);
+    }
+    for (int band = 0; band < DspEqualizer::MaxBands; band++) {
+        EqualizerBand off = { DspEqualizer::Peak, 1000, 0, 1 };
+        const EqualizerBand &wanted = band < settings.bands.size() ? settings.bands.at(band) : off;
+        const EqualizerBand &current = band < posted.bands.size() ? posted.bands.at(band) : off;
+        const float values[] = { float(wanted.type), wanted.frequency, wanted.gain, wanted.q };
+        const float previous[] = { float(current.type), current.frequency, current.gain, current.q };
+        for (int parameter = 0; parameter < DspEqualizer::ParametersPerBand; parameter++) {
+            if (postedAll && values[parameter] == previous[parameter])
+                continue;
+            const Message message = { Equalizer, band * DspEqualizer::ParametersPerBand + parameter, values[parameter] };
+            changes.append(message);
+        }
+    }
+    const int channels = format.channelCount();
+    const QVector<float> matrix = settings.mixerMatrix(channels);
+    const QVector<float> previous = posted.mixerMatrix(channels);
+    for (int i = 0; i < matrix.size(); i++) {
+        if (postedAll && matrix.at(i) == previous.at(i))
+            continue;
+        const Message message = { Mixer, (i / channels) * DspSource::MaxChannels + i % channels, matrix.at(i) };
+        changes.append(message);
+    }
+    if (changes.size() > messages.free())
+        return false;
+    foreach (const Message &message, changes)
+        messages.push(message);
+    posted = settings;
+    postedAll = true;
+    return true;
+}
+
+bool DspChain::addBoundary(qint64 frame)
+{
+    return crossfader.addBoundary(frame);
+}
+
+void DspChain::apply()
+{
+    Message message;
+    while (messages.pop(message)) {
+        switch (message.stage) {
+        case Crossfade:
+            crossfader.setDuration(int(message.value));
+            break;
+        case Resampler:
+            resampler.setRatio(message.value);
+            break;
+        case Equalizer:
+            equalizer.setParameter(message.parameter, message.value);
+            break;
+        case Mixer:
+            mixer.setCoefficient(message.parameter / DspSource::MaxChannels, message.parameter % DspSource::MaxChannels, message.value);
+            break;
+        }
+    }
+}
+
+void DspChain::fromFloat(const float *samples, char *data, int count) const
+{
+    if (format.sampleType() == QAudioFormat::SignedInt) {
+        qint16 *target = reinterpret_cast<qint16 *>(data);
+        for (int i = 0; i < count; i++)
+            target[i] = qint16(qBound(-32768, int(std::lrint(samples[i] * 32768)), 32767));
+    } else {
+        float *target = reinterpret_cast<float *>(data);
+        for (int i = 0; i < count; i++)
+            target[i] = qBound(-1.0f, samples[i], 1.0f);
+    }
+}
+
+// Called from the output thread's read callback: no locks, no allocation.
+int DspChain::render(char *data, int frames)
+{
+    apply();
+    if (!isSupported() || (!crossfader.isActive() && !resampler.isActive() && !equalizer.isActive() && !mixer.isActive()))
+        return crossfader.passThrough(data, frames);
+    const int channels = format.channelCount();
+    const int bytesPerFrame = format.bytesPerFrame();
+    int done = 0;
+    while (done < frames) {
+        const int n = qMin(frames - done, int(DspSource::BlockFrames));
+        const int got = resampler.render(work.data(), n, &crossfader);
+        equalizer.process(work.data(), got);
+        mixer.process(work.data(), got);
+        fromFloat(work.constData(), data + done * bytesPerFrame, got * channels);
+        done += got;
+        if (got < n)
+            break;
+    }
+    return done;
+}
+
+qint64 DspChain::framesConsumed() const
+{
+    return crossfader.position();
+}
+
+// Only called while the output is stopped, so the audio thread is not running.
+void DspChain::reset()
+{
+    apply();
+    crossfader.reset();
+    resampler.reset();
+    equalizer.reset();
+}
+
+const char *DspChain::stageName(int stage)
+{
+    static const char *const names[] = { "crossfade", "resampler", "equalizer", "mixer" };
+    return stage >= 0 && stage < StageCount ? names[stage] : "";
+}
+
+qint64 DspChain::benchmark(const DspSettings &settings, int seconds)
+{
+    QAudioFormat format;
+    format.setSampleRate(44100);
+    format.setChannelCount(2);
+    format.setSampleSize(16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+    const int rate = format.sampleRate();
+    AudioRingBuffer buffer(format.bytesForDuration(qint64(qMax(2000, 2 * settings.crossfade + 1000)) * 1000));
+    DspChain chain(&buffer, format);
+    chain.configure(settings);
+
+    QByteArray second(format.bytesForDuration(1000000), 0);
+    qint16 *samples = reinterpret_cast<qint16 *>(second.data());
+    quint32 seed = 1;
+    for (int i = 0; i < rate; i++) {
+        seed = seed * 1664525 + 1013904223;
+        const double tone = qSin(2 * M_PI * (100 + 10 * (i % 1000)) * i / rate);
+        samples[2 * i] = qint16(tone * 12000 + int(seed >> 22) - 512);
+        samples[2 * i + 1] = qint16(tone * -12000);
+    }
+    QByteArray out(DspSource::BlockFrames * format.bytesPerFrame(), 0);
+    const qint64 total = qint64(seconds) * rate;
+    qint64 written = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (;;) {
+        while (written < total && buffer.free() >= second.size()) {
+            if (written && written % (qint64(benchmarkTrackSeconds) * rate) == 0)
+                chain.addBoundary(written);
+            buffer.write(second.constData(), second.size());
+            written += rate;
+        }
+        if (!chain.render(out.data(), DspSource::BlockFrames))
+            break;
+    }
+    return timer.nsecsElapsed();
+}
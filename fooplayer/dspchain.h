@@ -0,0 +1,67 @@
+#ifndef DSPCHAIN_H
+#define DSPCHAIN_H
+
+#include "dspstages.h"
+#include "lockfreequeue.h"
+#include <QAudioFormat>
+#include <QVector>
+
+struct EqualizerBand
+{
+    int type;
+    float frequency;
+    float gain;
+    float q;
+};
+
+struct DspSettings
+{
+    DspSettings();
+    QVector<float> mixerMatrix(int channels) const;
+
+    int crossfade;
+    float speed;
+    QVector<EqualizerBand> bands;
+    bool mono;
+    float balance;
+};
+
+class DspChain
+{
+public:
+    enum Stage { Crossfade, Resampler, Equalizer, Mixer, StageCount };
+
+    DspChain(AudioRingBuffer *buffer, const QAudioFormat &format);
+    bool isSupported() const;
+    bool configure(const DspSettings &settings);
+    bool addBoundary(qint64 frame);
+    int render(char *data, int frames);
+    qint64 framesConsumed() const;
+    void reset();
+
+    static const char *stageName(int stage);
+    static qint64 benchmark(const DspSettings &settings, int seconds);
+
+private:
+    struct Message
+    {
+        int stage;
+        int parameter;
+        float value;
+    };
+
+    void apply();
+    void fromFloat(const float *samples, char *data, int count) const;
+
+    QAudioFormat format;
+    DspCrossfader crossfader;
+    DspResampler resampler;
+    DspEqualizer equalizer;
+    DspMixer mixer;
+    LockFreeQueue<Message, 256> messages;
+    QVector<float> work;
+    DspSettings posted;
+    bool postedAll;
+};
+
+#endif // DSPCHAIN_H
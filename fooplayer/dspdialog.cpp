@@ -0,0 +1,116 @@
+#include "dspdialog.h"
+#include <QSpinBox>
+#include <QDoubleSpinBox>
+#include <QComboBox>
+#include <QCheckBox>
+#include <QSlider>
+#include <QLabel>
+#include <QPushButton>
+#include <QGroupBox>
+#include <QFormLayout>
+#include <QGridLayout>
+#include <QVBoxLayout>
+
+DspDialog::DspDialog(PlaybackEngine *engine, QWidget *parent) :
+    QDialog(parent), engine(engine)
+{
+    setWindowTitle(tr("DSP"));
+    setAttribute(Qt::WA_DeleteOnClose);
+    const DspSettings settings = engine->dspSettings();
+
+    crossfade = new QSpinBox(this);
+    crossfade->setRange(0, 10000);
+    crossfade->setSingleStep(500);
+    crossfade->setSuffix(tr(" ms"));
+    crossfade->setSpecialValueText(tr("Off"));
+    crossfade->setValue(settings.crossfade);
+    speed = new QDoubleSpinBox(this);
+    speed->setRange(0.5, 2.0);
+    speed->setSingleStep(0.05);
+    speed->setSuffix(tr("x"));
+    speed->setValue(settings.speed);
+    mono = new QCheckBox(tr("Downmix to mono"), this);
+    mono->setChecked(settings.mono);
+    balance = new QSlider(Qt::Horizontal, this);
+    balance->setRange(-100, 100);
+    balance->setValue(qRound(settings.balance * 100));
+
+    QGroupBox *equalizerBox = new QGroupBox(tr("Equalizer"), this);
+    QGridLayout *grid = new QGridLayout(equalizerBox);
+    grid->addWidget(new QLabel(tr("Type")), 0, 0);
+    grid->addWidget(new QLabel(tr("Frequency")), 0, 1);
+    grid->addWidget(new QLabel(tr("Gain")), 0, 2);
+    grid->addWidget(new QLabel(tr("Q")), 0, 3);
+    for (int i = 0; i < settings.bands.size(); i++) {
+        const EqualizerBand &band = settings.bands.at(i);
+        BandControls controls;
+        controls.type = new QComboBox(equalizerBox);
+        controls.type->addItem(tr("Peak"), DspEqualizer::Peak);
+        controls.type->addItem(tr("Low shelf"), DspEqualizer::LowShelf);
+        controls.type->addItem(tr("High shelf"), DspEqualizer::HighShelf);
+        controls.type->setCurrentIndex(controls.type->findData(band.type));
+        controls.frequency = new QDoubleSpinBox(equalizerBox);
+        controls.frequency->setRange(20, 20000);
+        controls.frequency->setDecimals(0);
+        controls.frequency->setSuffix(tr(" Hz"));
+        controls.frequency->setValue(band.frequency);
+        controls.gain = new QDoubleSpinBox(equalizerBox);
+        controls.gain->setRange(-12, 12);
+        controls.gain->setSingleStep(0.5);
+        controls.gain->setSuffix(tr(" dB"));
+        controls.gain->setValue(band.gain);
+        controls.q = new QDoubleSpinBox(equalizerBox);
+        controls.q->setRange(0.1, 10);
+        controls.q->setSingleStep(0.1);
+        controls.q->setValue(band.q);
+        grid->addWidget(controls.type, i + 1, 0);
+        grid->addWidget(controls.frequency, i + 1, 1);
+        grid->addWidget(controls.gain, i + 1, 2);
+        grid->addWidget(controls.q, i + 1, 3);
+        connect(controls.type, SIGNAL(currentIndexChanged(int)), this, SLOT(settingsChanged()));
+        connect(controls.frequency, SIGNAL(valueChanged(double)), this, SLOT(settingsChanged()));
+        connect(controls.gain, SIGNAL(valueChanged(double)), this, SLOT(settingsChanged()));
+        connect(controls.q, SIGNAL(valueChanged(double)), this, SLOT(settingsChanged()));
+        bands.append(controls);
+    }
+    QPushButton *flatButton = new QPushButton(tr("Flat"), equalizerBox);
+    grid->addWidget(flatButton, settings.bands.size() + 1, 3);
+
+    QFormLayout *form = new QFormLayout;
+    form->addRow(tr("Crossfade"), crossfade);
+    form->addRow(tr("Speed"), speed);
+    form->addRow(tr("Balance"), balance);
+    form->addRow(QString(), mono);
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(form);
+    layout->addWidget(equalizerBox);
+
+    connect(crossfade, SIGNAL(valueChanged(int)), this, SLOT(settingsChanged()));
+    connect(speed, SIGNAL(valueChanged(double)), this, SLOT(settingsChanged()));
+    connect(mono, SIGNAL(toggled(bool)), this, SLOT(settingsChanged()));
+    connect(balance, SIGNAL(valueChanged(int)), this, SLOT(settingsChanged()));
+    connect(flatButton, SIGNAL(clicked()), this, SLOT(resetEqualizer()));
+}
+
+void DspDialog::settingsChanged()
+{
+    DspSettings settings = engine->dspSettings();
+    settings.crossfade = crossfade->value();
+    settings.speed = float(speed->value());
+    settings.mono = mono->isChecked();
+    settings.balance = balance->value() / 100.0f;
+    for (int i = 0; i < bands.size() && i < settings.bands.size(); i++) {
+        EqualizerBand &band = settings.bands[i];
+        band.type = bands.at(i).type->currentData().toInt();
+        band.frequency = float(bands.at(i).frequency->value());
+        band.gain = float(bands.at(i).gain->value());
+        band.q = float(bands.at(i).q->value());
+    }
+    engine->setDspSettings(settings);
+}
+
+void DspDialog::resetEqualizer()
+{
+    foreach (const BandControls &controls, bands)
+        controls.gain->setValue(0);
+}
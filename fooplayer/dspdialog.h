@@ -0,0 +1,41 @@
+#ifndef DSPDIALOG_H
+#define DSPDIALOG_H
+
+#include "playbackengine.h"
+#include <QDialog>
+#include <QVector>
+
+class QSpinBox;
+class QDoubleSpinBox;
+class QComboBox;
+class QCheckBox;
+class QSlider;
+
+class DspDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit DspDialog(PlaybackEngine *engine, QWidget *parent = nullptr);
+
+private slots:
+    void settingsChanged();
+    void resetEqualizer();
+
+private:
+    struct BandControls
+    {
+        QComboBox *type;
+        QDoubleSpinBox *frequency;
+        QDoubleSpinBox *gain;
+        QDoubleSpinBox *q;
+    };
+
+    PlaybackEngine *engine;
+    QSpinBox *crossfade;
+    QDoubleSpinBox *speed;
+    QCheckBox *mono;
+    QSlider *balance;
+    QVector<BandControls> bands;
+};
+
+#endif // DSPDIALOG_H
@@ -0,0 +1,425 @@
+#include "dspstages.h"
+#include <QtMath>
+#include <cmath>
+#include <cstring>
+
+static const float maximumRatio = 2.0f;
+static const float minimumRatio = 0.5f;
+static const int minimumFadeMsecs = 100;
+
+DspCrossfader::DspCrossfader(AudioRingBuffer *buffer, const QAudioFormat &format) :
+    buffer(buffer), sampleFormat(Unsupported), channels(format.channelCount()), bytesPerFrame(format.bytesPerFrame()),
+    sampleRate(format.sampleRate()), fadeFrames(0), frames(0), boundary(-1), fadeStart(0), fadeLength(0), skip(0)
+{
+    if (format.sampleType() == QAudioFormat::SignedInt && format.sampleSize() == 16)
+        sampleFormat = Int16;
+    else if (format.sampleType() == QAudioFormat::Float && format.sampleSize() == 32)
+        sampleFormat = Float32;
+    if (channels < 1 || channels > MaxChannels)
+        sampleFormat = Unsupported;
+    raw = QByteArray(BlockFrames * qMax(1, bytesPerFrame), 0);
+    incoming = QVector<float>(BlockFrames * qMax(1, channels));
+}
+
+bool DspCrossfader::isSupported() const
+{
+    return sampleFormat != Unsupported;
+}
+
+bool DspCrossfader::isActive() const
+{
+    return fadeFrames > 0 || fadeLength > 0 || skip > 0;
+}
+
+void DspCrossfader::setDuration(int msecs)
+{
+    fadeFrames = int(qint64(qMax(0, msecs)) * sampleRate / 1000);
+}
+
+bool DspCrossfader::addBoundary(qint64 frame)
+{
+    return boundaries.push(frame);
+}
+
+qint64 DspCrossfader::position() const
+{
+    return frames;
+}
+
+void DspCrossfader::reset()
+{
+    qint64 stale;
+    while (boundaries.pop(stale)) {
+    }
+    frames = 0;
+    boundary = -1;
+    fadeLength = 0;
+    skip = 0;
+}
+
+void DspCrossfader::toFloat(const char *data, float *samples, int count) const
+{
+    if (sampleFormat == Int16) {
+        const qint16 *source = reinterpret_cast<const qint16 *>(data);
+        for (int i = 0; i < count; i++)
+            samples[i] = source[i] * (1.0f / 32768);
+    } else {
+        memcpy(samples, data, size_t(count) * sizeof(float));
+    }
+}
+
+int DspCrossfader::read(float *samples, int count)
+{
+    const int got = buffer->read(raw.data(), count * bytesPerFrame) / bytesPerFrame;
+    toFloat(raw.constData(), samples, got * channels);
+    frames += got;
+    return got;
+}
+
+int DspCrossfader::passThrough(char *data, int count)
+{
+    const int got = buffer->read(data, count * bytesPerFrame) / bytesPerFrame;
+    frames += got;
+    return got;
+}
+
+void DspCrossfader::nextBoundary()
+{
+    if (boundary >= 0 && boundary <= frames && !fadeLength)
+        boundary = -1;
+    qint64 next;
+    while (boundary < 0 && boundaries.pop(next)) {
+        if (next > frames)
+            boundary = next;
+    }
+}
+
+// The decoder writes tracks back to back, so the head of the next track is already
+// in the ring buffer behind the tail of the current one. A fade mixes the two by
+// peeking ahead a fixed distance, then skips the head it has already played.
+int DspCrossfader::pull(float *samples, int count)
+{
+    int produced = 0;
+    while (produced < count) {
+        if (skip > 0) {
+            const int discarded = buffer->read(raw.data(), int(qMin<qint64>(skip, BlockFrames)) * bytesPerFrame) / bytesPerFrame;
+            if (!discarded)
+                break;
+            frames += discarded;
+            skip -= discarded;
+            continue;
+        }
+        nextBoundary();
+        int n = qMin(count - produced, int(BlockFrames));
+        float *out = samples + produced * channels;
+        if (boundary >= 0 && fadeFrames > 0) {
+            if (!fadeLength && frames >= boundary - fadeFrames) {
+                const qint64 length = boundary - frames;
+                if (length * 1000 >= qint64(minimumFadeMsecs) * sampleRate && buffer->available() >= 2 * length * bytesPerFrame) {
+                    fadeStart = frames;
+                    fadeLength = length;
+                }
+            }
+            if (fadeLength) {
+                n = int(qMin<qint64>(n, boundary - frames));
+                const int next = buffer->peek(raw.data(), n * bytesPerFrame, int(fadeLength) * bytesPerFrame) / bytesPerFrame;
+                toFloat(raw.constData(), incoming.data(), next * channels);
+                const qint64 start = frames;
+                n = read(out, qMin(n, next));
+                if (!n)
+                    break;
+                for (int i = 0; i < n; i++) {
+                    const double x = (start - fadeStart + i + 0.5) * M_PI_2 / fadeLength;
+                    const float fadeOut = float(qCos(x));
+                    const float fadeIn = float(qSin(x));
+                    for (int c = 0; c < channels; c++)
+                        out[i * channels + c] = out[i * channels + c] * fadeOut + incoming.at(i * channels + c) * fadeIn;
+                }
+                produced += n;
+                if (frames >= boundary) {
+                    skip = fadeLength;
+                    fadeLength = 0;
+                    boundary = -1;
+                }
+                continue;
+            }
+            if (frames < boundary - fadeFrames)
+                n = int(qMin<qint64>(n, boundary - fadeFrames - frames));
+        }
+        const int got = read(out, n);
+        produced += got;
+        if (got < n)
+            break;
+    }
+    return produced;
+}
+
+DspResampler::DspResampler() :
+    channels(0), ratio(1), cutoff(0), position(0), count(0), capacity(0)
+{
+}
+
+void DspResampler::prepare(int channels)
+{
+    this->channels = channels;
+    capacity = int(DspSource::BlockFrames * maximumRatio) + Taps + 2;
+    input = QVector<float>(capacity * channels);
+    table = QVector<float>((Phases + 1) * Taps);
+    buildTable(1);
+    reset();
+}
+
+bool DspResampler::isActive() const
+{
+    return ratio != 1;
+}
+
+void DspResampler::setRatio(float ratio)
+{
+    ratio = qBound(minimumRatio, ratio, maximumRatio);
+    if (ratio == this->ratio)
+        return;
+    if (this->ratio == 1)
+        reset();
+    this->ratio = ratio;
+    // Playing faster than realtime has to band-limit below the new Nyquist frequency.
+    const double wanted = ratio > 1 ? 0.95 / ratio : 0.95;
+    if (wanted != cutoff)
+        buildTable(wanted);
+}
+
+void DspResampler::buildTable(double cutoff)
+{
+    this->cutoff = cutoff;
+    for (int phase = 0; phase <= Phases; phase++) {
+        float *taps = table.data() + phase * Taps;
+        double sum = 0;
+        for (int k = 0; k < Taps; k++) {
+            const double d = k - (Taps / 2 - 1) - double(phase) / Phases;
+            const double x = M_PI * cutoff * d;
+            const double sinc = x == 0 ? 1 : std::sin(x) / x;
+            const double window = 0.42 + 0.5 * std::cos(2 * M_PI * d / Taps) + 0.08 * std::cos(4 * M_PI * d / Taps);
+            taps[k] = float(sinc * window);
+            sum += taps[k];
+        }
+        for (int k = 0; k < Taps; k++)
+            taps[k] = float(taps[k] / sum);
+    }
+}
+
+void DspResampler::reset()
+{
+    // Half a filter of silence lines the first output sample up with the first input.
+    count = Taps / 2 - 1;
+    std::fill(input.begin(), input.begin() + count * channels, 0.0f);
+    position = 0;
+}
+
+int DspResampler::render(float *samples, int frames, DspSource *source)
+{
+    if (!isActive())
+        return source->pull(samples, frames);
+    const int needed = qMin(capacity, int(position + (frames - 1) * double(ratio)) + Taps);
+    if (needed > count)
+        count += source->pull(input.data() + count * channels, needed - count);
+    const float *in = input.constData();
+    int produced = 0;
+    for (; produced < frames; produced++) {
+        const double t = position + produced * double(ratio);
+        const int base = int(t);
+        if (base + Taps > count)
+            break;
+        const double phase = (t - base) * Phases;
+        const int p = int(phase);
+        const float weight = float(phase - p);
+        const float *h0 = table.constData() + p * Taps;
+        const float *h1 = h0 + Taps;
+        for (int c = 0; c < channels; c++) {
+            const float *x = in + base * channels + c;
+            float y0 = 0;
+            float y1 = 0;
+            for (int k = 0; k < Taps; k++) {
+                y0 += x[k * channels] * h0[k];
+                y1 += x[k * channels] * h1[k];
+            }
+            samples[produced * channels + c] = y0 + (y1 - y0) * weight;
+        }
+    }
+    const double end = position + produced * double(ratio);
+    const int consumed = qMin(int(end), count);
+    memmove(input.data(), input.constData() + consumed * channels, size_t(count - consumed) * channels * sizeof(float));
+    count -= consumed;
+    position = end - consumed;
+    return produced;
+}
+
+DspEqualizer::DspEqualizer() :
+    sampleRate(44100), channels(0), active(false)
+{
+    memset(bands, 0, sizeof(bands));
+    for (int i = 0; i < MaxBands; i++) {
+        bands[i].frequency = 1000;
+        bands[i].q = 1;
+        update(bands[i]);
+    }
+}
+
+void DspEqualizer::prepare(int sampleRate, int channels)
+{
+    this->sampleRate = sampleRate;
+    this->channels = channels;
+    for (int i = 0; i < MaxBands; i++)
+        update(bands[i]);
+    reset();
+}
+
+bool DspEqualizer::isActive() const
+{
+    return active;
+}
+
+void DspEqualizer::setParameter(int parameter, float value)
+{
+    const int index = parameter / ParametersPerBand;
+    if (index < 0 || index >= MaxBands)
+        return;
+    Band &band = bands[index];
+    switch (parameter % ParametersPerBand) {
+    case Type:
+        band.type = int(value);
+        break;
+    case Frequency:
+        band.frequency = value;
+        break;
+    case Gain:
+        band.gain = value;
+        break;
+    case Q:
+        band.q = value;
+        break;
+    }
+    update(band);
+    active = false;
+    for (int i = 0; i < MaxBands; i++)
+        active = active || bands[i].gain != 0;
+}
+
+// Coefficients from the RBJ audio EQ cookbook.
+void DspEqualizer::update(Band &band)
+{
+    const double a = std::pow(10.0, band.gain / 40.0);
+    const double w0 = 2 * M_PI * qBound(10.0, double(band.frequency), 0.49 * sampleRate) / sampleRate;
+    const double cosine = std::cos(w0);
+    const double alpha = std::sin(w0) / (2 * qMax(0.1, double(band.q)));
+    const double shelf = 2 * std::sqrt(a) * alpha;
+    double b0, b1, b2, a0, a1, a2;
+    switch (band.type) {
+    case LowShelf:
+        b0 = a * ((a + 1) - (a - 1) * cosine + shelf);
+        b1 = 2 * a * ((a - 1) - (a + 1) * cosine);
+        b2 = a * ((a + 1) - (a - 1) * cosine - shelf);
+        a0 = (a + 1) + (a - 1) * cosine + shelf;
+        a1 = -2 * ((a - 1) + (a + 1) * cosine);
+        a2 = (a + 1) + (a - 1) * cosine - shelf;
+        break;
+    case HighShelf:
+        b0 = a * ((a + 1) + (a - 1) * cosine + shelf);
+        b1 = -2 * a * ((a - 1) + (a + 1) * cosine);
+        b2 = a * ((a + 1) + (a - 1) * cosine - shelf);
+        a0 = (a + 1) - (a - 1) * cosine + shelf;
+        a1 = 2 * ((a - 1) - (a + 1) * cosine);
+        a2 = (a + 1) - (a - 1) * cosine - shelf;
+        break;
+    default:
+        b0 = 1 + alpha * a;
+        b1 = -2 * cosine;
+        b2 = 1 - alpha * a;
+        a0 = 1 + alpha / a;
+        a1 = -2 * cosine;
+        a2 = 1 - alpha / a;
+        break;
+    }
+    band.b0 = b0 / a0;
+    band.b1 = b1 / a0;
+    band.b2 = b2 / a0;
+    band.a1 = a1 / a0;
+    band.a2 = a2 / a0;
+}
+
+void DspEqualizer::process(float *samples, int frames)
+{
+    if (!active)
+        return;
+    for (int i = 0; i < MaxBands; i++) {
+        Band &band = bands[i];
+        if (band.gain == 0)
+            continue;
+        for (int c = 0; c < channels; c++) {
+            double z1 = band.z1[c];
+            double z2 = band.z2[c];
+            float *x = samples + c;
+            for (int f = 0; f < frames; f++, x += channels) {
+                const double y = band.b0 * *x + z1;
+                z1 = band.b1 * *x - band.a1 * y + z2;
+                z2 = band.b2 * *x - band.a2 * y;
+                *x = float(y);
+            }
+            band.z1[c] = std::fabs(z1) < 1e-30 ? 0 : z1;
+            band.z2[c] = std::fabs(z2) < 1e-30 ? 0 : z2;
+        }
+    }
+}
+
+void DspEqualizer::reset()
+{
+    for (int i = 0; i < MaxBands; i++) {
+        memset(bands[i].z1, 0, sizeof(bands[i].z1));
+        memset(bands[i].z2, 0, sizeof(bands[i].z2));
+    }
+}
+
+DspMixer::DspMixer() :
+    channels(0), active(false)
+{
+    memset(matrix, 0, sizeof(matrix));
+    for (int i = 0; i < DspSource::MaxChannels; i++)
+        matrix[i][i] = 1;
+}
+
+void DspMixer::prepare(int channels)
+{
+    this->channels = channels;
+}
+
+bool DspMixer::isActive() const
+{
+    return active;
+}
+
+void DspMixer::setCoefficient(int output, int input, float value)
+{
+    if (output < 0 || input < 0 || output >= DspSource::MaxChannels || input >= DspSource::MaxChannels)
+        return;
+    matrix[output][input] = value;
+    active = false;
+    for (int o = 0; o < channels; o++) {
+        for (int i = 0; i < channels; i++)
+            active = active || matrix[o][i] != (o == i ? 1 : 0);
+    }
+}
+
+void DspMixer::process(float *samples, int frames)
+{
+    if (!active)
+        return;
+    float in[DspSource::MaxChannels];
+    for (int f = 0; f < frames; f++, samples += channels) {
+        memcpy(in, samples, size_t(channels) * sizeof(float));
+        for (int o = 0; o < channels; o++) {
+            float sum = 0;
+            for (int i = 0; i < channels; i++)
+                sum += matrix[o][i] * in[i];
+            samples[o] = sum;
+        }
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef DSPSTAGES_H
+#define DSPSTAGES_H
+
+#include "audioringbuffer.h"
+#include "lockfreequeue.h"
+#include <QAudioFormat>
+#include <QByteArray>
+#include <QVector>
+
+class DspSource
+{
+public:
+    enum { MaxChannels = 8, BlockFrames = 1024 };
+
+    virtual ~DspSource() {}
+    virtual int pull(float *samples, int frames) = 0;
+};
+
+class DspCrossfader : public DspSource
+{
+public:
+    DspCrossfader(AudioRingBuffer *buffer, const QAudioFormat &format);
+    bool isSupported() const;
+    bool isActive() const;
+    void setDuration(int msecs);
+    bool addBoundary(qint64 frame);
+    int pull(float *samples, int frames) override;
+    int passThrough(char *data, int frames);
+    qint64 position() const;
+    void reset();
+
+private:
+    enum SampleFormat { Unsupported, Int16, Float32 };
+
+    int read(float *samples, int frames);
+    void toFloat(const char *data, float *samples, int count) const;
+    void nextBoundary();
+
+    AudioRingBuffer *buffer;
+    LockFreeQueue<qint64, 64> boundaries;
+    SampleFormat sampleFormat;
+    int channels;
+    int bytesPerFrame;
+    int sampleRate;
+    QByteArray raw;
+    QVector<float> incoming;
+    int fadeFrames;
+    qint64 frames;
+    qint64 boundary;
+    qint64 fadeStart;
+    qint64 fadeLength;
+    qint64 skip;
+};
+
+class DspResampler
+{
+public:
+    enum { Taps = 16, Phases = 64 };
+
+    DspResampler();
+    void prepare(int channels);
+    bool isActive() const;
+    void setRatio(float ratio);
+    int render(float *samples, int frames, DspSource *source);
+    void reset();
+
+private:
+    void buildTable(double cutoff);
+
+    int channels;
+    float ratio;
+    double cutoff;
+    double position;
+    int count;
+    int capacity;
+    QVector<float> input;
+    QVector<float> table;
+};
+
+class DspEqualizer
+{
+public:
+    enum { MaxBands = 8 };
+    enum BandType { Peak, LowShelf, HighShelf };
+    enum Parameter { Type, Frequency, Gain, Q, ParametersPerBand };
+
+    DspEqualizer();
+    void prepare(int sampleRate, int channels);
+    bool isActive() const;
+    void setParameter(int parameter, float value);
+    void process(float *samples, int frames);
+    void reset();
+
+private:
+    struct Band
+    {
+        int type;
+        float frequency;
+        float gain;
+        float q;
+        double b0, b1, b2, a1, a2;
+        double z1[DspSource::MaxChannels];
+        double z2[DspSource::MaxChannels];
+    };
+
+    void update(Band &band);
+
+    Band bands[MaxBands];
+    int sampleRate;
+    int channels;
+    bool active;
+};
+
+class DspMixer
+{
+public:
+    DspMixer();
+    void prepare(int channels);
+    bool isActive() const;
+    void setCoefficient(int output, int input, float value);
+    void process(float *samples, int frames);
+
+private:
+    float matrix[DspSource::MaxChannels][DspSource::MaxChannels];
+    int channels;
+    bool active;
+};
+
+#endif // DSPSTAGES_H
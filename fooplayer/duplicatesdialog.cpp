@@ -0,0 +1,140 @@
+#include "duplicatesdialog.h"
+#include "acousticfingerprint.h"
+#include <QTreeWidget>
+#include <QHeaderView>
+#include <QProgressBar>
+#include <QLabel>
+#include <QVBoxLayout>
+#include <QDir>
+#include <QElapsedTimer>
+
+DuplicatesDialog::DuplicatesDialog(Library *library, const QStringList &playlistNames, QWidget *parent) :
+    QDialog(parent), library(library), names(playlistNames)
+{
+    setWindowTitle(tr("Duplicates"));
+    setAttribute(Qt::WA_DeleteOnClose);
+    resize(720, 480);
+    tree = new QTreeWidget(this);
+    tree->setHeaderLabels(QStringList() << tr("Title") << tr("Artist") << tr("Playlist") << tr("Path"));
+    tree->setRootIsDecorated(true);
+    tree->setUniformRowHeights(true);
+    progressBar = new QProgressBar(this);
+    status = new QLabel(this);
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(tree);
+    layout->addWidget(progressBar);
+    layout->addWidget(status);
+    connect(tree, SIGNAL(itemActivated(QTreeWidgetItem*,int)), this, SLOT(itemActivated(QTreeWidgetItem*,int)));
+
+    for (int playlist = 0; playlist < library->count(); playlist++) {
+        const PlaylistModel *model = library->model(playlist);
+        for (int row = 0; row < model->rowCount(); row++) {
+            const QString path = model->path(row);
+            QHash<QString, int>::const_iterator it = pathIndex.constFind(path);
+            int index;
+            if (it == pathIndex.constEnd()) {
+                index = paths.size();
+                pathIndex.insert(path, index);
+                paths.append(path);
+                entries.append(QVector<Entry>());
+            } else {
+                index = it.value();
+            }
+            const Entry entry = { playlist, row };
+            entries[index].append(entry);
+        }
+    }
+    fingerprints.resize(paths.size());
+
+    scanner = new FingerprintScanner(this);
+    scanner->setCache(library->cache());
+    connect(scanner, SIGNAL(fingerprinted(QStringList,QVector<QByteArray>)), this, SLOT(fingerprinted(QStringList,QVector<QByteArray>)));
+    connect(scanner, SIGNAL(progress(int,int)), this, SLOT(scanProgress(int,int)));
+    connect(scanner, SIGNAL(finished(int,int,qint64)), this, SLOT(scanFinished(int,int,qint64)));
+    progressBar->setMaximum(paths.size());
+    status->setText(tr("Fingerprinting %n track(s)...", 0, paths.size()));
+    scanner->scan(paths);
+}
+
+void DuplicatesDialog::fingerprinted(const QStringList &paths, const QVector<QByteArray> &fingerprints)
+{
+    for (int i = 0; i < paths.size(); i++) {
+        const int index = pathIndex.value(paths.at(i), -1);
+        if (index >= 0)
+            this->fingerprints[index] = fingerprints.at(i);
+    }
+}
+
+void DuplicatesDialog::scanProgress(int done, int total)
+{
+    progressBar->setMaximum(total);
+    progressBar->setValue(done);
+}
+
+void DuplicatesDialog::scanFinished(int files, int cached, qint64 msecs)
+{
+    library->cache()->save();
+    qint64 bytes = 0;
+    foreach (const QByteArray &fingerprint, fingerprints)
+        bytes += fingerprint.size();
+    const int computed = files - cached;
+    progressBar->hide();
+    showGroups(tr("Fingerprinted %1 track(s) in %2 ms, %3 tracks/min, %4 from cache, %5 bytes per fingerprint")
+               .arg(computed).arg(msecs).arg(qRound(computed * 60000.0 / qMax<qint64>(1, msecs)))
+               .arg(cached).arg(bytes / qMax(1, files)));
+}
+
+void DuplicatesDialog::showGroups(const QString &scanSummary)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const QVector<QVector<int> > matches = AcousticFingerprint::group(fingerprints);
+    QVector<bool> grouped(paths.size(), false);
+    QVector<QVector<int> > groups;
+    foreach (const QVector<int> &match, matches) {
+        foreach (int index, match)
+            grouped[index] = true;
+        groups.append(match);
+    }
+    // The same file listed more than once is a duplicate whatever its fingerprint.
+    for (int i = 0; i < paths.size(); i++) {
+        if (!grouped.at(i) && entries.at(i).size() > 1)
+            groups.append(QVector<int>() << i);
+    }
+
+    tree->clear();
+    QList<QTreeWidgetItem *> items;
+    foreach (const QVector<int> &group, groups) {
+        QTreeWidgetItem *parent = 0;
+        int copies = 0;
+        foreach (int index, group) {
+            foreach (const Entry &entry, entries.at(index)) {
+                const PlaylistModel *model = library->model(entry.playlist);
+                if (!parent)
+                    parent = new QTreeWidgetItem(QStringList() << model->title(entry.row) << model->track(entry.row).artist);
+                QTreeWidgetItem *item = new QTreeWidgetItem(parent, QStringList() << model->title(entry.row) << model->track(entry.row).artist
+                                                            << names.value(entry.playlist) << QDir::toNativeSeparators(paths.at(index)));
+                item->setData(0, Qt::UserRole, entry.playlist);
+                item->setData(0, Qt::UserRole + 1, entry.row);
+                copies++;
+            }
+        }
+        if (!parent)
+            continue;
+        parent->setText(2, tr("%n copies", 0, copies));
+        items.append(parent);
+    }
+    tree->addTopLevelItems(items);
+    tree->expandAll();
+    tree->header()->resizeSections(QHeaderView::ResizeToContents);
+    status->setText(scanSummary + '\n' + tr("%n group(s) of duplicates among %1 files, grouped in %2 ms", 0, items.size())
+                    .arg(paths.size()).arg(timer.elapsed()));
+}
+
+void DuplicatesDialog::itemActivated(QTreeWidgetItem *item, int column)
+{
+    Q_UNUSED(column);
+    if (!item->parent())
+        return;
+    emit trackActivated(item->data(0, Qt::UserRole).toInt(), item->data(0, Qt::UserRole + 1).toInt());
+}
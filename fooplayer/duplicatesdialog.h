@@ -0,0 +1,52 @@
+#ifndef DUPLICATESDIALOG_H
+#define DUPLICATESDIALOG_H
+
+#include "library.h"
+#include "fingerprintscanner.h"
+#include <QDialog>
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+
+class QTreeWidget;
+class QTreeWidgetItem;
+class QProgressBar;
+class QLabel;
+
+class DuplicatesDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    DuplicatesDialog(Library *library, const QStringList &playlistNames, QWidget *parent = nullptr);
+
+signals:
+    void trackActivated(int playlist, int row);
+
+private slots:
+    void fingerprinted(const QStringList &paths, const QVector<QByteArray> &fingerprints);
+    void scanProgress(int done, int total);
+    void scanFinished(int files, int cached, qint64 msecs);
+    void itemActivated(QTreeWidgetItem *item, int column);
+
+private:
+    struct Entry
+    {
+        int playlist;
+        int row;
+    };
+
+    void showGroups(const QString &scanSummary);
+
+    Library *library;
+    QStringList names;
+    FingerprintScanner *scanner;
+    QTreeWidget *tree;
+    QProgressBar *progressBar;
+    QLabel *status;
+    QStringList paths;
+    QHash<QString, int> pathIndex;
+    QVector<QByteArray> fingerprints;
+    QVector<QVector<Entry> > entries;
+};
+
+#endif // DUPLICATESDIALOG_H
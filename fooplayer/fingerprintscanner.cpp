@@ -0,0 +1,149 @@
+#include "fingerprintscanner.h"
+#include "acousticfingerprint.h"
+#include "profiler.h"
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QTimer>
+#include <QFileInfo>
+#include <QDateTime>
+
+static const int batchSize = 16;
+
+struct FingerprintJob
+{
+    QStringList paths;
+    MetadataCache *cache;
+    QAtomicInt next;
+    QAtomicInt done;
+    QAtomicInt cached;
+    QAtomicInt cancelled;
+    QMutex mutex;
+    QStringList finishedPaths;
+    QVector<QByteArray> fingerprints;
+};
+
+class FingerprintTask : public QRunnable
+{
+public:
+    explicit FingerprintTask(const QSharedPointer<FingerprintJob> &job) : job(job) {}
+
+    void run() override
+    {
+        QStringList paths;
+        QVector<QByteArray> fingerprints;
+        while (!job->cancelled.load()) {
+            const int i = job->next.fetchAndAddRelaxed(1);
+            if (i >= job->paths.size())
+                break;
+            const QString &path = job->paths.at(i);
+            const QFileInfo fileInfo(path);
+            TrackInfo info;
+            const bool known = job->cache && fileInfo.exists()
+                    && job->cache->lookup(path, fileInfo.lastModified().toMSecsSinceEpoch(), fileInfo.size(), info);
+            if (known && !info.acoustic.isEmpty()) {
+                job->cached.ref();
+            } else {
+                PROFILE_SCOPE("fingerprint.compute");
+                if (!known)
+                    info = TagReader::read(path);
+                info.acoustic = AcousticFingerprint::fromFile(path);
+                if (job->cache && info.valid && !info.acoustic.isEmpty())
+                    job->cache->insert(info);
+            }
+            paths.append(path);
+            fingerprints.append(info.acoustic);
+            if (paths.size() >= batchSize)
+                publish(paths, fingerprints);
+        }
+        publish(paths, fingerprints);
+    }
+
+private:
+    void publish(QStringList &paths, QVector<QByteArray> &fingerprints)
+    {
+        if (paths.isEmpty())
+            return;
+        QMutexLocker locker(&job->mutex);
+        job->finishedPaths += paths;
+        job->fingerprints += fingerprints;
+        job->done.fetchAndAddRelaxed(paths.size());
+        paths.clear();
+        fingerprints.clear();
+    }
+
+    QSharedPointer<FingerprintJob> job;
+};
+
+FingerprintScanner::FingerprintScanner(QObject *parent) : QObject(parent), cache(0)
+{
+    flushTimer = new QTimer(this);
+    flushTimer->setInterval(100);
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+FingerprintScanner::~FingerprintScanner()
+{
+    cancel();
+}
+
+void FingerprintScanner::scan(const QStringList &paths)
+{
+    cancel();
+    job = QSharedPointer<FingerprintJob>(new FingerprintJob);
+    job->paths = paths;
+    job->cache = cache;
+    elapsed.start();
+
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const int tasks = qMin(pool->maxThreadCount(), paths.size());
+    for (int i = 0; i < tasks; i++)
+        pool->start(new FingerprintTask(job));
+    flushTimer->start();
+}
+
+void FingerprintScanner::setCache(MetadataCache *cache)
+{
+    this->cache = cache;
+}
+
+void FingerprintScanner::cancel()
+{
+    flushTimer->stop();
+    if (job) {
+        job->cancelled.store(1);
+        job.clear();
+    }
+}
+
+bool FingerprintScanner::isRunning() const
+{
+    return !job.isNull();
+}
+
+void FingerprintScanner::flush()
+{
+    if (!job)
+        return;
+    QStringList paths;
+    QVector<QByteArray> fingerprints;
+    int done;
+    {
+        QMutexLocker locker(&job->mutex);
+        paths.swap(job->finishedPaths);
+        fingerprints.swap(job->fingerprints);
+        done = job->done.load();
+    }
+    const int total = job->paths.size();
+    if (!paths.isEmpty()) {
+        emit fingerprinted(paths, fingerprints);
+        emit progress(done, total);
+    }
+    if (job && done >= total) {
+        const int cached = job->cached.load();
+        flushTimer->stop();
+        job.clear();
+        emit finished(total, cached, elapsed.elapsed());
+    }
+}
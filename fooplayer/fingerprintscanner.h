@@ -0,0 +1,41 @@
+#ifndef FINGERPRINTSCANNER_H
+#define FINGERPRINTSCANNER_H
+
+#include "metadatacache.h"
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QSharedPointer>
+#include <QElapsedTimer>
+
+class QTimer;
+
+struct FingerprintJob;
+
+class FingerprintScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FingerprintScanner(QObject *parent = nullptr);
+    ~FingerprintScanner();
+    void scan(const QStringList &paths);
+    void setCache(MetadataCache *cache);
+    void cancel();
+    bool isRunning() const;
+
+signals:
+    void fingerprinted(const QStringList &paths, const QVector<QByteArray> &fingerprints);
+    void progress(int done, int total);
+    void finished(int files, int cached, qint64 msecs);
+
+private slots:
+    void flush();
+
+private:
+    QSharedPointer<FingerprintJob> job;
+    QTimer *flushTimer;
+    QElapsedTimer elapsed;
+    MetadataCache *cache;
+};
+
+#endif // FINGERPRINTSCANNER_H
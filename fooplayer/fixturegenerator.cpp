@@ -0,0 +1,239 @@
+#include "fixturegenerator.h"
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+
+static const int sampleRate = 44100;
+static const int flacBlockSize = 4096;
+
+static const char *const syllables[] = { "ka", "lo", "mi", "ren", "tor", "sa", "vel", "din", "ro", "e", "an", "bri", "us", "qua", "zel", "fo" };
+
+static QString word(quint32 seed)
+{
+    QString text;
+    seed = seed * 1664525 + 1013904223;
+    const int count = 2 + (seed >> 28) % 3;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1664525 + 1013904223;
+        text += QLatin1String(syllables[(seed >> 24) % 16]);
+    }
+    text[0] = text.at(0).toUpper();
+    return text;
+}
+
+static void appendBigEndian(QByteArray &out, quint32 value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--)
+        out.append(char(value >> (8 * i)));
+}
+
+static void appendLittleEndian(QByteArray &out, quint32 value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        out.append(char(value >> (8 * i)));
+}
+
+static QByteArray id3v2Frame(const char *id, const QString &text)
+{
+    const QByteArray body = char(3) + text.toUtf8();
+    QByteArray frame(id);
+    for (int i = 3; i >= 0; i--)
+        frame.append(char((body.size() >> (7 * i)) & 0x7f));
+    frame.append(2, 0);
+    return frame + body;
+}
+
+static QByteArray riffChunk(const char *id, const QByteArray &data)
+{
+    QByteArray chunk(id);
+    appendLittleEndian(chunk, quint32(data.size()), 4);
+    chunk += data;
+    if (data.size() & 1)
+        chunk.append(char(0));
+    return chunk;
+}
+
+static quint8 crc8(const QByteArray &data)
+{
+    quint8 crc = 0;
+    for (int i = 0; i < data.size(); i++) {
+        crc ^= quint8(data.at(i));
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? quint8((crc << 1) ^ 0x07) : quint8(crc << 1);
+    }
+    return crc;
+}
+
+static quint16 crc16(const QByteArray &data)
+{
+    quint16 crc = 0;
+    for (int i = 0; i < data.size(); i++) {
+        crc ^= quint16(quint8(data.at(i)) << 8);
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? quint16((crc << 1) ^ 0x8005) : quint16(crc << 1);
+    }
+    return crc;
+}
+
+static void appendUtf8Number(QByteArray &out, quint32 value)
+{
+    if (value < 0x80) {
+        out.append(char(value));
+    } else if (value < 0x800) {
+        out.append(char(0xc0 | (value >> 6)));
+        out.append(char(0x80 | (value & 0x3f)));
+    } else if (value < 0x10000) {
+        out.append(char(0xe0 | (value >> 12)));
+        out.append(char(0x80 | ((value >> 6) & 0x3f)));
+        out.append(char(0x80 | (value & 0x3f)));
+    } else {
+        out.append(char(0xf0 | (value >> 18)));
+        out.append(char(0x80 | ((value >> 12) & 0x3f)));
+        out.append(char(0x80 | ((value >> 6) & 0x3f)));
+        out.append(char(0x80 | (value & 0x3f)));
+    }
+}
+
+TrackInfo FixtureGenerator::track(int index)
+{
+    TrackInfo info;
+    const quint32 album = quint32(index / 10);
+    info.artist = word(album / 4 * 7919 + 1);
+    info.album = word(album * 104729 + 2) + ' ' + word(album * 15485863 + 3);
+    info.title = word(quint32(index) * 2654435761u + 4) + ' ' + word(quint32(index) * 40503 + 5);
+    info.trackNumber = index % 10 + 1;
+    info.hasTrackGain = true;
+    info.trackGain = -float(index % 90) / 10;
+    info.trackPeak = 0.5f + float(index % 50) / 100;
+    return info;
+}
+
+QByteArray FixtureGenerator::mp3(const TrackInfo &track, int seconds, bool vbr)
+{
+    QByteArray frames = id3v2Frame("TIT2", track.title) + id3v2Frame("TPE1", track.artist)
+            + id3v2Frame("TALB", track.album) + id3v2Frame("TRCK", QString::number(track.trackNumber))
+            + id3v2Frame("TXXX", QString("REPLAYGAIN_TRACK_GAIN") + QChar(0) + QString::number(track.trackGain, 'f', 2) + " dB");
+    QByteArray out("ID3\x04\x00\x00", 6);
+    for (int i = 3; i >= 0; i--)
+        out.append(char((frames.size() >> (7 * i)) & 0x7f));
+    out += frames;
+
+    // MPEG-1 Layer III, 128 kbit/s, 44.1 kHz, joint stereo; zeroed side info decodes as silence.
+    QByteArray frame(417, 0);
+    frame[0] = char(0xff);
+    frame[1] = char(0xfb);
+    frame[2] = char(0x90);
+    frame[3] = char(0x44);
+    const int count = seconds * sampleRate / 1152 + 1;
+    if (!vbr) {
+        out.reserve(out.size() + count * frame.size());
+        for (int i = 0; i < count; i++)
+            out += frame;
+        return out;
+    }
+
+    // Cycle pseudo-randomly through 32, 48 and 64 kbit/s frames without a Xing header.
+    static const int bitrates[3][2] = { { 0x10, 104 }, { 0x30, 156 }, { 0x50, 208 } };
+    out.reserve(out.size() + count * 156);
+    quint32 seed = 1;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        const int *bitrate = bitrates[(seed >> 16) % 3];
+        frame.fill(0, bitrate[1]);
+        frame[0] = char(0xff);
+        frame[1] = char(0xfb);
+        frame[2] = char(bitrate[0]);
+        frame[3] = char(0x44);
+        out += frame;
+    }
+    return out;
+}
+
+QByteArray FixtureGenerator::flac(const TrackInfo &track, int seconds)
+{
+    const int blocks = qMax(1, seconds * sampleRate / flacBlockSize);
+    QByteArray out("fLaC");
+    out.append(char(0));
+    appendBigEndian(out, 34, 3);
+    appendBigEndian(out, flacBlockSize, 2);
+    appendBigEndian(out, flacBlockSize, 2);
+    appendBigEndian(out, 0, 3);
+    appendBigEndian(out, 0, 3);
+    const quint64 samples = quint64(blocks) * flacBlockSize;
+    // 20 bits sample rate, 3 bits channels - 1, 5 bits bits per sample - 1, 36 bits total samples.
+    appendBigEndian(out, (quint32(sampleRate) << 12) | (1 << 9) | (15 << 4) | quint32(samples >> 32), 4);
+    appendBigEndian(out, quint32(samples), 4);
+    out.append(16, 0);
+
+    QStringList comments;
+    comments << "TITLE=" + track.title << "ARTIST=" + track.artist << "ALBUM=" + track.album
+             << "TRACKNUMBER=" + QString::number(track.trackNumber)
+             << "REPLAYGAIN_TRACK_GAIN=" + QString::number(track.trackGain, 'f', 2) + " dB"
+             << "REPLAYGAIN_TRACK_PEAK=" + QString::number(track.trackPeak, 'f', 6);
+    QByteArray block;
+    const QByteArray vendor("fooplayer");
+    appendLittleEndian(block, quint32(vendor.size()), 4);
+    block += vendor;
+    appendLittleEndian(block, quint32(comments.size()), 4);
+    foreach (const QString &comment, comments) {
+        const QByteArray text = comment.toUtf8();
+        appendLittleEndian(block, quint32(text.size()), 4);
+        block += text;
+    }
+    out.append(char(0x84));
+    appendBigEndian(out, quint32(block.size()), 3);
+    out += block;
+
+    // Fixed 4096-sample blocks of two CONSTANT zero subframes at 16 bits.
+    for (int i = 0; i < blocks; i++) {
+        QByteArray frame("\xff\xf8\xc9\x18", 4);
+        appendUtf8Number(frame, quint32(i));
+        frame.append(char(crc8(frame)));
+        frame.append(6, 0);
+        appendBigEndian(frame, crc16(frame), 2);
+        out += frame;
+    }
+    return out;
+}
+
+QByteArray FixtureGenerator::wave(const TrackInfo &track, int seconds)
+{
+    QByteArray format;
+    appendLittleEndian(format, 1, 2);
+    appendLittleEndian(format, 2, 2);
+    appendLittleEndian(format, sampleRate, 4);
+    appendLittleEndian(format, sampleRate * 4, 4);
+    appendLittleEndian(format, 4, 2);
+    appendLittleEndian(format, 16, 2);
+
+    QByteArray info("INFO");
+    info += riffChunk("INAM", track.title.toUtf8() + '\0');
+    info += riffChunk("IART", track.artist.toUtf8() + '\0');
+    info += riffChunk("IPRD", track.album.toUtf8() + '\0');
+    info += riffChunk("ITRK", QByteArray::number(track.trackNumber) + '\0');
+
+    const QByteArray body = QByteArray("WAVE") + riffChunk("fmt ", format) + riffChunk("LIST", info)
+            + riffChunk("data", QByteArray(seconds * sampleRate * 4, 0));
+    return riffChunk("RIFF", body);
+}
+
+int FixtureGenerator::generate(const QString &directory, int count, int seconds)
+{
+    static const char *const suffixes[] = { "mp3", "flac", "wav" };
+    int written = 0;
+    for (int i = 0; i < count; i++) {
+        const TrackInfo info = track(i);
+        const Format format = Format(i % 3);
+        const QString folder = directory + '/' + info.artist + '/' + info.album;
+        if (!QDir().mkpath(folder))
+            break;
+        QFile file(QString("%1/%2 %3.%4").arg(folder).arg(info.trackNumber, 2, 10, QChar('0')).arg(info.title).arg(suffixes[format]));
+        if (!file.open(QIODevice::WriteOnly))
+            break;
+        const QByteArray data = format == Mp3 ? mp3(info, seconds) : format == Flac ? flac(info, seconds) : wave(info, seconds);
+        if (file.write(data) != data.size())
+            break;
+        written++;
+    }
+    return written;
+}
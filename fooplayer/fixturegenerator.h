@@ -0,0 +1,20 @@
+#ifndef FIXTUREGENERATOR_H
+#define FIXTUREGENERATOR_H
+
+#include "tagreader.h"
+#include <QString>
+#include <QByteArray>
+
+class FixtureGenerator
+{
+public:
+    enum Format { Mp3, Flac, Wave };
+
+    static int generate(const QString &directory, int count, int seconds);
+    static TrackInfo track(int index);
+    static QByteArray mp3(const TrackInfo &track, int seconds, bool vbr = false);
+    static QByteArray flac(const TrackInfo &track, int seconds);
+    static QByteArray wave(const TrackInfo &track, int seconds);
+};
+
+#endif // FIXTUREGENERATOR_H
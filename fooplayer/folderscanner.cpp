@@ -0,0 +1,186 @@
+#include "folderscanner.h"
+#include <QThread>
+#include <QRunnable>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QQueue>
+#include <QSet>
+#include <QTimer>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <algorithm>
+
+static const int maxScanThreads = 4;
+
+struct FolderScanJob
+{
+    QMutex mutex;
+    QWaitCondition condition;
+    QQueue<QString> queue;
+    QSet<QString> visited;
+    int active = 0;
+    QAtomicInt cancelled;
+    QAtomicInt directories;
+    QAtomicInt files;
+    int workers = 0;
+    QStringList found;
+    QStringList foundDirectories;
+};
+
+class FolderScanTask : public QRunnable
+{
+public:
+    explicit FolderScanTask(const QSharedPointer<FolderScanJob> &job) : job(job) {}
+
+    void run() override
+    {
+        QString directory;
+        while (take(directory)) {
+            QStringList files;
+            QStringList directories;
+            const QFileInfoList entries = QDir(directory).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+            foreach (const QFileInfo &entry, entries) {
+                if (job->cancelled.load())
+                    break;
+                if (entry.isDir())
+                    directories.append(entry.isSymLink() ? entry.canonicalFilePath() : entry.absoluteFilePath());
+                else if (entry.isFile() && FolderScanner::isAudioFile(entry.absoluteFilePath()))
+                    files.append(entry.absoluteFilePath());
+            }
+            job->directories.ref();
+            job->files.fetchAndAddRelaxed(files.size());
+            finish(directory, directories, files);
+        }
+    }
+
+private:
+    bool take(QString &directory)
+    {
+        QMutexLocker locker(&job->mutex);
+        while (job->queue.isEmpty() && job->active > 0 && !job->cancelled.load())
+            job->condition.wait(&job->mutex);
+        if (job->queue.isEmpty() || job->cancelled.load()) {
+            job->workers--;
+            job->condition.wakeAll();
+            return false;
+        }
+        directory = job->queue.dequeue();
+        job->active++;
+        return true;
+    }
+
+    void finish(const QString &directory, const QStringList &directories, const QStringList &files)
+    {
+        QMutexLocker locker(&job->mutex);
+        foreach (const QString &path, directories) {
+            const QString canonical = QFileInfo(path).canonicalFilePath();
+            if (canonical.isEmpty() || job->visited.contains(canonical))
+                continue;
+            job->visited.insert(canonical);
+            job->queue.enqueue(path);
+        }
+        job->found += files;
+        job->foundDirectories.append(directory);
+        job->active--;
+        job->condition.wakeAll();
+    }
+
+    QSharedPointer<FolderScanJob> job;
+};
+
+FolderScanner::FolderScanner(QObject *parent) : QObject(parent)
+{
+    flushTimer = new QTimer(this);
+    flushTimer->setInterval(250);
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+    pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), maxScanThreads));
+}
+
+FolderScanner::~FolderScanner()
+{
+    cancel();
+    pool.waitForDone();
+}
+
+void FolderScanner::scan(const QString &directory)
+{
+    cancel();
+    job = QSharedPointer<FolderScanJob>(new FolderScanJob);
+    const QFileInfo root(directory);
+    job->visited.insert(root.canonicalFilePath());
+    job->queue.enqueue(root.absoluteFilePath());
+    elapsed.start();
+
+    job->workers = pool.maxThreadCount();
+    for (int i = 0; i < job->workers; i++)
+        pool.start(new FolderScanTask(job));
+    flushTimer->start();
+}
+
+void FolderScanner::cancel()
+{
+    flushTimer->stop();
+    if (job) {
+        QMutexLocker locker(&job->mutex);
+        job->cancelled.store(1);
+        job->condition.wakeAll();
+        locker.unlock();
+        job.clear();
+    }
+}
+
+bool FolderScanner::isRunning() const
+{
+    return !job.isNull();
+}
+
+bool FolderScanner::isAudioFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray head = file.read(12);
+    if (head.size() < 4)
+        return false;
+    const uchar *p = reinterpret_cast<const uchar *>(head.constData());
+    if (head.startsWith("ID3") || head.startsWith("fLaC") || head.startsWith("OggS"))
+        return true;
+    if (head.size() >= 12 && head.startsWith("RIFF") && head.mid(8, 4) == "WAVE")
+        return true;
+    if (head.size() >= 12 && head.mid(4, 4) == "ftyp") {
+        const QByteArray brand = head.mid(8, 4);
+        return brand == "M4A " || brand == "M4B " || brand == "mp42" || brand == "isom";
+    }
+    return p[0] == 0xff && (p[1] & 0xe0) == 0xe0 && (p[1] & 0x18) != 0x08 && (p[1] & 0x06) != 0
+        && (p[2] & 0xf0) != 0xf0 && (p[2] & 0x0c) != 0x0c;
+}
+
+void FolderScanner::flush()
+{
+    if (!job)
+        return;
+    QStringList files;
+    QStringList directories;
+    bool done;
+    {
+        QMutexLocker locker(&job->mutex);
+        files.swap(job->found);
+        directories.swap(job->foundDirectories);
+        done = job->workers == 0;
+    }
+    if (!directories.isEmpty())
+        emit directoriesFound(directories);
+    if (!files.isEmpty()) {
+        std::sort(files.begin(), files.end());
+        emit filesFound(files);
+    }
+    if (done) {
+        const int dirCount = job->directories.load();
+        const int fileCount = job->files.load();
+        flushTimer->stop();
+        job.clear();
+        emit finished(dirCount, fileCount, elapsed.elapsed());
+    }
+}
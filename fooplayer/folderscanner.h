@@ -0,0 +1,41 @@
+#ifndef FOLDERSCANNER_H
+#define FOLDERSCANNER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QSharedPointer>
+#include <QElapsedTimer>
+#include <QThreadPool>
+
+class QTimer;
+
+struct FolderScanJob;
+
+class FolderScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FolderScanner(QObject *parent = nullptr);
+    ~FolderScanner();
+    void scan(const QString &directory);
+    void cancel();
+    bool isRunning() const;
+
+    static bool isAudioFile(const QString &path);
+
+signals:
+    void filesFound(const QStringList &files);
+    void directoriesFound(const QStringList &directories);
+    void finished(int directories, int files, qint64 msecs);
+
+private slots:
+    void flush();
+
+private:
+    QSharedPointer<FolderScanJob> job;
+    QThreadPool pool;
+    QTimer *flushTimer;
+    QElapsedTimer elapsed;
+};
+
+#endif // FOLDERSCANNER_H
@@ -4,12 +4,13 @@
 #
 #-------------------------------------------------
 
-QT       += core gui multimedia
+QT       += core gui multimedia concurrent network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = fooplayer
 TEMPLATE = app
+CONFIG += c++11
 
 # The following define makes your compiler emit warnings if you use
 # any feature of Qt which has been marked as deprecated (the exact warnings
@@ -23,11 +24,7 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 
-SOURCES += \
-        main.cpp \
-        player.cpp \
-    playercontrols.cpp
+include(core.pri)
 
-HEADERS += \
-        player.h \
-    playercontrols.h
+SOURCES += \
+        main.cpp
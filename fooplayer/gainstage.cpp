@@ -0,0 +1,272 @@
+#include "gainstage.h"
+#include <QElapsedTimer>
+#include <QtMath>
+
+#if defined(Q_PROCESSOR_X86) && (defined(Q_CC_GNU) || defined(Q_CC_CLANG))
+#define GAINSTAGE_X86
+#include <immintrin.h>
+#endif
+
+// Peaks above the ceiling are pulled down on the sample that would overshoot and the gain
+// reduction recovers exponentially, so boosted peaks duck briefly instead of clipping.
+static const float limiterCeiling = 0.977f;
+static const float limiterReleaseMilliseconds = 80;
+
+typedef void (*Int16Kernel)(qint16 *samples, int count, float gain);
+typedef void (*FloatKernel)(float *samples, int count, float gain);
+
+struct GainKernels
+{
+    const char *name;
+    Int16Kernel int16;
+    FloatKernel float32;
+};
+
+static void scaleInt16Scalar(qint16 *samples, int count, float gain)
+{
+    for (int i = 0; i < count; i++)
+        samples[i] = qint16(qBound(-32768, qRound(samples[i] * gain), 32767));
+}
+
+static void scaleFloatScalar(float *samples, int count, float gain)
+{
+    for (int i = 0; i < count; i++)
+        samples[i] = qBound(-1.0f, samples[i] * gain, 1.0f);
+}
+
+#ifdef GAINSTAGE_X86
+__attribute__((target("sse2")))
+static void scaleInt16Sse2(qint16 *samples, int count, float gain)
+{
+    const __m128 factor = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + i));
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        const __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo), factor));
+        const __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi), factor));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(samples + i), _mm_packs_epi32(a, b));
+    }
+    scaleInt16Scalar(samples + i, count - i, gain);
+}
+
+__attribute__((target("sse2")))
+static void scaleFloatSse2(float *samples, int count, float gain)
+{
+    const __m128 factor = _mm_set1_ps(gain);
+    const __m128 high = _mm_set1_ps(1.0f);
+    const __m128 low = _mm_set1_ps(-1.0f);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 x = _mm_mul_ps(_mm_loadu_ps(samples + i), factor);
+        _mm_storeu_ps(samples + i, _mm_max_ps(low, _mm_min_ps(high, x)));
+    }
+    scaleFloatScalar(samples + i, count - i, gain);
+}
+
+__attribute__((target("avx2")))
+static void scaleInt16Avx2(qint16 *samples, int count, float gain)
+{
+    const __m256 factor = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + i));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + i + 8));
+        const __m256i a = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(lo)), factor));
+        const __m256i b = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(hi)), factor));
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(samples + i), packed);
+    }
+    scaleInt16Scalar(samples + i, count - i, gain);
+}
+
+__attribute__((target("avx2")))
+static void scaleFloatAvx2(float *samples, int count, float gain)
+{
+    const __m256 factor = _mm256_set1_ps(gain);
+    const __m256 high = _mm256_set1_ps(1.0f);
+    const __m256 low = _mm256_set1_ps(-1.0f);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 x = _mm256_mul_ps(_mm256_loadu_ps(samples + i), factor);
+        _mm256_storeu_ps(samples + i, _mm256_max_ps(low, _mm256_min_ps(high, x)));
+    }
+    scaleFloatScalar(samples + i, count - i, gain);
+}
+#endif
+
+static GainKernels selectKernels()
+{
+#ifdef GAINSTAGE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        const GainKernels avx2 = { "avx2", scaleInt16Avx2, scaleFloatAvx2 };
+        return avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        const GainKernels sse2 = { "sse2", scaleInt16Sse2, scaleFloatSse2 };
+        return sse2;
+    }
+#endif
+    const GainKernels scalar = { "scalar", scaleInt16Scalar, scaleFloatScalar };
+    return scalar;
+}
+
+static const GainKernels &kernels()
+{
+    static const GainKernels selected = selectKernels();
+    return selected;
+}
+
+GainStage::GainStage(const QAudioFormat &format) :
+    sampleFormat(Unsupported), channels(qMax(1, format.channelCount())), bytesPerFrame(format.bytesPerFrame()),
+    current(1), target(1), step(0), envelope(1), release(1), rampRemaining(0)
+{
+    if (format.sampleRate() > 0)
+        release = 1 - qExp(-1000.0 / (limiterReleaseMilliseconds * format.sampleRate()));
+    if (format.byteOrder() != QAudioFormat::LittleEndian || QSysInfo::ByteOrder != QSysInfo::LittleEndian)
+        return;
+    if (format.sampleType() == QAudioFormat::SignedInt && format.sampleSize() == 16)
+        sampleFormat = Int16;
+    else if (format.sampleType() == QAudioFormat::Float && format.sampleSize() == 32)
+        sampleFormat = Float32;
+    kernels();
+}
+
+bool GainStage::isSupported() const
+{
+    return sampleFormat != Unsupported;
+}
+
+qreal GainStage::gain() const
+{
+    return target;
+}
+
+void GainStage::setGain(qreal gain, int rampFrames)
+{
+    target = float(gain);
+    if (rampFrames <= 0 || target == current) {
+        current = target;
+        rampRemaining = 0;
+        return;
+    }
+    step = (target - current) / rampFrames;
+    rampRemaining = rampFrames;
+}
+
+void GainStage::process(char *data, int bytes)
+{
+    if (sampleFormat == Unsupported)
+        return;
+    int frames = bytes / bytesPerFrame;
+    if (rampRemaining > 0) {
+        const int ramped = qMin(frames, rampRemaining);
+        ramp(data, ramped);
+        data += ramped * bytesPerFrame;
+        frames -= ramped;
+    }
+    if (frames == 0 || (current == 1.0f && envelope == 1.0f))
+        return;
+    if (current > 1.0f || envelope < 1.0f)
+        limit(data, frames, current);
+    else if (sampleFormat == Int16)
+        kernels().int16(reinterpret_cast<qint16 *>(data), frames * channels, current);
+    else
+        kernels().float32(reinterpret_cast<float *>(data), frames * channels, current);
+}
+
+void GainStage::ramp(char *data, int frames)
+{
+    for (int i = 0; i < frames; i++) {
+        current += step;
+        if (--rampRemaining == 0)
+            current = target;
+        if (current > 1.0f || envelope < 1.0f)
+            limit(data + i * bytesPerFrame, 1, current);
+        else if (sampleFormat == Int16)
+            scaleInt16Scalar(reinterpret_cast<qint16 *>(data) + i * channels, channels, current);
+        else
+            scaleFloatScalar(reinterpret_cast<float *>(data) + i * channels, channels, current);
+    }
+}
+
+void GainStage::limit(char *data, int frames, float gain)
+{
+    const float scale = sampleFormat == Int16 ? 1.0f / 32768 : 1.0f;
+    for (int i = 0; i < frames; i++) {
+        char *frame = data + i * bytesPerFrame;
+        float peak = 0;
+        for (int c = 0; c < channels; c++) {
+            const float sample = sampleFormat == Int16 ? reinterpret_cast<const qint16 *>(frame)[c] : reinterpret_cast<const float *>(frame)[c];
+            peak = qMax(peak, qAbs(sample) * scale * gain);
+        }
+        const float wanted = peak > limiterCeiling ? limiterCeiling / peak : 1.0f;
+        envelope = qMin(wanted, envelope + (1.0f - envelope) * release);
+        if (envelope > 0.9999f && wanted == 1.0f)
+            envelope = 1.0f;
+        if (sampleFormat == Int16)
+            scaleInt16Scalar(reinterpret_cast<qint16 *>(frame), channels, gain * envelope);
+        else
+            scaleFloatScalar(reinterpret_cast<float *>(frame), channels, gain * envelope);
+    }
+}
+
+qreal GainStage::replayGain(const TrackInfo &info, ReplayGainMode mode)
+{
+    if (mode == ReplayGainOff || (!info.hasTrackGain && !info.hasAlbumGain))
+        return 1;
+    const bool album = info.hasAlbumGain && (mode == ReplayGainAlbum || !info.hasTrackGain);
+    const qreal gain = qPow(10, (album ? info.albumGain : info.trackGain) / 20.0);
+    const qreal peak = album ? info.albumPeak : info.trackPeak;
+    return peak > 0 ? qMin(gain, 1 / peak) : gain;
+}
+
+const char *GainStage::kernel()
+{
+    return kernels().name;
+}
+
+// Processes the same noise block at a fixed gain, restoring it between passes outside the
+// timed region so the data neither decays into denormals nor stays in the limiter's release.
+double GainStage::benchmark(QAudioFormat::SampleType type, int msecs, qreal gain)
+{
+    QAudioFormat format;
+    format.setSampleRate(44100);
+    format.setChannelCount(2);
+    format.setSampleSize(type == QAudioFormat::Float ? 32 : 16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(type);
+    GainStage stage(format);
+    if (!stage.isSupported())
+        return 0;
+
+    const int frames = 16384;
+    QByteArray data(frames * format.bytesPerFrame(), Qt::Uninitialized);
+    quint32 seed = 1;
+    for (int i = 0; i < frames * 2; i++) {
+        seed = seed * 1664525 + 1013904223;
+        if (type == QAudioFormat::Float)
+            reinterpret_cast<float *>(data.data())[i] = qint16(seed >> 16) / 32768.0f;
+        else
+            reinterpret_cast<qint16 *>(data.data())[i] = qint16(seed >> 16);
+    }
+
+    const QByteArray source = data;
+    stage.setGain(gain, 0);
+    QElapsedTimer wall;
+    QElapsedTimer timer;
+    qint64 samples = 0;
+    qint64 busy = 0;
+    wall.start();
+    do {
+        memcpy(data.data(), source.constData(), size_t(data.size()));
+        timer.start();
+        stage.process(data.data(), data.size());
+        busy += timer.nsecsElapsed();
+        samples += frames * 2;
+    } while (wall.elapsed() < msecs);
+    return samples * 1e9 / qMax<qint64>(1, busy);
+}
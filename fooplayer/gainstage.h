@@ -0,0 +1,39 @@
+#ifndef GAINSTAGE_H
+#define GAINSTAGE_H
+
+#include "tagreader.h"
+#include <QAudioFormat>
+
+class GainStage
+{
+public:
+    enum ReplayGainMode { ReplayGainOff, ReplayGainTrack, ReplayGainAlbum };
+
+    explicit GainStage(const QAudioFormat &format);
+    bool isSupported() const;
+    qreal gain() const;
+    void setGain(qreal gain, int rampFrames);
+    void process(char *data, int bytes);
+
+    static qreal replayGain(const TrackInfo &info, ReplayGainMode mode);
+    static const char *kernel();
+    static double benchmark(QAudioFormat::SampleType type, int msecs, qreal gain = 0.5);
+
+private:
+    enum SampleFormat { Unsupported, Int16, Float32 };
+
+    void ramp(char *data, int frames);
+    void limit(char *data, int frames, float gain);
+
+    SampleFormat sampleFormat;
+    int channels;
+    int bytesPerFrame;
+    float current;
+    float target;
+    float step;
+    float envelope;
+    float release;
+    int rampRemaining;
+};
+
+#endif // GAINSTAGE_H
@@ -0,0 +1,314 @@
+#include "headlessplayer.h"
+#include <QStandardPaths>
+#include <QTextStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QUrl>
+
+HeadlessPlayer::HeadlessPlayer(QObject *parent) :
+    QObject(parent), control(0), tail(0), transitions(0), scannedFiles(0), cachedFiles(0),
+    json(false), playing(false), audible(false), started(false), scanning(false), cold(false)
+{
+    library = new Library(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/metadata.cache", this);
+    PlaybackEngine *engine = library->engine();
+    connect(engine, SIGNAL(stateChanged(QMediaPlayer::State)), this, SLOT(stateChanged(QMediaPlayer::State)));
+    connect(engine, SIGNAL(durationChanged(qint64)), this, SLOT(durationChanged(qint64)));
+    connect(engine, SIGNAL(positionChanged(qint64)), this, SLOT(positionChanged(qint64)));
+    connect(engine, SIGNAL(trackTransition(qint64,qint64)), this, SLOT(trackTransition(qint64,qint64)));
+    connect(engine, SIGNAL(underrunsChanged(int)), this, SLOT(underrunsChanged(int)));
+    connect(library, SIGNAL(folderScanFinished(int,int,qint64)), this, SLOT(folderScanFinished(int,int,qint64)));
+    connect(library, SIGNAL(scanFinished(int,int,qint64)), this, SLOT(scanFinished(int,int,qint64)));
+    connect(library, SIGNAL(playlistImported(QString,int,int,qint64)), this, SLOT(playlistImported(QString,int,int,qint64)));
+    connect(library, SIGNAL(idle()), this, SLOT(idle()));
+}
+
+HeadlessPlayer::~HeadlessPlayer()
+{
+    delete control;
+    library->cancel();
+    delete library;
+}
+
+void HeadlessPlayer::setJson(bool json)
+{
+    this->json = json;
+}
+
+void HeadlessPlayer::setTail(qint64 milliseconds)
+{
+    tail = milliseconds;
+}
+
+void HeadlessPlayer::setColdScan(bool cold)
+{
+    this->cold = cold;
+    library->setColdScan(cold);
+}
+
+void HeadlessPlayer::setBufferDepth(int milliseconds)
+{
+    library->engine()->setBufferDepth(milliseconds);
+}
+
+void HeadlessPlayer::play(const QStringList &paths)
+{
+    elapsed.start();
+    library->playlist(0)->setPlaybackMode(QMediaPlaylist::Sequential);
+    add(paths);
+    if (library->playlist(0)->mediaCount() > 0)
+        start();
+    else if (!library->isBusy())
+        emit finished(1);
+}
+
+void HeadlessPlayer::scan(const QString &directory)
+{
+    elapsed.start();
+    scanning = true;
+    library->addFolder(directory, 0);
+}
+
+int HeadlessPlayer::dump(const QStringList &paths)
+{
+    QStringList files;
+    foreach (const QString &path, paths) {
+        if (QFileInfo(path).isDir()) {
+            QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+            while (it.hasNext()) {
+                const QString file = it.next();
+                if (FolderScanner::isAudioFile(file))
+                    files.append(file);
+            }
+        } else if (PlaylistReader::isPlaylist(path)) {
+            if (!library->importPlaylist(path, files))
+                importFailed(path);
+        } else {
+            files.append(path);
+        }
+    }
+
+    int failed = 0;
+    foreach (const QString &file, files) {
+        QElapsedTimer timer;
+        timer.start();
+        const TrackInfo info = TagReader::read(file);
+        QVariantMap fields;
+        fields["path"] = file;
+        fields["valid"] = info.valid;
+        fields["title"] = info.title;
+        fields["artist"] = info.artist;
+        fields["album"] = info.album;
+        fields["track"] = info.trackNumber;
+        fields["bitrate"] = info.bitrate;
+        fields["length"] = info.length;
+        fields["size"] = info.size;
+        if (info.hasTrackGain) {
+            fields["trackGain"] = info.trackGain;
+            fields["trackPeak"] = info.trackPeak;
+        }
+        if (info.hasAlbumGain) {
+            fields["albumGain"] = info.albumGain;
+            fields["albumPeak"] = info.albumPeak;
+        }
+        fields["usecs"] = timer.nsecsElapsed() / 1000;
+        report("track", fields);
+        if (!info.valid)
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
+
+// Keeps running as a playback core that front-ends drive over the control socket.
+bool HeadlessPlayer::serve(const QString &name)
+{
+    elapsed.start();
+    control = new ControlServer(library, this);
+    connect(control, SIGNAL(trackRequested(int,int)), this, SLOT(playTrack(int,int)));
+    QVariantMap fields;
+    fields["name"] = name;
+    if (!control->listen(name)) {
+        fields["error"] = control->errorString();
+        report("serveFailed", fields);
+        return false;
+    }
+    report("serving", fields);
+    return true;
+}
+
+void HeadlessPlayer::add(const QStringList &paths)
+{
+    QList<QUrl> urls;
+    foreach (const QString &path, paths) {
+        if (QFileInfo(path).isDir())
+            library->addFolder(path, 0);
+        else
+            urls.append(QUrl::fromUserInput(path, QDir::currentPath(), QUrl::AssumeLocalFile));
+    }
+    QStringList unreadable;
+    library->addUrls(urls, 0, &unreadable);
+    foreach (const QString &path, unreadable)
+        importFailed(path);
+}
+
+void HeadlessPlayer::start()
+{
+    if (started)
+        return;
+    started = true;
+    library->playlist(0)->setCurrentIndex(0);
+    library->engine()->play();
+}
+
+void HeadlessPlayer::stateChanged(QMediaPlayer::State state)
+{
+    if (state == QMediaPlayer::PlayingState) {
+        playing = true;
+    } else if (state == QMediaPlayer::StoppedState && playing) {
+        playing = false;
+        QVariantMap fields;
+        fields["tracks"] = library->playlist(0)->mediaCount();
+        fields["transitions"] = transitions;
+        fields["underruns"] = library->engine()->underruns();
+        fields["msecs"] = elapsed.elapsed();
+        report("stopped", fields);
+        if (!control)
+            emit finished(0);
+    }
+}
+
+void HeadlessPlayer::durationChanged(qint64 duration)
+{
+    if (tail > 0 && duration > tail && library->engine()->position() < duration - tail)
+        library->engine()->setPosition(duration - tail);
+}
+
+void HeadlessPlayer::positionChanged(qint64 position)
+{
+    if (position <= 0 || !playing || audible)
+        return;
+    audible = true;
+    QVariantMap fields;
+    fields["index"] = library->engine()->currentIndex();
+    fields["msecs"] = elapsed.elapsed();
+    report("playing", fields);
+}
+
+void HeadlessPlayer::trackTransition(qint64 latency, qint64 headroom)
+{
+    transitions++;
+    QVariantMap fields;
+    fields["index"] = library->engine()->currentIndex();
+    fields["latency"] = latency;
+    fields["headroom"] = headroom;
+    fields["underruns"] = library->engine()->underruns();
+    StreamCache *streams = library->streamCache();
+    if (streams->hitBytes() + streams->missBytes() > 0)
+        fields["cacheHitRatio"] = streams->hitRatio();
+    report("transition", fields);
+}
+
+void HeadlessPlayer::underrunsChanged(int underruns)
+{
+    QVariantMap fields;
+    fields["index"] = library->engine()->currentIndex();
+    fields["underruns"] = underruns;
+    fields["bufferDepth"] = library->engine()->bufferDepth();
+    fields["msecs"] = elapsed.elapsed();
+    report("underrun", fields);
+}
+
+void HeadlessPlayer::folderScanFinished(int directories, int files, qint64 msecs)
+{
+    QVariantMap fields;
+    fields["directories"] = directories;
+    fields["files"] = files;
+    fields["msecs"] = msecs;
+    fields["directoriesPerSecond"] = directories * 1000 / qMax<qint64>(1, msecs);
+    fields["filesPerSecond"] = files * 1000 / qMax<qint64>(1, msecs);
+    report("walk", fields);
+    if (!scanning && library->playlist(0)->mediaCount() > 0)
+        start();
+}
+
+void HeadlessPlayer::scanFinished(int files, int cached, qint64 msecs)
+{
+    scannedFiles += files;
+    cachedFiles += cached;
+    QVariantMap fields;
+    fields["files"] = files;
+    fields["cached"] = cached;
+    fields["msecs"] = msecs;
+    fields["filesPerSecond"] = files * 1000 / qMax<qint64>(1, msecs);
+    fields["cold"] = cold;
+    report("tags", fields);
+}
+
+void HeadlessPlayer::playlistImported(const QString &fileName, int entries, int lines, qint64 msecs)
+{
+    QVariantMap fields;
+    fields["path"] = fileName;
+    fields["entries"] = entries;
+    fields["lines"] = lines;
+    fields["msecs"] = msecs;
+    report("import", fields);
+}
+
+void HeadlessPlayer::importFailed(const QString &fileName)
+{
+    QVariantMap fields;
+    fields["path"] = fileName;
+    report("importFailed", fields);
+}
+
+void HeadlessPlayer::idle()
+{
+    if (!scanning) {
+        if (!started && !control)
+            emit finished(1);
+        return;
+    }
+    scanning = false;
+    const qint64 msecs = elapsed.elapsed();
+    QVariantMap fields;
+    fields["files"] = scannedFiles;
+    fields["cached"] = cachedFiles;
+    fields["msecs"] = msecs;
+    fields["filesPerSecond"] = scannedFiles * 1000 / qMax<qint64>(1, msecs);
+    fields["cold"] = cold;
+    report("scan", fields);
+    if (!control)
+        emit finished(0);
+}
+
+void HeadlessPlayer::playTrack(int playlist, int row)
+{
+    started = true;
+    library->setCurrentPlaylist(playlist);
+    library->playlist(playlist)->setCurrentIndex(row);
+    library->engine()->play();
+}
+
+void HeadlessPlayer::report(const QString &event, const QVariantMap &fields)
+{
+    printEvent(event, fields, json);
+}
+
+void HeadlessPlayer::printEvent(const QString &event, const QVariantMap &fields, bool json)
+{
+    QTextStream out(stdout);
+    if (json) {
+        QJsonObject object = QJsonObject::fromVariantMap(fields);
+        object.insert("event", event);
+        out << QJsonDocument(object).toJson(QJsonDocument::Compact) << endl;
+        return;
+    }
+    out << event;
+    QMapIterator<QString, QVariant> it(fields);
+    while (it.hasNext()) {
+        it.next();
+        out << ' ' << it.key() << '=' << it.value().toString();
+    }
+    out << endl;
+}
@@ -0,0 +1,63 @@
+#ifndef HEADLESSPLAYER_H
+#define HEADLESSPLAYER_H
+
+#include "library.h"
+#include "controlserver.h"
+#include <QObject>
+#include <QStringList>
+#include <QVariantMap>
+#include <QElapsedTimer>
+
+class HeadlessPlayer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HeadlessPlayer(QObject *parent = nullptr);
+    ~HeadlessPlayer();
+    void setJson(bool json);
+    void setTail(qint64 milliseconds);
+    void setColdScan(bool cold);
+    void setBufferDepth(int milliseconds);
+    void play(const QStringList &paths);
+    void scan(const QString &directory);
+    int dump(const QStringList &paths);
+    bool serve(const QString &name);
+    static void printEvent(const QString &event, const QVariantMap &fields, bool json);
+
+signals:
+    void finished(int code);
+
+private slots:
+    void stateChanged(QMediaPlayer::State state);
+    void durationChanged(qint64 duration);
+    void positionChanged(qint64 position);
+    void trackTransition(qint64 latency, qint64 headroom);
+    void underrunsChanged(int underruns);
+    void folderScanFinished(int directories, int files, qint64 msecs);
+    void scanFinished(int files, int cached, qint64 msecs);
+    void playlistImported(const QString &fileName, int entries, int lines, qint64 msecs);
+    void idle();
+    void playTrack(int playlist, int row);
+
+private:
+    void report(const QString &event, const QVariantMap &fields);
+    void importFailed(const QString &fileName);
+    void add(const QStringList &paths);
+    void start();
+
+    Library *library;
+    ControlServer *control;
+    QElapsedTimer elapsed;
+    qint64 tail;
+    int transitions;
+    int scannedFiles;
+    int cachedFiles;
+    bool json;
+    bool playing;
+    bool audible;
+    bool started;
+    bool scanning;
+    bool cold;
+};
+
+#endif // HEADLESSPLAYER_H
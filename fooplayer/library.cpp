@@ -0,0 +1,335 @@
+#include "library.h"
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QFileInfo>
+
+static const qint64 streamCacheBytes = Q_INT64_C(1024) * 1024 * 1024;
+
+Library::Library(const QString &cacheFileName, QObject *parent) :
+    QObject(parent), current(0), watching(false), coldScan(false)
+{
+    player = new PlaybackEngine(this);
+    metadataCache = new MetadataCache(cacheFileName);
+    seekIndexes = new SeekIndexCache(QFileInfo(cacheFileName).absolutePath() + "/seek");
+    streams = new StreamCache(QFileInfo(cacheFileName).absolutePath() + "/stream", streamCacheBytes);
+    player->setSeekIndexCache(seekIndexes);
+    player->setStreamCache(streams);
+    player->setMetadataCache(metadataCache);
+    addPlaylist();
+    setCurrentPlaylist(0);
+}
+
+Library::~Library()
+{
+    cancel();
+    metadataCache->save();
+    delete player;
+    delete metadataCache;
+    delete seekIndexes;
+    delete streams;
+    qDeleteAll(playlistVector);
+    qDeleteAll(modelVector);
+}
+
+PlaybackEngine *Library::engine() const
+{
+    return player;
+}
+
+MetadataCache *Library::cache() const
+{
+    return metadataCache;
+}
+
+StreamCache *Library::streamCache() const
+{
+    return streams;
+}
+
+int Library::count() const
+{
+    return modelVector.size();
+}
+
+QMediaPlaylist *Library::playlist(int row) const
+{
+    return playlistVector.at(row);
+}
+
+PlaylistModel *Library::model(int row) const
+{
+    return modelVector.at(row);
+}
+
+const QVector<PlaylistModel*> &Library::models() const
+{
+    return modelVector;
+}
+
+int Library::indexOf(PlaylistModel *model) const
+{
+    return modelVector.indexOf(model);
+}
+
+void Library::setCurrentPlaylist(int row)
+{
+    current = playlistVector.at(row);
+    player->setPlaylist(current);
+}
+
+int Library::currentPlaylist() const
+{
+    return playlistVector.indexOf(current);
+}
+
+int Library::addPlaylist()
+{
+    QMediaPlaylist *playlist = new QMediaPlaylist(this);
+    playlist->setPlaybackMode(QMediaPlaylist::Loop);
+    playlistVector.append(playlist);
+    modelVector.append(new PlaylistModel(this));
+    return modelVector.size() - 1;
+}
+
+bool Library::removePlaylist(int row)
+{
+    if (playlistVector.at(row) == current)
+        return false;
+    delete playlistVector.at(row);
+    delete modelVector.at(row);
+    playlistVector.remove(row);
+    modelVector.remove(row);
+    checkIdle();
+    return true;
+}
+
+// Returns false if any of the playlists among the urls could not be opened; their names
+// are appended to unreadable.
+bool Library::addUrls(const QList<QUrl> &urls, int row, QStringList *unreadable)
+{
+    QStringList paths;
+    bool ok = true;
+    foreach (const QUrl &url, urls) {
+        const QString path = url.isLocalFile() ? url.toLocalFile() : url.toString();
+        if (!PlaylistReader::isPlaylist(path)) {
+            paths.append(path);
+        } else if (!importPlaylist(path, paths)) {
+            ok = false;
+            if (unreadable)
+                unreadable->append(path);
+        }
+    }
+    addPaths(paths, row);
+    return ok;
+}
+
+bool Library::importPlaylist(const QString &fileName, QStringList &paths)
+{
+    PlaylistReader reader(fileName);
+    QElapsedTimer timer;
+    timer.start();
+    if (!reader.open())
+        return false;
+    const int first = paths.size();
+    QString path;
+    while (reader.next(path))
+        paths.append(path);
+    emit playlistImported(fileName, paths.size() - first, reader.lines(), timer.elapsed());
+    return true;
+}
+
+void Library::addPaths(const QStringList &added, int row)
+{
+    PlaylistModel *playlistModel = modelVector.at(row);
+    const QStringList paths = playlistModel->newPaths(added);
+    if (paths.isEmpty())
+        return;
+    QList<QMediaContent> media;
+    QVector<TrackInfo> tracks;
+    media.reserve(paths.size());
+    tracks.reserve(paths.size());
+    int firstRow = playlistModel->rowCount();
+    foreach (const QString &path, paths) {
+        media.append(QMediaContent(path.contains("://") ? QUrl(path) : QUrl::fromLocalFile(path)));
+        TrackInfo track;
+        track.path = path;
+        tracks.append(track);
+    }
+    playlistVector.at(row)->addMedia(media);
+    playlistModel->appendTracks(tracks);
+
+    TagScanner *scanner = new TagScanner(playlistModel);
+    scanner->setCache(coldScan ? 0 : metadataCache);
+    scanner->setColdCache(coldScan);
+    connect(scanner, SIGNAL(tracksScanned(QVector<int>,QVector<TrackInfo>)), this, SLOT(tracksScanned(QVector<int>,QVector<TrackInfo>)));
+    connect(scanner, SIGNAL(progress(int,int)), this, SIGNAL(scanProgress(int,int)));
+    connect(scanner, SIGNAL(finished(int,int,qint64)), this, SLOT(tagScanFinished(int,int,qint64)));
+    scanner->scan(paths, firstRow);
+}
+
+void Library::appendTracks(int row, const QVector<TrackInfo> &tracks)
+{
+    if (tracks.isEmpty())
+        return;
+    QList<QMediaContent> media;
+    media.reserve(tracks.size());
+    foreach (const TrackInfo &track, tracks)
+        media.append(QMediaContent(track.path.contains("://") ? QUrl(track.path) : QUrl::fromLocalFile(track.path)));
+    playlistVector.at(row)->addMedia(media);
+    modelVector.at(row)->appendTracks(tracks);
+}
+
+void Library::tracksScanned(const QVector<int> &rows, const QVector<TrackInfo> &tracks)
+{
+    TagScanner *scanner = qobject_cast<TagScanner *>(sender());
+    PlaylistModel *model = scanner ? qobject_cast<PlaylistModel *>(scanner->parent()) : 0;
+    if(model)
+        model->updateTracks(rows, tracks);
+}
+
+void Library::tagScanFinished(int files, int cached, qint64 msecs)
+{
+    metadataCache->save();
+    sender()->deleteLater();
+    emit scanFinished(files, cached, msecs);
+    checkIdle();
+}
+
+void Library::addFolder(const QString &directory, int row)
+{
+    FolderScanner *scanner = new FolderScanner(modelVector.at(row));
+    connect(scanner, SIGNAL(filesFound(QStringList)), this, SLOT(folderFilesFound(QStringList)));
+    connect(scanner, SIGNAL(directoriesFound(QStringList)), this, SLOT(folderDirectoriesFound(QStringList)));
+    connect(scanner, SIGNAL(finished(int,int,qint64)), this, SLOT(folderFinished(int,int,qint64)));
+    scanner->scan(directory);
+}
+
+void Library::folderFilesFound(const QStringList &files)
+{
+    const int row = modelVector.indexOf(qobject_cast<PlaylistModel *>(sender()->parent()));
+    if (row >= 0)
+        addPaths(files, row);
+}
+
+void Library::folderDirectoriesFound(const QStringList &directories)
+{
+    PlaylistModel *model = qobject_cast<PlaylistModel *>(sender()->parent());
+    if (!model || !watching)
+        return;
+    LibraryWatcher *watcher = model->findChild<LibraryWatcher *>();
+    if (!watcher) {
+        watcher = new LibraryWatcher(model, model);
+        connect(watcher, SIGNAL(filesAdded(PlaylistModel*,QStringList)), this, SLOT(libraryFilesAdded(PlaylistModel*,QStringList)));
+        connect(watcher, SIGNAL(filesRemoved(PlaylistModel*,QStringList)), this, SLOT(libraryFilesRemoved(PlaylistModel*,QStringList)));
+        connect(watcher, SIGNAL(folderAdded(PlaylistModel*,QString)), this, SLOT(libraryFolderAdded(PlaylistModel*,QString)));
+    }
+    watcher->watch(directories);
+}
+
+void Library::folderFinished(int directories, int files, qint64 msecs)
+{
+    sender()->deleteLater();
+    emit folderScanFinished(directories, files, msecs);
+    checkIdle();
+}
+
+void Library::libraryFilesAdded(PlaylistModel *model, const QStringList &files)
+{
+    const int row = modelVector.indexOf(model);
+    if (row >= 0)
+        addPaths(files, row);
+}
+
+void Library::libraryFolderAdded(PlaylistModel *model, const QString &directory)
+{
+    const int row = modelVector.indexOf(model);
+    if (row >= 0)
+        addFolder(directory, row);
+}
+
+void Library::libraryFilesRemoved(PlaylistModel *model, const QStringList &files)
+{
+    const int row = modelVector.indexOf(model);
+    if (row >= 0)
+        removePaths(files, row);
+}
+
+void Library::removePaths(const QStringList &paths, int row)
+{
+    PlaylistModel *model = modelVector.at(row);
+    QSet<QString> keys;
+    foreach (const QString &path, paths)
+        keys.insert(PlaylistModel::pathKey(path));
+    for (int i = model->rowCount() - 1; i >= 0; i--) {
+        if (keys.contains(PlaylistModel::pathKey(model->path(i)))) {
+            model->removeRow(i);
+            playlistVector.at(row)->removeMedia(i);
+        }
+    }
+}
+
+void Library::reorder(int row, const QVector<int> &order)
+{
+    QMediaPlaylist *target = playlistVector.at(row);
+    if (target == current) {
+        player->reorderPlaylist(order);
+    } else {
+        QList<QMediaContent> media;
+        media.reserve(order.size());
+        foreach (int index, order)
+            media.append(target->media(index));
+        target->clear();
+        target->addMedia(media);
+    }
+    modelVector.at(row)->permute(order);
+}
+
+void Library::setWatchFolders(bool watch)
+{
+    watching = watch;
+}
+
+bool Library::watchFolders() const
+{
+    return watching;
+}
+
+// Cold scans read every tag from disk: the metadata cache is bypassed and each file is
+// evicted from the page cache first where the platform allows it.
+void Library::setColdScan(bool cold)
+{
+    coldScan = cold;
+}
+
+bool Library::isBusy() const
+{
+    foreach (PlaylistModel *model, modelVector) {
+        foreach (TagScanner *scanner, model->findChildren<TagScanner *>()) {
+            if (scanner->isRunning())
+                return true;
+        }
+        foreach (FolderScanner *scanner, model->findChildren<FolderScanner *>()) {
+            if (scanner->isRunning())
+                return true;
+        }
+    }
+    return false;
+}
+
+void Library::cancel()
+{
+    foreach (PlaylistModel *model, modelVector) {
+        foreach (TagScanner *scanner, model->findChildren<TagScanner *>())
+            scanner->cancel();
+        foreach (FolderScanner *scanner, model->findChildren<FolderScanner *>())
+            scanner->cancel();
+    }
+    QThreadPool::globalInstance()->waitForDone();
+}
+
+void Library::checkIdle()
+{
+    if (!isBusy())
+        emit idle();
+}
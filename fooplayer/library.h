@@ -0,0 +1,81 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "playbackengine.h"
+#include "playlistmodel.h"
+#include "metadatacache.h"
+#include "tagscanner.h"
+#include "folderscanner.h"
+#include "librarywatcher.h"
+#include "playlistreader.h"
+#include <QObject>
+#include <QMediaPlaylist>
+#include <QVector>
+#include <QList>
+#include <QUrl>
+
+class Library : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Library(const QString &cacheFileName, QObject *parent = nullptr);
+    ~Library();
+    PlaybackEngine *engine() const;
+    MetadataCache *cache() const;
+    StreamCache *streamCache() const;
+    int count() const;
+    QMediaPlaylist *playlist(int row) const;
+    PlaylistModel *model(int row) const;
+    const QVector<PlaylistModel*> &models() const;
+    int indexOf(PlaylistModel *model) const;
+    void setCurrentPlaylist(int row);
+    int currentPlaylist() const;
+    int addPlaylist();
+    bool removePlaylist(int row);
+    bool addUrls(const QList<QUrl> &urls, int row, QStringList *unreadable = 0);
+    void addPaths(const QStringList &paths, int row);
+    void appendTracks(int row, const QVector<TrackInfo> &tracks);
+    void addFolder(const QString &directory, int row);
+    void removePaths(const QStringList &paths, int row);
+    void reorder(int row, const QVector<int> &order);
+    bool importPlaylist(const QString &fileName, QStringList &paths);
+    bool watchFolders() const;
+    void setColdScan(bool cold);
+    bool isBusy() const;
+    void cancel();
+
+public slots:
+    void setWatchFolders(bool watch);
+
+signals:
+    void scanProgress(int done, int total);
+    void scanFinished(int files, int cached, qint64 msecs);
+    void folderScanFinished(int directories, int files, qint64 msecs);
+    void playlistImported(const QString &fileName, int entries, int lines, qint64 msecs);
+    void idle();
+
+private slots:
+    void tracksScanned(const QVector<int> &rows, const QVector<TrackInfo> &tracks);
+    void tagScanFinished(int files, int cached, qint64 msecs);
+    void folderFilesFound(const QStringList &files);
+    void folderDirectoriesFound(const QStringList &directories);
+    void folderFinished(int directories, int files, qint64 msecs);
+    void libraryFilesAdded(PlaylistModel *model, const QStringList &files);
+    void libraryFilesRemoved(PlaylistModel *model, const QStringList &files);
+    void libraryFolderAdded(PlaylistModel *model, const QString &directory);
+
+private:
+    void checkIdle();
+
+    PlaybackEngine *player;
+    MetadataCache *metadataCache;
+    SeekIndexCache *seekIndexes;
+    StreamCache *streams;
+    QVector<QMediaPlaylist*> playlistVector;
+    QVector<PlaylistModel*> modelVector;
+    QMediaPlaylist *current;
+    bool watching;
+    bool coldScan;
+};
+
+#endif // LIBRARY_H
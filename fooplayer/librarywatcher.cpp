@@ -0,0 +1,102 @@
+#include "librarywatcher.h"
+#include "folderscanner.h"
+#include <QFileSystemWatcher>
+#include <QFileInfo>
+#include <QDir>
+
+LibraryWatcher::LibraryWatcher(PlaylistModel *model, QObject *parent) :
+    QObject(parent), playlistModel(model)
+{
+    watcher = new QFileSystemWatcher(this);
+    connect(watcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
+    if (model) {
+        connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(rowsInserted(QModelIndex,int,int)));
+        connect(model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)), this, SLOT(rowsAboutToBeRemoved(QModelIndex,int,int)));
+        connect(model, SIGNAL(modelReset()), this, SLOT(modelReset()));
+        modelReset();
+    }
+}
+
+PlaylistModel *LibraryWatcher::model() const
+{
+    return playlistModel;
+}
+
+void LibraryWatcher::watch(const QStringList &directories)
+{
+    if (!directories.isEmpty())
+        watcher->addPaths(directories);
+}
+
+int LibraryWatcher::directoryCount() const
+{
+    return watcher->directories().size();
+}
+
+void LibraryWatcher::directoryChanged(const QString &directory)
+{
+    if (!playlistModel)
+        return;
+    QStringList removed;
+    QSet<QString> known;
+    foreach (const QString &path, directoryFiles.value(PlaylistModel::pathKey(directory))) {
+        if (QFile::exists(path))
+            known.insert(PlaylistModel::pathKey(path));
+        else
+            removed.append(path);
+    }
+
+    QStringList added;
+    const QSet<QString> watched = watcher->directories().toSet();
+    const QFileInfoList entries = QDir(directory).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+    foreach (const QFileInfo &entry, entries) {
+        if (entry.isDir()) {
+            if (!watched.contains(entry.absoluteFilePath()))
+                emit folderAdded(playlistModel, entry.absoluteFilePath());
+        } else if (entry.isFile() && !known.contains(PlaylistModel::pathKey(entry.absoluteFilePath()))
+                   && FolderScanner::isAudioFile(entry.absoluteFilePath())) {
+            added.append(entry.absoluteFilePath());
+        }
+    }
+    if (!QFileInfo::exists(directory))
+        watcher->removePath(directory);
+    if (!removed.isEmpty())
+        emit filesRemoved(playlistModel, removed);
+    if (!added.isEmpty())
+        emit filesAdded(playlistModel, added);
+}
+
+void LibraryWatcher::rowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent);
+    for (int row = first; row <= last; row++)
+        addRow(row);
+}
+
+void LibraryWatcher::rowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent);
+    for (int row = first; row <= last; row++) {
+        const QString path = playlistModel->path(row);
+        const QString key = PlaylistModel::pathKey(QFileInfo(path).absolutePath());
+        QHash<QString, QSet<QString> >::iterator it = directoryFiles.find(key);
+        if (it == directoryFiles.end())
+            continue;
+        it->remove(path);
+        if (it->isEmpty())
+            directoryFiles.erase(it);
+    }
+}
+
+void LibraryWatcher::modelReset()
+{
+    directoryFiles.clear();
+    for (int row = 0; row < playlistModel->rowCount(); row++)
+        addRow(row);
+}
+
+void LibraryWatcher::addRow(int row)
+{
+    const QString path = playlistModel->path(row);
+    directoryFiles[PlaylistModel::pathKey(QFileInfo(path).absolutePath())].insert(path);
+}
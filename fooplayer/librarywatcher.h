@@ -0,0 +1,41 @@
+#ifndef LIBRARYWATCHER_H
+#define LIBRARYWATCHER_H
+
+#include "playlistmodel.h"
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+
+class QFileSystemWatcher;
+
+class LibraryWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LibraryWatcher(PlaylistModel *model, QObject *parent = nullptr);
+    PlaylistModel *model() const;
+    void watch(const QStringList &directories);
+    int directoryCount() const;
+
+signals:
+    void filesAdded(PlaylistModel *model, const QStringList &files);
+    void filesRemoved(PlaylistModel *model, const QStringList &files);
+    void folderAdded(PlaylistModel *model, const QString &directory);
+
+private slots:
+    void directoryChanged(const QString &directory);
+    void rowsInserted(const QModelIndex &parent, int first, int last);
+    void rowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    void modelReset();
+
+private:
+    void addRow(int row);
+
+    QPointer<PlaylistModel> playlistModel;
+    QFileSystemWatcher *watcher;
+    QHash<QString, QSet<QString> > directoryFiles;
+};
+
+#endif // LIBRARYWATCHER_H
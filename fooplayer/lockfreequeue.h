@@ -0,0 +1,47 @@
+#ifndef LOCKFREEQUEUE_H
+#define LOCKFREEQUEUE_H
+
+#include <QAtomicInteger>
+
+// Single producer, single consumer. Neither side allocates or blocks, so the
+// consumer may be a real-time audio callback.
+template <typename T, int Capacity>
+class LockFreeQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    LockFreeQueue() : head(0), tail(0) {}
+
+    bool push(const T &value)
+    {
+        const quint32 written = tail.load();
+        if (written - head.loadAcquire() >= quint32(Capacity))
+            return false;
+        items[written & (Capacity - 1)] = value;
+        tail.storeRelease(written + 1);
+        return true;
+    }
+
+    bool pop(T &value)
+    {
+        const quint32 consumed = head.load();
+        if (consumed == tail.loadAcquire())
+            return false;
+        value = items[consumed & (Capacity - 1)];
+        head.storeRelease(consumed + 1);
+        return true;
+    }
+
+    int free() const
+    {
+        return Capacity - int(tail.loadAcquire() - head.loadAcquire());
+    }
+
+private:
+    T items[Capacity];
+    QAtomicInteger<quint32> head;
+    QAtomicInteger<quint32> tail;
+};
+
+#endif // LOCKFREEQUEUE_H
@@ -0,0 +1,278 @@
+#include "loudnessanalyzer.h"
+#include "loudnessmeter.h"
+#include "tagwriter.h"
+#include "pcmreader.h"
+#include "profiler.h"
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QTimer>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <algorithm>
+
+static const int readBytes = 65536;
+
+struct LoudnessJob
+{
+    QVector<TrackInfo> tracks;
+    QVector<int> albums;
+    QVector<QVector<int> > members;
+    QVector<int> remaining;
+    QVector<LoudnessResult> results;
+    QVector<TrackInfo> measured;
+    bool writeTags;
+    MetadataCache *cache;
+    QAtomicInt next;
+    QAtomicInt analyzed;
+    QAtomicInt done;
+    QAtomicInt failed;
+    QAtomicInt tagged;
+    QAtomicInt cancelled;
+    QMutex mutex;
+    qint64 frames;
+    QVector<TrackInfo> finished;
+};
+
+static bool longerThan(const TrackInfo &a, const TrackInfo &b)
+{
+    return a.length > b.length;
+}
+
+class LoudnessTask : public QRunnable
+{
+public:
+    explicit LoudnessTask(const QSharedPointer<LoudnessJob> &job) : job(job) {}
+
+    void run() override
+    {
+        while (!job->cancelled.load()) {
+            const int i = job->next.fetchAndAddRelaxed(1);
+            if (i >= job->tracks.size())
+                break;
+            const QString &path = job->tracks.at(i).path;
+            TrackInfo info = load(path);
+            LoudnessResult result;
+            {
+                PROFILE_SCOPE("loudness.track");
+                result = measure(path);
+            }
+            if (job->cancelled.load())
+                break;
+            if (result.valid) {
+                info.loudness = float(result.integrated);
+                info.loudnessRange = float(result.range);
+                info.trackGain = LoudnessMeter::replayGain(result.integrated);
+                info.trackPeak = float(result.truePeak);
+                info.hasLoudness = true;
+                info.hasTrackGain = true;
+            } else {
+                job->failed.ref();
+            }
+            job->analyzed.ref();
+            complete(i, info, result);
+        }
+    }
+
+private:
+    TrackInfo load(const QString &path)
+    {
+        const QFileInfo fileInfo(path);
+        TrackInfo info;
+        if (job->cache && fileInfo.exists() && job->cache->lookup(path, fileInfo.lastModified().toMSecsSinceEpoch(), fileInfo.size(), info))
+            return info;
+        return TagReader::read(path);
+    }
+
+    LoudnessResult measure(const QString &path)
+    {
+        QAudioFormat format;
+        format.setSampleRate(LoudnessMeter::SampleRate);
+        format.setChannelCount(LoudnessMeter::Channels);
+        format.setSampleSize(16);
+        format.setCodec("audio/pcm");
+        format.setByteOrder(QAudioFormat::LittleEndian);
+        format.setSampleType(QAudioFormat::SignedInt);
+        PcmReader reader(format);
+        LoudnessMeter meter;
+        if (!reader.open(path))
+            return meter.result();
+        while (!reader.atEnd() && !job->cancelled.load()) {
+            const QByteArray pcm = reader.read(readBytes);
+            meter.process(reinterpret_cast<const qint16 *>(pcm.constData()), pcm.size() / format.bytesPerFrame());
+        }
+        return meter.result();
+    }
+
+    // Album values need every track of the album, so whichever task measures the
+    // last one gates the pooled blocks and finishes the whole album.
+    void complete(int index, const TrackInfo &info, const LoudnessResult &result)
+    {
+        QVector<int> finishedTracks;
+        QVector<LoudnessResult> albumResults;
+        QVector<TrackInfo> tracks;
+        {
+            QMutexLocker locker(&job->mutex);
+            job->frames += result.frames;
+            const int album = job->albums.at(index);
+            if (album < 0) {
+                tracks.append(info);
+            } else {
+                job->results[index] = result;
+                job->measured[index] = info;
+                if (--job->remaining[album] == 0) {
+                    finishedTracks = job->members.at(album);
+                    foreach (int track, finishedTracks) {
+                        albumResults.append(job->results.at(track));
+                        tracks.append(job->measured.at(track));
+                        job->results[track] = LoudnessResult();
+                    }
+                }
+            }
+        }
+        if (!albumResults.isEmpty()) {
+            const LoudnessResult album = LoudnessMeter::combine(albumResults);
+            for (int i = 0; i < tracks.size() && album.valid; i++) {
+                if (!tracks.at(i).hasTrackGain)
+                    continue;
+                tracks[i].albumGain = LoudnessMeter::replayGain(album.integrated);
+                tracks[i].albumPeak = float(album.truePeak);
+                tracks[i].hasAlbumGain = true;
+            }
+        }
+        for (int i = 0; i < tracks.size(); i++)
+            store(tracks[i]);
+        publish(tracks);
+    }
+
+    void store(TrackInfo &info)
+    {
+        if (!info.hasLoudness)
+            return;
+        if (job->writeTags && TagWriter::writeReplayGain(info.path, info)) {
+            const QFileInfo fileInfo(info.path);
+            info.modified = fileInfo.lastModified().toMSecsSinceEpoch();
+            info.size = fileInfo.size();
+            job->tagged.ref();
+        }
+        if (job->cache && info.valid)
+            job->cache->insert(info);
+    }
+
+    void publish(const QVector<TrackInfo> &tracks)
+    {
+        if (tracks.isEmpty())
+            return;
+        QMutexLocker locker(&job->mutex);
+        job->finished += tracks;
+        job->done.fetchAndAddRelaxed(tracks.size());
+    }
+
+    QSharedPointer<LoudnessJob> job;
+};
+
+LoudnessAnalyzer::LoudnessAnalyzer(QObject *parent) : QObject(parent), cache(0), audioMsecs(0)
+{
+    flushTimer = new QTimer(this);
+    flushTimer->setInterval(100);
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+LoudnessAnalyzer::~LoudnessAnalyzer()
+{
+    cancel();
+}
+
+void LoudnessAnalyzer::analyze(const QVector<TrackInfo> &tracks, bool writeTags)
+{
+    cancel();
+    job = QSharedPointer<LoudnessJob>(new LoudnessJob);
+    // Longest tracks go first so a long one picked up last cannot leave one worker
+    // decoding alone after the others have drained the queue.
+    job->tracks = tracks;
+    std::stable_sort(job->tracks.begin(), job->tracks.end(), longerThan);
+    job->writeTags = writeTags;
+    job->cache = cache;
+    job->frames = 0;
+    job->results.resize(tracks.size());
+    job->measured.resize(tracks.size());
+    QHash<QString, int> albumIndex;
+    for (int i = 0; i < job->tracks.size(); i++) {
+        const TrackInfo &track = job->tracks.at(i);
+        int album = -1;
+        if (!track.album.isEmpty()) {
+            const QString key = QFileInfo(track.path).absolutePath() + QLatin1Char('\n') + track.album.toLower();
+            album = albumIndex.value(key, -1);
+            if (album < 0) {
+                album = job->members.size();
+                albumIndex.insert(key, album);
+                job->members.append(QVector<int>());
+                job->remaining.append(0);
+            }
+            job->members[album].append(i);
+            job->remaining[album]++;
+        }
+        job->albums.append(album);
+    }
+    audioMsecs = 0;
+    elapsed.start();
+
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const int tasks = qMin(pool->maxThreadCount(), tracks.size());
+    for (int i = 0; i < tasks; i++)
+        pool->start(new LoudnessTask(job));
+    flushTimer->start();
+}
+
+void LoudnessAnalyzer::setCache(MetadataCache *cache)
+{
+    this->cache = cache;
+}
+
+void LoudnessAnalyzer::cancel()
+{
+    flushTimer->stop();
+    if (job) {
+        job->cancelled.store(1);
+        job.clear();
+    }
+}
+
+bool LoudnessAnalyzer::isRunning() const
+{
+    return !job.isNull();
+}
+
+double LoudnessAnalyzer::realtimeFactor() const
+{
+    return double(audioMsecs) / qMax<qint64>(1, elapsed.elapsed());
+}
+
+void LoudnessAnalyzer::flush()
+{
+    if (!job)
+        return;
+    QVector<TrackInfo> tracks;
+    int done;
+    qint64 frames;
+    {
+        QMutexLocker locker(&job->mutex);
+        tracks.swap(job->finished);
+        done = job->done.load();
+        frames = job->frames;
+    }
+    const int total = job->tracks.size();
+    audioMsecs = frames * 1000 / LoudnessMeter::SampleRate;
+    if (!tracks.isEmpty())
+        emit tracksAnalyzed(tracks);
+    emit progress(job->analyzed.load(), total);
+    if (job && done >= total) {
+        const int failed = job->failed.load();
+        const int tagged = job->tagged.load();
+        flushTimer->stop();
+        job.clear();
+        emit finished(total, failed, tagged, audioMsecs, elapsed.elapsed());
+    }
+}
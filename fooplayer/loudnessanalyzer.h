@@ -0,0 +1,42 @@
+#ifndef LOUDNESSANALYZER_H
+#define LOUDNESSANALYZER_H
+
+#include "metadatacache.h"
+#include <QObject>
+#include <QVector>
+#include <QSharedPointer>
+#include <QElapsedTimer>
+
+class QTimer;
+
+struct LoudnessJob;
+
+class LoudnessAnalyzer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LoudnessAnalyzer(QObject *parent = nullptr);
+    ~LoudnessAnalyzer();
+    void analyze(const QVector<TrackInfo> &tracks, bool writeTags);
+    void setCache(MetadataCache *cache);
+    void cancel();
+    bool isRunning() const;
+    double realtimeFactor() const;
+
+signals:
+    void tracksAnalyzed(const QVector<TrackInfo> &tracks);
+    void progress(int done, int total);
+    void finished(int files, int failed, int tagged, qint64 audioMsecs, qint64 msecs);
+
+private slots:
+    void flush();
+
+private:
+    QSharedPointer<LoudnessJob> job;
+    QTimer *flushTimer;
+    QElapsedTimer elapsed;
+    MetadataCache *cache;
+    qint64 audioMsecs;
+};
+
+#endif // LOUDNESSANALYZER_H
@@ -0,0 +1,351 @@
+#include "loudnessmeter.h"
+#include <QElapsedTimer>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(Q_PROCESSOR_X86) && (defined(Q_CC_GNU) || defined(Q_CC_CLANG))
+#define LOUDNESS_X86
+#include <immintrin.h>
+#endif
+
+static const int oversampling = 4;
+static const int peakTaps = 12;
+static const int blockSubBlocks = 4;
+static const int shortTermSubBlocks = 30;
+static const int shortTermStep = 10;
+static const double absoluteGate = -70;
+static const double relativeGate = -10;
+static const double rangeGate = -20;
+static const double replayGainReference = -18;
+
+// BS.1770 K-weighting at 48 kHz: a high shelf followed by the RLB high-pass.
+static const double shelfB0 = 1.53512485958697;
+static const double shelfB1 = -2.69169618940638;
+static const double shelfB2 = 1.19839281085285;
+static const double shelfA1 = -1.69065929318241;
+static const double shelfA2 = 0.73248077421585;
+static const double highPassA1 = -1.99004745483398;
+static const double highPassA2 = 0.99007225036621;
+
+struct PeakTables
+{
+    PeakTables()
+    {
+        const int length = oversampling * peakTaps;
+        double h[oversampling * peakTaps];
+        for (int n = 0; n < length; n++) {
+            const double x = double(n - length / 2) / oversampling;
+            const double sinc = x == 0 ? 1 : qSin(M_PI * x) / (M_PI * x);
+            h[n] = sinc * (0.5 - 0.5 * qCos(2 * M_PI * n / length));
+        }
+        // Each phase is normalised to unity gain; phase 0 passes the input samples through.
+        for (int phase = 0; phase < oversampling; phase++) {
+            double sum = 0;
+            for (int j = 0; j < peakTaps; j++)
+                sum += h[phase + oversampling * j];
+            for (int k = 0; k < peakTaps; k++)
+                taps[k][phase] = float(h[phase + oversampling * (peakTaps - 1 - k)] / sum);
+        }
+    }
+
+    float taps[peakTaps][oversampling];
+};
+
+static const PeakTables &peakTables()
+{
+    static const PeakTables built;
+    return built;
+}
+
+typedef void (*WeightingKernel)(const qint16 *samples, int frames, double *state, double *sums);
+typedef void (*PeakKernel)(const qint16 *samples, int frames, float (*history)[24], int &position, float &peak);
+
+struct LoudnessKernels
+{
+    const char *name;
+    WeightingKernel weighting;
+    PeakKernel peak;
+};
+
+static void weightingScalar(const qint16 *samples, int frames, double *state, double *sums)
+{
+    for (int channel = 0; channel < LoudnessMeter::Channels; channel++) {
+        double z1 = state[channel], z2 = state[2 + channel], z3 = state[4 + channel], z4 = state[6 + channel];
+        double sum = 0;
+        for (int i = 0; i < frames; i++) {
+            const double x = samples[i * LoudnessMeter::Channels + channel] * (1.0 / 32768);
+            const double y = shelfB0 * x + z1;
+            z1 = shelfB1 * x - shelfA1 * y + z2;
+            z2 = shelfB2 * x - shelfA2 * y;
+            const double k = y + z3;
+            z3 = -2 * y - highPassA1 * k + z4;
+            z4 = y - highPassA2 * k;
+            sum += k * k;
+        }
+        state[channel] = z1;
+        state[2 + channel] = z2;
+        state[4 + channel] = z3;
+        state[6 + channel] = z4;
+        sums[channel] += sum;
+    }
+}
+
+static void peakScalar(const qint16 *samples, int frames, float (*history)[24], int &position, float &peak)
+{
+    const PeakTables &table = peakTables();
+    for (int i = 0; i < frames; i++) {
+        position = (position + 1) % peakTaps;
+        for (int channel = 0; channel < LoudnessMeter::Channels; channel++) {
+            float *line = history[channel];
+            line[position] = line[position + peakTaps] = samples[i * LoudnessMeter::Channels + channel] * (1.0f / 32768);
+            const float *window = line + position + 1;
+            for (int phase = 0; phase < oversampling; phase++) {
+                float y = 0;
+                for (int k = 0; k < peakTaps; k++)
+                    y += window[k] * table.taps[k][phase];
+                peak = qMax(peak, std::fabs(y));
+            }
+        }
+    }
+}
+
+#ifdef LOUDNESS_X86
+// Both channels run through the biquads together, one per double lane.
+__attribute__((target("sse2")))
+static void weightingSse2(const qint16 *samples, int frames, double *state, double *sums)
+{
+    const __m128d scale = _mm_set1_pd(1.0 / 32768);
+    const __m128d b0 = _mm_set1_pd(shelfB0), b1 = _mm_set1_pd(shelfB1), b2 = _mm_set1_pd(shelfB2);
+    const __m128d a1 = _mm_set1_pd(shelfA1), a2 = _mm_set1_pd(shelfA2);
+    const __m128d c1 = _mm_set1_pd(highPassA1), c2 = _mm_set1_pd(highPassA2), two = _mm_set1_pd(2);
+    __m128d z1 = _mm_loadu_pd(state), z2 = _mm_loadu_pd(state + 2), z3 = _mm_loadu_pd(state + 4), z4 = _mm_loadu_pd(state + 6);
+    __m128d sum = _mm_setzero_pd();
+    for (int i = 0; i < frames; i++) {
+        qint32 pair;
+        std::memcpy(&pair, samples + i * 2, sizeof(pair));
+        const __m128i widened = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_cvtsi32_si128(pair), _mm_cvtsi32_si128(pair)), 16);
+        const __m128d x = _mm_mul_pd(_mm_cvtepi32_pd(widened), scale);
+        const __m128d y = _mm_add_pd(_mm_mul_pd(b0, x), z1);
+        z1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, x), _mm_mul_pd(a1, y)), z2);
+        z2 = _mm_sub_pd(_mm_mul_pd(b2, x), _mm_mul_pd(a2, y));
+        const __m128d k = _mm_add_pd(y, z3);
+        z3 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(_mm_sub_pd(_mm_setzero_pd(), two), y), _mm_mul_pd(c1, k)), z4);
+        z4 = _mm_sub_pd(y, _mm_mul_pd(c2, k));
+        sum = _mm_add_pd(sum, _mm_mul_pd(k, k));
+    }
+    _mm_storeu_pd(state, z1);
+    _mm_storeu_pd(state + 2, z2);
+    _mm_storeu_pd(state + 4, z3);
+    _mm_storeu_pd(state + 6, z4);
+    _mm_storeu_pd(sums, _mm_add_pd(_mm_loadu_pd(sums), sum));
+}
+
+// The four interpolation phases share a vector so no horizontal sums are needed.
+__attribute__((target("sse2")))
+static void peakSse2(const qint16 *samples, int frames, float (*history)[24], int &position, float &peak)
+{
+    const PeakTables &table = peakTables();
+    __m128 taps[peakTaps];
+    for (int k = 0; k < peakTaps; k++)
+        taps[k] = _mm_loadu_ps(table.taps[k]);
+    const __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 maximum = _mm_set1_ps(peak);
+    for (int i = 0; i < frames; i++) {
+        position = (position + 1) % peakTaps;
+        for (int channel = 0; channel < LoudnessMeter::Channels; channel++) {
+            float *line = history[channel];
+            line[position] = line[position + peakTaps] = samples[i * LoudnessMeter::Channels + channel] * (1.0f / 32768);
+            const float *window = line + position + 1;
+            __m128 y = _mm_setzero_ps();
+            for (int k = 0; k < peakTaps; k++)
+                y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(window[k]), taps[k]));
+            maximum = _mm_max_ps(maximum, _mm_and_ps(y, magnitude));
+        }
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, maximum);
+    peak = qMax(qMax(lanes[0], lanes[1]), qMax(lanes[2], lanes[3]));
+}
+#endif
+
+static LoudnessKernels selectKernels()
+{
+#ifdef LOUDNESS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        const LoudnessKernels sse2 = { "sse2", weightingSse2, peakSse2 };
+        return sse2;
+    }
+#endif
+    const LoudnessKernels scalar = { "scalar", weightingScalar, peakScalar };
+    return scalar;
+}
+
+static const LoudnessKernels &kernels()
+{
+    static const LoudnessKernels selected = selectKernels();
+    return selected;
+}
+
+static double loudness(double meanSquare)
+{
+    return -0.691 + 10 * std::log10(meanSquare);
+}
+
+static double meanSquare(double loudness)
+{
+    return std::pow(10.0, (loudness + 0.691) / 10);
+}
+
+// Two-stage gating from BS.1770-4: an absolute gate, then one relative to the
+// loudness of everything that passed it.
+static QVector<double> gated(const QVector<double> &blocks, double relative, double *gatedMean)
+{
+    const double absolute = meanSquare(absoluteGate);
+    double sum = 0;
+    int count = 0;
+    foreach (double block, blocks) {
+        if (block > absolute) {
+            sum += block;
+            count++;
+        }
+    }
+    QVector<double> passed;
+    if (!count)
+        return passed;
+    const double threshold = qMax(absolute, meanSquare(loudness(sum / count) + relative));
+    sum = 0;
+    foreach (double block, blocks) {
+        if (block > threshold) {
+            sum += block;
+            passed.append(block);
+        }
+    }
+    if (gatedMean && !passed.isEmpty())
+        *gatedMean = sum / passed.size();
+    return passed;
+}
+
+static void measure(LoudnessResult &result)
+{
+    double mean = 0;
+    result.valid = !gated(result.blocks, relativeGate, &mean).isEmpty();
+    result.integrated = result.valid ? loudness(mean) : absoluteGate;
+
+    QVector<double> levels = gated(result.shortTerm, rangeGate, 0);
+    result.range = 0;
+    if (levels.size() > 1) {
+        std::sort(levels.begin(), levels.end());
+        const double low = levels.at(qRound((levels.size() - 1) * 0.10));
+        const double high = levels.at(qRound((levels.size() - 1) * 0.95));
+        result.range = loudness(high) - loudness(low);
+    }
+}
+
+LoudnessMeter::LoudnessMeter() :
+    historyPosition(0), peak(0), subBlockFrames(0), frames(0)
+{
+    std::memset(filterState, 0, sizeof(filterState));
+    std::memset(sums, 0, sizeof(sums));
+    std::memset(history, 0, sizeof(history));
+}
+
+void LoudnessMeter::process(const qint16 *samples, int count)
+{
+    const LoudnessKernels &kernel = kernels();
+    while (count > 0) {
+        const int n = qMin(count, int(SubBlockFrames) - subBlockFrames);
+        kernel.weighting(samples, n, filterState, sums);
+        kernel.peak(samples, n, history, historyPosition, peak);
+        samples += n * Channels;
+        count -= n;
+        frames += n;
+        subBlockFrames += n;
+        if (subBlockFrames == SubBlockFrames)
+            finishSubBlock();
+    }
+}
+
+void LoudnessMeter::finishSubBlock()
+{
+    subBlocks.append((sums[0] + sums[1]) / SubBlockFrames);
+    sums[0] = sums[1] = 0;
+    subBlockFrames = 0;
+    // Keep decaying filter tails out of the denormal range during silence.
+    for (int i = 0; i < 8; i++) {
+        if (std::fabs(filterState[i]) < 1e-30)
+            filterState[i] = 0;
+    }
+}
+
+LoudnessResult LoudnessMeter::result() const
+{
+    LoudnessResult result;
+    result.frames = frames;
+    result.truePeak = peak;
+    double sum = 0;
+    for (int i = 0; i < subBlocks.size(); i++) {
+        sum += subBlocks.at(i);
+        if (i >= blockSubBlocks)
+            sum -= subBlocks.at(i - blockSubBlocks);
+        if (i >= blockSubBlocks - 1)
+            result.blocks.append(sum / blockSubBlocks);
+    }
+    for (int start = 0; start + shortTermSubBlocks <= subBlocks.size(); start += shortTermStep) {
+        double window = 0;
+        for (int i = start; i < start + shortTermSubBlocks; i++)
+            window += subBlocks.at(i);
+        result.shortTerm.append(window / shortTermSubBlocks);
+    }
+    measure(result);
+    return result;
+}
+
+LoudnessResult LoudnessMeter::combine(const QVector<LoudnessResult> &results)
+{
+    LoudnessResult album;
+    foreach (const LoudnessResult &result, results) {
+        album.frames += result.frames;
+        album.truePeak = qMax(album.truePeak, result.truePeak);
+        album.blocks += result.blocks;
+        album.shortTerm += result.shortTerm;
+    }
+    measure(album);
+    return album;
+}
+
+float LoudnessMeter::replayGain(double loudness)
+{
+    return float(replayGainReference - loudness);
+}
+
+const char *LoudnessMeter::kernel()
+{
+    return kernels().name;
+}
+
+double LoudnessMeter::benchmark(int msecs)
+{
+    QVector<qint16> samples(60 * SampleRate * Channels);
+    quint32 seed = 1;
+    for (int i = 0; i < samples.size(); i += Channels) {
+        const int frame = i / Channels;
+        const double tone = qSin(2 * M_PI * (110 + (frame / SampleRate) * 53 % 880) * frame / SampleRate);
+        for (int channel = 0; channel < Channels; channel++) {
+            seed = seed * 1664525 + 1013904223;
+            samples[i + channel] = qint16(tone * 16000 + int(seed >> 20) - 2048);
+        }
+    }
+    QElapsedTimer timer;
+    timer.start();
+    qint64 processed = 0;
+    do {
+        LoudnessMeter meter;
+        meter.process(samples.constData(), samples.size() / Channels);
+        meter.result();
+        processed += samples.size() / Channels;
+    } while (timer.elapsed() < msecs);
+    return processed * 1000.0 / SampleRate / qMax<qint64>(1, timer.elapsed());
+}
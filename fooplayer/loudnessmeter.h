@@ -0,0 +1,43 @@
+#ifndef LOUDNESSMETER_H
+#define LOUDNESSMETER_H
+
+#include <QVector>
+
+struct LoudnessResult
+{
+    double integrated = 0;
+    double range = 0;
+    double truePeak = 0;
+    qint64 frames = 0;
+    QVector<double> blocks;
+    QVector<double> shortTerm;
+    bool valid = false;
+};
+
+class LoudnessMeter
+{
+public:
+    enum { SampleRate = 48000, Channels = 2, SubBlockFrames = SampleRate / 10 };
+
+    LoudnessMeter();
+    void process(const qint16 *samples, int frames);
+    LoudnessResult result() const;
+    static LoudnessResult combine(const QVector<LoudnessResult> &results);
+    static float replayGain(double loudness);
+    static const char *kernel();
+    static double benchmark(int msecs);
+
+private:
+    void finishSubBlock();
+
+    double filterState[8];
+    double sums[Channels];
+    float history[Channels][24];
+    int historyPosition;
+    float peak;
+    int subBlockFrames;
+    qint64 frames;
+    QVector<double> subBlocks;
+};
+
+#endif // LOUDNESSMETER_H
@@ -1,17 +1,172 @@
 #include "player.h"
+#include "headlessplayer.h"
+#include "benchmarksuite.h"
+#include "fixturegenerator.h"
+#include "profiler.h"
 #include <QApplication>
 #include <QDesktopWidget>
+#include <QCommandLineParser>
+#include <QScopedPointer>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QJsonDocument>
+
+static int benchmark(const QCommandLineParser &parser)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    BenchmarkSuite suite(parser.isSet("rows") ? parser.value("rows").toInt() : 200000);
+    suite.setFixtures(parser.value("fixtures"));
+    if (!suite.run(parser.value("benchmark").split(',', QString::SkipEmptyParts))) {
+        err << "unknown benchmark, expected all or " << BenchmarkSuite::groups().join(',') << endl;
+        return 2;
+    }
+    const QJsonObject results = suite.results();
+    if (parser.isSet("json"))
+        out << QJsonDocument(results).toJson();
+    else
+        suite.print(out);
+    const QStringList failures = suite.failures();
+    foreach (const QString &failure, failures)
+        err << "FAILED " << failure << endl;
+    if (parser.isSet("output")) {
+        QSaveFile file(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(results).toJson()) < 0 || !file.commit()) {
+            err << "cannot write " << parser.value("output") << endl;
+            return 2;
+        }
+    }
+    if (parser.isSet("baseline")) {
+        QFile file(parser.value("baseline"));
+        if (!file.open(QIODevice::ReadOnly)) {
+            err << "cannot read " << parser.value("baseline") << endl;
+            return 2;
+        }
+        const double tolerance = (parser.isSet("tolerance") ? parser.value("tolerance").toDouble() : 10) / 100;
+        const int regressions = BenchmarkSuite::compare(results, QJsonDocument::fromJson(file.readAll()).object(), tolerance, err);
+        err << regressions << " regression(s)" << endl;
+        return regressions || !failures.isEmpty() ? 1 : 0;
+    }
+    return failures.isEmpty() ? 0 : 1;
+}
+
+static int generateLibrary(const QCommandLineParser &parser)
+{
+    const QString directory = parser.value("generate-library");
+    const int count = parser.isSet("count") ? parser.value("count").toInt() : 1000;
+    QElapsedTimer timer;
+    timer.start();
+    const int written = FixtureGenerator::generate(directory, count, parser.isSet("seconds") ? parser.value("seconds").toInt() : 1);
+    QTextStream(stdout) << "generated " << written << " files in " << directory << " in " << timer.elapsed() << " ms" << endl;
+    return written == count ? 0 : 1;
+}
+
+struct TraceWriter
+{
+    QString fileName;
+    ~TraceWriter()
+    {
+        if (!fileName.isEmpty() && !Profiler::instance()->writeTrace(fileName))
+            QTextStream(stderr) << "cannot write " << fileName << endl;
+    }
+};
+
+static bool isHeadless(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        const QByteArray arg(argv[i]);
+        if (arg == "-n" || arg == "-h" || arg == "--help" || arg == "--headless" || arg == "--dump"
+                || arg.startsWith("--scan") || arg.startsWith("--serve") || arg.startsWith("--benchmark") || arg.startsWith("--generate-library"))
+            return true;
+    }
+    return false;
+}
 
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
+    const bool headless = isHeadless(argc, argv);
+    QScopedPointer<QCoreApplication> a(headless ? new QCoreApplication(argc, argv) : new QApplication(argc, argv));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("fooplayer audio player");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption(QStringList() << "n" << "headless", "Play the given files without a window and exit when playback ends."));
+    parser.addOption(QCommandLineOption("scan", "Import a folder without a window and report scan timings.", "directory"));
+    parser.addOption(QCommandLineOption("cold", "With --scan, read every tag from disk, bypassing the metadata cache and evicting each file from the page cache (Linux)."));
+    parser.addOption(QCommandLineOption("serve", "Run without a window as a playback core that other processes control over this local socket name.", "name"));
+    parser.addOption(QCommandLineOption("dump", "Print the tags of the given files, folders or playlists."));
+    parser.addOption(QCommandLineOption("benchmark", "Run benchmark groups: all or a comma separated list of "
+                                        + BenchmarkSuite::groups().join(", ") + ".", "groups"));
+    parser.addOption(QCommandLineOption("rows", "Synthetic playlist size for the benchmarks.", "count"));
+    parser.addOption(QCommandLineOption("fixtures", "Folder of audio files for the tags benchmark.", "directory"));
+    parser.addOption(QCommandLineOption("output", "Write benchmark results as JSON to this file.", "file"));
+    parser.addOption(QCommandLineOption("baseline", "Compare benchmark results with this JSON file and fail on regressions.", "file"));
+    parser.addOption(QCommandLineOption("tolerance", "Allowed slowdown against the baseline, default 10.", "percent"));
+    parser.addOption(QCommandLineOption("generate-library", "Write tagged MP3, FLAC and WAV fixtures into a folder.", "directory"));
+    parser.addOption(QCommandLineOption("count", "Number of fixtures to generate, default 1000.", "count"));
+    parser.addOption(QCommandLineOption("seconds", "Length of each generated fixture, default 1.", "seconds"));
+    parser.addOption(QCommandLineOption("buffer-depth", "Milliseconds of decoded audio kept ahead of the output, 10 to 10000, default 2000.", "ms"));
+    parser.addOption(QCommandLineOption("tail", "In headless playback, seek to this many milliseconds before the end of each track.", "ms"));
+    parser.addOption(QCommandLineOption("trace", "Record profiling events and write them as Chrome trace JSON on exit.", "file"));
+    parser.addOption(QCommandLineOption("report-startup", "Print when the window first paints, when the restored session is playable, when it is fully restored and how long saving it on exit took."));
+    parser.addOption(QCommandLineOption("json", "Report headless events as one JSON object per line, or benchmark results as JSON."));
+    parser.addPositionalArgument("files", "Media files, folders or playlists.", "[files...]");
+    parser.process(*a);
+    const QStringList files = parser.positionalArguments();
+    TraceWriter trace;
+    if (parser.isSet("trace")) {
+        trace.fileName = parser.value("trace");
+        Profiler::setEnabled(true);
+    }
+
+    if (parser.isSet("benchmark"))
+        return benchmark(parser);
+    if (parser.isSet("generate-library"))
+        return generateLibrary(parser);
+
+    if (headless) {
+        HeadlessPlayer player;
+        player.setJson(parser.isSet("json"));
+        player.setTail(parser.value("tail").toLongLong());
+        player.setColdScan(parser.isSet("cold"));
+        if (parser.isSet("buffer-depth"))
+            player.setBufferDepth(parser.value("buffer-depth").toInt());
+        if (parser.isSet("dump"))
+            return player.dump(files);
+        QObject::connect(&player, SIGNAL(finished(int)), a.data(), SLOT(exit(int)));
+        if (parser.isSet("serve") && !player.serve(parser.value("serve")))
+            return 1;
+        if (parser.isSet("scan")) {
+            player.scan(parser.value("scan"));
+        } else if (files.isEmpty()) {
+            if (!parser.isSet("serve"))
+                parser.showHelp(2);
+        } else {
+            player.play(files);
+        }
+        return a->exec();
+    }
+
     Player w;
+    if (parser.isSet("report-startup"))
+        w.setStartupReport(parser.isSet("json"));
+    if (parser.isSet("buffer-depth"))
+        w.setBufferDepth(parser.value("buffer-depth").toInt());
     QDesktopWidget dw;
     QRect mainScreenSize = dw.availableGeometry(dw.primaryScreen());
     int x = mainScreenSize.width()*0.7;
     int y = mainScreenSize.height()*0.7;
     w.resize(x,y);
     w.show();
+    if (!files.isEmpty()) {
+        QList<QUrl> urls;
+        foreach (const QString &file, files)
+            urls.append(QUrl::fromUserInput(file, QDir::currentPath(), QUrl::AssumeLocalFile));
+        w.addToPlaylist(urls);
+    }
 
-    return a.exec();
+    return a->exec();
 }
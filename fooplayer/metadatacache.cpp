@@ -0,0 +1,349 @@
+#include "metadatacache.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QDate>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+
+static const char cacheMagic[4] = {'F', 'P', 'M', 'C'};
+static const quint32 cacheVersion = 4;
+static const qint64 cacheExpiryDays = 90;
+
+struct CacheHeader
+{
+    char magic[4];
+    quint32 version;
+    quint32 count;
+    quint32 poolSize;
+};
+
+struct CacheRecord
+{
+    quint64 hash;
+    qint64 modified;
+    qint64 size;
+    qint64 length;
+    quint32 path;
+    quint32 title;
+    quint32 artist;
+    quint32 album;
+    qint32 trackNumber;
+    qint32 bitrate;
+    quint32 seen;
+    quint32 acoustic;
+    float trackGain;
+    float trackPeak;
+    float albumGain;
+    float albumPeak;
+    float loudness;
+    float loudnessRange;
+    quint32 flags;
+    quint32 reserved;
+};
+
+enum CacheRecordFlags
+{
+    HasTrackGain = 0x1,
+    HasAlbumGain = 0x2,
+    HasLoudness = 0x4
+};
+
+static quint64 pathHash(const QByteArray &path)
+{
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+    for (int i = 0; i < path.size(); i++) {
+        hash ^= uchar(path.at(i));
+        hash *= Q_UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+static bool recordHashLess(const CacheRecord &record, quint64 hash)
+{
+    return record.hash < hash;
+}
+
+static bool recordLess(const CacheRecord &a, const CacheRecord &b)
+{
+    return a.hash < b.hash;
+}
+
+class StringPool
+{
+public:
+    StringPool()
+    {
+        add(QByteArray());
+    }
+
+    quint32 add(const QByteArray &string)
+    {
+        QHash<QByteArray, quint32>::const_iterator it = offsets.constFind(string);
+        if (it != offsets.constEnd())
+            return it.value();
+        const quint32 offset = quint32(data.size());
+        const quint32 length = quint32(string.size());
+        data.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        data.append(string);
+        offsets.insert(QByteArray(string.constData(), string.size()), offset);
+        return offset;
+    }
+
+    QByteArray data;
+
+private:
+    QHash<QByteArray, quint32> offsets;
+};
+
+MetadataCache::MetadataCache(const QString &fileName) :
+    fileName(fileName), file(0), data(0), records(0), recordCount(0), pool(0), poolSize(0), dirty(false)
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    map();
+}
+
+MetadataCache::~MetadataCache()
+{
+    unmap();
+}
+
+bool MetadataCache::map()
+{
+    file = new QFile(fileName);
+    if (!file->open(QIODevice::ReadOnly) || file->size() < qint64(sizeof(CacheHeader))) {
+        unmap();
+        return false;
+    }
+    data = file->map(0, file->size());
+    if (!data) {
+        unmap();
+        return false;
+    }
+    CacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    const qint64 expected = qint64(sizeof(CacheHeader)) + qint64(header.count) * qint64(sizeof(CacheRecord)) + header.poolSize;
+    if (memcmp(header.magic, cacheMagic, 4) != 0 || header.version != cacheVersion || expected != file->size()) {
+        unmap();
+        return false;
+    }
+    records = reinterpret_cast<const CacheRecord *>(data + sizeof(CacheHeader));
+    recordCount = header.count;
+    pool = data + sizeof(CacheHeader) + header.count * sizeof(CacheRecord);
+    poolSize = header.poolSize;
+    return true;
+}
+
+void MetadataCache::unmap()
+{
+    if (file) {
+        if (data)
+            file->unmap(const_cast<uchar *>(data));
+        delete file;
+    }
+    file = 0;
+    data = 0;
+    records = 0;
+    recordCount = 0;
+    pool = 0;
+    poolSize = 0;
+}
+
+QByteArray MetadataCache::string(quint32 offset) const
+{
+    quint32 length;
+    if (quint64(offset) + sizeof(length) > poolSize)
+        return QByteArray();
+    memcpy(&length, pool + offset, sizeof(length));
+    if (quint64(offset) + sizeof(length) + length > poolSize)
+        return QByteArray();
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(pool + offset + sizeof(length)), int(length));
+}
+
+int MetadataCache::find(const QByteArray &path) const
+{
+    const quint64 hash = pathHash(path);
+    const CacheRecord *end = records + recordCount;
+    for (const CacheRecord *it = std::lower_bound(records, end, hash, recordHashLess); it != end && it->hash == hash; ++it) {
+        if (string(it->path) == path)
+            return int(it - records);
+    }
+    return -1;
+}
+
+TrackInfo MetadataCache::trackInfo(int index) const
+{
+    const CacheRecord &record = records[index];
+    TrackInfo info;
+    info.path = QString::fromUtf8(string(record.path));
+    info.title = QString::fromUtf8(string(record.title));
+    info.artist = QString::fromUtf8(string(record.artist));
+    info.album = QString::fromUtf8(string(record.album));
+    info.trackNumber = record.trackNumber;
+    info.bitrate = record.bitrate;
+    info.length = record.length;
+    const QByteArray acoustic = string(record.acoustic);
+    info.acoustic = QByteArray(acoustic.constData(), acoustic.size());
+    info.trackGain = record.trackGain;
+    info.trackPeak = record.trackPeak;
+    info.albumGain = record.albumGain;
+    info.albumPeak = record.albumPeak;
+    info.loudness = record.loudness;
+    info.loudnessRange = record.loudnessRange;
+    info.hasTrackGain = record.flags & HasTrackGain;
+    info.hasAlbumGain = record.flags & HasAlbumGain;
+    info.hasLoudness = record.flags & HasLoudness;
+    info.modified = record.modified;
+    info.size = record.size;
+    info.valid = true;
+    return info;
+}
+
+bool MetadataCache::lookup(const QString &path, qint64 modified, qint64 size, TrackInfo &info)
+{
+    bool stale = false;
+    {
+        QReadLocker locker(&lock);
+        QHash<QString, TrackInfo>::const_iterator it = overlay.constFind(path);
+        if (it != overlay.constEnd()) {
+            if (it->modified == modified && it->size == size) {
+                info = it.value();
+                hitCount.ref();
+                return true;
+            }
+        } else {
+            const int index = find(path.toUtf8());
+            if (index >= 0 && !removed.contains(index)) {
+                if (records[index].modified == modified && records[index].size == size) {
+                    info = trackInfo(index);
+                    info.path = path;
+                    QMutexLocker touchedLocker(&touchedMutex);
+                    touched.insert(index);
+                    hitCount.ref();
+                    return true;
+                }
+                stale = true;
+            }
+        }
+    }
+    missCount.ref();
+    if (stale)
+        invalidate(path);
+    return false;
+}
+
+void MetadataCache::insert(const TrackInfo &info)
+{
+    QWriteLocker locker(&lock);
+    overlay.insert(info.path, info);
+    const int index = find(info.path.toUtf8());
+    if (index >= 0)
+        removed.insert(index);
+    dirty = true;
+}
+
+void MetadataCache::invalidate(const QString &path)
+{
+    QWriteLocker locker(&lock);
+    overlay.remove(path);
+    const int index = find(path.toUtf8());
+    if (index >= 0)
+        removed.insert(index);
+    dirty = true;
+}
+
+bool MetadataCache::save()
+{
+    QWriteLocker locker(&lock);
+    if (!dirty)
+        return true;
+
+    const qint64 today = QDate::currentDate().toJulianDay();
+    StringPool strings;
+    QVector<CacheRecord> out;
+    out.reserve(int(recordCount) + overlay.size());
+    for (quint32 i = 0; i < recordCount; i++) {
+        if (removed.contains(int(i)))
+            continue;
+        const bool seen = touched.contains(int(i));
+        if (!seen && today - records[i].seen > cacheExpiryDays)
+            continue;
+        CacheRecord record = records[i];
+        record.path = strings.add(string(record.path));
+        record.title = strings.add(string(record.title));
+        record.artist = strings.add(string(record.artist));
+        record.album = strings.add(string(record.album));
+        record.acoustic = strings.add(string(record.acoustic));
+        if (seen)
+            record.seen = quint32(today);
+        out.append(record);
+    }
+    foreach (const TrackInfo &info, overlay) {
+        CacheRecord record;
+        memset(&record, 0, sizeof(record));
+        const QByteArray path = info.path.toUtf8();
+        record.hash = pathHash(path);
+        record.modified = info.modified;
+        record.size = info.size;
+        record.length = info.length;
+        record.path = strings.add(path);
+        record.title = strings.add(info.title.toUtf8());
+        record.artist = strings.add(info.artist.toUtf8());
+        record.album = strings.add(info.album.toUtf8());
+        record.acoustic = strings.add(info.acoustic);
+        record.trackNumber = info.trackNumber;
+        record.bitrate = info.bitrate;
+        record.trackGain = info.trackGain;
+        record.trackPeak = info.trackPeak;
+        record.albumGain = info.albumGain;
+        record.albumPeak = info.albumPeak;
+        record.loudness = info.loudness;
+        record.loudnessRange = info.loudnessRange;
+        record.flags = (info.hasTrackGain ? HasTrackGain : 0) | (info.hasAlbumGain ? HasAlbumGain : 0) | (info.hasLoudness ? HasLoudness : 0);
+        record.seen = quint32(today);
+        out.append(record);
+    }
+    std::sort(out.begin(), out.end(), recordLess);
+
+    CacheHeader header;
+    memcpy(header.magic, cacheMagic, sizeof(header.magic));
+    header.version = cacheVersion;
+    header.count = quint32(out.size());
+    header.poolSize = quint32(strings.data.size());
+
+    QSaveFile saveFile(fileName);
+    if (!saveFile.open(QIODevice::WriteOnly))
+        return false;
+    saveFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    saveFile.write(reinterpret_cast<const char *>(out.constData()), qint64(out.size()) * qint64(sizeof(CacheRecord)));
+    saveFile.write(strings.data);
+
+    unmap();
+    const bool committed = saveFile.commit();
+    map();
+    if (committed) {
+        overlay.clear();
+        removed.clear();
+        touched.clear();
+        dirty = false;
+    }
+    return committed;
+}
+
+int MetadataCache::count() const
+{
+    QReadLocker locker(&lock);
+    return int(recordCount) - removed.size() + overlay.size();
+}
+
+int MetadataCache::hits() const
+{
+    return hitCount.load();
+}
+
+int MetadataCache::misses() const
+{
+    return missCount.load();
+}
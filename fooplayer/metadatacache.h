@@ -0,0 +1,52 @@
+#ifndef METADATACACHE_H
+#define METADATACACHE_H
+
+#include "tagreader.h"
+#include <QString>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QReadWriteLock>
+
+class QFile;
+struct CacheRecord;
+
+class MetadataCache
+{
+public:
+    explicit MetadataCache(const QString &fileName);
+    ~MetadataCache();
+    bool lookup(const QString &path, qint64 modified, qint64 size, TrackInfo &info);
+    void insert(const TrackInfo &info);
+    void invalidate(const QString &path);
+    bool save();
+    int count() const;
+    int hits() const;
+    int misses() const;
+
+private:
+    bool map();
+    void unmap();
+    int find(const QByteArray &path) const;
+    QByteArray string(quint32 offset) const;
+    TrackInfo trackInfo(int index) const;
+
+    QString fileName;
+    QFile *file;
+    const uchar *data;
+    const CacheRecord *records;
+    quint32 recordCount;
+    const uchar *pool;
+    quint32 poolSize;
+    QHash<QString, TrackInfo> overlay;
+    QSet<int> removed;
+    QSet<int> touched;
+    QAtomicInt hitCount;
+    QAtomicInt missCount;
+    mutable QReadWriteLock lock;
+    QMutex touchedMutex;
+    bool dirty;
+};
+
+#endif // METADATACACHE_H
@@ -0,0 +1,297 @@
+#include "pcmreader.h"
+#include "seekindexcache.h"
+#include "streamcache.h"
+#include <QFile>
+#include <QAudioDecoder>
+#include <QAudioBuffer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QtEndian>
+#include <cstring>
+
+static const int decoderTimeout = 5000;
+static const int indexedSeekThreshold = 5000;
+
+// Presents the decoder with a stream that starts at a frame boundary in the middle of the
+// file, behind whatever header the codec needs to recognise it.
+class SeekDevice : public QIODevice
+{
+public:
+    SeekDevice(const QString &path, const QByteArray &header, qint64 offset, QObject *parent) :
+        QIODevice(parent), file(path), header(header), offset(offset), position(0)
+    {
+    }
+
+    bool open(OpenMode mode) override
+    {
+        if (!file.open(QIODevice::ReadOnly) || !file.seek(offset))
+            return false;
+        return QIODevice::open(mode | QIODevice::Unbuffered);
+    }
+
+    void close() override
+    {
+        file.close();
+        QIODevice::close();
+    }
+
+    qint64 size() const override
+    {
+        return header.size() + file.size() - offset;
+    }
+
+    bool seek(qint64 pos) override
+    {
+        if (pos < 0 || !file.seek(offset + qMax<qint64>(0, pos - header.size())))
+            return false;
+        position = pos;
+        return QIODevice::seek(pos);
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        qint64 done = 0;
+        if (position < header.size()) {
+            done = qMin(maxSize, header.size() - position);
+            memcpy(data, header.constData() + position, size_t(done));
+        }
+        const qint64 read = file.read(data + done, maxSize - done);
+        if (read < 0)
+            return done ? done : -1;
+        position += done + read;
+        return done + read;
+    }
+
+    qint64 writeData(const char *, qint64) override
+    {
+        return -1;
+    }
+
+private:
+    QFile file;
+    QByteArray header;
+    qint64 offset;
+    qint64 position;
+};
+
+PcmReader::PcmReader(const QAudioFormat &format, QObject *parent) :
+    QObject(parent), format(format), file(0), dataStart(0), dataEnd(0), decoder(0), device(0), seekIndexes(0), streamCache(0), indexedDuration(0), skipBytes(0), finished(true)
+{
+}
+
+PcmReader::~PcmReader()
+{
+    close();
+}
+
+void PcmReader::setSeekIndexCache(SeekIndexCache *cache)
+{
+    seekIndexes = cache;
+}
+
+void PcmReader::setStreamCache(StreamCache *cache)
+{
+    streamCache = cache;
+}
+
+bool PcmReader::open(const QString &path, qint64 frame)
+{
+    close();
+    finished = false;
+    source = path;
+    if (streamCache && StreamCache::isRemote(path)) {
+        device = new StreamDevice(streamCache, path, this);
+        if (!device->open(QIODevice::ReadOnly) || !startDecoder(device)) {
+            close();
+            return false;
+        }
+        skipBytes = frame * format.bytesPerFrame();
+        return true;
+    }
+    if (openWave(path))
+        return seek(frame);
+
+    if (frame * 1000 / format.sampleRate() >= indexedSeekThreshold && openIndexed(frame))
+        return true;
+    if (seekIndexes)
+        seekIndexes->prepare(path);
+    if (!startDecoder(0)) {
+        close();
+        return false;
+    }
+    skipBytes = frame * format.bytesPerFrame();
+    return true;
+}
+
+// Starts decoding at the indexed frame boundary before the target and only skips the
+// remainder, rather than decoding everything from the start of the file.
+bool PcmReader::openIndexed(qint64 frame)
+{
+    if (!seekIndexes)
+        return false;
+    const SeekIndex index = seekIndexes->index(source);
+    qint64 offset, start;
+    if (!index.isValid() || !index.locate(frame * index.sampleRate() / format.sampleRate(), offset, start) || start <= 0)
+        return false;
+    device = new SeekDevice(source, index.header(), offset, this);
+    if (!device->open(QIODevice::ReadOnly) || !startDecoder(device)) {
+        close();
+        finished = false;
+        return false;
+    }
+    skipBytes = qMax<qint64>(0, frame - start * format.sampleRate() / index.sampleRate()) * format.bytesPerFrame();
+    indexedDuration = index.duration();
+    return true;
+}
+
+bool PcmReader::startDecoder(QIODevice *device)
+{
+    decoder = new QAudioDecoder(this);
+    decoder->setAudioFormat(format);
+    if (device)
+        decoder->setSourceDevice(device);
+    else
+        decoder->setSourceFilename(source);
+    connect(decoder, SIGNAL(finished()), this, SLOT(decoderFinished()));
+    connect(decoder, SIGNAL(error(QAudioDecoder::Error)), this, SLOT(decoderFinished()));
+    decoder->start();
+    return decoder->error() == QAudioDecoder::NoError;
+}
+
+bool PcmReader::openWave(const QString &path)
+{
+    file = new QFile(path);
+    if (!file->open(QIODevice::ReadOnly) || file->read(12).mid(8) != "WAVE") {
+        delete file;
+        file = 0;
+        return false;
+    }
+    bool formatMatches = false;
+    while (!file->atEnd()) {
+        const QByteArray header = file->read(8);
+        if (header.size() < 8)
+            break;
+        const quint32 size = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(header.constData()) + 4);
+        if (header.startsWith("fmt ")) {
+            const QByteArray chunk = file->read(size);
+            const uchar *p = reinterpret_cast<const uchar *>(chunk.constData());
+            if (chunk.size() < 16)
+                break;
+            const int tag = qFromLittleEndian<quint16>(p);
+            const int channels = qFromLittleEndian<quint16>(p + 2);
+            const int sampleRate = int(qFromLittleEndian<quint32>(p + 4));
+            const int bits = qFromLittleEndian<quint16>(p + 14);
+            formatMatches = (tag == 1 || tag == 0xfffe) && channels == format.channelCount()
+                    && sampleRate == format.sampleRate() && bits == format.sampleSize()
+                    && format.sampleType() == (bits == 8 ? QAudioFormat::UnSignedInt : QAudioFormat::SignedInt)
+                    && format.byteOrder() == QAudioFormat::LittleEndian;
+            if (size & 1)
+                file->read(1);
+        } else if (header.startsWith("data")) {
+            if (!formatMatches)
+                break;
+            dataStart = file->pos();
+            dataEnd = qMin(file->size(), dataStart + qint64(size));
+            return true;
+        } else if (!file->seek(file->pos() + size + (size & 1))) {
+            break;
+        }
+    }
+    delete file;
+    file = 0;
+    return false;
+}
+
+void PcmReader::close()
+{
+    delete file;
+    file = 0;
+    if (decoder) {
+        decoder->disconnect(this);
+        decoder->stop();
+        delete decoder;
+        decoder = 0;
+    }
+    delete device;
+    device = 0;
+    indexedDuration = 0;
+    pending.clear();
+    skipBytes = 0;
+    finished = true;
+}
+
+bool PcmReader::seek(qint64 frame)
+{
+    const qint64 offset = frame * format.bytesPerFrame();
+    if (file) {
+        finished = false;
+        return file->seek(qMin(dataEnd, dataStart + offset));
+    }
+    if (!decoder)
+        return false;
+    skipBytes = offset;
+    return true;
+}
+
+QByteArray PcmReader::read(int maxBytes)
+{
+    maxBytes -= maxBytes % format.bytesPerFrame();
+    if (file) {
+        const QByteArray data = file->read(qMin(qint64(maxBytes), dataEnd - file->pos()));
+        if (data.isEmpty())
+            finished = true;
+        return data;
+    }
+
+    while (decoder && pending.size() < maxBytes && !finished) {
+        if (decoder->bufferAvailable()) {
+            const QAudioBuffer buffer = decoder->read();
+            const char *data = buffer.constData<char>();
+            int size = buffer.byteCount();
+            if (skipBytes > 0) {
+                const int skipped = int(qMin(skipBytes, qint64(size)));
+                skipBytes -= skipped;
+                data += skipped;
+                size -= skipped;
+            }
+            pending.append(data, size);
+            continue;
+        }
+        QEventLoop loop;
+        QTimer timeout;
+        timeout.setSingleShot(true);
+        connect(&timeout, SIGNAL(timeout()), &loop, SLOT(quit()));
+        connect(decoder, SIGNAL(bufferReady()), &loop, SLOT(quit()));
+        connect(decoder, SIGNAL(finished()), &loop, SLOT(quit()));
+        connect(decoder, SIGNAL(error(QAudioDecoder::Error)), &loop, SLOT(quit()));
+        timeout.start(decoderTimeout);
+        loop.exec();
+        if (decoder && !decoder->bufferAvailable() && (decoder->state() == QAudioDecoder::StoppedState || !timeout.isActive()))
+            finished = true;
+    }
+
+    const QByteArray data = pending.left(maxBytes);
+    pending.remove(0, data.size());
+    return data;
+}
+
+qint64 PcmReader::duration() const
+{
+    if (file)
+        return (dataEnd - dataStart) * 1000 / qMax(1, format.bytesForDuration(1000000));
+    if (indexedDuration > 0)
+        return indexedDuration;
+    return decoder ? decoder->duration() : -1;
+}
+
+bool PcmReader::atEnd() const
+{
+    return finished && pending.isEmpty();
+}
+
+void PcmReader::decoderFinished()
+{
+    if (decoder && !decoder->bufferAvailable())
+        finished = true;
+}
@@ -0,0 +1,52 @@
+#ifndef PCMREADER_H
+#define PCMREADER_H
+
+#include <QObject>
+#include <QAudioFormat>
+#include <QByteArray>
+
+class QFile;
+class QIODevice;
+class QAudioDecoder;
+class SeekIndexCache;
+class StreamCache;
+
+class PcmReader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PcmReader(const QAudioFormat &format, QObject *parent = nullptr);
+    ~PcmReader();
+    void setSeekIndexCache(SeekIndexCache *cache);
+    void setStreamCache(StreamCache *cache);
+    bool open(const QString &path, qint64 frame = 0);
+    void close();
+    bool seek(qint64 frame);
+    QByteArray read(int maxBytes);
+    qint64 duration() const;
+    bool atEnd() const;
+
+private slots:
+    void decoderFinished();
+
+private:
+    bool openWave(const QString &path);
+    bool openIndexed(qint64 frame);
+    bool startDecoder(QIODevice *device);
+
+    QAudioFormat format;
+    QFile *file;
+    qint64 dataStart;
+    qint64 dataEnd;
+    QAudioDecoder *decoder;
+    QIODevice *device;
+    SeekIndexCache *seekIndexes;
+    StreamCache *streamCache;
+    QString source;
+    qint64 indexedDuration;
+    QByteArray pending;
+    qint64 skipBytes;
+    bool finished;
+};
+
+#endif // PCMREADER_H
@@ -0,0 +1,91 @@
+#include "performanceoverlay.h"
+#include <QPainter>
+#include <QTimer>
+#include <QFontDatabase>
+#include <algorithm>
+
+static const qint64 window = 1000000000;
+
+PerformanceOverlay::PerformanceOverlay(QWidget *parent) :
+    QWidget(parent), enabledProfiler(false)
+{
+    refreshTimer = new QTimer(this);
+    refreshTimer->setInterval(500);
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    connect(refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+    hide();
+}
+
+void PerformanceOverlay::setActive(bool active)
+{
+    if (active) {
+        enabledProfiler = !Profiler::isEnabled();
+        Profiler::setEnabled(true);
+        refreshTimer->start();
+        refresh();
+        show();
+        raise();
+    } else {
+        refreshTimer->stop();
+        hide();
+        if (enabledProfiler)
+            Profiler::setEnabled(false);
+        enabledProfiler = false;
+    }
+}
+
+// Status lines are shown whatever the profiler recorded, for totals that change rarely.
+void PerformanceOverlay::setStatus(const QString &name, const QString &text)
+{
+    status.insert(name, text);
+    if (isVisible())
+        refresh();
+}
+
+void PerformanceOverlay::refresh()
+{
+    lines.clear();
+    QVector<ProfileStat> stats = Profiler::instance()->stats(window);
+    std::sort(stats.begin(), stats.end(), [](const ProfileStat &a, const ProfileStat &b) { return qstrcmp(a.name, b.name) < 0; });
+    foreach (const ProfileStat &stat, stats) {
+        QString text;
+        if (stat.type == Profiler::Scope)
+            text = QString("%1/s  avg %2 ms  max %3 ms").arg(stat.count).arg(stat.total / 1e6 / stat.count, 0, 'f', 2).arg(stat.max / 1e6, 0, 'f', 2);
+        else if (stat.type == Profiler::Counter)
+            text = QString("%1  max %2").arg(stat.last).arg(stat.max);
+        else
+            text = QString("%1/s").arg(stat.count);
+        lines.append(QString("%1 %2").arg(QString(stat.name), -24).arg(text));
+    }
+    for (QMap<QString, QString>::const_iterator it = status.constBegin(); it != status.constEnd(); ++it)
+        lines.append(QString("%1 %2").arg(it.key(), -24).arg(it.value()));
+    const int dropped = Profiler::instance()->dropped();
+    if (dropped)
+        lines.append(QString("%1 events dropped").arg(dropped));
+    if (lines.isEmpty())
+        lines.append(tr("No events in the last second"));
+
+    const QFontMetrics metrics(font());
+    int width = 0;
+    foreach (const QString &line, lines)
+        width = qMax(width, metrics.width(line));
+    const QSize size(width + 16, lines.size() * metrics.lineSpacing() + 12);
+    if (parentWidget())
+        setGeometry(QRect(QPoint(parentWidget()->width() - size.width() - 8, 8), size));
+    update();
+}
+
+void PerformanceOverlay::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(0, 0, 0, 180));
+    painter.setPen(Qt::white);
+    const QFontMetrics metrics(font());
+    int y = 6 + metrics.ascent();
+    foreach (const QString &line, lines) {
+        painter.drawText(8, y, line);
+        y += metrics.lineSpacing();
+    }
+}
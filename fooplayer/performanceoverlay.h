@@ -0,0 +1,34 @@
+#ifndef PERFORMANCEOVERLAY_H
+#define PERFORMANCEOVERLAY_H
+
+#include "profiler.h"
+#include <QWidget>
+#include <QStringList>
+#include <QMap>
+
+class QTimer;
+
+class PerformanceOverlay : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit PerformanceOverlay(QWidget *parent = nullptr);
+
+public slots:
+    void setActive(bool active);
+    void setStatus(const QString &name, const QString &text);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private slots:
+    void refresh();
+
+private:
+    QTimer *refreshTimer;
+    QStringList lines;
+    QMap<QString, QString> status;
+    bool enabledProfiler;
+};
+
+#endif // PERFORMANCEOVERLAY_H
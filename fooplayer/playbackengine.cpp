@@ -0,0 +1,450 @@
+#include "playbackengine.h"
+#include "profiler.h"
+#include <QAudioDeviceInfo>
+#include <QCoreApplication>
+#include <QDateTime>
+
+static const int defaultDepth = 2000;
+static const int minimumDepth = 10;
+static const int maximumDepth = 10000;
+static const int outputLatency = 50;
+static const int positionInterval = 250;
+static const int crossfadeHeadroom = 1000;
+static const int dspRetryInterval = 50;
+
+PlaybackEngine::PlaybackEngine(QObject *parent) :
+    QObject(parent), playlist(0), streamCache(0), playerState(QMediaPlayer::StoppedState), playingIndex(-1), decodingIndex(-1),
+    playerPosition(0), playerDuration(0), resumePosition(0), latency(-1), headroom(-1), depth(defaultDepth), underrunCount(0), replayGain(GainStage::ReplayGainOff), playerVolume(100), playerMuted(false), changingIndex(false),
+    shuffleSeed(quint32(QDateTime::currentMSecsSinceEpoch()) ^ quint32(QCoreApplication::applicationPid()))
+{
+    format.setSampleRate(44100);
+    format.setChannelCount(2);
+    format.setSampleSize(16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+    const QAudioDeviceInfo device = QAudioDeviceInfo::defaultOutputDevice();
+    if (!device.isFormatSupported(format))
+        format = device.nearestFormat(format);
+
+    qRegisterMetaType<QAudio::State>("QAudio::State");
+    buffer = new AudioRingBuffer(bufferSize());
+    source = new AudioSource(buffer, format);
+    sink = new AudioSink(format, source);
+    sink->setBufferSize(sinkBufferSize());
+    outputThread = new QThread(this);
+    sink->moveToThread(outputThread);
+    decoder = new DecoderThread(buffer, source, format, this);
+    positionTimer = new QTimer(this);
+    positionTimer->setInterval(positionInterval);
+    dspTimer = new QTimer(this);
+    dspTimer->setSingleShot(true);
+    dspTimer->setInterval(dspRetryInterval);
+
+    connect(decoder, SIGNAL(trackStarted(int)), this, SLOT(trackStarted(int)));
+    connect(sink, SIGNAL(stateChanged(QAudio::State)), this, SLOT(outputStateChanged(QAudio::State)));
+    connect(positionTimer, SIGNAL(timeout()), this, SLOT(updatePosition()));
+    connect(dspTimer, SIGNAL(timeout()), this, SLOT(applyDspSettings()));
+    outputThread->start(QThread::TimeCriticalPriority);
+    decoder->start(QThread::HighPriority);
+}
+
+PlaybackEngine::~PlaybackEngine()
+{
+    invokeSink("stop");
+    outputThread->quit();
+    outputThread->wait();
+    delete sink;
+    delete decoder;
+    delete buffer;
+}
+
+void PlaybackEngine::setPlaylist(QMediaPlaylist *playlist)
+{
+    stop();
+    if (this->playlist)
+        this->playlist->disconnect(this);
+    this->playlist = playlist;
+    playingIndex = -1;
+    decodingIndex = -1;
+    if (!playlist)
+        return;
+    connect(playlist, SIGNAL(currentIndexChanged(int)), this, SLOT(playlistIndexChanged(int)));
+    connect(playlist, SIGNAL(playbackModeChanged(QMediaPlaylist::PlaybackMode)), this, SLOT(queueNext()));
+    connect(playlist, SIGNAL(mediaInserted(int,int)), this, SLOT(queueNext()));
+    connect(playlist, SIGNAL(mediaRemoved(int,int)), this, SLOT(queueNext()));
+}
+
+QMediaPlayer::State PlaybackEngine::state() const
+{
+    return playerState;
+}
+
+qint64 PlaybackEngine::position() const
+{
+    return playerPosition;
+}
+
+qint64 PlaybackEngine::duration() const
+{
+    return playerDuration;
+}
+
+int PlaybackEngine::volume() const
+{
+    return playerVolume;
+}
+
+bool PlaybackEngine::isMuted() const
+{
+    return playerMuted;
+}
+
+int PlaybackEngine::currentIndex() const
+{
+    return playingIndex;
+}
+
+qint64 PlaybackEngine::transitionLatency() const
+{
+    return latency;
+}
+
+qint64 PlaybackEngine::transitionHeadroom() const
+{
+    return headroom;
+}
+
+QAudioFormat PlaybackEngine::audioFormat() const
+{
+    return format;
+}
+
+int PlaybackEngine::bufferDepth() const
+{
+    return depth;
+}
+
+void PlaybackEngine::setBufferDepth(int milliseconds)
+{
+    milliseconds = qBound(minimumDepth, milliseconds, maximumDepth);
+    if (milliseconds == depth)
+        return;
+    depth = milliseconds;
+    resizeBuffer();
+}
+
+void PlaybackEngine::resizeBuffer()
+{
+    invokeSink("stop");
+    decoder->resizeBuffer(bufferSize());
+    QMetaObject::invokeMethod(sink, "setBufferSize", Qt::BlockingQueuedConnection, Q_ARG(int, sinkBufferSize()));
+    if (playerState != QMediaPlayer::StoppedState && playingIndex >= 0)
+        startTrack(playingIndex, playerPosition);
+}
+
+int PlaybackEngine::underruns() const
+{
+    return underrunCount;
+}
+
+GainStage::ReplayGainMode PlaybackEngine::replayGainMode() const
+{
+    return replayGain;
+}
+
+void PlaybackEngine::setReplayGainMode(GainStage::ReplayGainMode mode)
+{
+    replayGain = mode;
+    decoder->setReplayGainMode(mode);
+}
+
+void PlaybackEngine::setSeekIndexCache(SeekIndexCache *cache)
+{
+    decoder->setSeekIndexCache(cache);
+}
+
+void PlaybackEngine::setMetadataCache(MetadataCache *cache)
+{
+    decoder->setMetadataCache(cache);
+}
+
+void PlaybackEngine::setStreamCache(StreamCache *cache)
+{
+    streamCache = cache;
+    decoder->setStreamCache(cache);
+}
+
+DspSettings PlaybackEngine::dspSettings() const
+{
+    return dsp;
+}
+
+void PlaybackEngine::setDspSettings(const DspSettings &settings)
+{
+    dsp = settings;
+    if (bufferSize() > buffer->capacity())
+        resizeBuffer();
+    applyDspSettings();
+}
+
+void PlaybackEngine::applyDspSettings()
+{
+    // The queue to the output thread only drains while audio is playing.
+    if (!source->dspChain()->configure(dsp) && source->dspChain()->isSupported())
+        dspTimer->start();
+}
+
+void PlaybackEngine::setResumePosition(qint64 position)
+{
+    resumePosition = qMax<qint64>(0, position);
+}
+
+void PlaybackEngine::reorderPlaylist(const QVector<int> &order)
+{
+    if (!playlist || order.size() != playlist->mediaCount())
+        return;
+    QVector<int> position(order.size());
+    QList<QMediaContent> media;
+    media.reserve(order.size());
+    for (int i = 0; i < order.size(); i++) {
+        position[order.at(i)] = i;
+        media.append(playlist->media(order.at(i)));
+    }
+    const int current = playlist->currentIndex();
+    changingIndex = true;
+    playlist->blockSignals(true);
+    playlist->clear();
+    playlist->addMedia(media);
+    if (current >= 0 && current < position.size())
+        playlist->setCurrentIndex(position.at(current));
+    playlist->blockSignals(false);
+    changingIndex = false;
+
+    if (playingIndex >= 0 && playingIndex < position.size())
+        playingIndex = position.at(playingIndex);
+    decoder->remapIndices(position);
+    decodingIndex = decoder->currentIndex();
+    queueNext();
+}
+
+void PlaybackEngine::play()
+{
+    if (!playlist || playerState == QMediaPlayer::PlayingState)
+        return;
+    if (playerState == QMediaPlayer::PausedState) {
+        invokeSink("resume");
+        positionTimer->start();
+        setState(QMediaPlayer::PlayingState);
+        return;
+    }
+    int index = playlist->currentIndex();
+    if (index < 0) {
+        if (playlist->mediaCount() == 0)
+            return;
+        changingIndex = true;
+        playlist->setCurrentIndex(0);
+        changingIndex = false;
+        index = 0;
+    }
+    setState(QMediaPlayer::PlayingState);
+    startTrack(index, resumePosition);
+    resumePosition = 0;
+}
+
+void PlaybackEngine::pause()
+{
+    if (playerState != QMediaPlayer::PlayingState)
+        return;
+    invokeSink("suspend");
+    positionTimer->stop();
+    setState(QMediaPlayer::PausedState);
+}
+
+void PlaybackEngine::stop()
+{
+    if (playerState == QMediaPlayer::StoppedState)
+        return;
+    invokeSink("stop");
+    decoder->decode(-1, QString(), 0);
+    source->reset(true);
+    positionTimer->stop();
+    playingIndex = -1;
+    decodingIndex = -1;
+    playerPosition = 0;
+    emit positionChanged(0);
+    setState(QMediaPlayer::StoppedState);
+}
+
+void PlaybackEngine::setPosition(qint64 position)
+{
+    if (playerState == QMediaPlayer::StoppedState || playingIndex < 0)
+        return;
+    startTrack(playingIndex, qBound<qint64>(0, position, playerDuration > 0 ? playerDuration : position));
+}
+
+void PlaybackEngine::setVolume(int volume)
+{
+    volume = qBound(0, volume, 100);
+    if (volume == playerVolume)
+        return;
+    playerVolume = volume;
+    QMetaObject::invokeMethod(sink, "setVolume", Qt::QueuedConnection, Q_ARG(qreal, playerMuted ? 0 : playerVolume / qreal(100)));
+    emit volumeChanged(playerVolume);
+}
+
+void PlaybackEngine::setMuted(bool muted)
+{
+    if (muted == playerMuted)
+        return;
+    playerMuted = muted;
+    QMetaObject::invokeMethod(sink, "setVolume", Qt::QueuedConnection, Q_ARG(qreal, playerMuted ? 0 : playerVolume / qreal(100)));
+    emit mutedChanged(playerMuted);
+}
+
+void PlaybackEngine::startTrack(int index, qint64 position)
+{
+    invokeSink("stop");
+    decoder->decode(index, mediaPath(index), position);
+    decodingIndex = -1;
+    source->reset(false);
+    invokeSink("start");
+    if (playerState == QMediaPlayer::PausedState)
+        invokeSink("suspend");
+    else
+        positionTimer->start();
+
+    playerPosition = position;
+    emit positionChanged(position);
+    if (index != playingIndex) {
+        playingIndex = index;
+        emit metaDataChanged();
+    }
+}
+
+void PlaybackEngine::setState(QMediaPlayer::State state)
+{
+    if (state == playerState)
+        return;
+    playerState = state;
+    emit stateChanged(state);
+}
+
+void PlaybackEngine::invokeSink(const char *method)
+{
+    QMetaObject::invokeMethod(sink, method, Qt::BlockingQueuedConnection);
+}
+
+// A crossfade peeks at the next track's head while the current tail plays, so
+// the ring has to hold both.
+int PlaybackEngine::bufferSize() const
+{
+    return format.bytesForDuration(qint64(qMax(depth, 2 * dsp.crossfade + crossfadeHeadroom)) * 1000);
+}
+
+int PlaybackEngine::sinkBufferSize() const
+{
+    return qMin(buffer->capacity(), format.bytesForDuration(qint64(qMin(depth, outputLatency)) * 1000));
+}
+
+int PlaybackEngine::nextIndexAfter(int index) const
+{
+    const int count = playlist->mediaCount();
+    if (count == 0)
+        return -1;
+    switch (playlist->playbackMode()) {
+    case QMediaPlaylist::CurrentItemOnce:
+        return -1;
+    case QMediaPlaylist::CurrentItemInLoop:
+        return index;
+    case QMediaPlaylist::Sequential:
+        return index + 1 < count ? index + 1 : -1;
+    case QMediaPlaylist::Loop:
+        return (index + 1) % count;
+    case QMediaPlaylist::Random:
+        shuffleSeed = shuffleSeed * 1664525 + 1013904223;
+        return int((shuffleSeed >> 8) % quint32(count));
+    }
+    return -1;
+}
+
+QString PlaybackEngine::mediaPath(int index) const
+{
+    if (!playlist || index < 0)
+        return QString();
+    const QUrl url = playlist->media(index).canonicalUrl();
+    return url.isLocalFile() ? url.toLocalFile() : url.toString();
+}
+
+void PlaybackEngine::playlistIndexChanged(int index)
+{
+    if (!changingIndex && playerState == QMediaPlayer::StoppedState)
+        resumePosition = 0;
+    if (changingIndex || playerState == QMediaPlayer::StoppedState || index == playingIndex)
+        return;
+    if (index < 0)
+        stop();
+    else
+        startTrack(index, 0);
+}
+
+void PlaybackEngine::queueNext()
+{
+    if (!playlist || decodingIndex < 0)
+        return;
+    const int next = nextIndexAfter(decodingIndex);
+    decoder->setNext(decodingIndex, next, mediaPath(next));
+}
+
+void PlaybackEngine::trackStarted(int index)
+{
+    Q_UNUSED(index);
+    decodingIndex = decoder->currentIndex();
+    queueNext();
+}
+
+void PlaybackEngine::outputStateChanged(QAudio::State state)
+{
+    if (state == QAudio::IdleState && source->isFinished())
+        stop();
+}
+
+void PlaybackEngine::updatePosition()
+{
+    if (source->underruns() != underrunCount) {
+        underrunCount = source->underruns();
+        PROFILE_COUNTER("output.underruns", underrunCount);
+        emit underrunsChanged(underrunCount);
+    }
+
+    const qint64 frames = source->framesRead();
+    PROFILE_COUNTER("buffer.fill", qint64(buffer->available()) * 100 / buffer->capacity());
+    TrackBoundary boundary;
+    if (!decoder->boundaryAt(frames, boundary))
+        return;
+
+    if (boundary.index != playingIndex) {
+        playingIndex = boundary.index;
+        latency = boundary.latency;
+        headroom = boundary.headroom;
+        changingIndex = true;
+        playlist->setCurrentIndex(playingIndex);
+        changingIndex = false;
+        PROFILE_COUNTER("track.openLatency", latency);
+        if (streamCache && StreamCache::isRemote(mediaPath(playingIndex))) {
+            PROFILE_COUNTER("stream.hitRatio", qRound(streamCache->hitRatio() * 100));
+        }
+        emit metaDataChanged();
+        emit trackTransition(latency, headroom);
+    }
+    if (boundary.duration >= 0 && boundary.duration != playerDuration) {
+        playerDuration = boundary.duration;
+        emit durationChanged(playerDuration);
+    }
+    const qint64 position = boundary.startPosition + (frames - boundary.frame) * 1000 / format.sampleRate();
+    if (position != playerPosition) {
+        playerPosition = position;
+        PROFILE_MARK("engine.positionChanged");
+        emit positionChanged(position);
+    }
+}
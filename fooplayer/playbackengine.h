@@ -0,0 +1,108 @@
+#ifndef PLAYBACKENGINE_H
+#define PLAYBACKENGINE_H
+
+#include "audioringbuffer.h"
+#include "audiosource.h"
+#include "decoderthread.h"
+#include "audiosink.h"
+#include <QObject>
+#include <QMediaPlayer>
+#include <QMediaPlaylist>
+#include <QThread>
+#include <QAudioFormat>
+#include <QTimer>
+
+class PlaybackEngine : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PlaybackEngine(QObject *parent = nullptr);
+    ~PlaybackEngine();
+    void setPlaylist(QMediaPlaylist *playlist);
+    QMediaPlayer::State state() const;
+    qint64 position() const;
+    qint64 duration() const;
+    int volume() const;
+    bool isMuted() const;
+    int currentIndex() const;
+    qint64 transitionLatency() const;
+    qint64 transitionHeadroom() const;
+    QAudioFormat audioFormat() const;
+    int bufferDepth() const;
+    void setBufferDepth(int milliseconds);
+    int underruns() const;
+    GainStage::ReplayGainMode replayGainMode() const;
+    void setReplayGainMode(GainStage::ReplayGainMode mode);
+    void setSeekIndexCache(SeekIndexCache *cache);
+    void setMetadataCache(MetadataCache *cache);
+    void setStreamCache(StreamCache *cache);
+    DspSettings dspSettings() const;
+    void setDspSettings(const DspSettings &settings);
+    void setResumePosition(qint64 position);
+    void reorderPlaylist(const QVector<int> &order);
+
+public slots:
+    void play();
+    void pause();
+    void stop();
+    void setPosition(qint64 position);
+    void setVolume(int volume);
+    void setMuted(bool muted);
+
+signals:
+    void stateChanged(QMediaPlayer::State state);
+    void durationChanged(qint64 duration);
+    void positionChanged(qint64 position);
+    void volumeChanged(int volume);
+    void mutedChanged(bool muted);
+    void metaDataChanged();
+    void trackTransition(qint64 latency, qint64 headroom);
+    void underrunsChanged(int underruns);
+
+private slots:
+    void playlistIndexChanged(int index);
+    void queueNext();
+    void trackStarted(int index);
+    void outputStateChanged(QAudio::State state);
+    void updatePosition();
+    void applyDspSettings();
+
+private:
+    void startTrack(int index, qint64 position);
+    void setState(QMediaPlayer::State state);
+    void invokeSink(const char *method);
+    void resizeBuffer();
+    int bufferSize() const;
+    int sinkBufferSize() const;
+    int nextIndexAfter(int index) const;
+    QString mediaPath(int index) const;
+
+    QMediaPlaylist *playlist;
+    QAudioFormat format;
+    AudioRingBuffer *buffer;
+    AudioSource *source;
+    DecoderThread *decoder;
+    StreamCache *streamCache;
+    AudioSink *sink;
+    QThread *outputThread;
+    QTimer *positionTimer;
+    QTimer *dspTimer;
+    DspSettings dsp;
+    QMediaPlayer::State playerState;
+    int playingIndex;
+    int decodingIndex;
+    qint64 playerPosition;
+    qint64 playerDuration;
+    qint64 resumePosition;
+    qint64 latency;
+    qint64 headroom;
+    int depth;
+    int underrunCount;
+    GainStage::ReplayGainMode replayGain;
+    int playerVolume;
+    bool playerMuted;
+    bool changingIndex;
+    mutable quint32 shuffleSeed;
+};
+
+#endif // PLAYBACKENGINE_H
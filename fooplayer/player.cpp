@@ -1,26 +1,48 @@
 #include "player.h"
+#include "duplicatesdialog.h"
+#include "dspdialog.h"
+#include "headlessplayer.h"
+#include "profiler.h"
 #include <QtWidgets>
-#include <QMediaMetaData>
-#include <QtDebug>
 #include <QFileDialog>
 #include <QFileInfo>
 
+static QString timeString(qint64 seconds, bool hours)
+{
+    const QLatin1Char zero('0');
+    if (hours)
+        return QString("%1:%2:%3").arg(seconds / 3600, 2, 10, zero).arg(seconds / 60 % 60, 2, 10, zero).arg(seconds % 60, 2, 10, zero);
+    return QString("%1:%2").arg(seconds / 60 % 60, 2, 10, zero).arg(seconds % 60, 2, 10, zero);
+}
+
 Player::Player(QWidget *parent) :
-    QWidget(parent)
+    QWidget(parent), painted(false), reportStartup(false), reportJson(false), duration(0), position(0), positionMsecs(0), shownPosition(-1)
 {
-    player = new QMediaPlayer(this);
-    playlist = new QMediaPlaylist(this);
-    playlistModel = new QStandardItemModel(this);
+    startup.start();
+    library = new Library(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/metadata.cache", this);
+    player = library->engine();
+    playlist = library->playlist(0);
+    playlistModel = library->model(0);
+    filterModel = new PlaylistFilterModel(this);
+    searchEdit = new QLineEdit(this);
+    sorter = new PlaylistSorter(this);
     listModel = new QStandardItemModel(this);
     playerControls = new PlayerControls(this);
     list = new QListView(this);
     playlistView = new QTableView(this);
-    slider = new QSlider(Qt::Horizontal, this);
+    seekBar = new WaveformSeekBar(this);
     imageLabel = new QLabel(this);
     menu = new QMenuBar(this);
     fileMenu = new QMenu("File", this);
     playbackMenu = new QMenu("Playback", this);
+    viewMenu = new QMenu("View", this);
     aboutMenu = new QMenu("About", this);
+    overlay = new PerformanceOverlay(this);
+    display = new DisplayScheduler(this);
+    coverArt = new CoverArtService(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/covers", this);
+    waveforms = new WaveformService(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/waveforms", this);
+    loudness = new LoudnessAnalyzer(this);
+    session = new Session(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/session.bin", this);
 
     QBoxLayout *vlayout = new QVBoxLayout;
     QBoxLayout *controlLayout = new QHBoxLayout;
@@ -29,20 +51,31 @@ Player::Player(QWidget *parent) :
     QBoxLayout *playlistLayout = new QHBoxLayout;
     QBoxLayout *sliderLayout = new QHBoxLayout;
     durationLabel = new QLabel(this);
+    scanBar = new QProgressBar(this);
     QToolButton *addButton = new QToolButton;
 
     addButton->setIcon(style()->standardIcon(QStyle::SP_DirIcon));
-    playlistModel->setHorizontalHeaderLabels(QStringList() << tr("Title") << tr("Artist") << tr("#") << tr("Album") << tr("Bitrate") << tr("Length"));
+    loudness->setCache(library->cache());
 
-    playlistView->setModel(playlistModel);
+    filterModel->setSourceModel(playlistModel);
+    playlistView->setModel(filterModel);
     playlistView->setSelectionBehavior(QAbstractItemView::SelectRows);
     playlistView->horizontalHeader()->setStretchLastSection(true);
     playlistView->setSelectionMode(QAbstractItemView::SingleSelection);
     playlistView->setEditTriggers(QAbstractItemView::NoEditTriggers);
     playlistView->verticalHeader()->setVisible(false);
+    playlistView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    playlistView->verticalHeader()->setDefaultSectionSize(15);
+    playlistView->setWordWrap(false);
     playlistView->horizontalHeader()->resizeSection(2,25);
+    playlistView->horizontalHeader()->setSectionsClickable(true);
+    playlistView->horizontalHeader()->setSortIndicatorShown(false);
     playlistView->setContextMenuPolicy(Qt::CustomContextMenu);
 
+    searchEdit->setPlaceholderText(tr("Search"));
+    searchEdit->setClearButtonEnabled(true);
+    searchEdit->setMaximumWidth(250);
+
     list->setModel(listModel);
     list->setEditTriggers(QAbstractItemView::SelectedClicked);
     list->setContextMenuPolicy(Qt::CustomContextMenu);
@@ -55,19 +88,41 @@ Player::Player(QWidget *parent) :
     imageLabel->setAlignment(Qt::AlignCenter);
     imageLabel->setMaximumSize(350,350);
 
-    player->setPlaylist(playlist);
-    playlist->setPlaybackMode(QMediaPlaylist::Loop);
+    scanBar->setMaximumWidth(200);
+    scanBar->setFormat(tr("Scanning %v/%m"));
+    scanBar->hide();
 
     menu->addMenu(fileMenu);
     menu->addMenu(playbackMenu);
+    menu->addMenu(viewMenu);
     menu->addMenu(aboutMenu);
     fileMenu->addAction("Open...", this, SLOT(open()), QKeySequence(tr("Ctrl+O")));
+    fileMenu->addAction("Add folder...", this, SLOT(openFolder()));
+    watchAction = fileMenu->addAction("Watch added folders");
+    watchAction->setCheckable(true);
     fileMenu->addAction("New playlist...", this, SLOT(newPlaylist()));
+    fileMenu->addAction("Save playlist...", this, SLOT(savePlaylist()), QKeySequence(tr("Ctrl+S")));
     playbackMenu->addAction("Stop", player, SLOT(stop()));
     playbackMenu->addAction("Pause", player, SLOT(pause()));
     playbackMenu->addAction("Play", player, SLOT(play()));
     playbackMenu->addAction("Next", playlist, SLOT(next()));
     playbackMenu->addAction("Previous", playlist, SLOT(previous()));
+    playbackMenu->addAction("DSP...", this, SLOT(showDsp()));
+    replayGainMenu = playbackMenu->addMenu("ReplayGain");
+    QActionGroup *replayGainGroup = new QActionGroup(replayGainMenu);
+    replayGainGroup->addAction(replayGainMenu->addAction("Off"))->setData(GainStage::ReplayGainOff);
+    replayGainGroup->addAction(replayGainMenu->addAction("Track gain"))->setData(GainStage::ReplayGainTrack);
+    replayGainGroup->addAction(replayGainMenu->addAction("Album gain"))->setData(GainStage::ReplayGainAlbum);
+    foreach (QAction *action, replayGainGroup->actions())
+        action->setCheckable(true);
+    replayGainGroup->actions().first()->setChecked(true);
+    connect(replayGainGroup, SIGNAL(triggered(QAction*)), this, SLOT(replayGainChanged(QAction*)));
+    QAction *overlayAction = viewMenu->addAction("Performance overlay");
+    overlayAction->setCheckable(true);
+    overlayAction->setShortcut(QKeySequence(Qt::Key_F12));
+    connect(overlayAction, SIGNAL(toggled(bool)), overlay, SLOT(setActive(bool)));
+    viewMenu->addAction("Export trace...", this, SLOT(exportTrace()));
+    viewMenu->addAction("Find duplicates...", this, SLOT(findDuplicates()));
     aboutMenu->addAction("About", this, SLOT(about()));
 
     miscLayout->addWidget(list);
@@ -77,11 +132,13 @@ Player::Player(QWidget *parent) :
     layout->addLayout(playlistLayout);
     controlLayout->addWidget(addButton);
     controlLayout->addWidget(playerControls);
+    controlLayout->addWidget(searchEdit);
     vlayout->addWidget(menu);
     vlayout->addLayout(controlLayout);
     vlayout->addLayout(layout);
-    sliderLayout->addWidget(slider);
+    sliderLayout->addWidget(seekBar);
     sliderLayout->addWidget(durationLabel);
+    sliderLayout->addWidget(scanBar);
     vlayout->addLayout(sliderLayout);
     setLayout(vlayout);
 
@@ -100,38 +157,61 @@ Player::Player(QWidget *parent) :
     connect(player, SIGNAL(stateChanged(QMediaPlayer::State)), playerControls, SLOT(setState(QMediaPlayer::State)));
     connect(player, SIGNAL(durationChanged(qint64)), SLOT(durationChanged(qint64)));
     connect(player, SIGNAL(positionChanged(qint64)), SLOT(positionChanged(qint64)));
+    connect(display, SIGNAL(refresh()), this, SLOT(refreshPosition()));
     connect(player, SIGNAL(volumeChanged(int)), playerControls, SLOT(setVolume(int)));
     connect(player, SIGNAL(mutedChanged(bool)), playerControls, SLOT(setMuted(bool)));
     connect(addButton, SIGNAL(clicked()), this, SLOT(open()));
-    connect(slider, SIGNAL(sliderMoved(int)), this, SLOT(seek(int)));
+    connect(seekBar, SIGNAL(seekRequested(qint64)), this, SLOT(seek(qint64)));
     connect(player, SIGNAL(metaDataChanged()), SLOT(metaDataChanged()));
     connect(playlistView, SIGNAL(doubleClicked(QModelIndex)),this, SLOT(setTrack(QModelIndex)));
     connect(list, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(setPlaylist(QModelIndex)));
     connect(list, SIGNAL(customContextMenuRequested(const QPoint &)), this, SLOT(providePlaylistContextMenu(const QPoint &)));
     connect(playlistView, SIGNAL(customContextMenuRequested(const QPoint &)), this, SLOT(provideTrackContextMenu(const QPoint &)));
+    connect(searchEdit, SIGNAL(textChanged(QString)), this, SLOT(search(QString)));
+    connect(playlistView->horizontalHeader(), SIGNAL(sectionClicked(int)), this, SLOT(sortColumn(int)));
+    connect(sorter, SIGNAL(sorted(PlaylistModel*,QVector<int>,qint64)), this, SLOT(playlistSorted(PlaylistModel*,QVector<int>,qint64)));
+    connect(coverArt, SIGNAL(coverReady(QString,QImage)), this, SLOT(coverReady(QString,QImage)));
+    connect(waveforms, SIGNAL(waveformUpdated(QString,Waveform)), this, SLOT(waveformUpdated(QString,Waveform)));
+    connect(loudness, SIGNAL(progress(int,int)), this, SLOT(loudnessProgress(int,int)));
+    connect(loudness, SIGNAL(finished(int,int,int,qint64,qint64)), this, SLOT(loudnessFinished(int,int,int,qint64,qint64)));
+    connect(session, SIGNAL(playlistLoaded(int,QVector<TrackInfo>)), this, SLOT(sessionPlaylistLoaded(int,QVector<TrackInfo>)));
+    connect(library, SIGNAL(scanProgress(int,int)), this, SLOT(scanProgress(int,int)));
+    connect(library, SIGNAL(scanFinished(int,int,qint64)), this, SLOT(scanFinished(int,int,qint64)));
+    connect(library, SIGNAL(folderScanFinished(int,int,qint64)), this, SLOT(folderScanFinished(int,int,qint64)));
+    connect(watchAction, SIGNAL(toggled(bool)), library, SLOT(setWatchFolders(bool)));
+
+    control = new ControlServer(library, this);
+    connect(control, SIGNAL(trackRequested(int,int)), this, SLOT(playTrack(int,int)));
+    if (!control->listen("fooplayer"))
+        overlay->setStatus("control", control->errorString());
 
-
-    playlistVector.append(playlist);
-    modelVector.append(playlistModel);
     setWindowTitle(QString("Now playing nothing!"));
+    restoreSession();
 }
 
 Player::~Player()
 {
-    delete player;
-    delete playlist;
-    delete playlistModel;
+    loudness->cancel();
+    library->cancel();
+    delete coverArt;
+    delete waveforms;
+    saveSession();
+    delete control;
+    delete library;
     delete listModel;
     delete playerControls;
     delete list;
     delete playlistView;
-    delete slider;
+    delete searchEdit;
+    delete seekBar;
     delete imageLabel;
     delete menu;
     delete fileMenu;
     delete playbackMenu;
+    delete viewMenu;
     delete aboutMenu;
     delete durationLabel;
+    delete scanBar;
 }
 
 void Player::open()
@@ -139,7 +219,7 @@ void Player::open()
     QFileDialog fileDialog(this);
     QList<QStandardItem *> items;
     fileDialog.setAcceptMode(QFileDialog::AcceptOpen);
-    fileDialog.setNameFilter(tr("Audio files (*.mp3 *.flac *.m3u)"));
+    fileDialog.setNameFilter(tr("Audio files (*.mp3 *.flac *.wav *.m3u *.m3u8 *.pls *.xspf)"));
     fileDialog.setWindowTitle(tr("Open Files"));
     fileDialog.setDirectory(QStandardPaths::standardLocations(QStandardPaths::MusicLocation).value(0, QDir::homePath()));
     if(!filepath.isEmpty())
@@ -149,69 +229,111 @@ void Player::open()
         addToPlaylist(fileDialog.selectedUrls());
         playlist->setCurrentIndex(playlist->mediaCount()-1);
         QFileInfo fileInfo(fileDialog.selectedFiles().last());
-        filename =  fileInfo.completeBaseName();
         filepath = fileInfo.absolutePath();
     }
     player->play();
 }
 
+void Player::openFolder()
+{
+    const QString directory = QFileDialog::getExistingDirectory(this, tr("Add Folder"),
+        filepath.isEmpty() ? QStandardPaths::standardLocations(QStandardPaths::MusicLocation).value(0, QDir::homePath()) : filepath);
+    if (directory.isEmpty())
+        return;
+    filepath = directory;
+    library->addFolder(directory, library->indexOf(playlistModel));
+}
+
+
 void Player::durationChanged(qint64 duration)
 {
     this->duration = duration/1000;
-    slider->setMaximum(duration / 1000);
+    durationText = timeString(this->duration, this->duration >= 3600);
+    seekBar->setDuration(duration);
+    shownPosition = -1;
+    display->schedule();
 }
 
 void Player::positionChanged(qint64 progress)
 {
-    if (!slider->isSliderDown()) {
-        slider->setValue(progress / 1000);
-    }
-    updateDurationInfo(progress / 1000);
+    position = progress / 1000;
+    positionMsecs = progress;
+    if (position != shownPosition || seekBar->moves(progress))
+        display->schedule();
+}
+
+void Player::refreshPosition()
+{
+    overlay->setStatus("display", QString("%1 refreshes for %2 position updates").arg(display->refreshes()).arg(display->requests()));
+    if (!seekBar->isDragging())
+        seekBar->setPosition(positionMsecs);
+    if (position == shownPosition)
+        return;
+    shownPosition = position;
+    updateDurationInfo(position);
 }
 
 void Player::metaDataChanged()
 {
-    QString albumTitle, length, coverpath, number, bitrate;
-    title = filename;
+    int index = player->currentIndex();
+    title = playlistModel->title(index);
     artist = "Unknown artist";
-    if(player->isMetaDataAvailable())
+    if(index >= 0)
     {
-        if(player->metaData(QMediaMetaData::Title).toString() != "")
-            title = player->metaData(QMediaMetaData::Title).toString();
-        if(player->metaData(QMediaMetaData::AlbumArtist).toString() != "")
-            artist = player->metaData(QMediaMetaData::AlbumArtist).toString();
-        albumTitle = player->metaData(QMediaMetaData::AlbumTitle).toString();
-        QTime totalDuration((duration/3600)%60, (duration/60)%60, duration%60, (duration*1000)%1000);
-        QString format = duration > 3600 ? "hh:mm:ss" : "mm:ss";
-        length = totalDuration.toString(format);
-        number = player->metaData(QMediaMetaData::TrackNumber).toString();
-        bitrate = player->metaData(QMediaMetaData::AudioBitRate).toString();
-        if(playlistModel->findItems(player->metaData(QMediaMetaData::Title).toString()).isEmpty() && playlistModel->findItems(filename).isEmpty())
-        {
-            QList<QStandardItem *> items;
-            items.append(new QStandardItem(title));
-            items.append(new QStandardItem(artist));
-            items.append(new QStandardItem(number));
-            items.append(new QStandardItem(albumTitle));
-            items.append(new QStandardItem(bitrate));
-            items.append(new QStandardItem(length));
-            playlistModel->appendRow(items);
-            playlistView->setRowHeight(playlistModel->rowCount()-1, 15);
+        TrackInfo track = playlistModel->track(index);
+        if(!track.artist.isEmpty())
+            artist = track.artist;
+        if (track.path != coverPath) {
+            coverPath = track.path;
+            coverArt->request(track.path, imageLabel->maximumSize());
+            seekBar->clearWaveform();
+            waveforms->request(track.path);
         }
-        coverpath = filepath + "/cover.jpg";
-        QPixmap pixmap(coverpath);
-        QSize size = pixmap.size();
-        pixmap.scaled(size, Qt::KeepAspectRatio);
-        imageLabel->setPixmap(pixmap);
     }
     setTrackInfo();
 }
 
+void Player::coverReady(const QString &path, const QImage &image)
+{
+    if (path == coverPath)
+        imageLabel->setPixmap(QPixmap::fromImage(image));
+    overlay->setStatus("cover", QString("%1 memory  %2 disk  %3 decoded  avg %4 ms").arg(coverArt->memoryHits())
+                       .arg(coverArt->diskHits()).arg(coverArt->misses()).arg(coverArt->averageDecodeTime()));
+}
+
+void Player::waveformUpdated(const QString &path, const Waveform &waveform)
+{
+    if (path == coverPath)
+        seekBar->setWaveform(waveform);
+}
+
 void Player::addToPlaylist(const QList<QUrl> urls)
 {
-    foreach (const QUrl &url, urls) {
-        playlist->addMedia(url);
-    }
+    QStringList unreadable;
+    if (!library->addUrls(urls, library->indexOf(playlistModel), &unreadable))
+        QMessageBox::warning(this, tr("Add to playlist"), tr("Cannot open playlist:\n%1").arg(unreadable.join('\n')));
+}
+
+
+void Player::scanProgress(int done, int total)
+{
+    scanBar->setMaximum(total);
+    scanBar->setValue(done);
+    scanBar->setVisible(done < total);
+}
+
+void Player::scanFinished(int files, int cached, qint64 msecs)
+{
+    Q_UNUSED(files);
+    Q_UNUSED(cached);
+    Q_UNUSED(msecs);
+    scanBar->hide();
+}
+
+void Player::folderScanFinished(int directories, int files, qint64 msecs)
+{
+    overlay->setStatus("folders", QString("%1 dirs  %2 files  %3 ms  %4 files/s").arg(directories).arg(files)
+                       .arg(msecs).arg(files * 1000 / qMax<qint64>(1, msecs)));
 }
 
 void Player::previousClicked()
@@ -222,22 +344,16 @@ void Player::previousClicked()
         player->setPosition(0);
 }
 
-void Player::seek(int time)
+void Player::seek(qint64 position)
 {
-    player->setPosition(time * 1000);
+    player->setPosition(position);
 }
 
 void Player::updateDurationInfo(qint64 currentInfo)
 {
     QString tStr;
-    if (currentInfo || duration) {
-        QTime currentTime((currentInfo/3600)%60, (currentInfo/60)%60, currentInfo%60, (currentInfo*1000)%1000);
-        QTime totalTime((duration/3600)%60, (duration/60)%60, duration%60, (duration*1000)%1000);
-        QString format = "mm:ss";
-        if (duration > 3600)
-            format = "hh:mm:ss";
-        tStr = currentTime.toString(format) + " / " + totalTime.toString(format);
-    }
+    if (currentInfo || duration)
+        tStr = timeString(currentInfo, duration >= 3600) + " / " + durationText;
     durationLabel->setText(tStr);
 }
 
@@ -262,41 +378,197 @@ void Player::playbackModeChanged(int mode)
 
 void Player::setPlaylist(QModelIndex index)
 {
-    playlist = playlistVector[index.row()];
-    playlistModel = modelVector[index.row()];
-    player->setPlaylist(playlistVector[index.row()]);
-    playlistView->setModel(modelVector[index.row()]);
-    playlistView->setSelectionBehavior(QAbstractItemView::SelectRows);
-    playlistView->horizontalHeader()->setStretchLastSection(true);
-    playlistView->setSelectionMode(QAbstractItemView::SingleSelection);
-    playlistView->setEditTriggers(QAbstractItemView::NoEditTriggers);
-    playlistView->verticalHeader()->setVisible(false);
-    playlistView->horizontalHeader()->resizeSection(2,25);
-    playlistView->setContextMenuPolicy(Qt::CustomContextMenu);
+    showPlaylist(index.row());
     playlist->setCurrentIndex(0);
     player->play();
 }
 
+void Player::showPlaylist(int row)
+{
+    library->setCurrentPlaylist(row);
+    playlist = library->playlist(row);
+    playlistModel = library->model(row);
+    filterModel->setSourceModel(playlistModel);
+    sortKeys.clear();
+    playlistView->horizontalHeader()->setSortIndicatorShown(false);
+    playlistView->horizontalHeader()->resizeSection(2,25);
+}
+
+void Player::restoreSession()
+{
+    if (!session->open())
+        return;
+    const QStringList names = session->names();
+    const SessionState state = session->state();
+    if (names.isEmpty())
+        return;
+    for (int i = 0; i < names.size(); i++) {
+        if (i > 0)
+            newPlaylist();
+        listModel->item(i)->setText(names.at(i));
+    }
+
+    const int visible = qBound(0, state.currentPlaylist, names.size() - 1);
+    showPlaylist(visible);
+    list->setCurrentIndex(listModel->index(visible, 0));
+    library->appendTracks(visible, session->tracks(visible));
+    if (state.currentTrack >= 0 && state.currentTrack < playlist->mediaCount()) {
+        playlist->setCurrentIndex(state.currentTrack);
+        player->setResumePosition(state.position);
+        playlistView->scrollTo(filterModel->reveal(playlistModel->index(state.currentTrack, 0)), QAbstractItemView::PositionAtCenter);
+    }
+    playerControls->setPlaybackModeIndex(state.playbackMode);
+    player->setVolume(state.volume);
+    player->setMuted(state.muted);
+    foreach (QAction *action, replayGainMenu->actions()) {
+        if (action->data().toInt() == state.replayGain && !action->isChecked())
+            action->trigger();
+    }
+    QVariantMap fields;
+    fields["tracks"] = session->trackCount(visible);
+    reportStartupEvent("playable", fields);
+
+    QList<int> others;
+    for (int i = 0; i < names.size(); i++) {
+        if (i != visible) {
+            restoring.insert(i, library->model(i));
+            others.append(i);
+        }
+    }
+    if (others.isEmpty())
+        session->close();
+    else
+        session->loadInBackground(others);
+}
+
+void Player::sessionPlaylistLoaded(int index, const QVector<TrackInfo> &tracks)
+{
+    PlaylistModel *model = restoring.take(index);
+    const int row = library->indexOf(model);
+    if (row >= 0)
+        library->appendTracks(row, tracks);
+    if (restoring.isEmpty()) {
+        session->close();
+        QVariantMap fields;
+        fields["playlists"] = library->count();
+        reportStartupEvent("restored", fields);
+    }
+}
+
+void Player::saveSession()
+{
+    session->cancel();
+    QHashIterator<int, PlaylistModel*> it(restoring);
+    while (it.hasNext()) {
+        it.next();
+        const int row = library->indexOf(it.value());
+        if (row >= 0)
+            library->appendTracks(row, session->tracks(it.key()));
+    }
+    restoring.clear();
+
+    SessionState state;
+    QStringList names;
+    for (int row = 0; row < listModel->rowCount(); row++)
+        names.append(listModel->item(row)->text());
+    state.currentPlaylist = library->indexOf(playlistModel);
+    state.currentTrack = playlist->currentIndex();
+    state.position = player->state() == QMediaPlayer::StoppedState ? 0 : player->position();
+    state.playbackMode = playerControls->playbackModeIndex();
+    state.volume = player->volume();
+    state.muted = player->isMuted();
+    state.replayGain = player->replayGainMode();
+    QElapsedTimer timer;
+    timer.start();
+    if (!session->save(state, names, library->models())) {
+        QMessageBox::warning(this, tr("Session"), tr("The session could not be saved. Playlist changes since the last start will be lost."));
+        return;
+    }
+    PROFILE_COUNTER("session.save", timer.elapsed());
+    QVariantMap fields;
+    fields["saveMsecs"] = timer.elapsed();
+    reportStartupEvent("saved", fields);
+}
+
+void Player::search(const QString &text)
+{
+    filterModel->setFilterText(text);
+}
+
+void Player::sortColumn(int column)
+{
+    SortKey key;
+    key.column = column;
+    key.order = Qt::AscendingOrder;
+    if (QApplication::keyboardModifiers() & Qt::ShiftModifier) {
+        for (int i = 0; i < sortKeys.size(); i++) {
+            if (sortKeys.at(i).column == column) {
+                key.order = sortKeys.at(i).order == Qt::AscendingOrder ? Qt::DescendingOrder : Qt::AscendingOrder;
+                sortKeys.removeAt(i);
+                break;
+            }
+        }
+        sortKeys.append(key);
+    } else {
+        if (!sortKeys.isEmpty() && sortKeys.first().column == column && sortKeys.first().order == Qt::AscendingOrder)
+            key.order = Qt::DescendingOrder;
+        sortKeys.clear();
+        sortKeys.append(key);
+    }
+    playlistView->horizontalHeader()->setSortIndicatorShown(true);
+    playlistView->horizontalHeader()->setSortIndicator(sortKeys.first().column, sortKeys.first().order);
+    sorter->sort(playlistModel, sortKeys);
+}
+
+void Player::playlistSorted(PlaylistModel *model, const QVector<int> &order, qint64 msecs)
+{
+    const int row = library->indexOf(model);
+    if (row < 0)
+        return;
+    QElapsedTimer timer;
+    timer.start();
+    library->reorder(row, order);
+    PROFILE_COUNTER("sort.sort", msecs);
+    PROFILE_COUNTER("sort.apply", timer.elapsed());
+}
+
+void Player::paintEvent(QPaintEvent *event)
+{
+    QWidget::paintEvent(event);
+    if (!painted) {
+        painted = true;
+        reportStartupEvent("firstPaint", QVariantMap());
+    }
+}
+
 void Player::newPlaylist()
 {
     QStandardItem *item = new QStandardItem(tr("Untitled playlist"));
     listModel->appendRow(item);
-    playlist = new QMediaPlaylist(this);
-    playlistModel = new QStandardItemModel(this);
+    const int row = library->addPlaylist();
+    playlist = library->playlist(row);
+    playlistModel = library->model(row);
     connect(playerControls, SIGNAL(next()), playlist, SLOT(next()));
-    playlistModel->setHorizontalHeaderLabels(QStringList() << tr("Title") << tr("Artist") << tr("#") << tr("Album") << tr("Bitrate") << tr("Length"));
-    playlistVector.append(playlist);
-    modelVector.append(playlistModel);
+}
+
+void Player::savePlaylist()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Playlist"), filepath,
+        tr("M3U8 playlist (*.m3u8);;M3U playlist (*.m3u);;PLS playlist (*.pls);;XSPF playlist (*.xspf)"));
+    if (fileName.isEmpty())
+        return;
+    if (QFileInfo(fileName).suffix().isEmpty())
+        fileName += ".m3u8";
+    if (!PlaylistWriter::write(fileName, playlistModel))
+        QMessageBox::warning(this, tr("Save Playlist"), tr("Could not save %1").arg(QDir::toNativeSeparators(fileName)));
 }
 
 void Player::providePlaylistContextMenu(const QPoint &point)
 {
-    qDebug() << "context";
     QAction *addAction = new QAction("Add new playlist",list);
     QAction *removeAction = new QAction("Remove playlist",list);
     QMenu *contextMenu = new QMenu(this);
     remove = list->indexAt(point);
-    qDebug() << remove.isValid();
     contextMenu->addAction(addAction);
     contextMenu->addAction(removeAction);
     connect(addAction, SIGNAL(triggered()), this, SLOT(newPlaylist()));
@@ -309,11 +581,15 @@ void Player::removePlaylist()
 {
     if(remove.isValid() && remove.row() != 0)
     {
+        PlaylistModel *model = library->model(remove.row());
+        if (model == playlistModel || !library->removePlaylist(remove.row()))
+            return;
+        QMutableHashIterator<int, PlaylistModel*> it(restoring);
+        while (it.hasNext()) {
+            if (it.next().value() == model)
+                it.remove();
+        }
         listModel->removeRow(remove.row());
-        delete playlistVector[remove.row()];
-        delete modelVector[remove.row()];
-        playlistVector.remove(remove.row());
-        modelVector.remove(remove.row());
     }
 }
 
@@ -326,10 +602,14 @@ void Player::provideTrackContextMenu(const QPoint &point)
 {
     QAction *removeAction = new QAction("Remove track",playlistView);
     QMenu *contextMenu = new QMenu(this);
-    remove = playlistView->indexAt(point);
-    qDebug() << remove.isValid();
+    remove = filterModel->mapToSource(playlistView->indexAt(point));
     contextMenu->addAction(removeAction);
     connect(removeAction, SIGNAL(triggered()), this, SLOT(removeTrack()));
+    contextMenu->addSeparator();
+    QAction *analyzeAction = contextMenu->addAction("Analyze loudness", this, SLOT(analyzeLoudness()));
+    QAction *writeAction = contextMenu->addAction("Analyze loudness and write ReplayGain tags", this, SLOT(writeReplayGain()));
+    analyzeAction->setEnabled(!loudness->isRunning() && playlistModel->rowCount());
+    writeAction->setEnabled(analyzeAction->isEnabled());
     contextMenu->exec(QCursor::pos());
     delete contextMenu;
 }
@@ -344,9 +624,110 @@ void Player::removeTrack()
     }
 }
 
+void Player::analyzeLoudness()
+{
+    analyzePlaylist(false);
+}
+
+void Player::writeReplayGain()
+{
+    analyzePlaylist(true);
+}
+
+void Player::analyzePlaylist(bool writeTags)
+{
+    QVector<TrackInfo> tracks;
+    tracks.reserve(playlistModel->rowCount());
+    for (int row = 0; row < playlistModel->rowCount(); row++)
+        tracks.append(playlistModel->track(row));
+    scanBar->setFormat(tr("Analyzing %v/%m"));
+    loudness->analyze(tracks, writeTags);
+}
+
+void Player::loudnessProgress(int done, int total)
+{
+    scanBar->setFormat(tr("Analyzing %v/%m at %1x realtime").arg(loudness->realtimeFactor(), 0, 'f', 1));
+    scanProgress(done, total);
+}
+
+void Player::loudnessFinished(int files, int failed, int tagged, qint64 audioMsecs, qint64 msecs)
+{
+    scanBar->hide();
+    scanBar->setFormat(tr("Scanning %v/%m"));
+    overlay->setStatus("loudness", QString("%1 of %2 analyzed  %3 tagged  %4x realtime").arg(files - failed).arg(files)
+                       .arg(tagged).arg(double(audioMsecs) / qMax<qint64>(1, msecs), 0, 'f', 1));
+}
+
 void Player::setTrack(QModelIndex index)
 {
-    playlist->setCurrentIndex(index.row());
+    playlist->setCurrentIndex(filterModel->mapToSource(index).row());
+}
+
+void Player::replayGainChanged(QAction *action)
+{
+    player->setReplayGainMode(GainStage::ReplayGainMode(action->data().toInt()));
+    overlay->setStatus("gain", QString("%1  %2 kernels").arg(action->text().remove('&')).arg(GainStage::kernel()));
+}
+
+void Player::exportTrace()
+{
+    const QString fileName = QFileDialog::getSaveFileName(this, tr("Export Trace"), filepath, tr("Chrome trace (*.json)"));
+    if (fileName.isEmpty())
+        return;
+    if (!Profiler::instance()->writeTrace(fileName))
+        QMessageBox::warning(this, tr("Export Trace"), tr("Could not save %1").arg(QDir::toNativeSeparators(fileName)));
+}
+
+void Player::findDuplicates()
+{
+    QStringList names;
+    for (int row = 0; row < listModel->rowCount(); row++)
+        names.append(listModel->item(row)->text());
+    DuplicatesDialog *dialog = new DuplicatesDialog(library, names, this);
+    connect(dialog, SIGNAL(trackActivated(int,int)), this, SLOT(playTrack(int,int)));
+    dialog->show();
+}
+
+void Player::showDsp()
+{
+    DspDialog *dialog = new DspDialog(player, this);
+    dialog->show();
+}
+
+void Player::playTrack(int playlistRow, int row)
+{
+    if (playlistRow >= library->count() || row >= library->model(playlistRow)->rowCount())
+        return;
+    list->setCurrentIndex(listModel->index(playlistRow, 0));
+    showPlaylist(playlistRow);
+    playlistView->scrollTo(filterModel->reveal(playlistModel->index(row, 0)), QAbstractItemView::PositionAtCenter);
+    playlist->setCurrentIndex(row);
+    player->play();
+}
+
+void Player::setBufferDepth(int milliseconds)
+{
+    player->setBufferDepth(milliseconds);
+}
+
+// The session is restored while the window is constructed, so events from before the
+// report was switched on are kept and printed then.
+void Player::setStartupReport(bool json)
+{
+    reportStartup = true;
+    reportJson = json;
+    for (int i = 0; i < startupEvents.size(); i++)
+        HeadlessPlayer::printEvent(startupEvents.at(i).first, startupEvents.at(i).second, reportJson);
+    startupEvents.clear();
+}
+
+void Player::reportStartupEvent(const QString &event, QVariantMap fields)
+{
+    fields["msecs"] = startup.elapsed();
+    if (reportStartup)
+        HeadlessPlayer::printEvent(event, fields, reportJson);
+    else if (startupEvents.size() < 3)
+        startupEvents.append(qMakePair(event, fields));
 }
 
 void Player::about()
@@ -2,18 +2,34 @@
 #define PLAYER_H
 
 #include "playercontrols.h"
+#include "library.h"
+#include "playlistwriter.h"
+#include "session.h"
+#include "coverartservice.h"
+#include "waveformservice.h"
+#include "waveformseekbar.h"
+#include "playlistfiltermodel.h"
+#include "playlistsorter.h"
+#include "performanceoverlay.h"
+#include "displayscheduler.h"
+#include "loudnessanalyzer.h"
+#include "controlserver.h"
 #include <QWidget>
-#include <QMediaPlayer>
 #include <QMediaPlaylist>
 #include <QStandardItemModel>
 #include <QListView>
 #include <QTableView>
-#include <QSlider>
 #include <QLabel>
 #include <QToolBar>
 #include <QComboBox>
 #include <QMenuBar>
 #include <QVector>
+#include <QProgressBar>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QVariantMap>
+#include <QPair>
+#include <QLineEdit>
 
 class Player : public QWidget
 {
@@ -22,51 +38,106 @@ class Player : public QWidget
 public:
     explicit Player(QWidget *parent = 0);
     void addToPlaylist(const QList<QUrl> urls);
+    void setBufferDepth(int milliseconds);
+    void setStartupReport(bool json);
     ~Player();
 
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
 private slots:
     void open();
+    void openFolder();
     void durationChanged(qint64 duration);
     void positionChanged(qint64 progress);
+    void refreshPosition();
     void metaDataChanged();
     void previousClicked();
-    void seek(int time);
+    void seek(qint64 position);
     void playbackModeChanged(int mode);
     void setPlaylist(QModelIndex index);
     void newPlaylist();
+    void savePlaylist();
     void providePlaylistContextMenu(const QPoint &point);
     void removePlaylist();
     void provideTrackContextMenu(const QPoint &point);
     void removeTrack();
+    void analyzeLoudness();
+    void writeReplayGain();
+    void loudnessProgress(int done, int total);
+    void loudnessFinished(int files, int failed, int tagged, qint64 audioMsecs, qint64 msecs);
     void setTrack(QModelIndex index);
     void about();
+    void exportTrace();
+    void findDuplicates();
+    void showDsp();
+    void playTrack(int playlistRow, int row);
+    void scanProgress(int done, int total);
+    void scanFinished(int files, int cached, qint64 msecs);
+    void folderScanFinished(int directories, int files, qint64 msecs);
+    void replayGainChanged(QAction *action);
+    void sessionPlaylistLoaded(int index, const QVector<TrackInfo> &tracks);
+    void coverReady(const QString &path, const QImage &image);
+    void waveformUpdated(const QString &path, const Waveform &waveform);
+    void search(const QString &text);
+    void sortColumn(int column);
+    void playlistSorted(PlaylistModel *model, const QVector<int> &order, qint64 msecs);
 
 private:
+    void showPlaylist(int row);
+    void analyzePlaylist(bool writeTags);
+    void restoreSession();
+    void reportStartupEvent(const QString &event, QVariantMap fields);
+    void saveSession();
     void updateDurationInfo(qint64 currentInfo);
     void setTrackInfo();
-    QMediaPlayer *player;
+    Library *library;
+    ControlServer *control;
+    PlaybackEngine *player;
     QMediaPlaylist *playlist;
-    QStandardItemModel *playlistModel;
+    PlaylistModel *playlistModel;
+    PlaylistFilterModel *filterModel;
+    QLineEdit *searchEdit;
+    PlaylistSorter *sorter;
+    QList<SortKey> sortKeys;
     QStandardItemModel *listModel;
     QListView *list;
     QTableView *playlistView;
     QWidget *cover;
     PlayerControls *playerControls;
-    QSlider *slider;
+    WaveformSeekBar *seekBar;
     QMenuBar *menu;
     QMenu *fileMenu;
     QMenu *playbackMenu;
+    QMenu *viewMenu;
     QMenu *aboutMenu;
-    QString filename;
+    QMenu *replayGainMenu;
+    QAction *watchAction;
     QString filepath;
     QString statusInfo;
     QString title;
     QString artist;
     QLabel *durationLabel;
     QLabel *imageLabel;
+    PerformanceOverlay *overlay;
+    DisplayScheduler *display;
+    QProgressBar *scanBar;
+    Session *session;
+    CoverArtService *coverArt;
+    WaveformService *waveforms;
+    LoudnessAnalyzer *loudness;
+    QString coverPath;
+    QHash<int, PlaylistModel*> restoring;
+    QElapsedTimer startup;
+    bool painted;
+    bool reportStartup;
+    bool reportJson;
+    QList<QPair<QString, QVariantMap> > startupEvents;
     qint64 duration;
-    QVector<QMediaPlaylist*> playlistVector;
-    QVector<QStandardItemModel*> modelVector;
+    qint64 position;
+    qint64 positionMsecs;
+    qint64 shownPosition;
+    QString durationText;
     QModelIndex remove;
 };
 
@@ -137,6 +137,16 @@ void PlayerControls::onVolumeSliderValueChanged()
     emit changeVolume(volume());
 }
 
+int PlayerControls::playbackModeIndex() const
+{
+    return playbackMode->currentIndex();
+}
+
+void PlayerControls::setPlaybackModeIndex(int mode)
+{
+    playbackMode->setCurrentIndex(mode);
+}
+
 void PlayerControls::playbackModeChanged()
 {
     emit changePlaybackMode(playbackMode->currentIndex());
@@ -16,11 +16,13 @@ public:
     QMediaPlayer::State state() const;
     int volume() const;
     bool isMuted() const;
+    int playbackModeIndex() const;
 
 public slots:
     void setState(QMediaPlayer::State state);
     void setVolume(int volume);
     void setMuted(bool muted);
+    void setPlaybackModeIndex(int mode);
 
 signals:
     void play();
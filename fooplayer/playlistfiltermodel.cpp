@@ -0,0 +1,311 @@
+#include "playlistfiltermodel.h"
+#include "profiler.h"
+#include <QElapsedTimer>
+#include <QTimer>
+#include <algorithm>
+
+static const int refilterDelay = 500;
+static const int fetchRows = 1024;
+static const int incrementalRows = 4096;
+
+PlaylistFilterModel::PlaylistFilterModel(QObject *parent) :
+    QAbstractProxyModel(parent), playlistModel(0), filterTime(0), exposed(fetchRows), pending(false), indexValid(false)
+{
+    refilterTimer = new QTimer(this);
+    refilterTimer->setSingleShot(true);
+    refilterTimer->setInterval(refilterDelay);
+    connect(refilterTimer, SIGNAL(timeout()), this, SLOT(refilter()));
+}
+
+void PlaylistFilterModel::setSourceModel(QAbstractItemModel *model)
+{
+    beginResetModel();
+    if (sourceModel())
+        sourceModel()->disconnect(this);
+    QAbstractProxyModel::setSourceModel(model);
+    playlistModel = qobject_cast<PlaylistModel *>(model);
+    rebuildIndex();
+    rows.clear();
+    exposed = fetchRows;
+    if (model) {
+        connect(model, SIGNAL(rowsAboutToBeInserted(QModelIndex,int,int)), this, SLOT(sourceRowsAboutToBeInserted(QModelIndex,int,int)));
+        connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(sourceRowsInserted(QModelIndex,int,int)));
+        connect(model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)), this, SLOT(sourceRowsAboutToBeRemoved(QModelIndex,int,int)));
+        connect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(sourceRowsRemoved(QModelIndex,int,int)));
+        connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(sourceDataChanged(QModelIndex,QModelIndex)));
+        connect(model, SIGNAL(modelAboutToBeReset()), this, SLOT(sourceAboutToBeReset()));
+        connect(model, SIGNAL(modelReset()), this, SLOT(sourceReset()));
+        connect(model, SIGNAL(layoutAboutToBeChanged()), this, SLOT(sourceAboutToBeReset()));
+        connect(model, SIGNAL(layoutChanged()), this, SLOT(sourceReset()));
+        if (isFiltering())
+            rows = search(query, 0);
+    }
+    endResetModel();
+}
+
+QModelIndex PlaylistFilterModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (parent.isValid() || row < 0 || row >= rowCount() || column < 0 || column >= columnCount())
+        return QModelIndex();
+    return createIndex(row, column);
+}
+
+QModelIndex PlaylistFilterModel::parent(const QModelIndex &child) const
+{
+    Q_UNUSED(child);
+    return QModelIndex();
+}
+
+int PlaylistFilterModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid() || !sourceModel())
+        return 0;
+    return qMin(exposed, matchCount());
+}
+
+int PlaylistFilterModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid() || !sourceModel())
+        return 0;
+    return sourceModel()->columnCount();
+}
+
+QModelIndex PlaylistFilterModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if (!proxyIndex.isValid() || !sourceModel())
+        return QModelIndex();
+    if (!isFiltering())
+        return sourceModel()->index(proxyIndex.row(), proxyIndex.column());
+    if (proxyIndex.row() >= rows.size())
+        return QModelIndex();
+    return sourceModel()->index(rows.at(proxyIndex.row()), proxyIndex.column());
+}
+
+QModelIndex PlaylistFilterModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if (!sourceIndex.isValid())
+        return QModelIndex();
+    if (!isFiltering())
+        return index(sourceIndex.row(), sourceIndex.column());
+    QVector<int>::const_iterator it = std::lower_bound(rows.constBegin(), rows.constEnd(), sourceIndex.row());
+    if (it == rows.constEnd() || *it != sourceIndex.row())
+        return QModelIndex();
+    return index(int(it - rows.constBegin()), sourceIndex.column());
+}
+
+bool PlaylistFilterModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && rowCount() < matchCount();
+}
+
+void PlaylistFilterModel::fetchMore(const QModelIndex &parent)
+{
+    if (!parent.isValid())
+        fetchTo(rowCount() + fetchRows);
+}
+
+QModelIndex PlaylistFilterModel::reveal(const QModelIndex &sourceIndex)
+{
+    if (!sourceIndex.isValid())
+        return QModelIndex();
+    int row = sourceIndex.row();
+    if (isFiltering()) {
+        QVector<int>::const_iterator it = std::lower_bound(rows.constBegin(), rows.constEnd(), row);
+        if (it == rows.constEnd() || *it != row)
+            return QModelIndex();
+        row = int(it - rows.constBegin());
+    }
+    fetchTo(row + fetchRows);
+    return index(row, sourceIndex.column());
+}
+
+int PlaylistFilterModel::matchCount() const
+{
+    if (!sourceModel())
+        return 0;
+    return isFiltering() ? rows.size() : sourceModel()->rowCount();
+}
+
+QVariant PlaylistFilterModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (!sourceModel() || (orientation == Qt::Vertical && isFiltering()))
+        return QVariant();
+    return sourceModel()->headerData(section, orientation, role);
+}
+
+QString PlaylistFilterModel::filterText() const
+{
+    return filter;
+}
+
+bool PlaylistFilterModel::isFiltering() const
+{
+    return !query.isEmpty();
+}
+
+qint64 PlaylistFilterModel::lastFilterTime() const
+{
+    return filterTime;
+}
+
+void PlaylistFilterModel::setFilterText(const QString &text)
+{
+    filter = text;
+    const QString folded = SearchIndex::terms(text).join(QLatin1Char(' '));
+    if (folded != query)
+        applyFilter(folded, isFiltering() && folded.startsWith(query));
+}
+
+void PlaylistFilterModel::sourceRowsAboutToBeInserted(const QModelIndex &parent, int first, int last)
+{
+    const int visible = rowCount();
+    pending = !isFiltering() && first < exposed;
+    if (!pending)
+        return;
+    if (first < visible) {
+        exposed += last - first + 1;
+        beginInsertRows(parent, first, last);
+    } else {
+        beginInsertRows(parent, first, qMin(last, exposed - 1));
+    }
+}
+
+void PlaylistFilterModel::sourceRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent);
+    if (indexValid && playlistModel && first == searchIndex.size()) {
+        for (int row = first; row <= last; row++)
+            searchIndex.append(SearchIndex::text(playlistModel->track(row)));
+        if (isFiltering())
+            refilterTimer->start();
+    } else {
+        rebuildIndex();
+    }
+    if (pending)
+        endInsertRows();
+    pending = false;
+}
+
+void PlaylistFilterModel::sourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (isFiltering()) {
+        beginResetModel();
+        return;
+    }
+    const int visible = rowCount();
+    pending = first < visible;
+    if (pending) {
+        last = qMin(last, visible - 1);
+        exposed -= last - first + 1;
+        beginRemoveRows(parent, first, last);
+    }
+}
+
+void PlaylistFilterModel::sourceRowsRemoved(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent);
+    if (indexValid && last < searchIndex.size())
+        searchIndex.remove(first, last - first + 1);
+    else
+        rebuildIndex();
+    if (!isFiltering()) {
+        if (pending)
+            endRemoveRows();
+        pending = false;
+        return;
+    }
+    rows = search(query, 0);
+    endResetModel();
+}
+
+void PlaylistFilterModel::sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    const int changed = bottomRight.row() - topLeft.row() + 1;
+    if (indexValid && playlistModel && changed <= qMax(incrementalRows, searchIndex.size() / 8)) {
+        for (int row = topLeft.row(); row <= bottomRight.row(); row++)
+            searchIndex.update(row, SearchIndex::text(playlistModel->track(row)));
+        if (isFiltering())
+            refilterTimer->start();
+    } else {
+        rebuildIndex();
+    }
+    const int visible = rowCount();
+    if (!isFiltering() && topLeft.row() < visible)
+        emit dataChanged(index(topLeft.row(), topLeft.column()), index(qMin(bottomRight.row(), visible - 1), bottomRight.column()));
+    else if (isFiltering() && visible > 0)
+        emit dataChanged(index(0, 0), index(visible - 1, columnCount() - 1));
+}
+
+void PlaylistFilterModel::sourceAboutToBeReset()
+{
+    beginResetModel();
+}
+
+void PlaylistFilterModel::sourceReset()
+{
+    rebuildIndex();
+    rows.clear();
+    exposed = fetchRows;
+    if (isFiltering())
+        rows = search(query, 0);
+    refilterTimer->stop();
+    endResetModel();
+}
+
+void PlaylistFilterModel::refilter()
+{
+    if (isFiltering())
+        applyFilter(query, false);
+}
+
+void PlaylistFilterModel::applyFilter(const QString &folded, bool refine)
+{
+    PROFILE_SCOPE("filter.apply");
+    QElapsedTimer timer;
+    timer.start();
+    QVector<int> result;
+    if (!folded.isEmpty())
+        result = search(folded, refine ? &rows : 0);
+    beginResetModel();
+    query = folded;
+    rows = result;
+    exposed = fetchRows;
+    endResetModel();
+    filterTime = timer.nsecsElapsed();
+}
+
+QVector<int> PlaylistFilterModel::search(const QString &folded, const QVector<int> *within)
+{
+    if (!indexValid && playlistModel) {
+        searchIndex.build(playlistModel);
+        indexValid = true;
+        refilterTimer->stop();
+        within = 0;
+    }
+    return searchIndex.search(folded, within);
+}
+
+void PlaylistFilterModel::fetchTo(int row)
+{
+    const int visible = rowCount();
+    const int target = qMin(row, matchCount());
+    if (target <= visible)
+        return;
+    beginInsertRows(QModelIndex(), visible, target - 1);
+    exposed = target;
+    endInsertRows();
+}
+
+// Built eagerly whenever the source changes wholesale, so the first keystroke afterwards
+// only searches; appends, edits and removals patch the index in place.
+void PlaylistFilterModel::rebuildIndex()
+{
+    indexValid = false;
+    searchIndex.clear();
+    if (playlistModel) {
+        searchIndex.build(playlistModel);
+        indexValid = true;
+    }
+    if (isFiltering())
+        refilterTimer->start();
+}
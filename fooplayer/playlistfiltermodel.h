@@ -0,0 +1,64 @@
+#ifndef PLAYLISTFILTERMODEL_H
+#define PLAYLISTFILTERMODEL_H
+
+#include "playlistmodel.h"
+#include "searchindex.h"
+#include <QAbstractProxyModel>
+#include <QVector>
+
+class QTimer;
+
+class PlaylistFilterModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+public:
+    explicit PlaylistFilterModel(QObject *parent = nullptr);
+    void setSourceModel(QAbstractItemModel *model) override;
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+    QModelIndex reveal(const QModelIndex &sourceIndex);
+    int matchCount() const;
+    QString filterText() const;
+    bool isFiltering() const;
+    qint64 lastFilterTime() const;
+
+public slots:
+    void setFilterText(const QString &text);
+
+private slots:
+    void sourceRowsAboutToBeInserted(const QModelIndex &parent, int first, int last);
+    void sourceRowsInserted(const QModelIndex &parent, int first, int last);
+    void sourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    void sourceRowsRemoved(const QModelIndex &parent, int first, int last);
+    void sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void sourceAboutToBeReset();
+    void sourceReset();
+    void refilter();
+
+private:
+    void applyFilter(const QString &folded, bool refine);
+    QVector<int> search(const QString &folded, const QVector<int> *within);
+    void rebuildIndex();
+    void fetchTo(int row);
+
+    PlaylistModel *playlistModel;
+    SearchIndex searchIndex;
+    QVector<int> rows;
+    QString filter;
+    QString query;
+    QTimer *refilterTimer;
+    qint64 filterTime;
+    int exposed;
+    bool pending;
+    bool indexValid;
+};
+
+#endif // PLAYLISTFILTERMODEL_H
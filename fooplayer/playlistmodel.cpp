@@ -0,0 +1,334 @@
+#include "playlistmodel.h"
+#include "profiler.h"
+#include <QFileInfo>
+#include <QDir>
+#include <QSet>
+
+PlaylistModel::PlaylistModel(QObject *parent) : QAbstractTableModel(parent), mutations(0)
+{
+    strings.append(QString());
+    stringIndex.insert(QString(), 0);
+    formatted.resize(FormattedSlots);
+    clearFormatted();
+}
+
+int PlaylistModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : paths.size();
+}
+
+int PlaylistModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant PlaylistModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= paths.size())
+        return QVariant();
+    const int row = index.row();
+    if (role == Qt::UserRole)
+        return paths.at(row);
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    switch (index.column()) {
+    case Title:
+        return titles.at(row);
+    case Artist:
+        return strings.at(artists.at(row));
+    case Number:
+        return numbers.at(row) ? QVariant(int(numbers.at(row))) : QVariant();
+    case Album:
+        return strings.at(albums.at(row));
+    case Bitrate:
+        return formattedCells(row).bitrate;
+    case Length:
+        return formattedCells(row).length;
+    }
+    return QVariant();
+}
+
+QVariant PlaylistModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    switch (section) {
+    case Title:
+        return tr("Title");
+    case Artist:
+        return tr("Artist");
+    case Number:
+        return tr("#");
+    case Album:
+        return tr("Album");
+    case Bitrate:
+        return tr("Bitrate");
+    case Length:
+        return tr("Length");
+    }
+    return QVariant();
+}
+
+bool PlaylistModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || row < 0 || count <= 0 || row + count > paths.size())
+        return false;
+    beginRemoveRows(QModelIndex(), row, row + count - 1);
+    mutations++;
+    for (int i = row; i < row + count; i++)
+        removeFromIndex(i);
+    rowIndex.clear();
+    paths.remove(row, count);
+    titles.remove(row, count);
+    artists.remove(row, count);
+    albums.remove(row, count);
+    numbers.remove(row, count);
+    bitrates.remove(row, count);
+    lengths.remove(row, count);
+    clearFormatted();
+    endRemoveRows();
+    return true;
+}
+
+void PlaylistModel::appendTracks(const QVector<TrackInfo> &tracks)
+{
+    if (tracks.isEmpty())
+        return;
+    PROFILE_SCOPE("model.append");
+    const int first = paths.size();
+    const int size = first + tracks.size();
+    beginInsertRows(QModelIndex(), first, size - 1);
+    mutations++;
+    paths.resize(size);
+    titles.resize(size);
+    artists.resize(size);
+    albums.resize(size);
+    numbers.resize(size);
+    bitrates.resize(size);
+    lengths.resize(size);
+    for (int i = 0; i < tracks.size(); i++) {
+        setTrack(first + i, tracks.at(i));
+        addToIndex(first + i);
+        if (!rowIndex.isEmpty() && !rowIndex.contains(paths.at(first + i)))
+            rowIndex.insert(paths.at(first + i), first + i);
+    }
+    endInsertRows();
+}
+
+void PlaylistModel::updateTracks(const QVector<int> &rows, const QVector<TrackInfo> &tracks)
+{
+    PROFILE_SCOPE("model.update");
+    int top = paths.size();
+    int bottom = -1;
+    for (int i = 0; i < rows.size(); i++) {
+        int row = rows.at(i);
+        if (row < 0 || row >= paths.size() || paths.at(row) != tracks.at(i).path)
+            row = rowOf(tracks.at(i).path);
+        if (row < 0)
+            continue;
+        removeFromIndex(row);
+        setTrack(row, tracks.at(i));
+        addToIndex(row);
+        top = qMin(top, row);
+        bottom = qMax(bottom, row);
+    }
+    if (bottom >= top) {
+        mutations++;
+        clearFormatted();
+        emit dataChanged(index(top, 0), index(bottom, ColumnCount - 1));
+    }
+}
+
+template <typename T>
+static QVector<T> permuted(const QVector<T> &values, const QVector<int> &order)
+{
+    QVector<T> result;
+    result.reserve(values.size());
+    foreach (int row, order)
+        result.append(values.at(row));
+    return result;
+}
+
+void PlaylistModel::permute(const QVector<int> &order)
+{
+    if (order.size() != paths.size())
+        return;
+    emit layoutAboutToBeChanged();
+    mutations++;
+    rowIndex.clear();
+    QVector<int> position(order.size());
+    for (int i = 0; i < order.size(); i++)
+        position[order.at(i)] = i;
+    paths = permuted(paths, order);
+    titles = permuted(titles, order);
+    artists = permuted(artists, order);
+    albums = permuted(albums, order);
+    numbers = permuted(numbers, order);
+    bitrates = permuted(bitrates, order);
+    lengths = permuted(lengths, order);
+    clearFormatted();
+
+    const QModelIndexList from = persistentIndexList();
+    QModelIndexList to;
+    foreach (const QModelIndex &index, from)
+        to.append(this->index(position.at(index.row()), index.column()));
+    changePersistentIndexList(from, to);
+    emit layoutChanged();
+}
+
+PlaylistColumns PlaylistModel::columns() const
+{
+    PlaylistColumns columns;
+    columns.titles = titles;
+    columns.artists = artists;
+    columns.albums = albums;
+    columns.numbers = numbers;
+    columns.bitrates = bitrates;
+    columns.lengths = lengths;
+    columns.strings = strings;
+    return columns;
+}
+
+QString PlaylistModel::path(int row) const
+{
+    return paths.value(row);
+}
+
+QString PlaylistModel::title(int row) const
+{
+    return titles.value(row);
+}
+
+TrackInfo PlaylistModel::track(int row) const
+{
+    TrackInfo info;
+    if (row < 0 || row >= paths.size())
+        return info;
+    info.path = paths.at(row);
+    info.title = titles.at(row);
+    info.artist = strings.at(artists.at(row));
+    info.album = strings.at(albums.at(row));
+    info.trackNumber = numbers.at(row);
+    info.bitrate = bitrates.at(row);
+    info.length = lengths.at(row);
+    info.valid = true;
+    return info;
+}
+
+bool PlaylistModel::contains(const QString &path) const
+{
+    return pathIndex.contains(pathKey(path));
+}
+
+// The paths that are neither in the playlist nor earlier in the list, in their order.
+QStringList PlaylistModel::newPaths(const QStringList &paths) const
+{
+    QStringList fresh;
+    QSet<QString> seen;
+    foreach (const QString &path, paths) {
+        const QString key = pathKey(path);
+        if (pathIndex.contains(key) || seen.contains(key))
+            continue;
+        seen.insert(key);
+        fresh.append(path);
+    }
+    return fresh;
+}
+
+qint64 PlaylistModel::memoryUsage() const
+{
+    qint64 bytes = qint64(paths.capacity() + titles.capacity()) * qint64(sizeof(QString))
+            + qint64(artists.capacity() + albums.capacity()) * qint64(sizeof(int))
+            + qint64(numbers.capacity() + bitrates.capacity()) * qint64(sizeof(quint16))
+            + qint64(lengths.capacity()) * qint64(sizeof(qint32));
+    for (int i = 0; i < paths.size(); i++)
+        bytes += (paths.at(i).capacity() + titles.at(i).capacity()) * qint64(sizeof(QChar));
+    for (int i = 0; i < strings.size(); i++)
+        bytes += qint64(sizeof(QString)) + strings.at(i).capacity() * qint64(sizeof(QChar));
+    return bytes;
+}
+
+quint64 PlaylistModel::generation() const
+{
+    return mutations;
+}
+
+QString PlaylistModel::lengthString(qint64 seconds)
+{
+    const QString minutes = QString("%1:%2").arg((seconds / 60) % 60, 2, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'));
+    return seconds >= 3600 ? QString("%1:%2").arg(seconds / 3600, 2, 10, QChar('0')).arg(minutes) : minutes;
+}
+
+QString PlaylistModel::pathKey(const QString &path)
+{
+    const QString key = QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+#ifdef Q_OS_WIN
+    return key.toCaseFolded();
+#else
+    return key;
+#endif
+}
+
+const PlaylistModel::FormattedCells &PlaylistModel::formattedCells(int row) const
+{
+    FormattedCells &cells = formatted[row % FormattedSlots];
+    if (cells.row != row) {
+        cells.row = row;
+        cells.bitrate = bitrates.at(row) ? QVariant(tr("%1 kbps").arg(bitrates.at(row))) : QVariant();
+        cells.length = lengths.at(row) ? QVariant(lengthString(lengths.at(row) / 1000)) : QVariant();
+    }
+    return cells;
+}
+
+void PlaylistModel::clearFormatted()
+{
+    for (int i = 0; i < formatted.size(); i++)
+        formatted[i].row = -1;
+}
+
+int PlaylistModel::intern(const QString &string)
+{
+    QHash<QString, int>::const_iterator it = stringIndex.constFind(string);
+    if (it != stringIndex.constEnd())
+        return it.value();
+    strings.append(string);
+    stringIndex.insert(string, strings.size() - 1);
+    return strings.size() - 1;
+}
+
+void PlaylistModel::setTrack(int row, const TrackInfo &track)
+{
+    paths[row] = track.path;
+    titles[row] = track.title.isEmpty() ? QFileInfo(track.path).completeBaseName() : track.title;
+    artists[row] = intern(track.artist.isEmpty() && track.valid ? tr("Unknown artist") : track.artist);
+    albums[row] = intern(track.album);
+    numbers[row] = quint16(qBound(0, track.trackNumber, 0xffff));
+    bitrates[row] = quint16(qBound(0, track.bitrate, 0xffff));
+    lengths[row] = qint32(qBound<qint64>(0, track.length, 0x7fffffff));
+}
+
+void PlaylistModel::addToIndex(int row)
+{
+    pathIndex[pathKey(paths.at(row))]++;
+}
+
+// Scan results carry the row a path had when the scan started; after a removal or
+// reorder they are matched by path instead.
+int PlaylistModel::rowOf(const QString &path)
+{
+    if (rowIndex.isEmpty()) {
+        rowIndex.reserve(paths.size());
+        for (int row = paths.size() - 1; row >= 0; row--)
+            rowIndex.insert(paths.at(row), row);
+    }
+    return rowIndex.value(path, -1);
+}
+
+void PlaylistModel::removeFromIndex(int row)
+{
+    QHash<QString, int>::iterator path = pathIndex.find(pathKey(paths.at(row)));
+    if (path != pathIndex.end() && --path.value() <= 0)
+        pathIndex.erase(path);
+}
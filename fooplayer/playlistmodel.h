@@ -0,0 +1,80 @@
+#ifndef PLAYLISTMODEL_H
+#define PLAYLISTMODEL_H
+
+#include "tagreader.h"
+#include <QAbstractTableModel>
+#include <QVector>
+#include <QHash>
+#include <QStringList>
+
+struct PlaylistColumns
+{
+    QVector<QString> titles;
+    QVector<int> artists;
+    QVector<int> albums;
+    QVector<quint16> numbers;
+    QVector<quint16> bitrates;
+    QVector<qint32> lengths;
+    QStringList strings;
+};
+
+class PlaylistModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    enum Column { Title, Artist, Number, Album, Bitrate, Length, ColumnCount };
+
+    explicit PlaylistModel(QObject *parent = nullptr);
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+
+    void appendTracks(const QVector<TrackInfo> &tracks);
+    void updateTracks(const QVector<int> &rows, const QVector<TrackInfo> &tracks);
+    void permute(const QVector<int> &order);
+    PlaylistColumns columns() const;
+    QString path(int row) const;
+    QString title(int row) const;
+    TrackInfo track(int row) const;
+    bool contains(const QString &path) const;
+    QStringList newPaths(const QStringList &paths) const;
+    qint64 memoryUsage() const;
+    quint64 generation() const;
+    static QString lengthString(qint64 seconds);
+    static QString pathKey(const QString &path);
+
+private:
+    struct FormattedCells
+    {
+        int row;
+        QVariant bitrate;
+        QVariant length;
+    };
+    enum { FormattedSlots = 256 };
+
+    const FormattedCells &formattedCells(int row) const;
+    void clearFormatted();
+    int intern(const QString &string);
+    void setTrack(int row, const TrackInfo &track);
+    void addToIndex(int row);
+    void removeFromIndex(int row);
+    int rowOf(const QString &path);
+
+    QVector<QString> paths;
+    QVector<QString> titles;
+    QVector<int> artists;
+    QVector<int> albums;
+    QVector<quint16> numbers;
+    QVector<quint16> bitrates;
+    QVector<qint32> lengths;
+    QStringList strings;
+    QHash<QString, int> stringIndex;
+    QHash<QString, int> pathIndex;
+    QHash<QString, int> rowIndex;
+    mutable QVector<FormattedCells> formatted;
+    quint64 mutations;
+};
+
+#endif // PLAYLISTMODEL_H
@@ -0,0 +1,171 @@
+#include "playlistreader.h"
+#include <QFileInfo>
+#include <QTextCodec>
+#include <QXmlStreamReader>
+#include <QUrl>
+#include <cstring>
+
+PlaylistReader::PlaylistReader(const QString &fileName) :
+    file(fileName), base(QFileInfo(fileName).absoluteDir()), type(format(fileName)), data(0), size(0), pos(0),
+    lineCount(0), xml(0), codec(QTextCodec::codecForName("UTF-8")), fallback(0)
+{
+    if (type == M3u || type == Pls)
+        fallback = QTextCodec::codecForLocale();
+}
+
+PlaylistReader::~PlaylistReader()
+{
+    close();
+}
+
+bool PlaylistReader::open()
+{
+    close();
+    if (type == Unknown || !file.open(QIODevice::ReadOnly))
+        return false;
+    size = file.size();
+    if (size == 0)
+        return true;
+    data = reinterpret_cast<const char *>(file.map(0, size));
+    if (!data) {
+        file.close();
+        return false;
+    }
+    if (size >= 3 && memcmp(data, "\xef\xbb\xbf", 3) == 0) {
+        pos = 3;
+        fallback = 0;
+    }
+    if (type == Xspf) {
+        xmlData = QByteArray::fromRawData(data, int(qMin<qint64>(size, INT_MAX)));
+        xml = new QXmlStreamReader(xmlData);
+    }
+    return true;
+}
+
+void PlaylistReader::close()
+{
+    delete xml;
+    xml = 0;
+    xmlData.clear();
+    if (data)
+        file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+    data = 0;
+    size = 0;
+    pos = 0;
+    lineCount = 0;
+    file.close();
+}
+
+bool PlaylistReader::next(QString &path)
+{
+    if (xml) {
+        while (!xml->atEnd()) {
+            if (xml->readNext() != QXmlStreamReader::StartElement)
+                continue;
+            lineCount = xml->lineNumber();
+            if (xml->name() == QLatin1String("location")) {
+                const QString location = xml->readElementText().trimmed();
+                if (!location.isEmpty()) {
+                    path = resolve(location);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    const char *line;
+    int length;
+    while (nextLine(line, length)) {
+        if (type == Pls) {
+            if (length < 5 || qstrnicmp(line, "file", 4) != 0)
+                continue;
+            const char *eq = static_cast<const char *>(memchr(line, '=', size_t(length)));
+            if (!eq)
+                continue;
+            length -= int(eq + 1 - line);
+            line = eq + 1;
+        } else if (line[0] == '#') {
+            continue;
+        }
+        const QString location = decode(line, length).trimmed();
+        if (location.isEmpty())
+            continue;
+        path = resolve(location);
+        return true;
+    }
+    return false;
+}
+
+qint64 PlaylistReader::lines() const
+{
+    return lineCount;
+}
+
+PlaylistReader::Format PlaylistReader::format(const QString &fileName)
+{
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == QLatin1String("m3u"))
+        return M3u;
+    if (suffix == QLatin1String("m3u8"))
+        return M3u8;
+    if (suffix == QLatin1String("pls"))
+        return Pls;
+    if (suffix == QLatin1String("xspf"))
+        return Xspf;
+    return Unknown;
+}
+
+bool PlaylistReader::isPlaylist(const QString &fileName)
+{
+    return format(fileName) != Unknown;
+}
+
+bool PlaylistReader::nextLine(const char *&line, int &length)
+{
+    while (pos < size) {
+        const char *start = data + pos;
+        const char *end = static_cast<const char *>(memchr(start, '\n', size_t(size - pos)));
+        if (!end)
+            end = data + size;
+        pos = end - data + 1;
+        lineCount++;
+        while (end > start && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+            end--;
+        while (start < end && (*start == ' ' || *start == '\t'))
+            start++;
+        if (start == end)
+            continue;
+        line = start;
+        length = int(end - start);
+        return true;
+    }
+    return false;
+}
+
+QString PlaylistReader::decode(const char *text, int length) const
+{
+    int i = 0;
+    while (i < length && uchar(text[i]) < 0x80)
+        i++;
+    if (i == length)
+        return QString::fromLatin1(text, length);
+    if (!fallback)
+        return QString::fromUtf8(text, length);
+    QTextCodec::ConverterState state;
+    const QString decoded = codec->toUnicode(text, length, &state);
+    return state.invalidChars == 0 ? decoded : fallback->toUnicode(text, length);
+}
+
+QString PlaylistReader::resolve(const QString &location) const
+{
+    if (type == Xspf) {
+        const QUrl url = QUrl::fromLocalFile(base.absolutePath() + QLatin1Char('/')).resolved(QUrl(location));
+        return url.isLocalFile() ? QDir::cleanPath(url.toLocalFile()) : url.toString();
+    }
+    if (location.startsWith(QLatin1String("file:"), Qt::CaseInsensitive))
+        return QDir::cleanPath(QUrl(location).toLocalFile());
+    if (location.contains(QLatin1String("://")))
+        return location;
+    return QDir::cleanPath(base.absoluteFilePath(QDir::fromNativeSeparators(location)));
+}
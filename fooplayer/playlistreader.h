@@ -0,0 +1,44 @@
+#ifndef PLAYLISTREADER_H
+#define PLAYLISTREADER_H
+
+#include <QString>
+#include <QFile>
+#include <QDir>
+
+class QTextCodec;
+class QXmlStreamReader;
+
+class PlaylistReader
+{
+public:
+    enum Format { Unknown, M3u, M3u8, Pls, Xspf };
+
+    explicit PlaylistReader(const QString &fileName);
+    ~PlaylistReader();
+    bool open();
+    void close();
+    bool next(QString &path);
+    qint64 lines() const;
+
+    static Format format(const QString &fileName);
+    static bool isPlaylist(const QString &fileName);
+
+private:
+    bool nextLine(const char *&line, int &length);
+    QString decode(const char *text, int length) const;
+    QString resolve(const QString &location) const;
+
+    QFile file;
+    QDir base;
+    Format type;
+    const char *data;
+    qint64 size;
+    qint64 pos;
+    qint64 lineCount;
+    QByteArray xmlData;
+    QXmlStreamReader *xml;
+    QTextCodec *codec;
+    QTextCodec *fallback;
+};
+
+#endif // PLAYLISTREADER_H
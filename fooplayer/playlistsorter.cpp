@@ -0,0 +1,163 @@
+#include "playlistsorter.h"
+#include <QCollator>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+
+static const int minimumChunk = 16384;
+
+template <typename LessThan>
+static void parallelSort(QVector<int> &values, LessThan lessThan)
+{
+    const int chunks = qBound(1, values.size() / minimumChunk, qMax(1, QThread::idealThreadCount()));
+    if (chunks == 1) {
+        std::stable_sort(values.begin(), values.end(), lessThan);
+        return;
+    }
+    QList<QPair<int, int> > ranges;
+    for (int i = 0; i < chunks; i++)
+        ranges.append(qMakePair(int(qint64(values.size()) * i / chunks), int(qint64(values.size()) * (i + 1) / chunks)));
+    int *data = values.data();
+    QtConcurrent::blockingMap(ranges, [data, lessThan](const QPair<int, int> &range) {
+        std::stable_sort(data + range.first, data + range.second, lessThan);
+    });
+    while (ranges.size() > 1) {
+        QList<int> pairs;
+        QList<QPair<int, int> > merged;
+        for (int i = 0; i + 1 < ranges.size(); i += 2) {
+            pairs.append(i);
+            merged.append(qMakePair(ranges.at(i).first, ranges.at(i + 1).second));
+        }
+        QtConcurrent::blockingMap(pairs, [data, lessThan, &ranges](int i) {
+            std::inplace_merge(data + ranges.at(i).first, data + ranges.at(i).second, data + ranges.at(i + 1).second, lessThan);
+        });
+        if (ranges.size() % 2)
+            merged.append(ranges.last());
+        ranges = merged;
+    }
+}
+
+static QVector<int> collationRanks(const QVector<QString> &strings)
+{
+    QVector<QCollatorSortKey> keys;
+    keys.reserve(strings.size());
+    QCollator collator;
+    collator.setNumericMode(true);
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    const QCollatorSortKey empty = collator.sortKey(QString());
+    for (int i = 0; i < strings.size(); i++)
+        keys.append(empty);
+
+    const int chunks = qBound(1, strings.size() / minimumChunk, qMax(1, QThread::idealThreadCount()));
+    QList<QPair<int, int> > ranges;
+    for (int i = 0; i < chunks; i++)
+        ranges.append(qMakePair(int(qint64(strings.size()) * i / chunks), int(qint64(strings.size()) * (i + 1) / chunks)));
+    QCollatorSortKey *data = keys.data();
+    QtConcurrent::blockingMap(ranges, [data, &strings, &collator](const QPair<int, int> &range) {
+        QCollator local(collator);
+        for (int i = range.first; i < range.second; i++)
+            data[i] = local.sortKey(strings.at(i));
+    });
+
+    QVector<int> order(strings.size());
+    for (int i = 0; i < order.size(); i++)
+        order[i] = i;
+    parallelSort(order, [&keys](int a, int b) { return keys.at(a).compare(keys.at(b)) < 0; });
+    QVector<int> ranks(strings.size());
+    int rank = 0;
+    for (int i = 0; i < order.size(); i++) {
+        if (i > 0 && keys.at(order.at(i - 1)).compare(keys.at(order.at(i))) != 0)
+            rank++;
+        ranks[order.at(i)] = rank;
+    }
+    return ranks;
+}
+
+PlaylistSorter::PlaylistSorter(QObject *parent) :
+    QObject(parent), generation(0)
+{
+    watcher = new QFutureWatcher<QVector<int> >(this);
+    connect(watcher, SIGNAL(finished()), this, SLOT(finished()));
+}
+
+PlaylistSorter::~PlaylistSorter()
+{
+    watcher->waitForFinished();
+}
+
+void PlaylistSorter::sort(PlaylistModel *model, const QList<SortKey> &keys)
+{
+    if (isRunning())
+        watcher->waitForFinished();
+    this->model = model;
+    generation = model->generation();
+    elapsed.start();
+    watcher->setFuture(QtConcurrent::run(&PlaylistSorter::sortOrder, model->columns(), keys));
+}
+
+bool PlaylistSorter::isRunning() const
+{
+    return watcher->isRunning();
+}
+
+QVector<int> PlaylistSorter::sortOrder(const PlaylistColumns &columns, const QList<SortKey> &keys)
+{
+    const int count = columns.titles.size();
+    QVector<QVector<int> > ranks;
+    foreach (const SortKey &key, keys) {
+        QVector<int> rank(count);
+        switch (key.column) {
+        case PlaylistModel::Title:
+            rank = collationRanks(columns.titles);
+            break;
+        case PlaylistModel::Artist:
+        case PlaylistModel::Album: {
+            const QVector<int> &ids = key.column == PlaylistModel::Artist ? columns.artists : columns.albums;
+            const QVector<int> stringRanks = collationRanks(columns.strings.toVector());
+            for (int i = 0; i < count; i++)
+                rank[i] = stringRanks.at(ids.at(i));
+            break;
+        }
+        case PlaylistModel::Number:
+            for (int i = 0; i < count; i++)
+                rank[i] = columns.numbers.at(i);
+            break;
+        case PlaylistModel::Bitrate:
+            for (int i = 0; i < count; i++)
+                rank[i] = columns.bitrates.at(i);
+            break;
+        case PlaylistModel::Length:
+            for (int i = 0; i < count; i++)
+                rank[i] = columns.lengths.at(i);
+            break;
+        default:
+            continue;
+        }
+        if (key.order == Qt::DescendingOrder) {
+            for (int i = 0; i < count; i++)
+                rank[i] = -rank[i];
+        }
+        ranks.append(rank);
+    }
+
+    QVector<int> order(count);
+    for (int i = 0; i < count; i++)
+        order[i] = i;
+    parallelSort(order, [&ranks](int a, int b) {
+        for (int k = 0; k < ranks.size(); k++) {
+            const int x = ranks.at(k).at(a);
+            const int y = ranks.at(k).at(b);
+            if (x != y)
+                return x < y;
+        }
+        return false;
+    });
+    return order;
+}
+
+void PlaylistSorter::finished()
+{
+    const QVector<int> order = watcher->result();
+    if (model && model->generation() == generation)
+        emit sorted(model, order, elapsed.elapsed());
+}
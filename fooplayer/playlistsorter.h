@@ -0,0 +1,41 @@
+#ifndef PLAYLISTSORTER_H
+#define PLAYLISTSORTER_H
+
+#include "playlistmodel.h"
+#include <QObject>
+#include <QPointer>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QList>
+
+struct SortKey
+{
+    int column;
+    Qt::SortOrder order;
+};
+
+class PlaylistSorter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PlaylistSorter(QObject *parent = nullptr);
+    ~PlaylistSorter();
+    void sort(PlaylistModel *model, const QList<SortKey> &keys);
+    bool isRunning() const;
+
+    static QVector<int> sortOrder(const PlaylistColumns &columns, const QList<SortKey> &keys);
+
+signals:
+    void sorted(PlaylistModel *model, const QVector<int> &order, qint64 msecs);
+
+private slots:
+    void finished();
+
+private:
+    QFutureWatcher<QVector<int> > *watcher;
+    QPointer<PlaylistModel> model;
+    quint64 generation;
+    QElapsedTimer elapsed;
+};
+
+#endif // PLAYLISTSORTER_H
@@ -0,0 +1,108 @@
+#include "playlistwriter.h"
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QTextCodec>
+#include <QXmlStreamWriter>
+#include <QUrl>
+
+static const int flushSize = 65536;
+
+bool PlaylistWriter::write(const QString &fileName, const PlaylistModel *model)
+{
+    const PlaylistReader::Format format = PlaylistReader::format(fileName);
+    if (format == PlaylistReader::Unknown)
+        return false;
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    const QDir base = QFileInfo(fileName).absoluteDir();
+    if (format == PlaylistReader::Pls)
+        writePls(file, model, base);
+    else if (format == PlaylistReader::Xspf)
+        writeXspf(file, model, base);
+    else
+        writeM3u(file, model, base, format == PlaylistReader::M3u8);
+    return file.commit();
+}
+
+void PlaylistWriter::writeM3u(QIODevice &device, const PlaylistModel *model, const QDir &base, bool utf8)
+{
+    QTextCodec *codec = utf8 ? QTextCodec::codecForName("UTF-8") : QTextCodec::codecForLocale();
+    QByteArray buffer("#EXTM3U\n");
+    for (int row = 0; row < model->rowCount(); row++) {
+        const TrackInfo track = model->track(row);
+        const QString title = track.artist.isEmpty() ? track.title : track.artist + QLatin1String(" - ") + track.title;
+        buffer += "#EXTINF:" + QByteArray::number(track.length > 0 ? track.length / 1000 : -1) + ',';
+        buffer += codec->fromUnicode(title) + '\n';
+        buffer += codec->fromUnicode(location(track.path, base)) + '\n';
+        if (buffer.size() >= flushSize) {
+            device.write(buffer);
+            buffer.clear();
+        }
+    }
+    device.write(buffer);
+}
+
+void PlaylistWriter::writePls(QIODevice &device, const PlaylistModel *model, const QDir &base)
+{
+    QByteArray buffer("[playlist]\n");
+    for (int row = 0; row < model->rowCount(); row++) {
+        const TrackInfo track = model->track(row);
+        const QByteArray number = QByteArray::number(row + 1);
+        buffer += "File" + number + '=' + location(track.path, base).toUtf8() + '\n';
+        buffer += "Title" + number + '=' + track.title.toUtf8() + '\n';
+        buffer += "Length" + number + '=' + QByteArray::number(track.length > 0 ? track.length / 1000 : -1) + '\n';
+        if (buffer.size() >= flushSize) {
+            device.write(buffer);
+            buffer.clear();
+        }
+    }
+    buffer += "NumberOfEntries=" + QByteArray::number(model->rowCount()) + "\nVersion=2\n";
+    device.write(buffer);
+}
+
+void PlaylistWriter::writeXspf(QIODevice &device, const PlaylistModel *model, const QDir &base)
+{
+    QXmlStreamWriter xml(&device);
+    xml.setAutoFormatting(true);
+    xml.writeStartDocument();
+    xml.writeStartElement(QStringLiteral("playlist"));
+    xml.writeAttribute(QStringLiteral("version"), QStringLiteral("1"));
+    xml.writeDefaultNamespace(QStringLiteral("http://xspf.org/ns/0/"));
+    xml.writeStartElement(QStringLiteral("trackList"));
+    for (int row = 0; row < model->rowCount(); row++) {
+        const TrackInfo track = model->track(row);
+        const QString path = location(track.path, base);
+        xml.writeStartElement(QStringLiteral("track"));
+        if (path.contains(QLatin1String("://")))
+            xml.writeTextElement(QStringLiteral("location"), path);
+        else if (QDir::isRelativePath(path))
+            xml.writeTextElement(QStringLiteral("location"), QString::fromLatin1(QUrl::toPercentEncoding(path, "/")));
+        else
+            xml.writeTextElement(QStringLiteral("location"), QString::fromLatin1(QUrl::fromLocalFile(track.path).toEncoded()));
+        if (!track.title.isEmpty())
+            xml.writeTextElement(QStringLiteral("title"), track.title);
+        if (!track.artist.isEmpty())
+            xml.writeTextElement(QStringLiteral("creator"), track.artist);
+        if (!track.album.isEmpty())
+            xml.writeTextElement(QStringLiteral("album"), track.album);
+        if (track.trackNumber > 0)
+            xml.writeTextElement(QStringLiteral("trackNum"), QString::number(track.trackNumber));
+        if (track.length > 0)
+            xml.writeTextElement(QStringLiteral("duration"), QString::number(track.length));
+        xml.writeEndElement();
+    }
+    xml.writeEndElement();
+    xml.writeEndElement();
+    xml.writeEndDocument();
+}
+
+QString PlaylistWriter::location(const QString &path, const QDir &base)
+{
+    if (path.contains(QLatin1String("://")))
+        return path;
+    const QString relative = base.relativeFilePath(path);
+    if (relative.startsWith(QLatin1String("../")) || QDir::isAbsolutePath(relative))
+        return QDir::toNativeSeparators(path);
+    return relative;
+}
@@ -0,0 +1,22 @@
+#ifndef PLAYLISTWRITER_H
+#define PLAYLISTWRITER_H
+
+#include "playlistmodel.h"
+#include "playlistreader.h"
+#include <QString>
+
+class QIODevice;
+
+class PlaylistWriter
+{
+public:
+    static bool write(const QString &fileName, const PlaylistModel *model);
+
+private:
+    static void writeM3u(QIODevice &device, const PlaylistModel *model, const QDir &base, bool utf8);
+    static void writePls(QIODevice &device, const PlaylistModel *model, const QDir &base);
+    static void writeXspf(QIODevice &device, const PlaylistModel *model, const QDir &base);
+    static QString location(const QString &path, const QDir &base);
+};
+
+#endif // PLAYLISTWRITER_H
@@ -0,0 +1,235 @@
+#include "profiler.h"
+#include <QThread>
+#include <QThreadStorage>
+#include <QTimer>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QCoreApplication>
+
+static const quint32 bufferCapacity = 4096;
+static const int historyLimit = 1000000;
+static const int heartbeatInterval = 10;
+static const qint64 stallThreshold = 50000000;
+
+struct ProfileBuffer
+{
+    ProfileEvent events[bufferCapacity];
+    QAtomicInteger<quint32> readCount;
+    QAtomicInteger<quint32> writeCount;
+    QAtomicInt dropped;
+    QAtomicInt owned;
+    int thread;
+};
+
+struct ProfileHandle
+{
+    ProfileBuffer *buffer;
+    ~ProfileHandle() { buffer->owned.storeRelease(0); }
+};
+
+QAtomicInt Profiler::active;
+QElapsedTimer Profiler::clock;
+
+static QMutex registryMutex;
+static QVector<ProfileBuffer *> buffers;
+static QHash<int, QString> pendingNames;
+static int threadCount = 0;
+static QThreadStorage<ProfileHandle *> handles;
+
+Profiler::Profiler(QObject *parent) :
+    QObject(parent), lastBeat(0)
+{
+    heartbeatTimer = new QTimer(this);
+    heartbeatTimer->setTimerType(Qt::PreciseTimer);
+    heartbeatTimer->setInterval(heartbeatInterval);
+    drainTimer = new QTimer(this);
+    drainTimer->setInterval(250);
+    connect(heartbeatTimer, SIGNAL(timeout()), this, SLOT(heartbeat()));
+    connect(drainTimer, SIGNAL(timeout()), this, SLOT(collect()));
+}
+
+Profiler *Profiler::instance()
+{
+    static Profiler *profiler = 0;
+    if (!profiler)
+        profiler = new Profiler(QCoreApplication::instance());
+    return profiler;
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    Profiler *profiler = instance();
+    if (enabled == isEnabled())
+        return;
+    if (enabled) {
+        if (!clock.isValid())
+            clock.start();
+        profiler->lastBeat = now();
+        active.storeRelease(1);
+        profiler->heartbeatTimer->start();
+        profiler->drainTimer->start();
+    } else {
+        active.storeRelease(0);
+        profiler->heartbeatTimer->stop();
+        profiler->drainTimer->stop();
+        profiler->collect();
+    }
+}
+
+ProfileBuffer *Profiler::localBuffer()
+{
+    if (handles.hasLocalData())
+        return handles.localData()->buffer;
+
+    QMutexLocker locker(&registryMutex);
+    ProfileBuffer *buffer = 0;
+    foreach (ProfileBuffer *candidate, buffers) {
+        if (!candidate->owned.loadAcquire() && candidate->readCount.loadAcquire() == candidate->writeCount.loadAcquire()) {
+            buffer = candidate;
+            break;
+        }
+    }
+    if (!buffer) {
+        buffer = new ProfileBuffer;
+        buffer->dropped.store(0);
+        buffers.append(buffer);
+    }
+    buffer->owned.storeRelease(1);
+    buffer->thread = ++threadCount;
+    QThread *thread = QThread::currentThread();
+    if (thread == QCoreApplication::instance()->thread())
+        pendingNames.insert(buffer->thread, "GUI");
+    else
+        pendingNames.insert(buffer->thread, QString("%1 %2").arg(thread->objectName().isEmpty() ? QString(thread->metaObject()->className()) : thread->objectName()).arg(buffer->thread));
+    locker.unlock();
+
+    ProfileHandle *handle = new ProfileHandle;
+    handle->buffer = buffer;
+    handles.setLocalData(handle);
+    return buffer;
+}
+
+void Profiler::record(const char *name, Type type, qint64 start, qint64 value)
+{
+    ProfileBuffer *buffer = localBuffer();
+    const quint32 write = buffer->writeCount.load();
+    if (write - buffer->readCount.loadAcquire() >= bufferCapacity) {
+        buffer->dropped.fetchAndAddRelaxed(1);
+        return;
+    }
+    ProfileEvent &event = buffer->events[write % bufferCapacity];
+    event.name = name;
+    event.start = start;
+    event.value = value;
+    event.type = char(type);
+    buffer->writeCount.storeRelease(write + 1);
+}
+
+void Profiler::collect()
+{
+    QMutexLocker locker(&mutex);
+    QMutexLocker registry(&registryMutex);
+    for (QHash<int, QString>::const_iterator it = pendingNames.constBegin(); it != pendingNames.constEnd(); ++it)
+        threadNames.insert(it.key(), it.value());
+    pendingNames.clear();
+    foreach (ProfileBuffer *buffer, buffers) {
+        const quint32 write = buffer->writeCount.loadAcquire();
+        quint32 read = buffer->readCount.load();
+        for (; read != write; read++) {
+            ProfileEvent event = buffer->events[read % bufferCapacity];
+            event.thread = buffer->thread;
+            history.append(event);
+        }
+        buffer->readCount.storeRelease(read);
+    }
+    registry.unlock();
+    if (history.size() > historyLimit)
+        history.remove(0, history.size() - historyLimit / 2);
+}
+
+QVector<ProfileStat> Profiler::stats(qint64 window)
+{
+    collect();
+    QMutexLocker locker(&mutex);
+    QVector<ProfileStat> result;
+    QHash<QByteArray, int> indexes;
+    const qint64 from = now() - window;
+    for (int i = history.size() - 1; i >= 0; i--) {
+        const ProfileEvent &event = history.at(i);
+        if (event.start < from) {
+            if (event.start < from - window)
+                break;
+            continue;
+        }
+        const QByteArray key(event.name);
+        int index = indexes.value(key, -1);
+        if (index < 0) {
+            ProfileStat stat;
+            stat.name = event.name;
+            stat.type = event.type;
+            stat.count = 0;
+            stat.total = 0;
+            stat.max = 0;
+            stat.last = event.value;
+            index = result.size();
+            indexes.insert(key, index);
+            result.append(stat);
+        }
+        ProfileStat &stat = result[index];
+        stat.count++;
+        stat.total += event.value;
+        stat.max = qMax(stat.max, event.value);
+    }
+    return result;
+}
+
+int Profiler::dropped() const
+{
+    QMutexLocker registry(&registryMutex);
+    int total = 0;
+    foreach (ProfileBuffer *buffer, buffers)
+        total += buffer->dropped.load();
+    return total;
+}
+
+bool Profiler::writeTrace(const QString &fileName)
+{
+    collect();
+    QMutexLocker locker(&mutex);
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    QTextStream out(&file);
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (QHash<int, QString>::const_iterator it = threadNames.constBegin(); it != threadNames.constEnd(); ++it) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << it.key()
+            << ",\"args\":{\"name\":\"" << QString(it.value()).replace('"', '\'') << "\"}}";
+        first = false;
+    }
+    foreach (const ProfileEvent &event, history) {
+        out << (first ? "" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"" << event.type
+            << "\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << event.start / 1000.0;
+        if (event.type == Scope)
+            out << ",\"dur\":" << event.value / 1000.0 << '}';
+        else if (event.type == Counter)
+            out << ",\"args\":{\"value\":" << event.value << "}}";
+        else
+            out << ",\"s\":\"t\"}";
+        first = false;
+    }
+    out << "\n]}\n";
+    out.flush();
+    return file.commit();
+}
+
+void Profiler::heartbeat()
+{
+    const qint64 beat = now();
+    const qint64 gap = beat - lastBeat;
+    if (gap > stallThreshold)
+        record("gui.stall", Scope, lastBeat, gap);
+    lastBeat = beat;
+}
@@ -0,0 +1,94 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+
+class QTimer;
+struct ProfileBuffer;
+
+struct ProfileEvent
+{
+    const char *name;
+    qint64 start;
+    qint64 value;
+    int thread;
+    char type;
+};
+
+struct ProfileStat
+{
+    const char *name;
+    char type;
+    int count;
+    qint64 total;
+    qint64 max;
+    qint64 last;
+};
+
+class Profiler : public QObject
+{
+    Q_OBJECT
+public:
+    enum Type { Scope = 'X', Counter = 'C', Mark = 'i' };
+
+    static Profiler *instance();
+    static bool isEnabled() { return active.load() != 0; }
+    static void setEnabled(bool enabled);
+    static qint64 now() { return clock.nsecsElapsed(); }
+    static void record(const char *name, Type type, qint64 start, qint64 value);
+
+    QVector<ProfileStat> stats(qint64 window);
+    int dropped() const;
+    bool writeTrace(const QString &fileName);
+
+public slots:
+    void collect();
+
+private slots:
+    void heartbeat();
+
+private:
+    explicit Profiler(QObject *parent = nullptr);
+    static ProfileBuffer *localBuffer();
+
+    static QAtomicInt active;
+    static QElapsedTimer clock;
+
+    QTimer *heartbeatTimer;
+    QTimer *drainTimer;
+    qint64 lastBeat;
+    QVector<ProfileEvent> history;
+    QHash<int, QString> threadNames;
+    mutable QMutex mutex;
+};
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char *name) :
+        name(Profiler::isEnabled() ? name : 0), start(this->name ? Profiler::now() : 0) {}
+    ~ProfileScope()
+    {
+        if (name)
+            Profiler::record(name, Profiler::Scope, start, Profiler::now() - start);
+    }
+
+private:
+    const char *name;
+    qint64 start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) \
+    do { if (Profiler::isEnabled()) Profiler::record(name, Profiler::Counter, Profiler::now(), qint64(value)); } while (0)
+#define PROFILE_MARK(name) \
+    do { if (Profiler::isEnabled()) Profiler::record(name, Profiler::Mark, Profiler::now(), 0); } while (0)
+
+#endif // PROFILER_H
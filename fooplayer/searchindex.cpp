@@ -0,0 +1,173 @@
+#include "searchindex.h"
+#include "playlistmodel.h"
+#include <algorithm>
+
+static quint64 trigram(const QChar *p)
+{
+    return (quint64(p[0].unicode()) << 32) | (quint64(p[1].unicode()) << 16) | p[2].unicode();
+}
+
+SearchIndex::SearchIndex()
+{
+}
+
+void SearchIndex::clear()
+{
+    texts.clear();
+    trigrams.clear();
+}
+
+void SearchIndex::build(const PlaylistModel *model)
+{
+    clear();
+    texts.reserve(model->rowCount());
+    for (int row = 0; row < model->rowCount(); row++)
+        append(text(model->track(row)));
+}
+
+void SearchIndex::append(const QString &text)
+{
+    const int row = texts.size();
+    const QString folded = fold(text);
+    texts.append(folded);
+    foreach (quint64 key, keys(folded))
+        trigrams[key].append(row);
+}
+
+void SearchIndex::update(int row, const QString &text)
+{
+    const QString folded = fold(text);
+    if (row < 0 || row >= texts.size() || texts.at(row) == folded)
+        return;
+    foreach (quint64 key, keys(texts.at(row))) {
+        QHash<quint64, QVector<int> >::iterator it = trigrams.find(key);
+        if (it == trigrams.end())
+            continue;
+        QVector<int>::iterator found = std::lower_bound(it->begin(), it->end(), row);
+        if (found != it->end() && *found == row)
+            it->erase(found);
+        if (it->isEmpty())
+            trigrams.erase(it);
+    }
+    texts[row] = folded;
+    foreach (quint64 key, keys(folded)) {
+        QVector<int> &rows = trigrams[key];
+        rows.insert(std::lower_bound(rows.begin(), rows.end(), row), row);
+    }
+}
+
+void SearchIndex::remove(int first, int count)
+{
+    if (first < 0 || count <= 0 || first + count > texts.size())
+        return;
+    QHash<quint64, QVector<int> >::iterator it = trigrams.begin();
+    while (it != trigrams.end()) {
+        QVector<int> &rows = it.value();
+        QVector<int>::iterator from = std::lower_bound(rows.begin(), rows.end(), first);
+        QVector<int>::iterator to = std::lower_bound(from, rows.end(), first + count);
+        for (from = rows.erase(from, to); from != rows.end(); ++from)
+            *from -= count;
+        if (rows.isEmpty())
+            it = trigrams.erase(it);
+        else
+            ++it;
+    }
+    texts.remove(first, count);
+}
+
+int SearchIndex::size() const
+{
+    return texts.size();
+}
+
+QVector<int> SearchIndex::search(const QString &query, const QVector<int> *within) const
+{
+    const QStringList words = terms(query);
+    const QVector<int> *candidates = within;
+    QVector<int> none;
+    foreach (const QString &word, words) {
+        const QChar *p = word.constData();
+        for (int i = 0; i + 3 <= word.size(); i++) {
+            QHash<quint64, QVector<int> >::const_iterator it = trigrams.constFind(trigram(p + i));
+            if (it == trigrams.constEnd())
+                return none;
+            if (!candidates || it->size() < candidates->size())
+                candidates = &*it;
+        }
+    }
+
+    QVector<int> rows;
+    if (candidates) {
+        foreach (int row, *candidates) {
+            const QString &text = texts.at(row);
+            bool match = true;
+            for (int i = 0; match && i < words.size(); i++)
+                match = text.contains(words.at(i));
+            if (match)
+                rows.append(row);
+        }
+        return rows;
+    }
+    for (int row = 0; row < texts.size(); row++) {
+        const QString &text = texts.at(row);
+        bool match = true;
+        for (int i = 0; match && i < words.size(); i++)
+            match = text.contains(words.at(i));
+        if (match)
+            rows.append(row);
+    }
+    return rows;
+}
+
+qint64 SearchIndex::memoryUsage() const
+{
+    qint64 bytes = texts.capacity() * qint64(sizeof(QString));
+    foreach (const QString &text, texts)
+        bytes += text.capacity() * 2;
+    QHash<quint64, QVector<int> >::const_iterator it;
+    for (it = trigrams.constBegin(); it != trigrams.constEnd(); ++it)
+        bytes += sizeof(quint64) + sizeof(QVector<int>) + it->capacity() * qint64(sizeof(int));
+    return bytes;
+}
+
+QString SearchIndex::text(const TrackInfo &track)
+{
+    return track.title + QLatin1Char('\n') + track.artist + QLatin1Char('\n') + track.album;
+}
+
+QString SearchIndex::fold(const QString &text)
+{
+    QString folded = text.toCaseFolded();
+    bool ascii = true;
+    for (int i = 0; ascii && i < folded.size(); i++)
+        ascii = folded.at(i).unicode() < 0x80;
+    if (ascii)
+        return folded;
+    const QString decomposed = folded.normalized(QString::NormalizationForm_D);
+    folded.clear();
+    folded.reserve(decomposed.size());
+    foreach (const QChar c, decomposed) {
+        if (c.category() != QChar::Mark_NonSpacing)
+            folded.append(c);
+    }
+    return folded;
+}
+
+QStringList SearchIndex::terms(const QString &query)
+{
+    return fold(query).split(QLatin1Char(' '), QString::SkipEmptyParts);
+}
+
+QVector<quint64> SearchIndex::keys(const QString &folded)
+{
+    QVector<quint64> keys;
+    if (folded.size() < 3)
+        return keys;
+    keys.reserve(folded.size() - 2);
+    const QChar *p = folded.constData();
+    for (int i = 0; i + 3 <= folded.size(); i++)
+        keys.append(trigram(p + i));
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
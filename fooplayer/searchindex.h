@@ -0,0 +1,36 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+
+class PlaylistModel;
+struct TrackInfo;
+
+class SearchIndex
+{
+public:
+    SearchIndex();
+    void clear();
+    void build(const PlaylistModel *model);
+    void append(const QString &text);
+    void update(int row, const QString &text);
+    void remove(int first, int count);
+    int size() const;
+    QVector<int> search(const QString &query, const QVector<int> *within = 0) const;
+    qint64 memoryUsage() const;
+
+    static QString text(const TrackInfo &track);
+    static QString fold(const QString &text);
+    static QStringList terms(const QString &query);
+
+private:
+    static QVector<quint64> keys(const QString &folded);
+
+    QVector<QString> texts;
+    QHash<quint64, QVector<int> > trigrams;
+};
+
+#endif // SEARCHINDEX_H
@@ -0,0 +1,442 @@
+#include "seekindex.h"
+#include <QFile>
+#include <QDataStream>
+#include <QtEndian>
+#include <cstring>
+
+static const quint32 indexMagic = 0x46505349;
+static const int pointSeconds = 1;
+static const int mpegPreroll = 10;
+static const int resyncWindow = 65536;
+static const int flacProbe = 65536;
+
+struct PointGrid
+{
+    explicit PointGrid(qint64 interval) :
+        interval(interval), offset(-1), start(0)
+    {
+    }
+
+    // Grid point g may only use a frame whose output is correct from sample g * interval on,
+    // so a frame is committed to every grid point before the first sample it becomes usable at.
+    void add(qint64 usable, qint64 frameOffset, qint64 frameStart)
+    {
+        while (offset >= 0 && qint64(offsets.size()) * interval < usable)
+            push();
+        offset = frameOffset;
+        start = frameStart;
+    }
+
+    void finish(qint64 total)
+    {
+        while (offset >= 0 && (offsets.isEmpty() || qint64(offsets.size()) * interval < total))
+            push();
+    }
+
+    void push()
+    {
+        lags.append(quint32(qint64(offsets.size()) * interval - start));
+        offsets.append(offset);
+    }
+
+    qint64 interval;
+    qint64 offset;
+    qint64 start;
+    QVector<qint64> offsets;
+    QVector<quint32> lags;
+};
+
+struct MpegHeader
+{
+    int version;
+    int layer;
+    int rate;
+    int channels;
+    int samples;
+    int length;
+};
+
+static bool parseMpegHeader(const uchar *p, MpegHeader &header)
+{
+    static const short bitrates[5][15] = {
+        { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+        { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+    };
+    static const int rates[3] = { 44100, 48000, 32000 };
+    if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0)
+        return false;
+    const int version = (p[1] >> 3) & 3;
+    const int layer = 4 - ((p[1] >> 1) & 3);
+    const int bitrateIndex = p[2] >> 4;
+    const int rateIndex = (p[2] >> 2) & 3;
+    if (version == 1 || layer == 4 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3)
+        return false;
+    const bool mpeg1 = version == 3;
+    const int bitrate = bitrates[mpeg1 ? layer - 1 : (layer == 1 ? 3 : 4)][bitrateIndex] * 1000;
+    const int padding = (p[2] >> 1) & 1;
+    header.version = version;
+    header.layer = layer;
+    header.rate = rates[rateIndex] >> (mpeg1 ? 0 : version == 2 ? 1 : 2);
+    header.channels = (p[3] >> 6) == 3 ? 1 : 2;
+    if (layer == 1) {
+        header.samples = 384;
+        header.length = (12 * bitrate / header.rate + padding) * 4;
+    } else {
+        header.samples = layer == 3 && !mpeg1 ? 576 : 1152;
+        header.length = header.samples / 8 * bitrate / header.rate + padding;
+    }
+    return header.length > 4;
+}
+
+static bool sameStream(const uchar *p, const uchar *reference)
+{
+    return (p[1] & 0xfe) == (reference[1] & 0xfe) && (p[2] & 0x0c) == (reference[2] & 0x0c);
+}
+
+// A sync word only counts when the frame after it carries a matching header.
+static qint64 findMpegFrame(const uchar *data, qint64 size, qint64 from, const uchar *reference)
+{
+    MpegHeader header, next;
+    const qint64 end = qMin(size - 4, from + resyncWindow);
+    for (qint64 pos = from; pos <= end; pos++) {
+        if (data[pos] != 0xff || !parseMpegHeader(data + pos, header))
+            continue;
+        if (reference && !sameStream(data + pos, reference))
+            continue;
+        const qint64 following = pos + header.length;
+        if (following == size)
+            return pos;
+        if (following + 4 <= size && parseMpegHeader(data + following, next) && sameStream(data + following, data + pos))
+            return pos;
+    }
+    return -1;
+}
+
+static quint8 crc8(const uchar *data, int size)
+{
+    quint8 crc = 0;
+    for (int i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = quint8(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+    return crc;
+}
+
+static bool parseFlacFrame(const uchar *p, int available, int blockSize, qint64 &sample)
+{
+    if (p[0] != 0xff || (p[1] & 0xfe) != 0xf8)
+        return false;
+    const bool variable = p[1] & 1;
+    const int blockCode = p[2] >> 4;
+    const int rateCode = p[2] & 0x0f;
+    if (blockCode == 0 || rateCode == 15 || (p[3] >> 4) > 10 || ((p[3] >> 1) & 7) == 3 || (p[3] & 1))
+        return false;
+    quint64 number = p[4];
+    int extra = 0;
+    if (number < 0x80)
+        extra = 0;
+    else if ((number & 0xe0) == 0xc0)
+        extra = 1;
+    else if ((number & 0xf0) == 0xe0)
+        extra = 2;
+    else if ((number & 0xf8) == 0xf0)
+        extra = 3;
+    else if ((number & 0xfc) == 0xf8)
+        extra = 4;
+    else if ((number & 0xfe) == 0xfc)
+        extra = 5;
+    else if (number == 0xfe)
+        extra = 6;
+    else
+        return false;
+    if (extra)
+        number &= 0x7f >> (extra + 1);
+    int length = 5 + extra;
+    length += blockCode == 6 ? 1 : blockCode == 7 ? 2 : 0;
+    length += rateCode == 12 ? 1 : rateCode == 13 || rateCode == 14 ? 2 : 0;
+    if (length >= available)
+        return false;
+    for (int i = 0; i < extra; i++) {
+        if ((p[5 + i] & 0xc0) != 0x80)
+            return false;
+        number = (number << 6) | (p[5 + i] & 0x3f);
+    }
+    if (crc8(p, length) != p[length] || (!variable && blockSize <= 0))
+        return false;
+    sample = variable ? qint64(number) : qint64(number) * blockSize;
+    return true;
+}
+
+SeekIndex::SeekIndex() :
+    type(Unknown), rate(0), total(0), interval(0)
+{
+}
+
+bool SeekIndex::isValid() const
+{
+    return type != Unknown && rate > 0 && !offsets.isEmpty();
+}
+
+SeekIndex::Codec SeekIndex::codec() const
+{
+    return type;
+}
+
+int SeekIndex::sampleRate() const
+{
+    return rate;
+}
+
+qint64 SeekIndex::samples() const
+{
+    return total;
+}
+
+qint64 SeekIndex::duration() const
+{
+    return rate > 0 ? total * 1000 / rate : 0;
+}
+
+int SeekIndex::pointCount() const
+{
+    return offsets.size();
+}
+
+QByteArray SeekIndex::header() const
+{
+    return prefix;
+}
+
+bool SeekIndex::locate(qint64 sample, qint64 &offset, qint64 &start) const
+{
+    if (offsets.isEmpty() || sample < 0)
+        return false;
+    const int point = int(qMin(sample / interval, qint64(offsets.size() - 1)));
+    offset = offsets.at(point);
+    start = qint64(point) * interval - lags.at(point);
+    return true;
+}
+
+QByteArray SeekIndex::serialize() const
+{
+    QVector<quint32> deltas(offsets.size());
+    for (int i = 0; i < offsets.size(); i++)
+        deltas[i] = quint32(offsets.at(i) - (i ? offsets.at(i - 1) : 0));
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_9);
+    out << indexMagic << quint32(1) << qint32(type) << qint32(rate) << total << interval << prefix << deltas << lags;
+    return data;
+}
+
+SeekIndex SeekIndex::deserialize(const QByteArray &data)
+{
+    SeekIndex index;
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_9);
+    quint32 magic, version;
+    qint32 type, rate;
+    QVector<quint32> deltas;
+    in >> magic >> version >> type >> rate >> index.total >> index.interval >> index.prefix >> deltas >> index.lags;
+    if (in.status() != QDataStream::Ok || magic != indexMagic || version != 1 || deltas.size() != index.lags.size()
+            || (type != Mpeg && type != Flac) || index.interval <= 0)
+        return SeekIndex();
+    index.type = Codec(type);
+    index.rate = rate;
+    index.offsets.resize(deltas.size());
+    qint64 offset = 0;
+    for (int i = 0; i < deltas.size(); i++)
+        index.offsets[i] = offset += deltas.at(i);
+    return index;
+}
+
+SeekIndex SeekIndex::build(const QString &path)
+{
+    SeekIndex index;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return index;
+    const QByteArray head = file.read(10);
+    bool built = false;
+    if (head.startsWith("fLaC")) {
+        built = buildFlac(file, index);
+    } else if (!head.startsWith("RIFF")) {
+        qint64 start = 0;
+        if (head.startsWith("ID3") && head.size() == 10) {
+            const uchar *p = reinterpret_cast<const uchar *>(head.constData());
+            const quint32 size = (quint32(p[6] & 0x7f) << 21) | (quint32(p[7] & 0x7f) << 14) | (quint32(p[8] & 0x7f) << 7) | quint32(p[9] & 0x7f);
+            start = 10 + qint64(size) + (p[5] & 0x10 ? 10 : 0);
+        }
+        built = buildMpeg(file, start, index);
+    }
+    return built ? index : SeekIndex();
+}
+
+void SeekIndex::setPoints(const PointGrid &grid)
+{
+    interval = grid.interval;
+    offsets = grid.offsets;
+    lags = grid.lags;
+}
+
+bool SeekIndex::buildMpeg(QFile &file, qint64 start, SeekIndex &index)
+{
+    const qint64 size = file.size();
+    const uchar *data = size > start ? file.map(0, size) : 0;
+    if (!data)
+        return false;
+    qint64 pos = findMpegFrame(data, size, start, 0);
+    if (pos < 0) {
+        file.unmap(const_cast<uchar *>(data));
+        return false;
+    }
+    MpegHeader first, header;
+    parseMpegHeader(data + pos, first);
+    const uchar *reference = data + pos;
+    const qint64 streamStart = pos;
+
+    // Decoders drop the Xing/Info frame and, when a LAME tag follows it, trim the encoder
+    // delay plus the 529 sample decoder delay from the front. Frames decoded from the middle
+    // of the stream get neither, so their sample positions are shifted by the same amount.
+    qint64 trim = 0;
+    const int sideInfo = first.version == 3 ? (first.channels == 1 ? 17 : 32) : (first.channels == 1 ? 9 : 17);
+    if (first.layer == 3 && pos + first.length <= size && first.length >= 4 + sideInfo + 8) {
+        const uchar *xing = data + pos + 4 + sideInfo;
+        if (!memcmp(xing, "Xing", 4) || !memcmp(xing, "Info", 4)) {
+            const quint32 flags = qFromBigEndian<quint32>(xing + 4);
+            const int lame = 8 + (flags & 1 ? 4 : 0) + (flags & 2 ? 4 : 0) + (flags & 4 ? 100 : 0) + (flags & 8 ? 4 : 0);
+            if (4 + sideInfo + lame + 24 <= first.length
+                    && (!memcmp(xing + lame, "LAME", 4) || !memcmp(xing + lame, "Lavc", 4) || !memcmp(xing + lame, "Lavf", 4)))
+                trim = ((xing[lame + 21] << 4) | (xing[lame + 22] >> 4)) + 529;
+            pos += first.length;
+        } else if (first.length >= 40 && !memcmp(data + pos + 36, "VBRI", 4)) {
+            pos += first.length;
+        }
+    }
+
+    PointGrid grid(qint64(first.rate) * pointSeconds);
+    grid.add(0, streamStart, 0);
+    qint64 recent[mpegPreroll + 1];
+    qint64 frames = 0;
+    while (pos + 4 <= size) {
+        if (!parseMpegHeader(data + pos, header) || !sameStream(data + pos, reference)) {
+            if (size - pos >= 3 && !memcmp(data + pos, "TAG", 3))
+                break;
+            pos = findMpegFrame(data, size, pos + 1, reference);
+            if (pos < 0)
+                break;
+            continue;
+        }
+        if (pos + header.length > size)
+            break;
+        recent[frames % (mpegPreroll + 1)] = pos;
+        if (frames >= mpegPreroll) {
+            const qint64 from = frames - mpegPreroll;
+            grid.add(frames * first.samples - trim, recent[from % (mpegPreroll + 1)], from * first.samples - trim);
+        }
+        frames++;
+        pos += header.length;
+    }
+    file.unmap(const_cast<uchar *>(data));
+    if (frames == 0)
+        return false;
+
+    index.type = Mpeg;
+    index.rate = first.rate;
+    index.total = qMax<qint64>(0, frames * first.samples - trim);
+    grid.finish(index.total);
+    index.setPoints(grid);
+    return true;
+}
+
+bool SeekIndex::buildFlac(QFile &file, SeekIndex &index)
+{
+    QByteArray streamInfo;
+    QByteArray seekTable;
+    bool last = false;
+    if (!file.seek(4))
+        return false;
+    while (!last) {
+        const QByteArray header = file.read(4);
+        if (header.size() < 4)
+            return false;
+        const uchar *p = reinterpret_cast<const uchar *>(header.constData());
+        last = p[0] & 0x80;
+        const int type = p[0] & 0x7f;
+        const qint64 length = (qint64(p[1]) << 16) | (p[2] << 8) | p[3];
+        if (type == 0)
+            streamInfo = file.read(length);
+        else if (type == 3)
+            seekTable = file.read(length);
+        else if (!file.seek(file.pos() + length))
+            return false;
+    }
+    if (streamInfo.size() < 34)
+        return false;
+    const qint64 audioStart = file.pos();
+    const uchar *s = reinterpret_cast<const uchar *>(streamInfo.constData());
+    const int minimumBlock = qFromBigEndian<quint16>(s);
+    const int maximumBlock = qFromBigEndian<quint16>(s + 2);
+    index.rate = (s[10] << 12) | (s[11] << 4) | (s[12] >> 4);
+    index.total = qint64((quint64(s[13] & 0x0f) << 32) | qFromBigEndian<quint32>(s + 14));
+    if (index.rate <= 0)
+        return false;
+
+    PointGrid grid(qint64(index.rate) * pointSeconds);
+    grid.add(0, audioStart, 0);
+    if (seekTable.size() >= 18) {
+        const uchar *p = reinterpret_cast<const uchar *>(seekTable.constData());
+        qint64 previous = 0;
+        for (int i = 0; i + 18 <= seekTable.size(); i += 18) {
+            const quint64 sample = qFromBigEndian<quint64>(p + i);
+            if (sample == ~quint64(0))
+                break;
+            if (qint64(sample) <= previous)
+                continue;
+            previous = qint64(sample);
+            grid.add(previous, audioStart + qint64(qFromBigEndian<quint64>(p + i + 8)), previous);
+        }
+    } else {
+        scanFlac(file, audioStart, minimumBlock == maximumBlock ? minimumBlock : 0, index.total, grid);
+    }
+
+    index.type = Flac;
+    index.prefix = QByteArray("fLaC\x80\x00\x00\x22", 8) + streamInfo.left(34);
+    grid.finish(index.total);
+    index.setPoints(grid);
+    return true;
+}
+
+// Without a SEEKTABLE, jump to where each grid point should be assuming an even bitrate and
+// resync on the next frame header, instead of walking every frame of the file.
+void SeekIndex::scanFlac(QFile &file, qint64 audioStart, int blockSize, qint64 total, PointGrid &grid)
+{
+    const qint64 size = file.size();
+    if (total <= 0 || size <= audioStart)
+        return;
+    const double bytesPerSample = double(size - audioStart) / total;
+    qint64 previous = 0;
+    qint64 position = audioStart;
+    for (qint64 target = grid.interval; target < total; target += grid.interval) {
+        if (target <= previous)
+            continue;
+        const qint64 from = qMax(position, audioStart + qint64(target * bytesPerSample * 0.95));
+        if (!file.seek(from))
+            break;
+        const QByteArray probe = file.read(flacProbe);
+        const uchar *p = reinterpret_cast<const uchar *>(probe.constData());
+        for (int i = 0; i + 16 <= probe.size(); i++) {
+            qint64 sample;
+            if (parseFlacFrame(p + i, probe.size() - i, blockSize, sample) && sample > previous && sample < total) {
+                grid.add(sample, from + i, sample);
+                previous = sample;
+                position = from + i + 1;
+                break;
+            }
+        }
+    }
+}
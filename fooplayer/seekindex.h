@@ -0,0 +1,44 @@
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QString>
+
+class QFile;
+struct PointGrid;
+
+class SeekIndex
+{
+public:
+    enum Codec { Unknown, Mpeg, Flac };
+
+    SeekIndex();
+    bool isValid() const;
+    Codec codec() const;
+    int sampleRate() const;
+    qint64 samples() const;
+    qint64 duration() const;
+    int pointCount() const;
+    QByteArray header() const;
+    bool locate(qint64 sample, qint64 &offset, qint64 &start) const;
+    QByteArray serialize() const;
+    static SeekIndex deserialize(const QByteArray &data);
+    static SeekIndex build(const QString &path);
+
+private:
+    static bool buildMpeg(QFile &file, qint64 start, SeekIndex &index);
+    static bool buildFlac(QFile &file, SeekIndex &index);
+    static void scanFlac(QFile &file, qint64 audioStart, int blockSize, qint64 total, PointGrid &grid);
+    void setPoints(const PointGrid &grid);
+
+    Codec type;
+    int rate;
+    qint64 total;
+    qint64 interval;
+    QByteArray prefix;
+    QVector<qint64> offsets;
+    QVector<quint32> lags;
+};
+
+#endif // SEEKINDEX_H
@@ -0,0 +1,92 @@
+#include "seekindexcache.h"
+#include "profiler.h"
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QDir>
+#include <QRunnable>
+
+static const int memoryEntries = 64;
+
+class SeekIndexTask : public QRunnable
+{
+public:
+    SeekIndexTask(SeekIndexCache *cache, const QString &path) :
+        cache(cache), path(path)
+    {
+    }
+
+    void run() override
+    {
+        cache->index(path);
+        QMutexLocker locker(&cache->mutex);
+        cache->pending.remove(path);
+    }
+
+private:
+    SeekIndexCache *cache;
+    QString path;
+};
+
+SeekIndexCache::SeekIndexCache(const QString &cacheDirectory) :
+    directory(cacheDirectory), memory(memoryEntries)
+{
+    QDir().mkpath(directory);
+    pool.setMaxThreadCount(1);
+}
+
+SeekIndexCache::~SeekIndexCache()
+{
+    pool.clear();
+    pool.waitForDone();
+}
+
+SeekIndex SeekIndexCache::index(const QString &path)
+{
+    const QString file = cachePath(path);
+    {
+        QMutexLocker locker(&mutex);
+        if (const SeekIndex *index = memory.object(file))
+            return *index;
+    }
+
+    QFile cached(file);
+    SeekIndex index;
+    if (cached.open(QIODevice::ReadOnly))
+        index = SeekIndex::deserialize(cached.readAll());
+    if (!index.isValid()) {
+        PROFILE_SCOPE("seek.index");
+        index = SeekIndex::build(path);
+        if (!index.isValid())
+            return index;
+        PROFILE_COUNTER("seek.indexPoints", index.pointCount());
+        QSaveFile out(file);
+        if (out.open(QIODevice::WriteOnly)) {
+            out.write(index.serialize());
+            out.commit();
+        }
+    }
+    QMutexLocker locker(&mutex);
+    memory.insert(file, new SeekIndex(index));
+    return index;
+}
+
+void SeekIndexCache::prepare(const QString &path)
+{
+    QMutexLocker locker(&mutex);
+    if (pending.contains(path) || memory.contains(cachePath(path)))
+        return;
+    pending.insert(path);
+    pool.start(new SeekIndexTask(this, path));
+}
+
+QString SeekIndexCache::cachePath(const QString &path) const
+{
+    const QFileInfo track(path);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(path.toUtf8());
+    hash.addData(QByteArray::number(track.lastModified().toMSecsSinceEpoch()));
+    hash.addData(QByteArray::number(track.size()));
+    return directory + '/' + QString::fromLatin1(hash.result().toHex()) + ".seek";
+}
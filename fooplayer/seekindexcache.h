@@ -0,0 +1,30 @@
+#ifndef SEEKINDEXCACHE_H
+#define SEEKINDEXCACHE_H
+
+#include "seekindex.h"
+#include <QCache>
+#include <QSet>
+#include <QMutex>
+#include <QThreadPool>
+
+class SeekIndexCache
+{
+public:
+    explicit SeekIndexCache(const QString &cacheDirectory);
+    ~SeekIndexCache();
+    SeekIndex index(const QString &path);
+    void prepare(const QString &path);
+
+private:
+    friend class SeekIndexTask;
+
+    QString cachePath(const QString &path) const;
+
+    QString directory;
+    QCache<QString, SeekIndex> memory;
+    QSet<QString> pending;
+    QMutex mutex;
+    QThreadPool pool;
+};
+
+#endif // SEEKINDEXCACHE_H
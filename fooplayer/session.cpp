@@ -0,0 +1,237 @@
+#include "session.h"
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDataStream>
+#include <QHash>
+#include <QRunnable>
+
+static const quint32 sessionMagic = 0x53535046; // "FPSS"
+static const quint32 sessionVersion = 2;
+
+class SessionLoadTask : public QRunnable
+{
+public:
+    SessionLoadTask(Session *session, const QList<int> &playlists, const QAtomicInt *cancelled) :
+        session(session), playlists(playlists), cancelled(cancelled)
+    {
+    }
+
+    void run() override
+    {
+        foreach (int playlist, playlists) {
+            if (cancelled->load())
+                return;
+            emit session->playlistLoaded(playlist, session->tracks(playlist));
+        }
+    }
+
+private:
+    Session *session;
+    QList<int> playlists;
+    const QAtomicInt *cancelled;
+};
+
+Session::Session(const QString &fileName, QObject *parent) :
+    QObject(parent), fileName(fileName), data(0), size(0)
+{
+    qRegisterMetaType<QVector<TrackInfo> >("QVector<TrackInfo>");
+    pool.setMaxThreadCount(1);
+}
+
+Session::~Session()
+{
+    cancel();
+    close();
+}
+
+bool Session::open()
+{
+    close();
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    size = file.size();
+    data = size > 0 ? reinterpret_cast<const char *>(file.map(0, size)) : 0;
+    if (!data) {
+        close();
+        return false;
+    }
+
+    QByteArray bytes = QByteArray::fromRawData(data, int(qMin<qint64>(size, INT_MAX)));
+    QDataStream in(bytes);
+    in.setByteOrder(QDataStream::LittleEndian);
+    quint32 magic, version, count;
+    qint32 currentPlaylist, currentTrack, playbackMode, volume, replayGain;
+    quint8 muted;
+    qint64 position;
+    in >> magic >> version;
+    if (magic != sessionMagic || version != sessionVersion) {
+        close();
+        return false;
+    }
+    in >> currentPlaylist >> currentTrack >> position >> playbackMode >> volume >> muted >> replayGain >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QByteArray name;
+        Entry entry;
+        in >> name >> entry.trackCount >> entry.offset >> entry.size;
+        entry.name = QString::fromUtf8(name);
+        if (entry.offset + entry.size > quint64(size))
+            break;
+        entries.append(entry);
+    }
+    if (in.status() != QDataStream::Ok || entries.size() != int(count)) {
+        close();
+        return false;
+    }
+    sessionState.currentPlaylist = currentPlaylist;
+    sessionState.currentTrack = currentTrack;
+    sessionState.position = position;
+    sessionState.playbackMode = playbackMode;
+    sessionState.volume = volume;
+    sessionState.muted = muted != 0;
+    sessionState.replayGain = replayGain;
+    return true;
+}
+
+void Session::close()
+{
+    pool.waitForDone();
+    if (data)
+        file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+    data = 0;
+    size = 0;
+    entries.clear();
+    file.close();
+}
+
+SessionState Session::state() const
+{
+    return sessionState;
+}
+
+QStringList Session::names() const
+{
+    QStringList names;
+    foreach (const Entry &entry, entries)
+        names.append(entry.name);
+    return names;
+}
+
+int Session::trackCount(int playlist) const
+{
+    return playlist >= 0 && playlist < entries.size() ? int(entries.at(playlist).trackCount) : 0;
+}
+
+QVector<TrackInfo> Session::tracks(int playlist) const
+{
+    QVector<TrackInfo> tracks;
+    if (playlist < 0 || playlist >= entries.size())
+        return tracks;
+    const Entry &entry = entries.at(playlist);
+    QByteArray bytes = QByteArray::fromRawData(data + entry.offset, int(entry.size));
+    QDataStream in(bytes);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 stringCount;
+    in >> stringCount;
+    QStringList strings;
+    for (quint32 i = 0; i < stringCount && in.status() == QDataStream::Ok; i++) {
+        QByteArray string;
+        in >> string;
+        strings.append(QString::fromUtf8(string));
+    }
+
+    tracks.reserve(int(entry.trackCount));
+    for (quint32 i = 0; i < entry.trackCount && in.status() == QDataStream::Ok; i++) {
+        QByteArray path, title;
+        quint32 artist, album;
+        quint16 number, bitrate;
+        qint32 length;
+        TrackInfo track;
+        in >> path >> title >> artist >> album >> number >> bitrate >> length;
+        track.path = QString::fromUtf8(path);
+        track.title = QString::fromUtf8(title);
+        track.artist = strings.value(int(artist));
+        track.album = strings.value(int(album));
+        track.trackNumber = number;
+        track.bitrate = bitrate;
+        track.length = length;
+        track.valid = true;
+        tracks.append(track);
+    }
+    if (in.status() != QDataStream::Ok)
+        tracks.clear();
+    return tracks;
+}
+
+void Session::loadInBackground(const QList<int> &playlists)
+{
+    cancelled.store(0);
+    pool.start(new SessionLoadTask(this, playlists, &cancelled));
+}
+
+void Session::cancel()
+{
+    cancelled.store(1);
+    pool.waitForDone();
+}
+
+bool Session::save(const SessionState &state, const QStringList &names, const QVector<PlaylistModel *> &models)
+{
+    close();
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile out(fileName);
+    if (!out.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream stream(&out);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << sessionMagic << sessionVersion << qint32(state.currentPlaylist) << qint32(state.currentTrack)
+           << qint64(state.position) << qint32(state.playbackMode) << qint32(state.volume) << quint8(state.muted)
+           << qint32(state.replayGain) << quint32(models.size());
+
+    QVector<qint64> directory;
+    for (int i = 0; i < models.size(); i++) {
+        stream << names.value(i).toUtf8() << quint32(models.at(i)->rowCount());
+        directory.append(out.pos());
+        stream << quint64(0) << quint64(0);
+    }
+
+    for (int i = 0; i < models.size(); i++) {
+        const PlaylistModel *model = models.at(i);
+        QStringList strings(QString());
+        QHash<QString, quint32> stringIndex;
+        QVector<TrackInfo> tracks;
+        tracks.reserve(model->rowCount());
+        for (int row = 0; row < model->rowCount(); row++) {
+            const TrackInfo track = model->track(row);
+            foreach (const QString &string, QStringList() << track.artist << track.album) {
+                if (!string.isEmpty() && !stringIndex.contains(string)) {
+                    stringIndex.insert(string, quint32(strings.size()));
+                    strings.append(string);
+                }
+            }
+            tracks.append(track);
+        }
+
+        const qint64 offset = out.pos();
+        stream << quint32(strings.size());
+        foreach (const QString &string, strings)
+            stream << string.toUtf8();
+        foreach (const TrackInfo &track, tracks) {
+            stream << track.path.toUtf8() << track.title.toUtf8() << stringIndex.value(track.artist)
+                   << stringIndex.value(track.album) << quint16(track.trackNumber) << quint16(track.bitrate)
+                   << qint32(track.length);
+        }
+        const qint64 end = out.pos();
+        out.seek(directory.at(i));
+        stream << quint64(offset) << quint64(end - offset);
+        out.seek(end);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        out.cancelWriting();
+        return false;
+    }
+    return out.commit();
+}
@@ -0,0 +1,64 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "tagreader.h"
+#include "playlistmodel.h"
+#include <QObject>
+#include <QFile>
+#include <QStringList>
+#include <QVector>
+#include <QThreadPool>
+#include <QAtomicInt>
+
+struct SessionState
+{
+    int currentPlaylist = 0;
+    int currentTrack = -1;
+    qint64 position = 0;
+    int playbackMode = 0;
+    int volume = 100;
+    bool muted = false;
+    int replayGain = 0;
+};
+
+class Session : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Session(const QString &fileName, QObject *parent = nullptr);
+    ~Session();
+    bool open();
+    void close();
+    SessionState state() const;
+    QStringList names() const;
+    int trackCount(int playlist) const;
+    QVector<TrackInfo> tracks(int playlist) const;
+    void loadInBackground(const QList<int> &playlists);
+    void cancel();
+    bool save(const SessionState &state, const QStringList &names, const QVector<PlaylistModel *> &models);
+
+signals:
+    void playlistLoaded(int playlist, const QVector<TrackInfo> &tracks);
+
+private:
+    struct Entry
+    {
+        QString name;
+        quint32 trackCount;
+        quint64 offset;
+        quint64 size;
+    };
+
+    void load(const QList<int> &playlists);
+
+    QString fileName;
+    QFile file;
+    const char *data;
+    qint64 size;
+    SessionState sessionState;
+    QVector<Entry> entries;
+    QThreadPool pool;
+    QAtomicInt cancelled;
+};
+
+#endif // SESSION_H
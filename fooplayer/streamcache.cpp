@@ -0,0 +1,501 @@
+#include "streamcache.h"
+#include "profiler.h"
+#include <QCryptographicHash>
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QScopedPointer>
+
+static const int readAheadChunks = 8;
+static const int streamTimeout = 10000;
+static const quint32 mapMagic = 0x464f5343;
+static const quint32 mapVersion = 1;
+
+StreamFetcher::StreamFetcher(StreamCache *cache) :
+    QObject(0), cache(cache), manager(0)
+{
+}
+
+void StreamFetcher::fetch(const QString &url, qint64 begin, qint64 end)
+{
+    if (!manager)
+        manager = new QNetworkAccessManager(this);
+    QNetworkRequest request((QUrl(url)));
+    request.setRawHeader("Range", "bytes=" + QByteArray::number(begin) + '-' + QByteArray::number(end - 1));
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+    QNetworkReply *reply = manager->get(request);
+    Transfer transfer;
+    transfer.url = url;
+    transfer.begin = begin;
+    transfer.end = end;
+    transfer.start = -1;
+    transfer.offset = -1;
+    transfer.total = -1;
+    transfers.insert(reply, transfer);
+    connect(reply, SIGNAL(readyRead()), this, SLOT(replyReadyRead()));
+    connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+}
+
+void StreamFetcher::shutdown()
+{
+    foreach (QNetworkReply *reply, transfers.keys())
+        reply->abort();
+    delete manager;
+    manager = 0;
+}
+
+void StreamFetcher::replyReadyRead()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (transfers.contains(reply))
+        process(reply, transfers[reply]);
+}
+
+void StreamFetcher::replyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (!transfers.contains(reply))
+        return;
+    process(reply, transfers[reply]);
+    const Transfer transfer = transfers.take(reply);
+    const bool ok = reply->error() == QNetworkReply::NoError && transfer.start >= 0;
+    reply->deleteLater();
+    cache->finished(transfer.url, transfer.begin, transfer.end, transfer.start, transfer.offset, ok);
+}
+
+// Servers that ignore the Range header answer 200 with the whole file, which is stored
+// from offset zero like any other transfer.
+void StreamFetcher::process(QNetworkReply *reply, Transfer &transfer)
+{
+    if (transfer.start < 0) {
+        const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (status == 206) {
+            const QByteArray range = reply->rawHeader("Content-Range");
+            const int space = range.indexOf(' ');
+            const int dash = range.indexOf('-');
+            const int slash = range.indexOf('/');
+            if (dash > space && slash > dash) {
+                transfer.start = range.mid(space + 1, dash - space - 1).toLongLong();
+                transfer.total = range.mid(slash + 1) == "*" ? -1 : range.mid(slash + 1).toLongLong();
+            }
+        } else if (status == 200) {
+            const QVariant length = reply->header(QNetworkRequest::ContentLengthHeader);
+            transfer.start = 0;
+            transfer.total = length.isValid() ? length.toLongLong() : -1;
+        }
+        transfer.offset = transfer.start;
+    }
+    const QByteArray data = reply->readAll();
+    if (transfer.start < 0 || data.isEmpty())
+        return;
+    cache->received(transfer.url, transfer.start, transfer.end, transfer.offset, data, transfer.total);
+    transfer.offset += data.size();
+}
+
+StreamCache::StreamCache(const QString &cacheDirectory, qint64 maxBytes) :
+    directory(cacheDirectory), maxBytes(maxBytes), totalBytes(0)
+{
+    QDir().mkpath(directory);
+    loadIndex();
+    fetcher = new StreamFetcher(this);
+    fetcher->moveToThread(&thread);
+    thread.start();
+}
+
+StreamCache::~StreamCache()
+{
+    QMetaObject::invokeMethod(fetcher, "shutdown", Qt::BlockingQueuedConnection);
+    thread.quit();
+    thread.wait();
+    delete fetcher;
+    foreach (StreamEntry *entry, entries) {
+        saveMap(entry);
+        delete entry->file;
+        delete entry;
+    }
+}
+
+bool StreamCache::isRemote(const QString &path)
+{
+    return path.startsWith("http://", Qt::CaseInsensitive) || path.startsWith("https://", Qt::CaseInsensitive);
+}
+
+void StreamCache::setMaxBytes(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    maxBytes = bytes;
+    evict();
+}
+
+qint64 StreamCache::open(const QString &url, int timeout)
+{
+    QMutexLocker locker(&mutex);
+    StreamEntry *entry = this->entry(url);
+    entry->users++;
+    entry->lastUsed = QDateTime::currentMSecsSinceEpoch();
+    entry->failed = false;
+    QElapsedTimer timer;
+    timer.start();
+    while (entry->total < 0 && !entry->failed && timer.elapsed() < timeout) {
+        request(entry, 0, readAheadChunks * ChunkSize);
+        arrived.wait(&mutex, qMax<qint64>(1, timeout - timer.elapsed()));
+    }
+    if (entry->total >= 0)
+        request(entry, 0, readAheadChunks * ChunkSize);
+    return entry->total;
+}
+
+void StreamCache::release(const QString &url)
+{
+    QMutexLocker locker(&mutex);
+    StreamEntry *entry = entries.value(url);
+    if (!entry)
+        return;
+    entry->users--;
+    entry->lastUsed = QDateTime::currentMSecsSinceEpoch();
+    saveMap(entry);
+    evict();
+}
+
+qint64 StreamCache::read(const QString &url, qint64 position, char *data, qint64 maxSize, int timeout)
+{
+    QMutexLocker locker(&mutex);
+    StreamEntry *entry = this->entry(url);
+    entry->lastUsed = QDateTime::currentMSecsSinceEpoch();
+    QElapsedTimer timer;
+    timer.start();
+    bool waited = false;
+    forever {
+        if (entry->total >= 0 && position >= entry->total)
+            return 0;
+        if (entry->total >= 0 && entry->chunks.testBit(int(position / ChunkSize)))
+            break;
+        if (entry->failed || timer.elapsed() >= timeout)
+            return -1;
+        request(entry, position, readAheadChunks * ChunkSize);
+        waited = true;
+        arrived.wait(&mutex, qMax<qint64>(1, timeout - timer.elapsed()));
+        entry = this->entry(url);
+    }
+    if (!openFile(entry))
+        return -1;
+
+    int chunk = int(position / ChunkSize);
+    qint64 end = position;
+    while (end < position + maxSize && chunk < entry->chunks.size() && entry->chunks.testBit(chunk))
+        end = chunkEnd(entry, chunk++);
+    end = qMin(end, position + maxSize);
+    if (!entry->file->seek(position))
+        return -1;
+    const qint64 read = entry->file->read(data, end - position);
+    if (read > 0)
+        (waited ? misses : hits).fetchAndAddRelaxed(read);
+    request(entry, position, readAheadChunks * ChunkSize);
+    return read;
+}
+
+void StreamCache::prefetch(const QString &url, qint64 position, qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    StreamEntry *entry = this->entry(url);
+    entry->lastUsed = QDateTime::currentMSecsSinceEpoch();
+    entry->failed = false;
+    request(entry, position, bytes);
+}
+
+qint64 StreamCache::cachedBytes()
+{
+    QMutexLocker locker(&mutex);
+    return totalBytes;
+}
+
+qint64 StreamCache::hitBytes() const
+{
+    return hits.load();
+}
+
+qint64 StreamCache::missBytes() const
+{
+    return misses.load();
+}
+
+qreal StreamCache::hitRatio() const
+{
+    const qint64 total = hits.load() + misses.load();
+    return total ? qreal(hits.load()) / total : 0;
+}
+
+StreamEntry *StreamCache::entry(const QString &url)
+{
+    StreamEntry *entry = entries.value(url);
+    if (entry)
+        return entry;
+    entry = new StreamEntry;
+    entry->url = url;
+    entry->key = QString::fromLatin1(QCryptographicHash::hash(url.toUtf8(), QCryptographicHash::Sha1).toHex());
+    entry->total = -1;
+    entry->cached = 0;
+    entry->lastUsed = QDateTime::currentMSecsSinceEpoch();
+    entry->file = 0;
+    entry->users = 0;
+    entry->transfers = 0;
+    entry->failed = false;
+    entries.insert(url, entry);
+    return entry;
+}
+
+// Asks for every chunk in the window that is neither cached nor already in flight, one
+// range request per contiguous gap. Until the length is known only a single probe runs.
+void StreamCache::request(StreamEntry *entry, qint64 position, qint64 bytes)
+{
+    if (entry->total < 0) {
+        if (entry->transfers)
+            return;
+        const qint64 begin = position - position % ChunkSize;
+        entry->transfers++;
+        QMetaObject::invokeMethod(fetcher, "fetch", Qt::QueuedConnection, Q_ARG(QString, entry->url),
+                                  Q_ARG(qint64, begin), Q_ARG(qint64, begin + qMax<qint64>(ChunkSize, bytes)));
+        return;
+    }
+    const int first = int(position / ChunkSize);
+    const int last = int((qMin(entry->total, position + bytes) + ChunkSize - 1) / ChunkSize);
+    int run = -1;
+    for (int i = first; i <= last; i++) {
+        const bool missing = i < last && !entry->chunks.testBit(i) && !entry->requested.testBit(i);
+        if (missing) {
+            entry->requested.setBit(i);
+            if (run < 0)
+                run = i;
+        } else if (run >= 0) {
+            entry->transfers++;
+            QMetaObject::invokeMethod(fetcher, "fetch", Qt::QueuedConnection, Q_ARG(QString, entry->url),
+                                      Q_ARG(qint64, qint64(run) * ChunkSize), Q_ARG(qint64, chunkEnd(entry, i - 1)));
+            run = -1;
+        }
+    }
+}
+
+// The first response of a probe reveals the length; the rest of the probe's range is
+// marked as in flight so the reads that follow do not ask for it a second time.
+void StreamCache::received(const QString &url, qint64 start, qint64 end, qint64 offset, const QByteArray &data, qint64 total)
+{
+    QMutexLocker locker(&mutex);
+    StreamEntry *entry = entries.value(url);
+    if (!entry)
+        return;
+    if (total >= 0 && total != entry->total) {
+        if (entry->total >= 0) {
+            totalBytes -= entry->cached;
+            entry->cached = 0;
+            entry->chunks.fill(false);
+        }
+        setTotal(entry, total);
+        const int last = int((qMin(end, total) + ChunkSize - 1) / ChunkSize);
+        for (int i = int(start / ChunkSize); i < last; i++)
+            entry->requested.setBit(i);
+    }
+    if (!openFile(entry) || !entry->file->seek(offset) || entry->file->write(data) != data.size())
+        return;
+    markCompleted(entry, start, offset + data.size());
+    arrived.wakeAll();
+}
+
+void StreamCache::finished(const QString &url, qint64 begin, qint64 end, qint64 start, qint64 offset, bool ok)
+{
+    QMutexLocker locker(&mutex);
+    StreamEntry *entry = entries.value(url);
+    if (!entry)
+        return;
+    entry->transfers--;
+    if (ok && entry->total < 0) {
+        setTotal(entry, offset);
+        markCompleted(entry, start, offset);
+    }
+    const int last = int(qMin<qint64>(entry->requested.size(), (end + ChunkSize - 1) / ChunkSize));
+    for (int i = int(qMin(begin, start >= 0 ? start : begin) / ChunkSize); i < last; i++)
+        entry->requested.clearBit(i);
+    if (!ok)
+        entry->failed = true;
+    saveMap(entry);
+    evict();
+    arrived.wakeAll();
+}
+
+void StreamCache::setTotal(StreamEntry *entry, qint64 total)
+{
+    const int count = int((total + ChunkSize - 1) / ChunkSize);
+    entry->total = total;
+    entry->chunks.resize(count);
+    entry->requested.resize(count);
+    if (entry->file)
+        entry->file->resize(total);
+}
+
+void StreamCache::markCompleted(StreamEntry *entry, qint64 start, qint64 end)
+{
+    if (entry->total < 0 && entry->chunks.size() < end / ChunkSize) {
+        entry->chunks.resize(int(end / ChunkSize));
+        entry->requested.resize(int(end / ChunkSize));
+    }
+    for (int i = int((start + ChunkSize - 1) / ChunkSize); i < entry->chunks.size() && chunkEnd(entry, i) <= end; i++) {
+        if (entry->chunks.testBit(i))
+            continue;
+        const qint64 bytes = chunkEnd(entry, i) - qint64(i) * ChunkSize;
+        entry->chunks.setBit(i);
+        entry->cached += bytes;
+        totalBytes += bytes;
+    }
+}
+
+qint64 StreamCache::chunkEnd(const StreamEntry *entry, int chunk) const
+{
+    const qint64 end = qint64(chunk + 1) * ChunkSize;
+    return entry->total >= 0 ? qMin(end, entry->total) : end;
+}
+
+bool StreamCache::openFile(StreamEntry *entry)
+{
+    if (entry->file)
+        return true;
+    entry->file = new QFile(directory + '/' + entry->key + ".data");
+    if (!entry->file->open(QIODevice::ReadWrite)) {
+        delete entry->file;
+        entry->file = 0;
+        return false;
+    }
+    if (entry->total >= 0 && entry->file->size() != entry->total)
+        entry->file->resize(entry->total);
+    return true;
+}
+
+void StreamCache::saveMap(StreamEntry *entry)
+{
+    if (entry->total < 0)
+        return;
+    QSaveFile out(directory + '/' + entry->key + ".map");
+    if (!out.open(QIODevice::WriteOnly))
+        return;
+    QDataStream stream(&out);
+    stream << mapMagic << mapVersion << entry->url << entry->total << entry->lastUsed << entry->chunks;
+    out.commit();
+}
+
+void StreamCache::loadIndex()
+{
+    const QStringList maps = QDir(directory).entryList(QStringList() << "*.map", QDir::Files);
+    foreach (const QString &name, maps) {
+        QFile in(directory + '/' + name);
+        if (!in.open(QIODevice::ReadOnly))
+            continue;
+        QDataStream stream(&in);
+        quint32 magic, version;
+        QScopedPointer<StreamEntry> entry(new StreamEntry);
+        stream >> magic >> version >> entry->url >> entry->total >> entry->lastUsed >> entry->chunks;
+        in.close();
+        const QString data = directory + '/' + name.left(name.size() - 4) + ".data";
+        if (stream.status() != QDataStream::Ok || magic != mapMagic || version != mapVersion || !QFile::exists(data)
+                || entry->chunks.size() != int((entry->total + ChunkSize - 1) / ChunkSize)) {
+            QFile::remove(in.fileName());
+            QFile::remove(data);
+            continue;
+        }
+        entry->key = name.left(name.size() - 4);
+        entry->cached = 0;
+        entry->requested = QBitArray(entry->chunks.size());
+        entry->file = 0;
+        entry->users = 0;
+        entry->transfers = 0;
+        entry->failed = false;
+        for (int i = 0; i < entry->chunks.size(); i++) {
+            if (entry->chunks.testBit(i))
+                entry->cached += chunkEnd(entry.data(), i) - qint64(i) * ChunkSize;
+        }
+        totalBytes += entry->cached;
+        entries.insert(entry->url, entry.take());
+    }
+}
+
+void StreamCache::evict()
+{
+    while (totalBytes > maxBytes) {
+        StreamEntry *victim = 0;
+        foreach (StreamEntry *entry, entries) {
+            if (!entry->users && !entry->transfers && entry->cached && (!victim || entry->lastUsed < victim->lastUsed))
+                victim = entry;
+        }
+        if (!victim)
+            break;
+        remove(victim);
+    }
+}
+
+void StreamCache::remove(StreamEntry *entry)
+{
+    delete entry->file;
+    QFile::remove(directory + '/' + entry->key + ".data");
+    QFile::remove(directory + '/' + entry->key + ".map");
+    totalBytes -= entry->cached;
+    entries.remove(entry->url);
+    delete entry;
+}
+
+StreamDevice::StreamDevice(StreamCache *cache, const QString &url, QObject *parent) :
+    QIODevice(parent), cache(cache), url(url), length(-1), position(0)
+{
+}
+
+StreamDevice::~StreamDevice()
+{
+    close();
+}
+
+bool StreamDevice::open(OpenMode mode)
+{
+    PROFILE_SCOPE("stream.open");
+    length = cache->open(url, streamTimeout);
+    if (length < 0) {
+        cache->release(url);
+        return false;
+    }
+    position = 0;
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void StreamDevice::close()
+{
+    if (isOpen())
+        cache->release(url);
+    QIODevice::close();
+}
+
+qint64 StreamDevice::size() const
+{
+    return length;
+}
+
+bool StreamDevice::seek(qint64 pos)
+{
+    if (pos < 0 || pos > length)
+        return false;
+    position = pos;
+    return QIODevice::seek(pos);
+}
+
+qint64 StreamDevice::readData(char *data, qint64 maxSize)
+{
+    const qint64 read = cache->read(url, position, data, maxSize, streamTimeout);
+    if (read > 0)
+        position += read;
+    return read;
+}
+
+qint64 StreamDevice::writeData(const char *, qint64)
+{
+    return -1;
+}
@@ -0,0 +1,135 @@
+#ifndef STREAMCACHE_H
+#define STREAMCACHE_H
+
+#include <QObject>
+#include <QIODevice>
+#include <QBitArray>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <QAtomicInteger>
+
+class QFile;
+class QNetworkAccessManager;
+class QNetworkReply;
+class StreamCache;
+
+struct StreamEntry
+{
+    QString url;
+    QString key;
+    qint64 total;
+    qint64 cached;
+    qint64 lastUsed;
+    QBitArray chunks;
+    QBitArray requested;
+    QFile *file;
+    int users;
+    int transfers;
+    bool failed;
+};
+
+class StreamFetcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StreamFetcher(StreamCache *cache);
+
+public slots:
+    void fetch(const QString &url, qint64 begin, qint64 end);
+    void shutdown();
+
+private slots:
+    void replyReadyRead();
+    void replyFinished();
+
+private:
+    struct Transfer
+    {
+        QString url;
+        qint64 begin;
+        qint64 end;
+        qint64 start;
+        qint64 offset;
+        qint64 total;
+    };
+
+    void process(QNetworkReply *reply, Transfer &transfer);
+
+    StreamCache *cache;
+    QNetworkAccessManager *manager;
+    QHash<QNetworkReply *, Transfer> transfers;
+};
+
+// Read-through cache for remote tracks. Each URL is kept as a sparse data file plus a
+// bitmap of the chunks fetched so far, so replays and seeks into fetched ranges never go
+// back to the network. Whole entries are evicted least recently used first.
+class StreamCache
+{
+public:
+    enum { ChunkSize = 256 * 1024 };
+
+    StreamCache(const QString &cacheDirectory, qint64 maxBytes);
+    ~StreamCache();
+    static bool isRemote(const QString &path);
+    void setMaxBytes(qint64 bytes);
+    qint64 open(const QString &url, int timeout);
+    void release(const QString &url);
+    qint64 read(const QString &url, qint64 position, char *data, qint64 maxSize, int timeout);
+    void prefetch(const QString &url, qint64 position, qint64 bytes);
+    qint64 cachedBytes();
+    qint64 hitBytes() const;
+    qint64 missBytes() const;
+    qreal hitRatio() const;
+
+private:
+    friend class StreamFetcher;
+
+    StreamEntry *entry(const QString &url);
+    void request(StreamEntry *entry, qint64 position, qint64 bytes);
+    void received(const QString &url, qint64 start, qint64 end, qint64 offset, const QByteArray &data, qint64 total);
+    void finished(const QString &url, qint64 begin, qint64 end, qint64 start, qint64 offset, bool ok);
+    void setTotal(StreamEntry *entry, qint64 total);
+    void markCompleted(StreamEntry *entry, qint64 start, qint64 end);
+    qint64 chunkEnd(const StreamEntry *entry, int chunk) const;
+    bool openFile(StreamEntry *entry);
+    void saveMap(StreamEntry *entry);
+    void loadIndex();
+    void evict();
+    void remove(StreamEntry *entry);
+
+    QString directory;
+    qint64 maxBytes;
+    qint64 totalBytes;
+    QHash<QString, StreamEntry *> entries;
+    QMutex mutex;
+    QWaitCondition arrived;
+    QThread thread;
+    StreamFetcher *fetcher;
+    QAtomicInteger<qint64> hits;
+    QAtomicInteger<qint64> misses;
+};
+
+class StreamDevice : public QIODevice
+{
+public:
+    StreamDevice(StreamCache *cache, const QString &url, QObject *parent = nullptr);
+    ~StreamDevice();
+    bool open(OpenMode mode) override;
+    void close() override;
+    qint64 size() const override;
+    bool seek(qint64 pos) override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    StreamCache *cache;
+    QString url;
+    qint64 length;
+    qint64 position;
+};
+
+#endif // STREAMCACHE_H
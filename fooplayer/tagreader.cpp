@@ -0,0 +1,572 @@
+#include "tagreader.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <cstring>
+
+static const int mpegBitrates[2][3][16] = {
+    {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0}
+    },
+    {
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}
+    }
+};
+
+static const int mpegSampleRates[4][3] = {
+    {11025, 12000, 8000},
+    {0, 0, 0},
+    {22050, 24000, 16000},
+    {44100, 48000, 32000}
+};
+
+struct MpegFrameHeader
+{
+    int version;
+    int layer;
+    int bitrate;
+    int sampleRate;
+    int channels;
+    int samplesPerFrame;
+    int frameLength;
+};
+
+static quint32 syncsafe(const uchar *p)
+{
+    return (quint32(p[0] & 0x7f) << 21) | (quint32(p[1] & 0x7f) << 14) | (quint32(p[2] & 0x7f) << 7) | quint32(p[3] & 0x7f);
+}
+
+static quint32 bigEndian24(const uchar *p)
+{
+    return (quint32(p[0]) << 16) | (quint32(p[1]) << 8) | quint32(p[2]);
+}
+
+static quint32 bigEndian32(const uchar *p)
+{
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+static quint32 littleEndian32(const uchar *p)
+{
+    return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+}
+
+static bool decodeMpegHeader(const uchar *p, MpegFrameHeader &h)
+{
+    if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0)
+        return false;
+    h.version = (p[1] >> 3) & 3;
+    const int layerBits = (p[1] >> 1) & 3;
+    const int bitrateIndex = p[2] >> 4;
+    const int sampleRateIndex = (p[2] >> 2) & 3;
+    const int padding = (p[2] >> 1) & 1;
+    if (h.version == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3)
+        return false;
+    h.layer = 4 - layerBits;
+    h.bitrate = mpegBitrates[h.version == 3 ? 0 : 1][h.layer - 1][bitrateIndex];
+    h.sampleRate = mpegSampleRates[h.version][sampleRateIndex];
+    h.channels = (p[3] >> 6) == 3 ? 1 : 2;
+    if (h.layer == 1) {
+        h.samplesPerFrame = 384;
+        h.frameLength = (12000 * h.bitrate / h.sampleRate + padding) * 4;
+    } else if (h.layer == 2 || h.version == 3) {
+        h.samplesPerFrame = 1152;
+        h.frameLength = 144000 * h.bitrate / h.sampleRate + padding;
+    } else {
+        h.samplesPerFrame = 576;
+        h.frameLength = 72000 * h.bitrate / h.sampleRate + padding;
+    }
+    return h.frameLength > 4;
+}
+
+static QByteArray removeUnsynchronisation(const QByteArray &data)
+{
+    QByteArray out;
+    out.reserve(data.size());
+    for (int i = 0; i < data.size(); i++) {
+        out.append(data.at(i));
+        if (uchar(data.at(i)) == 0xff && i + 1 < data.size() && data.at(i + 1) == 0)
+            i++;
+    }
+    return out;
+}
+
+static QString decodeUtf16(const uchar *p, int n, bool bigEndian)
+{
+    QString text;
+    text.reserve(n / 2);
+    for (int i = 0; i + 1 < n; i += 2) {
+        const ushort c = bigEndian ? ushort((p[i] << 8) | p[i + 1]) : ushort(p[i] | (p[i + 1] << 8));
+        if (c == 0)
+            break;
+        text.append(QChar(c));
+    }
+    return text;
+}
+
+static QString decodeText(const QByteArray &frame)
+{
+    if (frame.isEmpty())
+        return QString();
+    const uchar *p = reinterpret_cast<const uchar *>(frame.constData()) + 1;
+    const char *s = frame.constData() + 1;
+    const int n = frame.size() - 1;
+    QString text;
+    switch (uchar(frame.at(0))) {
+    case 1:
+        if (n >= 2 && p[0] == 0xfe && p[1] == 0xff)
+            text = decodeUtf16(p + 2, n - 2, true);
+        else if (n >= 2 && p[0] == 0xff && p[1] == 0xfe)
+            text = decodeUtf16(p + 2, n - 2, false);
+        else
+            text = decodeUtf16(p, n, false);
+        break;
+    case 2:
+        text = decodeUtf16(p, n, true);
+        break;
+    case 3:
+        text = QString::fromUtf8(s, int(qstrnlen(s, n)));
+        break;
+    default:
+        text = QString::fromLatin1(s, int(qstrnlen(s, n)));
+        break;
+    }
+    return text.trimmed();
+}
+
+static QString decodeUserText(const QByteArray &frame, QString &description)
+{
+    if (frame.isEmpty())
+        return QString();
+    const char encoding = frame.at(0);
+    const bool wide = encoding == 1 || encoding == 2;
+    int end = 1;
+    while (end < frame.size() && !(frame.at(end) == 0 && (!wide || (end + 1 < frame.size() && frame.at(end + 1) == 0))))
+        end += wide ? 2 : 1;
+    description = decodeText(frame.left(end));
+    if (end >= frame.size())
+        return QString();
+    return decodeText(encoding + frame.mid(end + (wide ? 2 : 1)));
+}
+
+static void parseReplayGain(const QString &key, const QString &value, TrackInfo &info)
+{
+    bool ok;
+    const float number = QString(value).remove(QLatin1String("dB"), Qt::CaseInsensitive).trimmed().toFloat(&ok);
+    if (!ok)
+        return;
+    const QString name = key.toUpper();
+    if (name == QLatin1String("REPLAYGAIN_TRACK_GAIN")) {
+        info.trackGain = number;
+        info.hasTrackGain = true;
+    } else if (name == QLatin1String("REPLAYGAIN_TRACK_PEAK")) {
+        info.trackPeak = number;
+    } else if (name == QLatin1String("REPLAYGAIN_ALBUM_GAIN")) {
+        info.albumGain = number;
+        info.hasAlbumGain = true;
+    } else if (name == QLatin1String("REPLAYGAIN_ALBUM_PEAK")) {
+        info.albumPeak = number;
+    }
+}
+
+static int parseTrackNumber(const QString &text)
+{
+    return text.section('/', 0, 0).trimmed().toInt();
+}
+
+TrackInfo TagReader::read(const QString &path)
+{
+    TrackInfo info;
+    info.path = path;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return info;
+    info.size = file.size();
+    info.modified = QFileInfo(file).lastModified().toMSecsSinceEpoch();
+    const QByteArray head = file.read(10);
+    if (head.startsWith("fLaC"))
+        info.valid = readFlac(file, info);
+    else if (head.startsWith("RIFF"))
+        info.valid = readWave(file, info);
+    else
+        info.valid = readMpeg(file, head, info);
+    return info;
+}
+
+QByteArray TagReader::readPicture(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    const QByteArray head = file.read(10);
+    if (head.startsWith("ID3") && head.size() == 10) {
+        const uchar *p = reinterpret_cast<const uchar *>(head.constData());
+        const quint32 size = syncsafe(p + 6);
+        if (p[3] < 2 || p[3] > 4 || size > file.size())
+            return QByteArray();
+        return parseId3v2Picture(file.read(size), p[3], p[5]);
+    }
+    if (!head.startsWith("fLaC") || !file.seek(4))
+        return QByteArray();
+    QByteArray picture;
+    bool last = false;
+    while (!last) {
+        const QByteArray header = file.read(4);
+        if (header.size() < 4)
+            break;
+        const uchar *p = reinterpret_cast<const uchar *>(header.constData());
+        last = p[0] & 0x80;
+        const quint32 length = bigEndian24(p + 1);
+        if ((p[0] & 0x7f) == 6) {
+            int type;
+            const QByteArray data = parseFlacPicture(file.read(length), type);
+            if (type == 3 && !data.isEmpty())
+                return data;
+            if (picture.isEmpty())
+                picture = data;
+        } else if (!file.seek(file.pos() + length)) {
+            break;
+        }
+    }
+    return picture;
+}
+
+bool TagReader::readMpeg(QFile &file, const QByteArray &head, TrackInfo &info)
+{
+    qint64 audioStart = 0;
+    if (head.size() == 10 && head.startsWith("ID3")) {
+        const uchar *p = reinterpret_cast<const uchar *>(head.constData());
+        const int major = p[3];
+        const int flags = p[5];
+        const quint32 size = syncsafe(p + 6);
+        if (major >= 2 && major <= 4 && size <= file.size())
+            parseId3v2(file.read(size), major, flags, info);
+        audioStart = 10 + qint64(size) + ((flags & 0x10) ? 10 : 0);
+    }
+    info.audioOffset = audioStart;
+    if (!file.seek(audioStart))
+        return false;
+    return parseMpegFrame(file.read(16384), file.size() - audioStart, info);
+}
+
+static QList<QPair<QByteArray, QByteArray> > id3v2Frames(const QByteArray &tag, int major, int flags)
+{
+    QList<QPair<QByteArray, QByteArray> > frames;
+    QByteArray data = tag;
+    if (major < 4 && (flags & 0x80))
+        data = removeUnsynchronisation(data);
+    int pos = 0;
+    if ((flags & 0x40) && major >= 3 && data.size() >= 4) {
+        const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+        pos = major == 4 ? int(syncsafe(p)) : int(bigEndian32(p)) + 4;
+    }
+    const int headerSize = major == 2 ? 6 : 10;
+    while (pos >= 0 && pos + headerSize <= data.size()) {
+        const uchar *p = reinterpret_cast<const uchar *>(data.constData()) + pos;
+        if (p[0] == 0)
+            break;
+        QByteArray id;
+        quint32 size;
+        int frameFlags = 0;
+        if (major == 2) {
+            id = QByteArray(reinterpret_cast<const char *>(p), 3);
+            size = bigEndian24(p + 3);
+        } else {
+            id = QByteArray(reinterpret_cast<const char *>(p), 4);
+            size = major == 4 ? syncsafe(p + 4) : bigEndian32(p + 4);
+            frameFlags = (p[8] << 8) | p[9];
+        }
+        pos += headerSize;
+        if (size > quint32(data.size() - pos))
+            break;
+        QByteArray frame = data.mid(pos, int(size));
+        pos += int(size);
+        if (major == 4) {
+            if (frameFlags & 0x000c)
+                continue;
+            if (frameFlags & 0x0001)
+                frame.remove(0, 4);
+            if (frameFlags & 0x0002)
+                frame = removeUnsynchronisation(frame);
+        } else if (major == 3) {
+            if (frameFlags & 0x00c0)
+                continue;
+            if (frameFlags & 0x0020)
+                frame.remove(0, 1);
+        }
+        frames.append(qMakePair(id, frame));
+    }
+    return frames;
+}
+
+void TagReader::parseId3v2(const QByteArray &tag, int major, int flags, TrackInfo &info)
+{
+    QString albumArtist;
+    typedef QPair<QByteArray, QByteArray> Frame;
+    foreach (const Frame &entry, id3v2Frames(tag, major, flags)) {
+        const QByteArray &id = entry.first;
+        const QByteArray &frame = entry.second;
+        if (id == "TIT2" || id == "TT2")
+            info.title = decodeText(frame);
+        else if (id == "TPE1" || id == "TP1")
+            info.artist = decodeText(frame);
+        else if (id == "TPE2" || id == "TP2")
+            albumArtist = decodeText(frame);
+        else if (id == "TALB" || id == "TAL")
+            info.album = decodeText(frame);
+        else if (id == "TRCK" || id == "TRK")
+            info.trackNumber = parseTrackNumber(decodeText(frame));
+        else if (id == "TLEN" || id == "TLE")
+            info.length = decodeText(frame).toLongLong();
+        else if (id == "TXXX" || id == "TXX") {
+            QString description;
+            const QString value = decodeUserText(frame, description);
+            if (description.startsWith(QLatin1String("REPLAYGAIN_"), Qt::CaseInsensitive))
+                parseReplayGain(description, value, info);
+        }
+    }
+    if (info.artist.isEmpty())
+        info.artist = albumArtist;
+}
+
+QByteArray TagReader::parseId3v2Picture(const QByteArray &tag, int major, int flags)
+{
+    QByteArray picture;
+    typedef QPair<QByteArray, QByteArray> Frame;
+    foreach (const Frame &entry, id3v2Frames(tag, major, flags)) {
+        if (entry.first != "APIC" && entry.first != "PIC")
+            continue;
+        const QByteArray &frame = entry.second;
+        if (frame.size() < 5)
+            continue;
+        const bool wide = frame.at(0) == 1 || frame.at(0) == 2;
+        int pos = 1;
+        if (major == 2) {
+            pos += 3;
+        } else {
+            while (pos < frame.size() && frame.at(pos) != 0)
+                pos++;
+            pos++;
+        }
+        if (pos >= frame.size())
+            continue;
+        const int type = uchar(frame.at(pos++));
+        if (wide) {
+            while (pos + 1 < frame.size() && (frame.at(pos) != 0 || frame.at(pos + 1) != 0))
+                pos += 2;
+            pos += 2;
+        } else {
+            while (pos < frame.size() && frame.at(pos) != 0)
+                pos++;
+            pos++;
+        }
+        if (pos >= frame.size())
+            continue;
+        if (type == 3)
+            return frame.mid(pos);
+        if (picture.isEmpty())
+            picture = frame.mid(pos);
+    }
+    return picture;
+}
+
+QByteArray TagReader::parseFlacPicture(const QByteArray &block, int &type)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(block.constData());
+    const qint64 n = block.size();
+    type = -1;
+    if (n < 32)
+        return QByteArray();
+    type = int(bigEndian32(p));
+    qint64 pos = 8 + qint64(bigEndian32(p + 4));
+    if (pos + 4 > n)
+        return QByteArray();
+    pos += 4 + qint64(bigEndian32(p + pos)) + 16;
+    if (pos + 4 > n)
+        return QByteArray();
+    const quint32 length = bigEndian32(p + pos);
+    pos += 4;
+    if (length > quint64(n - pos))
+        return QByteArray();
+    return block.mid(int(pos), int(length));
+}
+
+bool TagReader::parseMpegFrame(const QByteArray &data, qint64 audioBytes, TrackInfo &info)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+    const int n = data.size();
+    MpegFrameHeader h;
+    for (int i = 0; i + 4 <= n; i++) {
+        if (!decodeMpegHeader(p + i, h))
+            continue;
+        MpegFrameHeader next;
+        if (i + h.frameLength + 4 <= n
+                && (!decodeMpegHeader(p + i + h.frameLength, next) || next.version != h.version || next.layer != h.layer))
+            continue;
+
+        quint32 frames = 0;
+        if (h.layer == 3) {
+            const int xing = i + 4 + (h.version == 3 ? (h.channels == 1 ? 17 : 32) : (h.channels == 1 ? 9 : 17));
+            if (xing + 12 <= n && (memcmp(p + xing, "Xing", 4) == 0 || memcmp(p + xing, "Info", 4) == 0)) {
+                if (bigEndian32(p + xing + 4) & 1)
+                    frames = bigEndian32(p + xing + 8);
+            } else if (i + 36 + 18 <= n && memcmp(p + i + 36, "VBRI", 4) == 0) {
+                frames = bigEndian32(p + i + 36 + 14);
+            }
+        }
+
+        audioBytes -= i;
+        info.audioOffset += i;
+        if (frames) {
+            info.length = qint64(frames) * h.samplesPerFrame * 1000 / h.sampleRate;
+            info.bitrate = info.length ? int(audioBytes * 8 / info.length) : h.bitrate;
+        } else {
+            info.bitrate = h.bitrate;
+            if (info.length == 0)
+                info.length = audioBytes * 8 / h.bitrate;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool TagReader::readFlac(QFile &file, TrackInfo &info)
+{
+    bool streamInfo = false;
+    bool last = false;
+    if (!file.seek(4))
+        return false;
+    while (!last) {
+        const QByteArray header = file.read(4);
+        if (header.size() < 4)
+            break;
+        const uchar *p = reinterpret_cast<const uchar *>(header.constData());
+        last = p[0] & 0x80;
+        const int type = p[0] & 0x7f;
+        const quint32 length = bigEndian24(p + 1);
+        if (type == 0 && length >= 18) {
+            const QByteArray block = file.read(length);
+            if (block.size() < 18)
+                return false;
+            const uchar *b = reinterpret_cast<const uchar *>(block.constData());
+            const int sampleRate = (b[10] << 12) | (b[11] << 4) | (b[12] >> 4);
+            const quint64 totalSamples = (quint64(b[13] & 0x0f) << 32) | bigEndian32(b + 14);
+            if (sampleRate > 0)
+                info.length = qint64(totalSamples * 1000 / sampleRate);
+            streamInfo = true;
+        } else if (type == 4) {
+            parseVorbisComment(file.read(length), info);
+        } else if (!file.seek(file.pos() + length)) {
+            break;
+        }
+    }
+    info.audioOffset = file.pos();
+    if (streamInfo && info.length > 0)
+        info.bitrate = int((file.size() - file.pos()) * 8 / info.length);
+    return streamInfo;
+}
+
+bool TagReader::readWave(QFile &file, TrackInfo &info)
+{
+    if (!file.seek(8) || file.read(4) != "WAVE")
+        return false;
+    quint32 byteRate = 0;
+    qint64 dataBytes = -1;
+    for (;;) {
+        const QByteArray header = file.read(8);
+        if (header.size() < 8)
+            break;
+        const quint32 length = littleEndian32(reinterpret_cast<const uchar *>(header.constData()) + 4);
+        const qint64 next = file.pos() + length + (length & 1);
+        if (header.startsWith("fmt ") && length >= 16) {
+            const QByteArray format = file.read(16);
+            if (format.size() < 16)
+                return false;
+            byteRate = littleEndian32(reinterpret_cast<const uchar *>(format.constData()) + 8);
+        } else if (header.startsWith("data")) {
+            info.audioOffset = file.pos();
+            dataBytes = qMin<qint64>(length, file.size() - file.pos());
+        } else if (header.startsWith("LIST") && length >= 4) {
+            const QByteArray list = file.read(qMin<qint64>(length, 65536));
+            if (list.startsWith("INFO"))
+                parseRiffInfo(list.mid(4), info);
+        }
+        if (next >= file.size() || !file.seek(next))
+            break;
+    }
+    if (byteRate == 0 || dataBytes < 0)
+        return false;
+    info.length = dataBytes * 1000 / byteRate;
+    info.bitrate = int(qint64(byteRate) * 8 / 1000);
+    return true;
+}
+
+void TagReader::parseRiffInfo(const QByteArray &list, TrackInfo &info)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(list.constData());
+    const int n = list.size();
+    int pos = 0;
+    while (pos + 8 <= n) {
+        const QByteArray id = list.mid(pos, 4);
+        const quint32 length = littleEndian32(p + pos + 4);
+        pos += 8;
+        if (length > quint32(n - pos))
+            break;
+        const char *s = list.constData() + pos;
+        const QString value = QString::fromUtf8(s, int(qstrnlen(s, length))).trimmed();
+        if (id == "INAM")
+            info.title = value;
+        else if (id == "IART")
+            info.artist = value;
+        else if (id == "IPRD")
+            info.album = value;
+        else if (id == "ITRK" || id == "IPRT")
+            info.trackNumber = parseTrackNumber(value);
+        pos += int(length + (length & 1));
+    }
+}
+
+void TagReader::parseVorbisComment(const QByteArray &block, TrackInfo &info)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(block.constData());
+    const qint64 n = block.size();
+    if (n < 8)
+        return;
+    qint64 pos = 4 + qint64(littleEndian32(p));
+    if (pos + 4 > n)
+        return;
+    const quint32 count = littleEndian32(p + pos);
+    pos += 4;
+    QString albumArtist;
+    for (quint32 i = 0; i < count && pos + 4 <= n; i++) {
+        const quint32 length = littleEndian32(p + pos);
+        pos += 4;
+        if (length > quint64(n - pos))
+            break;
+        const QByteArray comment = QByteArray::fromRawData(block.constData() + pos, int(length));
+        pos += length;
+        const int eq = comment.indexOf('=');
+        if (eq <= 0)
+            continue;
+        const QByteArray key = comment.left(eq).toUpper();
+        const QString value = QString::fromUtf8(comment.constData() + eq + 1, comment.size() - eq - 1).trimmed();
+        if (key == "TITLE")
+            info.title = value;
+        else if (key == "ARTIST")
+            info.artist = value;
+        else if (key == "ALBUMARTIST" || key == "ALBUM ARTIST")
+            albumArtist = value;
+        else if (key == "ALBUM")
+            info.album = value;
+        else if (key == "TRACKNUMBER")
+            info.trackNumber = parseTrackNumber(value);
+        else if (key.startsWith("REPLAYGAIN_"))
+            parseReplayGain(QString::fromLatin1(key), value, info);
+    }
+    if (info.artist.isEmpty())
+        info.artist = albumArtist;
+}
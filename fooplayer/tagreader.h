@@ -0,0 +1,55 @@
+#ifndef TAGREADER_H
+#define TAGREADER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QMetaType>
+
+class QFile;
+
+struct TrackInfo
+{
+    QString path;
+    QString title;
+    QString artist;
+    QString album;
+    int trackNumber = 0;
+    int bitrate = 0;
+    qint64 length = 0;
+    qint64 modified = 0;
+    qint64 size = 0;
+    qint64 audioOffset = 0;
+    QByteArray acoustic;
+    float trackGain = 0;
+    float trackPeak = 0;
+    float albumGain = 0;
+    float albumPeak = 0;
+    float loudness = 0;
+    float loudnessRange = 0;
+    bool hasTrackGain = false;
+    bool hasAlbumGain = false;
+    bool hasLoudness = false;
+    bool valid = false;
+};
+
+Q_DECLARE_METATYPE(TrackInfo)
+
+class TagReader
+{
+public:
+    static TrackInfo read(const QString &path);
+    static QByteArray readPicture(const QString &path);
+
+private:
+    static bool readMpeg(QFile &file, const QByteArray &head, TrackInfo &info);
+    static bool readFlac(QFile &file, TrackInfo &info);
+    static bool readWave(QFile &file, TrackInfo &info);
+    static void parseId3v2(const QByteArray &tag, int major, int flags, TrackInfo &info);
+    static void parseVorbisComment(const QByteArray &block, TrackInfo &info);
+    static void parseRiffInfo(const QByteArray &list, TrackInfo &info);
+    static bool parseMpegFrame(const QByteArray &data, qint64 audioBytes, TrackInfo &info);
+    static QByteArray parseId3v2Picture(const QByteArray &tag, int major, int flags);
+    static QByteArray parseFlacPicture(const QByteArray &block, int &type);
+};
+
+#endif // TAGREADER_H
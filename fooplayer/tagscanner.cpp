@@ -0,0 +1,179 @@
+#include "tagscanner.h"
+#include "profiler.h"
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const int batchSize = 64;
+
+struct TagScanJob
+{
+    QStringList paths;
+    int firstRow;
+    bool coldCache;
+    MetadataCache *cache;
+    QAtomicInt next;
+    QAtomicInt done;
+    QAtomicInt cached;
+    QAtomicInt cancelled;
+    QMutex mutex;
+    QVector<int> rows;
+    QVector<TrackInfo> tracks;
+};
+
+static void dropPageCache(const QString &path)
+{
+#ifdef Q_OS_LINUX
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+class TagScanTask : public QRunnable
+{
+public:
+    explicit TagScanTask(const QSharedPointer<TagScanJob> &job) : job(job) {}
+
+    void run() override
+    {
+        QVector<int> rows;
+        QVector<TrackInfo> tracks;
+        while (!job->cancelled.load()) {
+            const int i = job->next.fetchAndAddRelaxed(1);
+            if (i >= job->paths.size())
+                break;
+            const QString &path = job->paths.at(i);
+            TrackInfo info;
+            if (job->cache && lookup(path, info)) {
+                job->cached.ref();
+            } else {
+                if (job->coldCache)
+                    dropPageCache(path);
+                PROFILE_SCOPE("tags.read");
+                info = TagReader::read(path);
+                if (job->cache && info.valid)
+                    job->cache->insert(info);
+            }
+            rows.append(job->firstRow + i);
+            tracks.append(info);
+            if (tracks.size() >= batchSize)
+                publish(rows, tracks);
+        }
+        publish(rows, tracks);
+    }
+
+private:
+    bool lookup(const QString &path, TrackInfo &info)
+    {
+        const QFileInfo fileInfo(path);
+        return fileInfo.exists() && job->cache->lookup(path, fileInfo.lastModified().toMSecsSinceEpoch(), fileInfo.size(), info);
+    }
+
+    void publish(QVector<int> &rows, QVector<TrackInfo> &tracks)
+    {
+        if (tracks.isEmpty())
+            return;
+        QMutexLocker locker(&job->mutex);
+        job->rows += rows;
+        job->tracks += tracks;
+        job->done.fetchAndAddRelaxed(tracks.size());
+        rows.clear();
+        tracks.clear();
+    }
+
+    QSharedPointer<TagScanJob> job;
+};
+
+TagScanner::TagScanner(QObject *parent) : QObject(parent), cache(0), coldCache(false)
+{
+    flushTimer = new QTimer(this);
+    flushTimer->setInterval(50);
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+TagScanner::~TagScanner()
+{
+    cancel();
+}
+
+void TagScanner::scan(const QStringList &paths, int firstRow)
+{
+    cancel();
+    job = QSharedPointer<TagScanJob>(new TagScanJob);
+    job->paths = paths;
+    job->firstRow = firstRow;
+    job->coldCache = coldCache;
+    job->cache = cache;
+    elapsed.start();
+
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const int tasks = qMin(pool->maxThreadCount(), paths.size());
+    for (int i = 0; i < tasks; i++)
+        pool->start(new TagScanTask(job));
+    flushTimer->start();
+}
+
+void TagScanner::setColdCache(bool cold)
+{
+    coldCache = cold;
+}
+
+void TagScanner::setCache(MetadataCache *cache)
+{
+    this->cache = cache;
+}
+
+void TagScanner::cancel()
+{
+    flushTimer->stop();
+    if (job) {
+        job->cancelled.store(1);
+        job.clear();
+    }
+}
+
+bool TagScanner::isRunning() const
+{
+    return !job.isNull();
+}
+
+void TagScanner::flush()
+{
+    if (!job)
+        return;
+    QVector<int> rows;
+    QVector<TrackInfo> tracks;
+    int done;
+    {
+        QMutexLocker locker(&job->mutex);
+        rows.swap(job->rows);
+        tracks.swap(job->tracks);
+        done = job->done.load();
+    }
+    const int total = job->paths.size();
+    if (!tracks.isEmpty()) {
+        PROFILE_COUNTER("metadata.arrival", elapsed.elapsed());
+        emit tracksScanned(rows, tracks);
+        emit progress(done, total);
+    }
+    if (job && done >= total) {
+        const int cached = job->cached.load();
+        flushTimer->stop();
+        job.clear();
+        emit finished(total, cached, elapsed.elapsed());
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef TAGSCANNER_H
+#define TAGSCANNER_H
+
+#include "tagreader.h"
+#include "metadatacache.h"
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QSharedPointer>
+#include <QElapsedTimer>
+
+class QTimer;
+
+struct TagScanJob;
+
+class TagScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TagScanner(QObject *parent = nullptr);
+    ~TagScanner();
+    void scan(const QStringList &paths, int firstRow);
+    void setColdCache(bool cold);
+    void setCache(MetadataCache *cache);
+    void cancel();
+    bool isRunning() const;
+
+signals:
+    void tracksScanned(const QVector<int> &rows, const QVector<TrackInfo> &tracks);
+    void progress(int done, int total);
+    void finished(int files, int cached, qint64 msecs);
+
+private slots:
+    void flush();
+
+private:
+    QSharedPointer<TagScanJob> job;
+    QTimer *flushTimer;
+    QElapsedTimer elapsed;
+    MetadataCache *cache;
+    bool coldCache;
+};
+
+#endif // TAGSCANNER_H
@@ -0,0 +1,269 @@
+#include "tagwriter.h"
+#include <QFile>
+#include <QSaveFile>
+
+static const int id3v2Padding = 2048;
+static const int flacPadding = 4096;
+static const qint64 copyChunk = 1 << 20;
+
+static quint32 syncsafe(const uchar *p)
+{
+    return (quint32(p[0] & 0x7f) << 21) | (quint32(p[1] & 0x7f) << 14) | (quint32(p[2] & 0x7f) << 7) | quint32(p[3] & 0x7f);
+}
+
+static quint32 bigEndian24(const uchar *p)
+{
+    return (quint32(p[0]) << 16) | (quint32(p[1]) << 8) | quint32(p[2]);
+}
+
+static quint32 bigEndian32(const uchar *p)
+{
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+static quint32 littleEndian32(const uchar *p)
+{
+    return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+}
+
+static QByteArray encodeSyncsafe(quint32 value)
+{
+    QByteArray bytes(4, 0);
+    for (int i = 0; i < 4; i++)
+        bytes[i] = char((value >> (7 * (3 - i))) & 0x7f);
+    return bytes;
+}
+
+static QByteArray encodeBigEndian(quint32 value, int bytes)
+{
+    QByteArray encoded(bytes, 0);
+    for (int i = 0; i < bytes; i++)
+        encoded[i] = char(value >> (8 * (bytes - 1 - i)));
+    return encoded;
+}
+
+static QByteArray encodeLittleEndian32(quint32 value)
+{
+    QByteArray encoded(4, 0);
+    for (int i = 0; i < 4; i++)
+        encoded[i] = char(value >> (8 * i));
+    return encoded;
+}
+
+static bool replaces(const TagWriter::Fields &fields, const QByteArray &key)
+{
+    const QByteArray name = key.toUpper();
+    for (int i = 0; i < fields.size(); i++) {
+        if (fields.at(i).first == name)
+            return true;
+    }
+    return false;
+}
+
+// Reads the description of a TXXX frame body without caring about its value.
+static QByteArray userTextDescription(const QByteArray &body)
+{
+    if (body.isEmpty())
+        return QByteArray();
+    const char encoding = body.at(0);
+    if (encoding == 1 || encoding == 2) {
+        QByteArray description;
+        int i = 1;
+        if (encoding == 1 && body.size() >= 3)
+            i = 3;
+        const bool littleEndian = encoding == 1 && uchar(body.at(1)) == 0xff;
+        for (; i + 1 < body.size() && (body.at(i) || body.at(i + 1)); i += 2)
+            description.append(littleEndian ? body.at(i) : body.at(i + 1));
+        return description;
+    }
+    const int end = body.indexOf('\0', 1);
+    return body.mid(1, end < 0 ? -1 : end - 1);
+}
+
+TagWriter::Fields TagWriter::replayGainFields(const TrackInfo &info)
+{
+    Fields fields;
+    if (info.hasTrackGain) {
+        fields.append(qMakePair(QByteArray("REPLAYGAIN_TRACK_GAIN"), QByteArray::number(info.trackGain, 'f', 2) + " dB"));
+        fields.append(qMakePair(QByteArray("REPLAYGAIN_TRACK_PEAK"), QByteArray::number(info.trackPeak, 'f', 6)));
+    }
+    if (info.hasAlbumGain) {
+        fields.append(qMakePair(QByteArray("REPLAYGAIN_ALBUM_GAIN"), QByteArray::number(info.albumGain, 'f', 2) + " dB"));
+        fields.append(qMakePair(QByteArray("REPLAYGAIN_ALBUM_PEAK"), QByteArray::number(info.albumPeak, 'f', 6)));
+    }
+    return fields;
+}
+
+bool TagWriter::writeReplayGain(const QString &path, const TrackInfo &info)
+{
+    const Fields fields = replayGainFields(info);
+    if (fields.isEmpty())
+        return false;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadWrite))
+        return false;
+    const QByteArray head = file.read(10);
+    if (head.startsWith("fLaC"))
+        return writeFlac(file, fields);
+    if (head.startsWith("RIFF"))
+        return false;
+    return writeId3v2(file, head, fields);
+}
+
+bool TagWriter::writeId3v2(QFile &file, const QByteArray &head, const Fields &fields)
+{
+    int major = 4;
+    int flags = 0;
+    quint32 size = 0;
+    QByteArray frames;
+    if (head.size() == 10 && head.startsWith("ID3")) {
+        const uchar *p = reinterpret_cast<const uchar *>(head.constData());
+        major = p[3];
+        flags = p[5];
+        size = syncsafe(p + 6);
+        // Unsynchronised tags, extended headers and footers are left alone rather than rebuilt.
+        if (major < 3 || major > 4 || (flags & 0xd0) || size > file.size() - 10)
+            return false;
+        const QByteArray tag = file.read(size);
+        int pos = 0;
+        while (pos + 10 <= tag.size() && tag.at(pos)) {
+            const uchar *frame = reinterpret_cast<const uchar *>(tag.constData()) + pos;
+            const quint32 length = major == 4 ? syncsafe(frame + 4) : bigEndian32(frame + 4);
+            if (length > quint32(tag.size() - pos - 10))
+                break;
+            const QByteArray body = tag.mid(pos + 10, int(length));
+            const int frameFlags = (frame[8] << 8) | frame[9];
+            const bool plain = major == 4 ? !(frameFlags & 0x000f) : !(frameFlags & 0x00e0);
+            if (!(tag.mid(pos, 4) == "TXXX" && plain && replaces(fields, userTextDescription(body))))
+                frames += tag.mid(pos, 10 + int(length));
+            pos += 10 + int(length);
+        }
+    }
+    for (int i = 0; i < fields.size(); i++) {
+        const QByteArray body = '\0' + fields.at(i).first + '\0' + fields.at(i).second;
+        frames += "TXXX";
+        frames += major == 4 ? encodeSyncsafe(quint32(body.size())) : encodeBigEndian(quint32(body.size()), 4);
+        frames += QByteArray(2, 0);
+        frames += body;
+    }
+
+    if (size && quint32(frames.size()) <= size) {
+        frames += QByteArray(int(size) - frames.size(), 0);
+        return file.seek(10) && file.write(frames) == frames.size();
+    }
+    const quint32 newSize = quint32(frames.size() + id3v2Padding);
+    QByteArray tag = "ID3" + QByteArray(1, char(major)) + QByteArray(1, 0) + QByteArray(1, char(flags)) + encodeSyncsafe(newSize);
+    tag += frames;
+    tag += QByteArray(id3v2Padding, 0);
+    return rewrite(file, tag, size ? 10 + qint64(size) : 0);
+}
+
+QByteArray TagWriter::updateVorbisComment(const QByteArray &block, const Fields &fields)
+{
+    QByteArray vendor = "fooplayer";
+    QList<QByteArray> comments;
+    if (block.size() >= 8) {
+        const uchar *p = reinterpret_cast<const uchar *>(block.constData());
+        const quint32 vendorLength = littleEndian32(p);
+        if (vendorLength <= quint32(block.size() - 8)) {
+            vendor = block.mid(4, int(vendorLength));
+            int pos = 4 + int(vendorLength);
+            const quint32 count = littleEndian32(p + pos);
+            pos += 4;
+            for (quint32 i = 0; i < count && pos + 4 <= block.size(); i++) {
+                const quint32 length = littleEndian32(p + pos);
+                pos += 4;
+                if (length > quint32(block.size() - pos))
+                    break;
+                const QByteArray comment = block.mid(pos, int(length));
+                pos += int(length);
+                const int equals = comment.indexOf('=');
+                if (equals < 0 || !replaces(fields, comment.left(equals)))
+                    comments.append(comment);
+            }
+        }
+    }
+    for (int i = 0; i < fields.size(); i++)
+        comments.append(fields.at(i).first + '=' + fields.at(i).second);
+
+    QByteArray updated = encodeLittleEndian32(quint32(vendor.size())) + vendor;
+    updated += encodeLittleEndian32(quint32(comments.size()));
+    foreach (const QByteArray &comment, comments)
+        updated += encodeLittleEndian32(quint32(comment.size())) + comment;
+    return updated;
+}
+
+bool TagWriter::writeFlac(QFile &file, const Fields &fields)
+{
+    if (!file.seek(4))
+        return false;
+    QList<QPair<int, QByteArray> > blocks;
+    int comment = -1;
+    bool last = false;
+    while (!last) {
+        const QByteArray header = file.read(4);
+        if (header.size() < 4)
+            return false;
+        const uchar *p = reinterpret_cast<const uchar *>(header.constData());
+        last = p[0] & 0x80;
+        const int type = p[0] & 0x7f;
+        const quint32 length = bigEndian24(p + 1);
+        if (type == 1) {
+            if (!file.seek(file.pos() + length))
+                return false;
+            continue;
+        }
+        const QByteArray data = file.read(length);
+        if (quint32(data.size()) != length)
+            return false;
+        if (type == 4)
+            comment = blocks.size();
+        blocks.append(qMakePair(type, data));
+    }
+    if (blocks.isEmpty() || blocks.first().first != 0)
+        return false;
+    const qint64 audioStart = file.pos();
+    if (comment < 0) {
+        comment = 1;
+        blocks.insert(comment, qMakePair(4, QByteArray()));
+    }
+    blocks[comment].second = updateVorbisComment(blocks.at(comment).second, fields);
+
+    // Shrinking or growing into the existing padding keeps the audio where it is.
+    qint64 used = 0;
+    for (int i = 0; i < blocks.size(); i++)
+        used += 4 + blocks.at(i).second.size();
+    const qint64 available = audioStart - 4;
+    const bool inPlace = used == available || used + 4 <= available;
+    const qint64 padding = inPlace ? available - used - 4 : flacPadding;
+    if (padding >= 0)
+        blocks.append(qMakePair(1, QByteArray(int(padding), 0)));
+
+    QByteArray metadata;
+    for (int i = 0; i < blocks.size(); i++) {
+        const int type = blocks.at(i).first | (i == blocks.size() - 1 ? 0x80 : 0);
+        metadata += char(type);
+        metadata += encodeBigEndian(quint32(blocks.at(i).second.size()), 3);
+        metadata += blocks.at(i).second;
+    }
+    if (inPlace)
+        return file.seek(4) && file.write(metadata) == metadata.size();
+    return rewrite(file, "fLaC" + metadata, audioStart);
+}
+
+bool TagWriter::rewrite(QFile &file, const QByteArray &head, qint64 audioStart)
+{
+    QSaveFile saveFile(file.fileName());
+    if (!saveFile.open(QIODevice::WriteOnly) || !file.seek(audioStart))
+        return false;
+    saveFile.write(head);
+    while (!file.atEnd()) {
+        const QByteArray chunk = file.read(copyChunk);
+        if (chunk.isEmpty() || saveFile.write(chunk) != chunk.size()) {
+            saveFile.cancelWriting();
+            break;
+        }
+    }
+    file.close();
+    return saveFile.commit();
+}
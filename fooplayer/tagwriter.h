@@ -0,0 +1,23 @@
+#ifndef TAGWRITER_H
+#define TAGWRITER_H
+
+#include "tagreader.h"
+#include <QList>
+#include <QPair>
+
+class TagWriter
+{
+public:
+    typedef QList<QPair<QByteArray, QByteArray> > Fields;
+
+    static bool writeReplayGain(const QString &path, const TrackInfo &info);
+    static Fields replayGainFields(const TrackInfo &info);
+
+private:
+    static bool writeId3v2(QFile &file, const QByteArray &head, const Fields &fields);
+    static bool writeFlac(QFile &file, const Fields &fields);
+    static QByteArray updateVorbisComment(const QByteArray &block, const Fields &fields);
+    static bool rewrite(QFile &file, const QByteArray &head, qint64 audioStart);
+};
+
+#endif // TAGWRITER_H
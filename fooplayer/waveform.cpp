@@ -0,0 +1,297 @@
+#include "waveform.h"
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <cstring>
+
+#if defined(Q_PROCESSOR_X86) && (defined(Q_CC_GNU) || defined(Q_CC_CLANG))
+#define WAVEFORM_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*ReduceKernel)(const qint16 *samples, int count, qint16 &minimum, qint16 &maximum);
+
+struct PeakKernel
+{
+    const char *name;
+    ReduceKernel reduce;
+};
+
+static void reduceScalar(const qint16 *samples, int count, qint16 &minimum, qint16 &maximum)
+{
+    qint16 low = minimum;
+    qint16 high = maximum;
+    for (int i = 0; i < count; i++) {
+        low = qMin(low, samples[i]);
+        high = qMax(high, samples[i]);
+    }
+    minimum = low;
+    maximum = high;
+}
+
+#ifdef WAVEFORM_X86
+__attribute__((target("sse2")))
+static void reduceSse2(const qint16 *samples, int count, qint16 &minimum, qint16 &maximum)
+{
+    __m128i low = _mm_set1_epi16(minimum);
+    __m128i high = _mm_set1_epi16(maximum);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + i));
+        low = _mm_min_epi16(low, x);
+        high = _mm_max_epi16(high, x);
+    }
+    low = _mm_min_epi16(low, _mm_shuffle_epi32(low, 0x4e));
+    low = _mm_min_epi16(low, _mm_shuffle_epi32(low, 0xb1));
+    low = _mm_min_epi16(low, _mm_shufflelo_epi16(low, 0xb1));
+    high = _mm_max_epi16(high, _mm_shuffle_epi32(high, 0x4e));
+    high = _mm_max_epi16(high, _mm_shuffle_epi32(high, 0xb1));
+    high = _mm_max_epi16(high, _mm_shufflelo_epi16(high, 0xb1));
+    minimum = qint16(_mm_extract_epi16(low, 0));
+    maximum = qint16(_mm_extract_epi16(high, 0));
+    reduceScalar(samples + i, count - i, minimum, maximum);
+}
+
+__attribute__((target("avx2")))
+static void reduceAvx2(const qint16 *samples, int count, qint16 &minimum, qint16 &maximum)
+{
+    __m256i low = _mm256_set1_epi16(minimum);
+    __m256i high = _mm256_set1_epi16(maximum);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(samples + i));
+        low = _mm256_min_epi16(low, x);
+        high = _mm256_max_epi16(high, x);
+    }
+    __m128i low128 = _mm_min_epi16(_mm256_castsi256_si128(low), _mm256_extracti128_si256(low, 1));
+    __m128i high128 = _mm_max_epi16(_mm256_castsi256_si128(high), _mm256_extracti128_si256(high, 1));
+    low128 = _mm_min_epi16(low128, _mm_shuffle_epi32(low128, 0x4e));
+    low128 = _mm_min_epi16(low128, _mm_shuffle_epi32(low128, 0xb1));
+    low128 = _mm_min_epi16(low128, _mm_shufflelo_epi16(low128, 0xb1));
+    high128 = _mm_max_epi16(high128, _mm_shuffle_epi32(high128, 0x4e));
+    high128 = _mm_max_epi16(high128, _mm_shuffle_epi32(high128, 0xb1));
+    high128 = _mm_max_epi16(high128, _mm_shufflelo_epi16(high128, 0xb1));
+    minimum = qint16(_mm_extract_epi16(low128, 0));
+    maximum = qint16(_mm_extract_epi16(high128, 0));
+    reduceScalar(samples + i, count - i, minimum, maximum);
+}
+#endif
+
+static PeakKernel selectKernel()
+{
+#ifdef WAVEFORM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        const PeakKernel avx2 = { "avx2", reduceAvx2 };
+        return avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        const PeakKernel sse2 = { "sse2", reduceSse2 };
+        return sse2;
+    }
+#endif
+    const PeakKernel scalar = { "scalar", reduceScalar };
+    return scalar;
+}
+
+static const PeakKernel &peakKernel()
+{
+    static const PeakKernel selected = selectKernel();
+    return selected;
+}
+
+static void appendPeak(QByteArray &peaks, const qint16 *samples, int count)
+{
+    qint16 minimum = 32767;
+    qint16 maximum = -32768;
+    peakKernel().reduce(samples, count, minimum, maximum);
+    peaks.append(char(minimum >> 8));
+    peaks.append(char(maximum >> 8));
+}
+
+Waveform::Waveform() :
+    rate(0), frameCount(0), complete(false)
+{
+}
+
+bool Waveform::isEmpty() const
+{
+    return levels.isEmpty();
+}
+
+bool Waveform::isComplete() const
+{
+    return complete;
+}
+
+void Waveform::setComplete(bool complete)
+{
+    if (complete && !partial.isEmpty()) {
+        QByteArray peaks;
+        appendPeak(peaks, partial.constData(), partial.size());
+        partial.clear();
+        appendPeaks(peaks);
+    }
+    this->complete = complete;
+}
+
+int Waveform::sampleRate() const
+{
+    return rate;
+}
+
+void Waveform::setSampleRate(int rate)
+{
+    this->rate = rate;
+}
+
+qint64 Waveform::frames() const
+{
+    return frameCount;
+}
+
+int Waveform::levelCount() const
+{
+    return levels.size();
+}
+
+int Waveform::peakCount(int level) const
+{
+    return level < levels.size() ? levels.at(level).size() / 2 : 0;
+}
+
+void Waveform::peak(int level, int index, int &minimum, int &maximum) const
+{
+    const char *data = levels.at(level).constData() + 2 * index;
+    minimum = qint8(data[0]);
+    maximum = qint8(data[1]);
+}
+
+bool Waveform::range(qint64 fromFrame, qint64 toFrame, int &minimum, int &maximum) const
+{
+    if (levels.isEmpty() || toFrame <= fromFrame)
+        return false;
+    int level = 0;
+    while (level + 1 < levels.size() && (qint64(FramesPerPeak) << (level + 1)) <= (toFrame - fromFrame))
+        level++;
+    const qint64 span = qint64(FramesPerPeak) << level;
+    const int first = int(fromFrame / span);
+    const int last = qMin(peakCount(level), int((toFrame + span - 1) / span));
+    if (first >= last)
+        return false;
+    minimum = 127;
+    maximum = -128;
+    for (int i = first; i < last; i++) {
+        int low, high;
+        peak(level, i, low, high);
+        minimum = qMin(minimum, low);
+        maximum = qMax(maximum, high);
+    }
+    return true;
+}
+
+void Waveform::append(const qint16 *samples, int frames, int channels)
+{
+    const int block = FramesPerPeak * channels;
+    const int total = frames * channels;
+    int offset = 0;
+    QByteArray peaks;
+    peaks.reserve((total / block + 1) * 2);
+    if (!partial.isEmpty()) {
+        offset = qMin(block - partial.size(), total);
+        const int size = partial.size();
+        partial.resize(size + offset);
+        memcpy(partial.data() + size, samples, offset * sizeof(qint16));
+        if (partial.size() == block) {
+            appendPeak(peaks, partial.constData(), block);
+            partial.clear();
+        }
+    }
+    for (; offset + block <= total; offset += block)
+        appendPeak(peaks, samples + offset, block);
+    if (offset < total) {
+        const int size = partial.size();
+        partial.resize(size + total - offset);
+        memcpy(partial.data() + size, samples + offset, (total - offset) * sizeof(qint16));
+    }
+    frameCount += frames;
+    appendPeaks(peaks);
+}
+
+void Waveform::appendPeaks(const QByteArray &peaks)
+{
+    if (peaks.isEmpty())
+        return;
+    if (levels.isEmpty())
+        levels.append(QByteArray());
+    levels[0] += peaks;
+    for (int level = 1; level < MaxLevels; level++) {
+        const int parentPeaks = peakCount(level - 1);
+        if (parentPeaks < 2)
+            break;
+        if (level == levels.size())
+            levels.append(QByteArray());
+        const QByteArray &parent = levels.at(level - 1);
+        QByteArray &child = levels[level];
+        for (int i = child.size() / 2; 2 * i + 1 < parentPeaks; i++) {
+            const char *pair = parent.constData() + 4 * i;
+            child.append(qMin(pair[0], pair[2]));
+            child.append(qMax(pair[1], pair[3]));
+        }
+    }
+}
+
+QByteArray Waveform::serialize() const
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_9);
+    out << quint32(0x46505746) << quint32(1) << qint32(rate) << qint64(frameCount) << (levels.isEmpty() ? QByteArray() : levels.first());
+    return data;
+}
+
+Waveform Waveform::deserialize(const QByteArray &data)
+{
+    Waveform waveform;
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_9);
+    quint32 magic, version;
+    qint32 rate;
+    qint64 frames;
+    QByteArray peaks;
+    in >> magic >> version >> rate >> frames >> peaks;
+    if (in.status() != QDataStream::Ok || magic != 0x46505746 || version != 1 || peaks.size() % 2)
+        return waveform;
+    waveform.rate = rate;
+    waveform.frameCount = frames;
+    waveform.appendPeaks(peaks);
+    waveform.complete = true;
+    return waveform;
+}
+
+const char *Waveform::kernel()
+{
+    return peakKernel().name;
+}
+
+double Waveform::benchmark(int msecs)
+{
+    const int frames = 44100;
+    QVector<qint16> samples(frames * 2);
+    quint32 seed = 1;
+    for (int i = 0; i < samples.size(); i++) {
+        seed = seed * 1664525 + 1013904223;
+        samples[i] = qint16(seed >> 16);
+    }
+
+    QElapsedTimer timer;
+    qint64 processed = 0;
+    timer.start();
+    do {
+        Waveform waveform;
+        for (int i = 0; i < 60; i++)
+            waveform.append(samples.constData(), frames, 2);
+        waveform.setComplete(true);
+        processed += 60 * frames;
+    } while (timer.elapsed() < msecs);
+    return processed / 44100.0 * 1000.0 / qMax<qint64>(1, timer.elapsed());
+}
@@ -0,0 +1,43 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QMetaType>
+
+class Waveform
+{
+public:
+    enum { FramesPerPeak = 256, MaxLevels = 12 };
+
+    Waveform();
+    bool isEmpty() const;
+    bool isComplete() const;
+    void setComplete(bool complete);
+    int sampleRate() const;
+    void setSampleRate(int rate);
+    qint64 frames() const;
+    int levelCount() const;
+    int peakCount(int level) const;
+    void peak(int level, int index, int &minimum, int &maximum) const;
+    bool range(qint64 fromFrame, qint64 toFrame, int &minimum, int &maximum) const;
+    void append(const qint16 *samples, int frames, int channels);
+    QByteArray serialize() const;
+    static Waveform deserialize(const QByteArray &data);
+
+    static const char *kernel();
+    static double benchmark(int msecs);
+
+private:
+    void appendPeaks(const QByteArray &peaks);
+
+    int rate;
+    qint64 frameCount;
+    QVector<QByteArray> levels;
+    QVector<qint16> partial;
+    bool complete;
+};
+
+Q_DECLARE_METATYPE(Waveform)
+
+#endif // WAVEFORM_H
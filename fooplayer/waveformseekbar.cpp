@@ -0,0 +1,177 @@
+#include "waveformseekbar.h"
+#include <QPainter>
+#include <QMouseEvent>
+
+WaveformSeekBar::WaveformSeekBar(QWidget *parent) :
+    QWidget(parent), renderedColumns(0), trackDuration(0), trackPosition(0), dragPosition(0), dragging(false)
+{
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+    setCursor(Qt::PointingHandCursor);
+}
+
+QSize WaveformSeekBar::sizeHint() const
+{
+    return QSize(400, 40);
+}
+
+QSize WaveformSeekBar::minimumSizeHint() const
+{
+    return QSize(50, 40);
+}
+
+qint64 WaveformSeekBar::duration() const
+{
+    return trackDuration;
+}
+
+qint64 WaveformSeekBar::position() const
+{
+    return trackPosition;
+}
+
+bool WaveformSeekBar::isDragging() const
+{
+    return dragging;
+}
+
+bool WaveformSeekBar::moves(qint64 position) const
+{
+    return !dragging && pixelFor(position) != pixelFor(trackPosition);
+}
+
+void WaveformSeekBar::setDuration(qint64 duration)
+{
+    if (duration == trackDuration)
+        return;
+    trackDuration = duration;
+    renderedColumns = 0;
+    render();
+    update();
+}
+
+void WaveformSeekBar::setPosition(qint64 position)
+{
+    if (position == trackPosition)
+        return;
+    const int before = pixelFor(trackPosition);
+    trackPosition = position;
+    const int after = pixelFor(trackPosition);
+    if (before != after && !dragging)
+        update(QRect(QPoint(qMin(before, after) - 1, 0), QPoint(qMax(before, after) + 1, height())));
+}
+
+void WaveformSeekBar::setWaveform(const Waveform &waveform)
+{
+    const bool grown = !this->waveform.isEmpty() && waveform.frames() >= this->waveform.frames();
+    this->waveform = waveform;
+    if (!grown)
+        renderedColumns = 0;
+    const int from = renderedColumns;
+    render();
+    update(QRect(qMax(0, from - 1), 0, width(), height()));
+}
+
+void WaveformSeekBar::clearWaveform()
+{
+    waveform = Waveform();
+    renderedColumns = 0;
+    render();
+    update();
+}
+
+int WaveformSeekBar::pixelFor(qint64 position) const
+{
+    return trackDuration > 0 ? int(qBound<qint64>(0, position, trackDuration) * width() / trackDuration) : 0;
+}
+
+qint64 WaveformSeekBar::positionAt(int x) const
+{
+    return trackDuration > 0 && width() > 0 ? qBound<qint64>(0, qint64(x) * trackDuration / width(), trackDuration) : 0;
+}
+
+void WaveformSeekBar::render()
+{
+    if (image.size() != size()) {
+        image = QImage(size(), QImage::Format_ARGB32_Premultiplied);
+        renderedColumns = 0;
+    }
+    if (image.isNull())
+        return;
+    if (renderedColumns == 0)
+        image.fill(Qt::transparent);
+    if (waveform.isEmpty() || trackDuration <= 0 || waveform.sampleRate() <= 0)
+        return;
+
+    QPainter painter(&image);
+    painter.setPen(palette().color(QPalette::Mid));
+    const int middle = height() / 2;
+    const qint64 totalFrames = trackDuration * waveform.sampleRate() / 1000;
+    int column = renderedColumns;
+    for (; column < width(); column++) {
+        const qint64 from = qint64(column) * totalFrames / width();
+        const qint64 to = qint64(column + 1) * totalFrames / width();
+        if (!waveform.isComplete() && to > waveform.frames())
+            break;
+        int minimum, maximum;
+        if (!waveform.range(from, to, minimum, maximum))
+            continue;
+        painter.drawLine(column, middle - maximum * middle / 128, column, middle - minimum * middle / 128);
+    }
+    renderedColumns = column;
+}
+
+void WaveformSeekBar::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    painter.setClipRect(event->rect());
+    painter.fillRect(rect(), palette().color(QPalette::Base));
+    const int played = pixelFor(dragging ? dragPosition : trackPosition);
+    if (waveform.isEmpty()) {
+        const int middle = height() / 2;
+        painter.fillRect(QRect(0, middle - 1, width(), 3), palette().color(QPalette::Mid));
+        painter.fillRect(QRect(0, middle - 1, played, 3), palette().color(QPalette::Highlight));
+    } else {
+        painter.drawImage(0, 0, image);
+        painter.setCompositionMode(QPainter::CompositionMode_SourceAtop);
+        QColor highlight = palette().color(QPalette::Highlight);
+        highlight.setAlpha(160);
+        painter.fillRect(QRect(0, 0, played, height()), highlight);
+        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    }
+    painter.setPen(palette().color(QPalette::Text));
+    painter.drawLine(played, 0, played, height());
+}
+
+void WaveformSeekBar::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    render();
+}
+
+void WaveformSeekBar::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton || trackDuration <= 0)
+        return;
+    dragging = true;
+    dragPosition = positionAt(event->x());
+    update();
+}
+
+void WaveformSeekBar::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!dragging)
+        return;
+    dragPosition = positionAt(event->x());
+    update();
+}
+
+void WaveformSeekBar::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (!dragging || event->button() != Qt::LeftButton)
+        return;
+    dragging = false;
+    dragPosition = positionAt(event->x());
+    trackPosition = dragPosition;
+    update();
+    emit seekRequested(dragPosition);
+}
@@ -0,0 +1,50 @@
+#ifndef WAVEFORMSEEKBAR_H
+#define WAVEFORMSEEKBAR_H
+
+#include "waveform.h"
+#include <QWidget>
+#include <QImage>
+
+class WaveformSeekBar : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit WaveformSeekBar(QWidget *parent = nullptr);
+    QSize sizeHint() const override;
+    QSize minimumSizeHint() const override;
+    qint64 duration() const;
+    qint64 position() const;
+    bool isDragging() const;
+    bool moves(qint64 position) const;
+
+public slots:
+    void setDuration(qint64 duration);
+    void setPosition(qint64 position);
+    void setWaveform(const Waveform &waveform);
+    void clearWaveform();
+
+signals:
+    void seekRequested(qint64 position);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+
+private:
+    int pixelFor(qint64 position) const;
+    qint64 positionAt(int x) const;
+    void render();
+
+    Waveform waveform;
+    QImage image;
+    int renderedColumns;
+    qint64 trackDuration;
+    qint64 trackPosition;
+    qint64 dragPosition;
+    bool dragging;
+};
+
+#endif // WAVEFORMSEEKBAR_H
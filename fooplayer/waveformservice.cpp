@@ -0,0 +1,128 @@
+#include "waveformservice.h"
+#include "pcmreader.h"
+#include "profiler.h"
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QDir>
+#include <QRunnable>
+
+static const int memoryEntries = 32;
+static const int chunkFrames = 65536;
+static const int updateInterval = 250;
+
+class WaveformTask : public QRunnable
+{
+public:
+    WaveformTask(WaveformService *service, const QString &path, int generation) :
+        service(service), path(path), generation(generation)
+    {
+    }
+
+    void run() override
+    {
+        PROFILE_SCOPE("waveform.extract");
+        service->extract(path, generation);
+    }
+
+private:
+    WaveformService *service;
+    QString path;
+    int generation;
+};
+
+WaveformService::WaveformService(const QString &cacheDirectory, QObject *parent) :
+    QObject(parent), directory(cacheDirectory), memory(memoryEntries)
+{
+    qRegisterMetaType<Waveform>("Waveform");
+    QDir().mkpath(directory);
+    pool.setMaxThreadCount(1);
+}
+
+WaveformService::~WaveformService()
+{
+    current.ref();
+    pool.waitForDone();
+}
+
+void WaveformService::request(const QString &path)
+{
+    const int generation = current.fetchAndAddOrdered(1) + 1;
+    {
+        QMutexLocker locker(&mutex);
+        if (const Waveform *waveform = memory.object(cachePath(path))) {
+            emit waveformUpdated(path, *waveform);
+            return;
+        }
+    }
+    pool.start(new WaveformTask(this, path, generation));
+}
+
+void WaveformService::extract(const QString &path, int generation)
+{
+    if (generation != current.load())
+        return;
+    const QString file = cachePath(path);
+    QFile cached(file);
+    if (cached.open(QIODevice::ReadOnly)) {
+        const Waveform waveform = Waveform::deserialize(cached.readAll());
+        if (waveform.isComplete()) {
+            QMutexLocker locker(&mutex);
+            memory.insert(file, new Waveform(waveform));
+            locker.unlock();
+            emit waveformUpdated(path, waveform);
+            return;
+        }
+    }
+
+    QAudioFormat format;
+    format.setSampleRate(44100);
+    format.setChannelCount(2);
+    format.setSampleSize(16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+    PcmReader reader(format);
+    if (!reader.open(path))
+        return;
+
+    QElapsedTimer update;
+    update.start();
+    Waveform waveform;
+    waveform.setSampleRate(format.sampleRate());
+    while (!reader.atEnd()) {
+        if (generation != current.load())
+            return;
+        const QByteArray chunk = reader.read(chunkFrames * format.bytesPerFrame());
+        if (chunk.isEmpty())
+            continue;
+        waveform.append(reinterpret_cast<const qint16 *>(chunk.constData()), chunk.size() / format.bytesPerFrame(), format.channelCount());
+        if (update.elapsed() >= updateInterval) {
+            update.restart();
+            emit waveformUpdated(path, waveform);
+        }
+    }
+    waveform.setComplete(true);
+
+    QSaveFile out(file);
+    if (out.open(QIODevice::WriteOnly)) {
+        out.write(waveform.serialize());
+        out.commit();
+    }
+    QMutexLocker locker(&mutex);
+    memory.insert(file, new Waveform(waveform));
+    locker.unlock();
+    emit waveformUpdated(path, waveform);
+}
+
+QString WaveformService::cachePath(const QString &path) const
+{
+    const QFileInfo track(path);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(path.toUtf8());
+    hash.addData(QByteArray::number(track.lastModified().toMSecsSinceEpoch()));
+    hash.addData(QByteArray::number(track.size()));
+    return directory + '/' + QString::fromLatin1(hash.result().toHex()) + ".peaks";
+}
@@ -0,0 +1,35 @@
+#ifndef WAVEFORMSERVICE_H
+#define WAVEFORMSERVICE_H
+
+#include "waveform.h"
+#include <QObject>
+#include <QCache>
+#include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+
+class WaveformService : public QObject
+{
+    Q_OBJECT
+public:
+    explicit WaveformService(const QString &cacheDirectory, QObject *parent = nullptr);
+    ~WaveformService();
+    void request(const QString &path);
+
+signals:
+    void waveformUpdated(const QString &path, const Waveform &waveform);
+
+private:
+    friend class WaveformTask;
+
+    void extract(const QString &path, int generation);
+    QString cachePath(const QString &path) const;
+
+    QString directory;
+    QCache<QString, Waveform> memory;
+    QMutex mutex;
+    QThreadPool pool;
+    QAtomicInt current;
+};
+
+#endif // WAVEFORMSERVICE_H